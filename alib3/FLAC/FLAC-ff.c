@@ -7,6 +7,7 @@
 #include <FLAC/stream_decoder.h>
 #include <FLAC/stream_encoder.h>
 #include <private/crc.h>
+#include <private/md5.h>
 #include <memory.h>
 
 const char* flac_errstr(int err)
@@ -154,3 +155,40 @@ int flac_encode(flac_encoder *f, const int * const *audio, unsigned int *samples
 {
 	return _flac_encode(f->encoder, audio, samples, buf);
 }
+
+
+struct flac_md5 {
+	FLAC__MD5Context ctx;
+};
+
+flac_md5* flac_md5_new(void)
+{
+	flac_md5 *m;
+	if (NULL == (m = calloc(1, sizeof(flac_md5))))
+		return NULL;
+	FLAC__MD5Init(&m->ctx);
+	return m;
+}
+
+int flac_md5_update(flac_md5 *m, const int * const *audio, unsigned int channels, unsigned int samples, unsigned int bytes_per_sample)
+{
+	if (!FLAC__MD5Accumulate(&m->ctx, audio, channels, samples, bytes_per_sample))
+		return -1;
+	return 0;
+}
+
+void flac_md5_fin(flac_md5 *m, char md5[16])
+{
+	FLAC__MD5Final((FLAC__byte*)md5, &m->ctx);
+	free(m);
+}
+
+unsigned int flac_crc8(const void *data, size_t len)
+{
+	return FLAC__crc8(data, len);
+}
+
+unsigned int flac_crc16(const void *data, size_t len)
+{
+	return FLAC__crc16(data, len);
+}
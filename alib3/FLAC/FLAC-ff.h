@@ -65,6 +65,23 @@ _EXPORT int flac_encode(flac_encoder *enc, const int * const *audio, unsigned in
 /** Get stream info. */
 _EXPORT void flac_encode_info(flac_encoder *enc, flac_conf *info);
 
+
+typedef struct flac_md5 flac_md5;
+
+_EXPORT flac_md5* flac_md5_new(void);
+
+/** Add audio samples to MD5 as libFLAC encoder does. */
+_EXPORT int flac_md5_update(flac_md5 *m, const int * const *audio, unsigned int channels, unsigned int samples, unsigned int bytes_per_sample);
+
+/** Get the result and free the object. */
+_EXPORT void flac_md5_fin(flac_md5 *m, char md5[16]);
+
+/** CRC-8 of the frame header */
+_EXPORT unsigned int flac_crc8(const void *data, size_t len);
+
+/** CRC-16 of the frame */
+_EXPORT unsigned int flac_crc16(const void *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
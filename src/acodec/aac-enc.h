@@ -2,12 +2,14 @@
 2016, Simon Zolin */
 
 #include <acodec/alib3-bridge/aac.h>
+#include <acodec/enc-mt.h>
 
 static struct aac_out_conf_t {
 	uint aot;
 	uint qual;
 	uint afterburner;
 	uint bandwidth;
+	uint threads;
 } aac_out_conf;
 
 static int aac_conf_aot(fmed_conf *fc, void *obj, const ffstr *val);
@@ -17,6 +19,7 @@ static const fmed_conf_arg aac_out_conf_args[] = {
 	{ "quality",	FMC_INT32,  FMC_O(struct aac_out_conf_t, qual) },
 	{ "afterburner",	FMC_INT32,  FMC_O(struct aac_out_conf_t, afterburner) },
 	{ "bandwidth",	FMC_INT32,  FMC_O(struct aac_out_conf_t, bandwidth) },
+	{ "threads",	FMC_INT32,  FMC_O(struct aac_out_conf_t, threads) },
 	{}
 };
 
@@ -25,6 +28,10 @@ typedef struct aac_out {
 	ffpcm fmt;
 	ffstr in;
 	ffaac_enc aac;
+
+	encmt *mt;
+	void *trk;
+	const fmed_track *track;
 } aac_out;
 
 static int aac_profile(const ffstr *name)
@@ -50,6 +57,7 @@ int aac_out_config(fmed_conf_ctx *ctx)
 	aac_out_conf.qual = 256;
 	aac_out_conf.afterburner = 1;
 	aac_out_conf.bandwidth = 0;
+	aac_out_conf.threads = 1;
 	fmed_conf_addctx(ctx, &aac_out_conf, aac_out_conf_args);
 	return 0;
 }
@@ -65,10 +73,132 @@ static void* aac_out_create(fmed_track_info *d)
 static void aac_out_free(void *ctx)
 {
 	aac_out *a = ctx;
+	if (a->mt != NULL) {
+		encmt_close(a->mt);
+		ffmem_free(a->mt);
+	}
 	ffaac_enc_close(&a->aac);
 	ffmem_free(a);
 }
 
+/** Encode a chunk with a new encoder instance (on worker thread) */
+static int aac_out_mt_chunk(void *udata, struct encmt_chunk *c)
+{
+	aac_out *a = udata;
+	fdkaac_encoder *enc;
+	fdkaac_conf conf = {};
+	conf.channels = a->aac.info.channels;
+	conf.rate = a->aac.info.rate;
+	conf.aot = a->aac.info.aot;
+	conf.quality = a->aac.info.quality;
+	conf.bandwidth = a->aac.info.bandwidth;
+	conf.afterburner = a->aac.info.afterburner;
+	int r;
+	if (0 != (r = fdkaac_encode_create(&enc, &conf)))
+		return -r;
+
+	char *buf;
+	if (NULL == (buf = ffmem_alloc(conf.max_frame_size))) {
+		r = AAC_ESYS;
+		goto end;
+	}
+
+	const short *pcm = c->pcm.ptr;
+	size_t total = c->pcm.len / (conf.channels * sizeof(short)), off = 0;
+	for (;;) {
+		// all input samples, then flush
+		size_t n = total - off;
+		if (0 > (r = fdkaac_encode(enc, pcm + off * conf.channels, &n, buf))) {
+			r = -r;
+			goto end;
+		}
+		off += n;
+
+		if (r != 0)
+			encmt_packet_add(c, buf, r, conf.frame_samples);
+		else if (n == 0)
+			break;
+	}
+	r = 0;
+
+end:
+	ffmem_free(buf);
+	fdkaac_encode_free(enc);
+	return r;
+}
+
+static void aac_out_mt_ready(void *udata)
+{
+	aac_out *a = udata;
+	a->track->cmd(a->trk, FMED_TRACK_WAKE);
+}
+
+/** Start encoding on several threads if the input is long enough */
+static void aac_out_mt_open(aac_out *a, fmed_track_info *d)
+{
+	struct encmt_conf conf = {};
+	conf.nthreads = encmt_nthreads(aac_out_conf.threads);
+	conf.frame_samples = a->aac.info.frame_samples;
+	conf.sample_size = ffpcm_size1(&a->fmt);
+	conf.overlap_frames = a->aac.info.enc_delay / conf.frame_samples + 2;
+	conf.chunk_frames = ffmax(a->fmt.sample_rate * 5 / conf.frame_samples, conf.overlap_frames);
+	uint64 chunk = conf.chunk_frames * conf.frame_samples;
+	if (conf.nthreads <= 1
+		|| (d->audio.total != ~0ULL && d->audio.total < chunk * 2))
+		return;
+
+	conf.encode = aac_out_mt_chunk;
+	conf.onready = aac_out_mt_ready;
+	conf.udata = a;
+	a->trk = d->trk;
+	a->track = d->track;
+	a->mt = ffmem_new(encmt);
+	if (0 != encmt_create(a->mt, &conf)) {
+		warnlog1(d->trk, "can't start encoding threads: %E", fferr_last());
+		encmt_close(a->mt);
+		ffmem_free(a->mt);
+		a->mt = NULL;
+		return;
+	}
+	dbglog1(d->trk, "encoding on %u threads: chunk:%u frames, overlap:%u frames"
+		, conf.nthreads, conf.chunk_frames, conf.overlap_frames);
+}
+
+static int aac_out_mt_encode(aac_out *a, fmed_track_info *d)
+{
+	encmt *m = a->mt;
+	if (d->flags & FMED_FLAST)
+		m->fin = 1;
+	if (a->in.len != 0) {
+		m->pcm = a->in.ptr,  m->pcm_samples = a->in.len / m->conf.sample_size,  m->pcm_off = 0;
+		a->in.len = 0;
+	}
+
+	switch (encmt_process(m)) {
+	case ENCMT_MORE:
+		return FMED_RMORE;
+
+	case ENCMT_ASYNC:
+		return FMED_RASYNC;
+
+	case ENCMT_DONE:
+		d->outlen = 0;
+		return FMED_RDONE;
+
+	case ENCMT_DATA:
+		break;
+
+	default:
+		a->aac.err = m->err;
+		errlog1(d->trk, "encmt_process(): %s", ffaac_enc_errstr(&a->aac));
+		return FMED_RERR;
+	}
+
+	dbglog1(d->trk, "output: %L bytes", m->datalen);
+	ffstr_set(&d->data_out, m->data, m->datalen);
+	return FMED_RDATA;
+}
+
 static int aac_out_encode(void *ctx, fmed_track_info *d)
 {
 	aac_out *a = ctx;
@@ -123,11 +253,16 @@ static int aac_out_encode(void *ctx, fmed_track_info *d)
 		dbglog1(d->trk, "using bitrate %ubps, bandwidth %uHz, asc %*xb"
 			, d->a_enc_bitrate, a->aac.info.bandwidth, asc.len, asc.ptr);
 
+		aac_out_mt_open(a, d);
+
 		d->out = asc.ptr,  d->outlen = asc.len;
 		a->state = W_DATA;
 		return FMED_RDATA;
 	}
 
+	if (a->mt != NULL)
+		return aac_out_mt_encode(a, d);
+
 	if (d->flags & FMED_FLAST)
 		a->aac.fin = 1;
 
@@ -0,0 +1,353 @@
+/** fmedia: encode long audio in chunks on several threads
+2023, Simon Zolin */
+
+/*
+The input PCM timeline is split into chunks of CHUNK packets,
+ and each chunk is encoded by a new encoder instance on one of the worker threads.
+An encoder needs some audio before the chunk start to get into the same state
+ as a single encoder would have at this point (pre-roll),
+ and some audio after the chunk end so the last packets don't see the end of stream (post-roll):
+
+  input:   [PRE | CHUNK | POST]
+  packets:  ...   KEEP    ...
+
+The packets encoded from pre-roll and post-roll are dropped,
+ so the resulting packet stream has the same layout as the output of a single encoder:
+ the same encoder delay, the same number of packets and the same padding at the end.
+A codec with independent frames (FLAC) sets overlap_frames=0:
+ a chunk is then exactly CHUNK frames of the input.
+Chunk #i is always processed by thread #(i % nthreads),
+ and the packets are returned to the user in order.
+*/
+
+#include <FFOS/thread.h>
+#include <FFOS/semaphore.h>
+#include <FFOS/sysconf.h>
+
+enum {
+	ENCMT_THREADS_MAX = 8,
+};
+
+enum ENCMT_R {
+	ENCMT_DATA,
+	ENCMT_MORE,
+	ENCMT_ASYNC, // wait for onready()
+	ENCMT_DONE,
+	ENCMT_ERR,
+};
+
+struct encmt_packet {
+	uint size, samples;
+};
+
+struct encmt_chunk {
+	uint64 seq;
+	ffvec pcm; // PCM: [PRE | CHUNK | POST];  interleaved unless encmt_conf.copy() stores it differently
+	uint pre; // packets encoded from pre-roll
+	uint last; // the last chunk: keep all packets after pre-roll
+	uint iend; // index of the first post-roll packet
+	ffvec data; // encoded packets
+	ffvec packets; // struct encmt_packet[]
+	uint ipkt;
+	size_t data_off;
+	int err;
+	uint done; // set by worker thread
+};
+
+struct encmt_conf {
+	uint frame_samples;
+	uint sample_size; // bytes per sample of all channels in encmt_chunk.pcm
+	uint chunk_frames;
+	uint overlap_frames; // pre-roll and post-roll length
+	uint lead_samples; // silence in front of the input
+	uint nthreads;
+
+	/** Encode all samples of the chunk with a new encoder (on worker thread).
+	Call encmt_packet_add() for each output packet.
+	Return 0 on success;  error code stored in encmt.err */
+	int (*encode)(void *udata, struct encmt_chunk *c);
+
+	/** Copy 'n' samples of the input starting at sample 'off' to the chunk at sample 'at' (on user's thread).
+	NULL: the input is interleaved in the same format as the chunk: it's copied as is.
+	A codec that sets this function uses overlap_frames=0.
+	Return 0 on success;  error code */
+	int (*copy)(void *udata, struct encmt_chunk *c, size_t at, size_t off, size_t n);
+	void (*onready)(void *udata);
+	void *udata;
+};
+
+struct encmt_thread {
+	struct encmt *m;
+	ffthread th;
+	ffsem sem;
+	uint64 next_seq;
+};
+
+typedef struct encmt {
+	struct encmt_conf conf;
+	struct encmt_thread thds[ENCMT_THREADS_MAX];
+	struct encmt_chunk *chunks;
+	uint nchunks;
+	uint64 in_seq; // chunk being filled
+	uint64 out_seq; // chunk being returned to user
+	uint stop;
+	ffvec tail; // pre-roll for the next chunk
+	uint tail_pending :1;
+	uint last_sent :1;
+
+	// input
+	const void *pcm;
+	size_t pcm_samples, pcm_off;
+	uint fin :1;
+
+	// output
+	const void *data;
+	size_t datalen;
+	uint pkt_samples;
+	int err;
+} encmt;
+
+/** Get the number of threads to use: 0 (auto) means the number of CPUs */
+static uint encmt_nthreads(uint conf)
+{
+	if (conf == 0) {
+		ffsysconf sc;
+		ffsysconf_init(&sc);
+		conf = ffsysconf_get(&sc, FFSYSCONF_NPROCESSORS_ONLN);
+	}
+	return ffmin(conf, ENCMT_THREADS_MAX);
+}
+
+/** Store encoded packet (on worker thread) */
+static void encmt_packet_add(struct encmt_chunk *c, const void *data, size_t len, uint samples)
+{
+	ffvec_add(&c->data, data, len, 1);
+	struct encmt_packet *p = ffvec_pushT(&c->packets, struct encmt_packet);
+	p->size = len;
+	p->samples = samples;
+}
+
+static int FFTHREAD_PROCCALL encmt_loop(void *param)
+{
+	struct encmt_thread *t = param;
+	encmt *m = t->m;
+
+	for (;;) {
+		ffsem_wait(t->sem, -1);
+		if (FF_READONCE(m->stop))
+			break;
+
+		struct encmt_chunk *c = &m->chunks[t->next_seq % m->nchunks];
+		FF_ASSERT(c->seq == t->next_seq);
+		t->next_seq += m->conf.nthreads;
+
+		c->data.len = 0;
+		c->packets.len = 0;
+		c->err = m->conf.encode(m->conf.udata, c);
+		ffcpu_fence_release(); // the chunk is complete when the user sees 'done'
+		FF_WRITEONCE(c->done, 1);
+		if (!FF_READONCE(m->stop))
+			m->conf.onready(m->conf.udata);
+	}
+	return 0;
+}
+
+static void encmt_close(encmt *m)
+{
+	FF_WRITEONCE(m->stop, 1);
+	for (uint i = 0;  i != m->conf.nthreads;  i++) {
+		struct encmt_thread *t = &m->thds[i];
+		if (t->th != FFTHREAD_NULL) {
+			ffsem_post(t->sem);
+			ffthread_join(t->th, -1, NULL);
+		}
+		if (t->sem != FFSEM_INV)
+			ffsem_close(t->sem);
+		t->sem = FFSEM_INV;
+	}
+
+	for (uint i = 0;  i != m->nchunks;  i++) {
+		struct encmt_chunk *c = &m->chunks[i];
+		ffvec_free(&c->pcm);
+		ffvec_free(&c->data);
+		ffvec_free(&c->packets);
+	}
+	ffmem_free(m->chunks);
+	m->chunks = NULL;
+	ffvec_free(&m->tail);
+}
+
+/**
+conf.chunk_frames: must be >= overlap_frames
+Return 0 on success */
+static int encmt_create(encmt *m, const struct encmt_conf *conf)
+{
+	FF_ASSERT(conf->chunk_frames >= conf->overlap_frames);
+	FF_ASSERT(conf->copy == NULL || conf->overlap_frames == 0);
+	m->conf = *conf;
+	m->conf.nthreads = ffmin(conf->nthreads, ENCMT_THREADS_MAX);
+	for (uint i = 0;  i != m->conf.nthreads;  i++) {
+		m->thds[i].sem = FFSEM_INV;
+	}
+
+	if (NULL == (m->chunks = ffmem_callocT(m->conf.nthreads * 2, struct encmt_chunk)))
+		return -1;
+	m->nchunks = m->conf.nthreads * 2; // a thread has its next chunk ready while the user receives the previous one
+
+	size_t cap = (m->conf.overlap_frames + m->conf.chunk_frames + m->conf.overlap_frames)
+		* m->conf.frame_samples * m->conf.sample_size;
+	for (uint i = 0;  i != m->nchunks;  i++) {
+		if (NULL == ffvec_alloc(&m->chunks[i].pcm, cap, 1))
+			return -1;
+	}
+
+	// the first chunk has no pre-roll, but starts with silence
+	struct encmt_chunk *c = &m->chunks[0];
+	size_t lead = m->conf.lead_samples * m->conf.sample_size;
+	ffmem_zero(c->pcm.ptr, lead);
+	c->pcm.len = lead;
+
+	for (uint i = 0;  i != m->conf.nthreads;  i++) {
+		struct encmt_thread *t = &m->thds[i];
+		t->m = m;
+		t->next_seq = i;
+		if (FFSEM_INV == (t->sem = ffsem_open(NULL, 0, 0)))
+			return -1;
+		if (FFTHREAD_NULL == (t->th = ffthread_create(&encmt_loop, t, 0)))
+			return -1;
+	}
+	return 0;
+}
+
+/** Pass the chunk to its thread */
+static void encmt_submit(encmt *m, uint last)
+{
+	struct encmt_chunk *c = &m->chunks[m->in_seq % m->nchunks];
+	c->seq = m->in_seq++;
+	c->last = last;
+	c->iend = (last) ? (uint)-1 : c->pre + m->conf.chunk_frames;
+
+	if (!last) {
+		// the next chunk starts with pre-roll: the audio at the end of the current chunk
+		size_t n = m->conf.overlap_frames * 2 * m->conf.frame_samples * m->conf.sample_size;
+		m->tail.len = 0;
+		ffvec_add(&m->tail, (char*)c->pcm.ptr + c->pcm.len - n, n, 1);
+		m->tail_pending = 1;
+	} else {
+		m->last_sent = 1;
+	}
+
+	ffsem_post(m->thds[c->seq % m->conf.nthreads].sem);
+}
+
+/** Prepare the next chunk after its slot is free */
+static void encmt_next(encmt *m)
+{
+	struct encmt_chunk *c = &m->chunks[m->in_seq % m->nchunks];
+	c->pre = m->conf.overlap_frames;
+	c->pcm.len = 0;
+	ffvec_add(&c->pcm, m->tail.ptr, m->tail.len, 1);
+	m->tail_pending = 0;
+}
+
+/** Copy input data to the current chunk
+Return 0 on success */
+static int encmt_fill(encmt *m)
+{
+	if (m->tail_pending)
+		encmt_next(m);
+
+	struct encmt_chunk *c = &m->chunks[m->in_seq % m->nchunks];
+	size_t cap = (c->pre + m->conf.chunk_frames + m->conf.overlap_frames) * m->conf.frame_samples;
+	size_t have = c->pcm.len / m->conf.sample_size;
+	size_t n = ffmin(m->pcm_samples - m->pcm_off, cap - have);
+	if (m->conf.copy != NULL) {
+		int r;
+		if (0 != (r = m->conf.copy(m->conf.udata, c, have, m->pcm_off, n))) {
+			m->err = r;
+			return -1;
+		}
+	} else {
+		ffmem_copy((char*)c->pcm.ptr + c->pcm.len
+			, (char*)m->pcm + m->pcm_off * m->conf.sample_size, n * m->conf.sample_size);
+	}
+	c->pcm.len += n * m->conf.sample_size;
+	m->pcm_off += n;
+	if (have + n == cap)
+		encmt_submit(m, 0);
+	return 0;
+}
+
+/** Get the next packet from the completed chunk.
+Return ENCMT_DATA;  ENCMT_MORE: not ready */
+static int encmt_output(encmt *m)
+{
+	while (m->out_seq != m->in_seq) {
+		struct encmt_chunk *c = &m->chunks[m->out_seq % m->nchunks];
+		if (!FF_READONCE(c->done))
+			break;
+		ffcpu_fence_acquire();
+
+		if (c->err != 0) {
+			m->err = c->err;
+			return ENCMT_ERR;
+		}
+
+		const struct encmt_packet *p = c->packets.ptr;
+		for (;  c->ipkt < c->pre && c->ipkt != c->packets.len;  c->ipkt++) {
+			c->data_off += p[c->ipkt].size; // skip packets encoded from pre-roll
+		}
+
+		if (c->ipkt != c->packets.len && c->ipkt != c->iend) {
+			p = &p[c->ipkt++];
+			m->data = (char*)c->data.ptr + c->data_off;
+			m->datalen = p->size;
+			m->pkt_samples = p->samples;
+			c->data_off += p->size;
+			return ENCMT_DATA;
+		}
+
+		// the chunk is free for new data
+		c->ipkt = 0;
+		c->data_off = 0;
+		c->done = 0;
+		m->out_seq++;
+	}
+	return ENCMT_MORE;
+}
+
+/**
+Return enum ENCMT_R */
+static int encmt_process(encmt *m)
+{
+	for (;;) {
+		int r = encmt_output(m);
+		if (r != ENCMT_MORE)
+			return r;
+
+		int have_slot = (m->in_seq - m->out_seq != m->nchunks);
+
+		if (m->pcm_off != m->pcm_samples) {
+			if (!have_slot)
+				return ENCMT_ASYNC;
+			if (0 != encmt_fill(m))
+				return ENCMT_ERR;
+			continue;
+		}
+
+		if (!m->fin)
+			return ENCMT_MORE;
+
+		if (have_slot && !m->last_sent) {
+			if (m->tail_pending)
+				encmt_next(m);
+			encmt_submit(m, 1);
+			continue;
+		}
+
+		if (m->in_seq != m->out_seq)
+			return ENCMT_ASYNC;
+
+		return ENCMT_DONE;
+	}
+}
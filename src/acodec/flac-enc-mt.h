@@ -0,0 +1,265 @@
+/** fmedia: FLAC encode: several frames in parallel
+2023, Simon Zolin */
+
+/*
+FLAC frames are independent, so the audio is split into chunks of FLACMT_CHUNK_FRAMES frames
+ without pre-roll, and each chunk is encoded by a separate libFLAC encoder (see enc-mt.h).
+The input samples are converted to int[channels][FLACMT_CHUNK_FRAMES * blocksize] while copying.
+libFLAC numbers the frames from 0 in each chunk,
+ so the frame number in the header is rewritten and CRC-8 and CRC-16 are computed again.
+MD5 of the audio is computed on the user's thread while the input data is copied.
+*/
+
+#include <acodec/enc-mt.h>
+
+enum {
+	FLACMT_CHUNK_FRAMES = 32,
+};
+
+enum FLACMT_R {
+	FLACMT_DATA = ENCMT_DATA,
+	FLACMT_MORE = ENCMT_MORE,
+	FLACMT_ASYNC = ENCMT_ASYNC, // wait for onready()
+	FLACMT_DONE = ENCMT_DONE,
+	FLACMT_ERR = ENCMT_ERR,
+};
+
+typedef struct flacmt {
+	encmt mt;
+	flac_conf conf;
+	uint blocksize;
+	flac_md5 *md5;
+
+	void (*onready)(void *udata);
+	void *udata;
+
+	// input
+	const void **pcm;
+
+	// output
+	const byte *data;
+	size_t datalen;
+	uint frsamps;
+	uint minframe, maxframe;
+	char md5sum[16];
+} flacmt;
+
+/** Put UTF-8 coded frame number.
+Return the number of bytes written */
+static uint flacmt_utf8(byte *d, uint64 n)
+{
+	if (n < 0x80) {
+		d[0] = n;
+		return 1;
+	}
+
+	uint len = (n < 0x800) ? 2
+		: (n < 0x10000) ? 3
+		: (n < 0x200000) ? 4
+		: (n < 0x4000000) ? 5
+		: 6;
+	for (uint i = len - 1;  i != 0;  i--) {
+		d[i] = 0x80 | (n & 0x3f);
+		n >>= 6;
+	}
+	d[0] = (0xff00 >> len) | n;
+	return len;
+}
+
+/** Copy frame setting a new frame number in its header.
+Return 0 on success */
+static int flacmt_frame_renum(ffvec *out, const byte *fr, size_t len, uint64 num)
+{
+	if (len < 4 + 1 + 1 + 2)
+		return -1;
+
+	// skip frame number
+	uint i = 4, n = 1;
+	if (fr[i] & 0x80) {
+		while (n != 7 && (fr[i] & (0x80 >> n))) {
+			n++;
+		}
+		if (n == 1 || n == 7)
+			return -1;
+	}
+	i += n;
+
+	uint bs = fr[2] >> 4, sr = fr[2] & 0x0f;
+	uint hdr_ext = ((bs == 6) ? 1 : (bs == 7) ? 2 : 0)
+		+ ((sr == 12) ? 1 : (sr == 13 || sr == 14) ? 2 : 0);
+	if (i + hdr_ext + 1 + 2 > len)
+		return -1;
+
+	ffvec_grow(out, len + 6, 1);
+	byte *d = ffslice_end(out, 1), *p = d;
+	ffmem_copy(p, fr, 4);
+	p += 4;
+	p += flacmt_utf8(p, num);
+	ffmem_copy(p, &fr[i], hdr_ext);
+	p += hdr_ext;
+	*p = flac_crc8(d, p - d);
+	p++;
+
+	i += hdr_ext + 1; // skip old CRC-8
+	size_t body = len - 2 - i;
+	ffmem_copy(p, &fr[i], body);
+	p += body;
+	uint crc = flac_crc16(d, p - d);
+	*p++ = crc >> 8;
+	*p++ = crc;
+	out->len += p - d;
+	return 0;
+}
+
+/** Encode all samples of the chunk (on worker thread).
+Return 0 on success;  enum FLAC_E;  <0: libFLAC error */
+static int flacmt_chunk_encode(void *udata, struct encmt_chunk *c)
+{
+	flacmt *m = udata;
+	uint bs = m->blocksize, cap = bs * FLACMT_CHUNK_FRAMES, off = 0, nframes = 0;
+	uint nsamples = c->pcm.len / (m->conf.channels * sizeof(int));
+	if (nsamples == 0)
+		return 0; // the input length is a multiple of the chunk size
+
+	flac_encoder *enc;
+	flac_conf conf = m->conf;
+	int r;
+	if (0 != (r = flac_encode_init(&enc, &conf)))
+		return r;
+
+	uint64 frame = c->seq * FLACMT_CHUNK_FRAMES;
+	const int *pcm[FLAC__MAX_CHANNELS];
+
+	for (;;) {
+		// libFLAC needs BLOCK+1 samples to output the first frame, then it outputs 1 frame per BLOCK samples
+		uint n = 0;
+		if (off != nsamples)
+			n = ffmin((off == 0) ? bs + 1 : bs, nsamples - off);
+		for (uint ic = 0;  ic != m->conf.channels;  ic++) {
+			pcm[ic] = (int*)c->pcm.ptr + ic * cap + off;
+		}
+
+		uint samples = n;
+		char *buf;
+		if (0 > (r = flac_encode(enc, pcm, &samples, &buf)))
+			goto end;
+		if (n != 0)
+			off += samples;
+
+		if (r > 0) {
+			uint fr_samples = (n != 0) ? bs : nsamples - nframes * bs;
+			if (frame == 0) {
+				encmt_packet_add(c, buf, r, fr_samples);
+			} else {
+				size_t len = c->data.len;
+				if (0 != flacmt_frame_renum(&c->data, (byte*)buf, r, frame + nframes)) {
+					r = FLAC_EFMT;
+					goto end;
+				}
+				struct encmt_packet *p = ffvec_pushT(&c->packets, struct encmt_packet);
+				p->size = c->data.len - len;
+				p->samples = fr_samples;
+			}
+			nframes++;
+		}
+
+		if (n == 0)
+			break;
+	}
+	r = 0;
+
+end:
+	flac_encode_free(enc);
+	return r;
+}
+
+/** Convert input samples to the chunk's format and update MD5 (on user's thread) */
+static int flacmt_copy(void *udata, struct encmt_chunk *c, size_t at, size_t off, size_t n)
+{
+	flacmt *m = udata;
+	uint cap = m->blocksize * FLACMT_CHUNK_FRAMES;
+	const void *src[FLAC__MAX_CHANNELS];
+	int *dst[FLAC__MAX_CHANNELS];
+	for (uint i = 0;  i != m->conf.channels;  i++) {
+		src[i] = (char*)m->pcm[i] + off * m->conf.bps / 8;
+		dst[i] = (int*)c->pcm.ptr + i * cap + at;
+	}
+
+	if (0 != pcm_to32(dst, src, m->conf.bps, m->conf.channels, n))
+		return FLAC_EFMT;
+	if (m->md5 != NULL
+		&& 0 != flac_md5_update(m->md5, (const int**)dst, m->conf.channels, n, m->conf.bps / 8))
+		return FLAC_EFMT;
+	return 0;
+}
+
+static void flacmt_ready(void *udata)
+{
+	flacmt *m = udata;
+	m->onready(m->udata);
+}
+
+static void flacmt_close(flacmt *m)
+{
+	encmt_close(&m->mt);
+	if (m->md5 != NULL)
+		flac_md5_fin(m->md5, m->md5sum);
+}
+
+/**
+conf: bps, channels, rate, level, nomd5
+Return 0 on success */
+static int flacmt_create(flacmt *m, const flac_conf *conf, uint blocksize, uint nthreads)
+{
+	m->conf = *conf;
+	m->conf.nomd5 = 1; // MD5 is computed for the whole stream here
+	m->blocksize = blocksize;
+	m->minframe = (uint)-1;
+
+	if (!conf->nomd5
+		&& NULL == (m->md5 = flac_md5_new()))
+		return -1;
+
+	struct encmt_conf ec = {};
+	ec.frame_samples = blocksize;
+	ec.sample_size = conf->channels * sizeof(int);
+	ec.chunk_frames = FLACMT_CHUNK_FRAMES;
+	ec.nthreads = nthreads;
+	ec.encode = flacmt_chunk_encode;
+	ec.copy = flacmt_copy;
+	ec.onready = flacmt_ready;
+	ec.udata = m;
+	return encmt_create(&m->mt, &ec);
+}
+
+static const char* flacmt_errstr(flacmt *m)
+{
+	ffflac_dec fl;
+	fl.errtype = (m->mt.err < 0) ? FLAC_ELIB : m->mt.err;
+	fl.err = m->mt.err;
+	return ffflac_dec_errstr(&fl);
+}
+
+/**
+Return enum FLACMT_R */
+static int flacmt_process(flacmt *m)
+{
+	int r = encmt_process(&m->mt);
+	switch (r) {
+	case ENCMT_DATA:
+		m->data = m->mt.data;
+		m->datalen = m->mt.datalen;
+		m->frsamps = m->mt.pkt_samples;
+		m->minframe = ffmin(m->minframe, m->datalen);
+		m->maxframe = ffmax(m->maxframe, m->datalen);
+		break;
+
+	case ENCMT_DONE:
+		if (m->md5 != NULL) {
+			flac_md5_fin(m->md5, m->md5sum);
+			m->md5 = NULL;
+		}
+		break;
+	}
+	return r;
+}
@@ -2,15 +2,18 @@
 2015, Simon Zolin */
 
 #include <acodec/alib3-bridge/flac.h>
+#include <acodec/flac-enc-mt.h>
 
 static struct flac_out_conf_t {
 	byte level;
 	byte md5;
+	byte threads;
 } flac_out_conf;
 
 static const fmed_conf_arg flac_enc_conf_args[] = {
 	{ "compression",  FMC_INT8,  FMC_O(struct flac_out_conf_t, level) },
 	{ "md5",	FMC_BOOL8,  FMC_O(struct flac_out_conf_t, md5) },
+	{ "threads",	FMC_INT8,  FMC_O(struct flac_out_conf_t, threads) },
 	{}
 };
 
@@ -18,6 +21,7 @@ int flac_enc_config(fmed_conf_ctx *conf)
 {
 	flac_out_conf.level = 6;
 	flac_out_conf.md5 = 1;
+	flac_out_conf.threads = 1;
 	fmed_conf_addctx(conf, &flac_out_conf, flac_enc_conf_args);
 	return 0;
 }
@@ -26,6 +30,10 @@ int flac_enc_config(fmed_conf_ctx *conf)
 typedef struct flac_enc {
 	ffflac_enc fl;
 	uint state;
+
+	flacmt *mt;
+	void *trk;
+	const fmed_track *track;
 } flac_enc;
 
 static void* flac_enc_create(fmed_filt *d)
@@ -45,10 +53,83 @@ static void* flac_enc_create(fmed_filt *d)
 static void flac_enc_free(void *ctx)
 {
 	flac_enc *f = ctx;
+	if (f->mt != NULL) {
+		flacmt_close(f->mt);
+		ffmem_free(f->mt);
+	}
 	ffflac_enc_close(&f->fl);
 	ffmem_free(f);
 }
 
+static void flac_enc_mt_ready(void *udata)
+{
+	flac_enc *f = udata;
+	f->track->cmd(f->trk, FMED_TRACK_WAKE);
+}
+
+/** Start encoding on several threads if it makes sense */
+static void flac_enc_mt_open(flac_enc *f, fmed_filt *d)
+{
+	uint n = encmt_nthreads(flac_out_conf.threads);
+	uint64 chunk = f->fl.info.minblock * FLACMT_CHUNK_FRAMES;
+	if (n <= 1
+		|| f->fl.info.minblock != f->fl.info.maxblock
+		|| (d->audio.total != ~0ULL && d->audio.total < chunk * 2))
+		return;
+
+	flac_conf conf = {};
+	conf.bps = f->fl.info.bits;
+	conf.channels = f->fl.info.channels;
+	conf.rate = f->fl.info.sample_rate;
+	conf.level = f->fl.level;
+	conf.nomd5 = !!(f->fl.opts & FFFLAC_ENC_NOMD5);
+
+	f->mt = ffmem_new(flacmt);
+	f->mt->onready = flac_enc_mt_ready;
+	f->mt->udata = f;
+	f->trk = d->trk;
+	f->track = d->track;
+	if (0 != flacmt_create(f->mt, &conf, f->fl.info.minblock, n)) {
+		warnlog(core, d->trk, NULL, "can't start encoding threads: %E", fferr_last());
+		flacmt_close(f->mt);
+		ffmem_free(f->mt);
+		f->mt = NULL;
+		return;
+	}
+	dbglog(core, d->trk, NULL, "encoding on %u threads", n);
+}
+
+static int flac_enc_mt_encode(flac_enc *f, fmed_filt *d)
+{
+	flacmt *m = f->mt;
+
+	switch (flacmt_process(m)) {
+	case FLACMT_MORE:
+		return FMED_RMORE;
+
+	case FLACMT_ASYNC:
+		return FMED_RASYNC;
+
+	case FLACMT_DATA:
+		d->flac_frame_samples = m->frsamps;
+		d->out = (void*)m->data;
+		d->outlen = m->datalen;
+		dbglog(core, d->trk, NULL, "output: %L bytes"
+			, d->outlen);
+		return FMED_RDATA;
+
+	case FLACMT_DONE:
+		f->fl.info.minframe = m->minframe;
+		f->fl.info.maxframe = m->maxframe;
+		ffmem_copy(f->fl.info.md5, m->md5sum, sizeof(f->fl.info.md5));
+		d->out = (void*)&f->fl.info,  d->outlen = sizeof(f->fl.info);
+		return FMED_RDONE;
+	}
+
+	errlog(core, d->trk, "flac", "flacmt_process(): %s", flacmt_errstr(m));
+	return FMED_RERR;
+}
+
 static int flac_enc_encode(void *ctx, fmed_filt *d)
 {
 	flac_enc *f = ctx;
@@ -96,11 +177,23 @@ static int flac_enc_encode(void *ctx, fmed_filt *d)
 		break;
 	}
 
+	if (f->state != 3)
+		flac_enc_mt_open(f, d);
+
 	if (d->flags & FMED_FFWD) {
-		f->fl.pcm = (const void**)d->datani;
-		f->fl.pcmlen = d->datalen;
-		if (d->flags & FMED_FLAST)
-			ffflac_enc_fin(&f->fl);
+		if (f->mt != NULL) {
+			flacmt *m = f->mt;
+			m->pcm = (const void**)d->datani;
+			m->mt.pcm_samples = d->datalen / (f->fl.info.bits/8 * f->fl.info.channels);
+			m->mt.pcm_off = 0;
+			if (d->flags & FMED_FLAST)
+				m->mt.fin = 1;
+		} else {
+			f->fl.pcm = (const void**)d->datani;
+			f->fl.pcmlen = d->datalen;
+			if (d->flags & FMED_FLAST)
+				ffflac_enc_fin(&f->fl);
+		}
 	}
 
 	if (f->state != 3) {
@@ -109,6 +202,9 @@ static int flac_enc_encode(void *ctx, fmed_filt *d)
 		return FMED_RDATA;
 	}
 
+	if (f->mt != NULL)
+		return flac_enc_mt_encode(f, d);
+
 	r = ffflac_encode(&f->fl);
 
 	switch (r) {
@@ -1,12 +1,15 @@
 /** fmedia: Opus encode
 2016, Simon Zolin */
 
+#include <acodec/enc-mt.h>
+
 static struct opus_out_conf_t {
 	ushort min_tag_size;
 	uint bitrate;
 	uint frame_size;
 	uint complexity;
 	uint bandwidth;
+	uint threads;
 } opus_out_conf;
 
 static const fmed_conf_arg opus_out_conf_args[] = {
@@ -15,6 +18,7 @@ static const fmed_conf_arg opus_out_conf_args[] = {
 	{ "frame_size",  FMC_INT32,  FMC_O(struct opus_out_conf_t, frame_size) },
 	{ "complexity",  FMC_INT32,  FMC_O(struct opus_out_conf_t, complexity) },
 	{ "bandwidth",  FMC_INT32,  FMC_O(struct opus_out_conf_t, bandwidth) },
+	{ "threads",  FMC_INT32,  FMC_O(struct opus_out_conf_t, threads) },
 	{}
 };
 
@@ -23,6 +27,7 @@ static int opus_out_config(fmed_conf_ctx *ctx)
 	opus_out_conf.min_tag_size = 1000;
 	opus_out_conf.bitrate = 192;
 	opus_out_conf.frame_size = 40;
+	opus_out_conf.threads = 1;
 	fmed_conf_addctx(ctx, &opus_out_conf, opus_out_conf_args);
 	return 0;
 }
@@ -34,6 +39,10 @@ typedef struct opus_out {
 	ffopus_enc opus;
 	uint64 npkt;
 	uint64 endpos;
+
+	encmt *mt;
+	void *trk;
+	const fmed_track *track;
 } opus_out;
 
 static void* opus_out_create(fmed_filt *d)
@@ -47,10 +56,136 @@ static void* opus_out_create(fmed_filt *d)
 static void opus_out_free(void *ctx)
 {
 	opus_out *o = ctx;
+	if (o->mt != NULL) {
+		encmt_close(o->mt);
+		ffmem_free(o->mt);
+	}
 	ffopus_enc_close(&o->opus);
 	ffmem_free(o);
 }
 
+/** Encode a chunk with a new encoder instance (on worker thread) */
+static int opus_out_mt_chunk(void *udata, struct encmt_chunk *c)
+{
+	opus_out *o = udata;
+	opus_ctx *enc;
+	opus_encode_conf conf = {};
+	conf.channels = o->opus.channels;
+	conf.sample_rate = o->opus.sample_rate;
+	conf.bitrate = o->opus.bitrate;
+	conf.complexity = o->opus.complexity;
+	conf.bandwidth = o->opus.bandwidth;
+	int r;
+	if (0 != (r = opus_encode_create(&enc, &conf)))
+		return r;
+
+	uint samp_size = ffpcm_size(FFPCM_FLOAT, conf.channels);
+	uint fr_samples = ffpcm_samples(o->opus.packet_dur, 48000);
+	char *buf = ffmem_alloc(OPUS_MAX_PKT);
+	float *frame = ffmem_calloc(fr_samples, samp_size);
+	if (buf == NULL || frame == NULL) {
+		r = FFOPUS_ESYS;
+		goto end;
+	}
+
+	size_t total = c->pcm.len / samp_size;
+	for (size_t off = 0;  ;  off += fr_samples) {
+		uint n = ffmin(total - off, fr_samples);
+		const float *pcm = (float*)((char*)c->pcm.ptr + off * samp_size);
+		if (n != fr_samples) {
+			if (!c->last)
+				break;
+			// the last packet is padded with silence, as ffopus_encode() does
+			ffmem_copy(frame, pcm, n * samp_size);
+			pcm = frame;
+		}
+
+		if (0 > (r = opus_encode_f(enc, pcm, fr_samples, buf)))
+			goto end;
+		encmt_packet_add(c, buf, r, n);
+		if (n != fr_samples)
+			break;
+	}
+	r = 0;
+
+end:
+	ffmem_free(frame);
+	ffmem_free(buf);
+	opus_encode_free(enc);
+	return r;
+}
+
+static void opus_out_mt_ready(void *udata)
+{
+	opus_out *o = udata;
+	o->track->cmd(o->trk, FMED_TRACK_WAKE);
+}
+
+/** Start encoding on several threads if the input is long enough */
+static void opus_out_mt_open(opus_out *o, fmed_filt *d)
+{
+	struct encmt_conf conf = {};
+	conf.nthreads = encmt_nthreads(opus_out_conf.threads);
+	conf.frame_samples = ffpcm_samples(o->opus.packet_dur, 48000);
+	conf.sample_size = ffpcm_size(FFPCM_FLOAT, o->opus.channels);
+	conf.overlap_frames = (80 + o->opus.packet_dur - 1) / o->opus.packet_dur + 1; // 80msec is enough for decoder to converge
+	conf.chunk_frames = ffmax(5000 / o->opus.packet_dur, conf.overlap_frames);
+	conf.lead_samples = o->opus.preskip;
+	uint64 chunk = conf.chunk_frames * conf.frame_samples;
+	if (conf.nthreads <= 1
+		|| ((int64)d->audio.total != FMED_NULL && d->audio.total < chunk * 2))
+		return;
+
+	conf.encode = opus_out_mt_chunk;
+	conf.onready = opus_out_mt_ready;
+	conf.udata = o;
+	o->trk = d->trk;
+	o->track = d->track;
+	o->mt = ffmem_new(encmt);
+	if (0 != encmt_create(o->mt, &conf)) {
+		warnlog(core, d->trk, NULL, "can't start encoding threads: %E", fferr_last());
+		encmt_close(o->mt);
+		ffmem_free(o->mt);
+		o->mt = NULL;
+		return;
+	}
+	dbglog(core, d->trk, NULL, "encoding on %u threads: chunk:%u frames, overlap:%u frames"
+		, conf.nthreads, conf.chunk_frames, conf.overlap_frames);
+}
+
+static int opus_out_mt_encode(opus_out *o, fmed_filt *d)
+{
+	encmt *m = o->mt;
+
+	switch (encmt_process(m)) {
+	case ENCMT_MORE:
+		return FMED_RMORE;
+
+	case ENCMT_ASYNC:
+		return FMED_RASYNC;
+
+	case ENCMT_DONE:
+		d->outlen = 0;
+		d->audio.pos = o->endpos;
+		return FMED_RDONE;
+
+	case ENCMT_DATA:
+		break;
+
+	default:
+		errlog(core, d->trk, NULL, "encmt_process(): %s", _ffopus_errstr(m->err));
+		return FMED_RERR;
+	}
+
+	d->audio.pos = o->endpos;
+	o->endpos += m->pkt_samples;
+	o->npkt++;
+	dbglog(core, d->trk, NULL, "output: %L bytes @%U [%U]"
+		, m->datalen, d->audio.pos, o->endpos);
+	d->out = m->data,  d->outlen = m->datalen;
+	return FMED_RDATA;
+}
+
 static int opus_out_addmeta(opus_out *o, fmed_filt *d)
 {
 	uint i;
@@ -113,10 +248,22 @@ static int opus_out_encode(void *ctx, fmed_filt *d)
 			d->output.size = ffopus_enc_size(&o->opus, total);
 		}
 
+		opus_out_mt_open(o, d);
+
 		o->state = W_DATA;
 		break;
 	}
 
+	if (o->mt != NULL) {
+		if (d->flags & FMED_FLAST)
+			o->mt->fin = 1;
+		if (d->flags & FMED_FFWD)
+			o->mt->pcm = d->data,  o->mt->pcm_samples = d->datalen / o->mt->conf.sample_size,  o->mt->pcm_off = 0;
+
+		if (o->npkt >= 2) // OpusHead and OpusTags packets are written by ffopus_encode()
+			return opus_out_mt_encode(o, d);
+	}
+
 	if (d->flags & FMED_FLAST)
 		o->opus.fin = 1;
 
@@ -1,6 +1,17 @@
 /** ALSA input/output.
 Copyright (c) 2015 Simon Zolin */
 
+/*
+The worker isn't woken up periodically while the audio data is being transferred.
+Only when the device buffer is full (or empty, for capture), a one-shot timer is armed,
+ which expires after 1 period, when the device is able to accept (or provide) the next portion of data.
+
+The playback buffer is shared between the tracks (it's reused by the next track).
+The tracks may run on the real-time worker, while the filter's close() and the timer handlers
+ run on the main thread: module data is protected by a lock,
+ which is held only for short operations (never while the buffer is being freed).
+*/
+
 #include <fmedia.h>
 #include <adev/audio.h>
 
@@ -17,6 +28,8 @@ typedef struct alsa_mod {
 	audio_out *usedby;
 	const fmed_track *track;
 	uint dev_idx;
+	uint period_msec;
+	fflock lock; // protects 'out', 'usedby', 'fmt', 'dev_idx'
 	uint init_ok :1;
 } alsa_mod;
 
@@ -27,6 +40,7 @@ enum { I_TRYOPEN, I_OPEN, I_DATA };
 static struct alsa_out_conf_t {
 	uint idev;
 	uint buflen;
+	uint period;
 	uint nfy_rate;
 } alsa_out_conf;
 
@@ -55,6 +69,7 @@ static const fmed_filter fmed_alsa_out = {
 static const fmed_conf_arg alsa_out_conf_args[] = {
 	{ "device_index",	FMC_INT32,  FMC_O(struct alsa_out_conf_t, idev) },
 	{ "buffer_length",	FMC_INT32NZ,  FMC_O(struct alsa_out_conf_t, buflen) },
+	{ "period_length",	FMC_INT32,  FMC_O(struct alsa_out_conf_t, period) },
 	{ "notify_rate",	FMC_INT32,  FMC_O(struct alsa_out_conf_t, nfy_rate) },
 	{}
 };
@@ -71,11 +86,13 @@ static const fmed_filter fmed_alsa_in = {
 static struct alsa_in_conf_t {
 	uint idev;
 	uint buflen;
+	uint period;
 } alsa_in_conf;
 
 static const fmed_conf_arg alsa_in_conf_args[] = {
 	{ "device_index",	FMC_INT32,  FMC_O(struct alsa_in_conf_t, idev) },
 	{ "buffer_length",	FMC_INT32NZ,  FMC_O(struct alsa_in_conf_t, buflen) },
+	{ "period_length",	FMC_INT32,  FMC_O(struct alsa_in_conf_t, period) },
 	{}
 };
 
@@ -123,23 +140,37 @@ static int alsa_sig(uint signo)
 			return -1;
 
 		mod->track = core->getmod("#core.track");
+		fflk_init(&mod->lock);
 		return 0;
 	}
 	return 0;
 }
 
-void alsa_buf_close(void *param)
+static void alsa_buf_free(ffaudio_buf *out)
 {
-	if (mod->out == NULL)
+	if (out == NULL)
 		return;
 	dbglog1(NULL, "free buffer");
-	ffalsa.free(mod->out);
-	mod->out = NULL;
+	ffalsa.free(out);
+}
+
+/** Timer handler: free the buffer if it hasn't been reused by another track.
+Thread: main */
+void alsa_buf_close(void *param)
+{
+	ffaudio_buf *out = NULL;
+	fflk_lock(&mod->lock);
+	if (mod->usedby == NULL) {
+		out = mod->out;
+		mod->out = NULL;
+	}
+	fflk_unlock(&mod->lock);
+	alsa_buf_free(out);
 }
 
 static void alsa_destroy(void)
 {
-	alsa_buf_close(NULL);
+	alsa_buf_free(mod->out);
 	ffvec_free(&mod->fmts);
 	ffmem_free(mod);
 	mod = NULL;
@@ -169,11 +200,21 @@ static int alsa_adev_list(fmed_adev_ent **ents, uint flags)
 	return r;
 }
 
+/** Get the wakeup period.
+period: user-specified value (msec);  0:default */
+static uint alsa_period(uint period, uint buffer_length_msec)
+{
+	if (period == 0 || period > buffer_length_msec / 2)
+		period = buffer_length_msec / 3;
+	return ffmax(period, 1);
+}
+
 
 static int alsa_out_config(fmed_conf_ctx *ctx)
 {
 	alsa_out_conf.idev = 0;
 	alsa_out_conf.buflen = 500;
+	alsa_out_conf.period = 0;
 	alsa_out_conf.nfy_rate = 0;
 	fmed_conf_addctx(ctx, &alsa_out_conf, alsa_out_conf_args);
 	return 0;
@@ -203,6 +244,7 @@ static void* alsa_open(fmed_filt *d)
 static void alsa_close(void *ctx)
 {
 	audio_out *a = ctx;
+	fflk_lock(&mod->lock);
 	if (mod->usedby == a) {
 		dbglog1(NULL, "stop");
 		if (0 != ffalsa.stop(mod->out))
@@ -216,6 +258,7 @@ static void alsa_close(void *ctx)
 
 		mod->usedby = NULL;
 	}
+	fflk_unlock(&mod->lock);
 
 	ffalsa.dev_free(a->dev);
 	ffmem_free(a);
@@ -234,6 +277,7 @@ static int alsa_create(audio_out *a, fmed_filt *d)
 	a->aflags = FFAUDIO_O_HWDEV; // try "hw" device first, then fall back to "plughw"
 	a->try_open = (a->state == I_TRYOPEN);
 
+	fflk_lock(&mod->lock);
 	if (mod->out != NULL) {
 
 		core->timer(&mod->tmr, 0, 0); // stop 'alsa_buf_close' timer
@@ -266,11 +310,17 @@ static int alsa_create(audio_out *a, fmed_filt *d)
 				// Instead, just use the format ffaudio set for us previously.
 				ffpcm_fmtcopy(&d->audio.convfmt, good_fmt);
 				a->state = I_OPEN;
+				fflk_unlock(&mod->lock);
 				return FMED_RMORE;
 			}
 		}
 
-		alsa_buf_close(NULL);
+		ffaudio_buf *out = mod->out;
+		mod->out = NULL;
+		fflk_unlock(&mod->lock);
+		alsa_buf_free(out);
+	} else {
+		fflk_unlock(&mod->lock);
 	}
 
 	r = audio_out_open(a, d, &fmt);
@@ -284,22 +334,22 @@ static int alsa_create(audio_out *a, fmed_filt *d)
 	ffalsa.dev_free(a->dev);
 	a->dev = NULL;
 
+	fflk_lock(&mod->lock);
 	mod->out = a->stream;
 	mod->fmt = fmt;
 	mod->dev_idx = a->dev_idx;
 
 fin:
 	mod->usedby = a;
-	dbglog1(d->trk, "%s buffer %ums, %s/%uHz/%u"
-		, reused ? "reused" : "opened", a->buffer_length_msec
+	fflk_unlock(&mod->lock);
+	mod->period_msec = alsa_period(alsa_out_conf.period, a->buffer_length_msec);
+	dbglog1(d->trk, "%s buffer %ums, period %ums, %s/%uHz/%u"
+		, reused ? "reused" : "opened", a->buffer_length_msec, mod->period_msec
 		, ffpcm_format_str(mod->fmt.format), mod->fmt.sample_rate, mod->fmt.channels);
 
 	// if (alsa_out_conf.nfy_rate != 0)
 	// 	mod->out.nfy_interval = ffpcm_samples(alsa_out_conf.buflen / alsa_out_conf.nfy_rate, fmt.sample_rate);
 	fmed_timer_set(&mod->tmr, audio_out_onplay, a);
-	if (0 != core->timer(&mod->tmr, a->buffer_length_msec / 3, 0))
-		return FMED_RERR;
-
 	return 0;
 
 }
@@ -323,17 +373,25 @@ static int alsa_write(void *ctx, fmed_filt *d)
 		break;
 	}
 
-	if (mod->usedby != a) {
+	if (FF_READONCE(mod->usedby) != a) { // the buffer is taken by another track
 		a->track->cmd(a->trk, FMED_TRACK_STOPPED);
 		return FMED_RFIN;
 	}
 
 	r = audio_out_write(a, d);
 	if (r == FMED_RERR) {
-		alsa_buf_close(NULL);
+		fflk_lock(&mod->lock);
+		ffaudio_buf *out = mod->out;
+		mod->out = NULL;
 		core->timer(&mod->tmr, 0, 0);
 		mod->usedby = NULL;
+		fflk_unlock(&mod->lock);
+		alsa_buf_free(out);
 		return FMED_RERR;
+	} else if (r == FMED_RASYNC && a->async) {
+		// wait until the device has free space for 1 period
+		if (0 != core->timer(&mod->tmr, -(int)mod->period_msec, 0))
+			return FMED_RERR;
 	}
 	return r;
 }
@@ -342,12 +400,14 @@ static int alsa_write(void *ctx, fmed_filt *d)
 typedef struct alsa_in {
 	audio_in in;
 	fftimerqueue_node tmr;
+	uint period_msec;
 } alsa_in;
 
 static int alsa_in_config(fmed_conf_ctx *ctx)
 {
 	alsa_in_conf.idev = 0;
 	alsa_in_conf.buflen = 500;
+	alsa_in_conf.period = 0;
 	fmed_conf_addctx(ctx, &alsa_in_conf, alsa_in_conf_args);
 	return 0;
 }
@@ -377,10 +437,9 @@ static void* alsa_in_open(fmed_filt *d)
 	if (0 != audio_in_open(a, d))
 		goto fail;
 
+	al->period_msec = alsa_period(alsa_in_conf.period, a->buffer_length_msec);
+	dbglog1(d->trk, "capture period %ums", al->period_msec);
 	fmed_timer_set(&al->tmr, audio_oncapt, a);
-	if (0 != core->timer(&al->tmr, a->buffer_length_msec / 3, 0))
-		goto fail;
-
 	return al;
 
 fail:
@@ -399,5 +458,11 @@ static void alsa_in_close(void *ctx)
 static int alsa_in_read(void *ctx, fmed_filt *d)
 {
 	alsa_in *al = ctx;
-	return audio_in_read(&al->in, d);
+	int r = audio_in_read(&al->in, d);
+	if (r == FMED_RASYNC) {
+		// wait until the device has 1 period of data
+		if (0 != core->timer(&al->tmr, -(int)al->period_msec, 0))
+			return FMED_RERR;
+	}
+	return r;
 }
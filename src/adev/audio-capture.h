@@ -18,6 +18,7 @@ typedef struct audio_in {
 	uint64 total_samples;
 	uint frame_size;
 	uint async;
+	uint overruns;
 } audio_in;
 
 static void audio_oncapt(void *udata);
@@ -130,6 +131,8 @@ err:
 
 static void audio_in_close(audio_in *a)
 {
+	if (a->stream != NULL)
+		dbglog1(a->trk, "captured %U samples.  overruns:%u", a->total_samples, a->overruns);
 	a->audio->free(a->stream);
 	a->stream = NULL;
 }
@@ -157,7 +160,8 @@ static int audio_in_read(audio_in *a, fmed_filt *d)
 	for (;;) {
 		r = a->audio->read(a->stream, &buf);
 		if (r == -FFAUDIO_ESYNC) {
-			warnlog1(d->trk, "overrun detected", 0);
+			a->overruns++;
+			warnlog1(d->trk, "overrun detected (%u)", a->overruns);
 			continue;
 
 		} else if (r < 0) {
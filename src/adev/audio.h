@@ -199,6 +199,9 @@ struct audio_out {
 	ffaudio_dev *dev;
 	uint async;
 	uint clear :1;
+	uint underruns;
+	uint64 written; // bytes written since 'write_start'
+	fftime write_start; // time of the first write after open/clear/pause
 
 	// user's
 	uint state;
@@ -306,6 +309,39 @@ end:
 	return rc;
 }
 
+/** Reset the output latency measurement. */
+static inline void audio_out_latency_reset(audio_out *a)
+{
+	a->written = 0;
+	ffmem_zero_obj(&a->write_start);
+}
+
+/** Get output latency: the time passed since the first write minus the duration of the data written.
+Called when the device has played all data.
+Return -1 if the value can't be measured. */
+static inline int audio_out_latency(audio_out *a, const fmed_filt *d)
+{
+	uint frame_size = ffpcm_size1(&d->audio.convfmt);
+	if (a->underruns != 0 || a->write_start.sec == 0 || frame_size == 0)
+		return -1;
+	fftime t = fftime_monotonic();
+	fftime_sub(&t, &a->write_start);
+	int64 played_msec = a->written / frame_size * 1000 / d->audio.convfmt.sample_rate;
+	return (int)(fftime_to_msec(&t) - played_msec);
+}
+
+/** Estimate the amount of queued data as the duration of the data written minus the time passed. */
+static inline void audio_out_fill_update(audio_out *a, fmed_filt *d)
+{
+	uint frame_size = ffpcm_size1(&d->audio.convfmt);
+	if (frame_size == 0 || d->audio.convfmt.sample_rate == 0)
+		return;
+	fftime t = fftime_monotonic();
+	fftime_sub(&t, &a->write_start);
+	int64 fill = (int64)(a->written / frame_size * 1000 / d->audio.convfmt.sample_rate) - (int64)fftime_to_msec(&t);
+	d->a_out_buf_fill = ffmax(ffmin(fill, (int64)a->buffer_length_msec), 0);
+}
+
 static inline void audio_out_onplay(void *param)
 {
 	audio_out *a = param;
@@ -335,6 +371,7 @@ static inline int audio_out_write(audio_out *a, fmed_filt *d)
 			warnlog1(a->trk, "audio.stop: %s", a->audio->error(a->stream));
 		if (0 != a->audio->clear(a->stream))
 			warnlog1(d->trk, "audio.clear: %s", a->audio->error(a->stream));
+		audio_out_latency_reset(a);
 		if (d->seek_req)
 			return FMED_RMORE;
 	}
@@ -344,6 +381,7 @@ static inline int audio_out_write(audio_out *a, fmed_filt *d)
 		d->track->cmd(d->trk, FMED_TRACK_PAUSE);
 		if (0 != a->audio->stop(a->stream))
 			warnlog1(d->trk, "pause: audio.stop: %s", a->audio->error(a->stream));
+		audio_out_latency_reset(a);
 		return FMED_RASYNC;
 	}
 
@@ -357,7 +395,8 @@ static inline int audio_out_write(audio_out *a, fmed_filt *d)
 			return FMED_RASYNC;
 
 		} else if (r == -FFAUDIO_ESYNC) {
-			warnlog1(d->trk, "underrun detected", 0);
+			a->underruns++;
+			warnlog1(d->trk, "underrun detected (%u)", a->underruns);
 			continue;
 
 		} else if (r == -FFAUDIO_EDEV_OFFLINE && a->handle_dev_offline) {
@@ -375,6 +414,10 @@ static inline int audio_out_write(audio_out *a, fmed_filt *d)
 			return FMED_RERR;
 		}
 
+		if (a->write_start.sec == 0)
+			a->write_start = fftime_monotonic();
+		a->written += r;
+		audio_out_fill_update(a, d);
 		d->data += r;
 		d->datalen -= r;
 		dbglog1(d->trk, "written %u bytes"
@@ -384,8 +427,11 @@ static inline int audio_out_write(audio_out *a, fmed_filt *d)
 	if (d->flags & FMED_FLAST) {
 
 		r = a->audio->drain(a->stream);
-		if (r == 1)
+		if (r == 1) {
+			dbglog1(d->trk, "drained.  underruns:%u  output latency:%dms"
+				, a->underruns, audio_out_latency(a, d));
 			return FMED_RDONE;
+		}
 		else if (r < 0) {
 			errlog1(d->trk, "drain(): %s", a->audio->error(a->stream));
 			return FMED_RERR;
@@ -0,0 +1,212 @@
+/** fmedia: afilter.dsp: several lightweight operations on PCM data in one pass
+2023, Simon Zolin */
+
+/*
+Performs the operations of afilter.until -> afilter.rtpeak -> start-level trigger -> stop-level trigger -> afilter.gain
+ with the same results, but each block of data is walked through once (or twice when waiting for start level).
+The operations for each instance are set by the track (fmed_track_info.dsp_ops).
+*/
+
+extern void startlev_log(double val, uint64 offset, const ffpcmex *fmt, fmed_filt *d);
+extern void stoplev_init(ffpcm_stoplev *sl, fmed_filt *d);
+extern void stoplev_log(const ffpcm_stoplev *sl, const ffpcmex *fmt, fmed_filt *d);
+
+struct dsp {
+	uint ops; //enum FMED_DSP
+	ffpcmex fmt;
+	uint samp_size;
+	ffpcm_dsp pcm;
+
+	uint64 until;
+	uint64 total;
+	uint64 offset; //start-level: number of skipped samples
+	uint started :1;
+	int db;
+	void *ni[8];
+};
+
+static void* dsp_open(fmed_filt *d)
+{
+	uint ops = d->dsp_ops & 0xff;
+	d->dsp_ops >>= 8;
+
+	if ((int64)d->audio.until == FMED_NULL)
+		ops &= ~FMED_DSP_UNTIL;
+	if (d->a_start_level == 0)
+		ops &= ~FMED_DSP_STARTLEV;
+	if (d->a_stop_level == 0)
+		ops &= ~FMED_DSP_STOPLEV;
+
+	double t;
+	if ((ops & FMED_DSP_RTPEAK)
+		&& 0 != ffpcm_peak(&d->audio.fmt, NULL, 0, &t)) {
+		errlog1(d->trk, "ffpcm_peak(): unsupported format");
+		ops &= ~FMED_DSP_RTPEAK;
+	}
+
+	if (d->audio.fmt.channels > 8) {
+		// only 'until' doesn't depend on the number of channels; pass the data through as before
+		if (ops & ~(FMED_DSP_UNTIL | FMED_DSP_GAIN))
+			warnlog1(d->trk, "%u channels: level detection isn't supported"
+				, d->audio.fmt.channels);
+		ops &= FMED_DSP_UNTIL;
+	}
+
+	if (ops == 0)
+		return FMED_FILT_SKIP;
+
+	struct dsp *c = ffmem_new(struct dsp);
+	if (c == NULL)
+		return NULL;
+	c->ops = ops;
+	c->fmt = d->audio.fmt;
+	c->samp_size = ffpcm_size1(&c->fmt);
+	c->db = ~d->audio.gain;
+
+	if (ops & FMED_DSP_UNTIL) {
+		int64 val = d->audio.until;
+		if (val > 0)
+			c->until = ffpcm_samples(val, c->fmt.sample_rate);
+		else
+			c->until = -val * c->fmt.sample_rate / 75;
+
+		if ((int64)d->audio.total != FMED_NULL)
+			d->audio.total = c->until;
+	}
+
+	if (ops & FMED_DSP_STARTLEV)
+		c->pcm.start_level = ffpcm_db2gain(-d->a_start_level);
+
+	if (ops & FMED_DSP_STOPLEV)
+		stoplev_init(&c->pcm.stop, d);
+
+	return c;
+}
+
+static void dsp_close(void *ctx)
+{
+	struct dsp *c = ctx;
+	ffmem_free(c);
+}
+
+/** Get pointer to the input data starting at sample #off */
+static void* dsp_data(struct dsp *c, fmed_filt *d, size_t off)
+{
+	if (off == 0)
+		return (void*)d->data;
+
+	if (c->fmt.ileaved)
+		return (char*)d->data + off * c->samp_size;
+
+	for (uint i = 0;  i != c->fmt.channels;  i++) {
+		c->ni[i] = (char*)d->datani[i] + off * ffpcm_bits(c->fmt.format) / 8;
+	}
+	return c->ni;
+}
+
+static void dsp_peak(struct dsp *c, fmed_filt *d)
+{
+	double db = ffpcm_gain2db(c->pcm.maxpeak);
+	d->audio.maxpeak = db;
+	dbglog1(d->trk, "maxpeak:%.2F", db);
+}
+
+static int dsp_process(void *ctx, fmed_filt *d)
+{
+	struct dsp *c = ctx;
+	size_t n = d->datalen / c->samp_size, off = 0;
+	uint ops = 0, stop = 0;
+	ssize_t r;
+
+	if (!(d->flags & FMED_FFWD)) {
+		d->outlen = 0;
+		return FMED_RMORE;
+	}
+
+	if ((c->ops & FMED_DSP_UNTIL) && !(d->flags & FMED_FLAST)) {
+		uint64 pos;
+		if (FMED_NULL == (int64)(pos = d->audio.pos)) {
+			pos = c->total;
+			c->total += n;
+		}
+
+		dbglog1(d->trk, "at %U..%U", pos, pos + n);
+		if (pos + n >= c->until) {
+			dbglog1(d->trk, "reached sample #%U", c->until);
+			n = (c->until > pos) ? c->until - pos : 0;
+			stop = 1;
+		}
+	}
+
+	if (c->ops & FMED_DSP_RTPEAK)
+		ops |= FFPCM_DSP_PEAK;
+
+	if ((c->ops & FMED_DSP_STARTLEV) && !c->started) {
+		c->pcm.ops = ops | FFPCM_DSP_STARTLEV;
+		ops = 0;
+		r = ffpcm_dsp_process(&c->pcm, &c->fmt, dsp_data(c, d, 0), n);
+		if (r == -2)
+			return FMED_RERR;
+		if (c->pcm.ops & FFPCM_DSP_PEAK)
+			dsp_peak(c, d);
+
+		if (r == -1) {
+			c->offset += n;
+			d->datalen = 0;
+			d->outlen = 0;
+			if (stop)
+				return FMED_RLASTOUT;
+			return (d->flags & FMED_FLAST) ? FMED_RDONE : FMED_RMORE;
+		}
+
+		c->offset += r;
+		startlev_log(c->pcm.start_val, c->offset, &c->fmt, d);
+		c->started = 1;
+		off = r;
+
+	} else if ((ops & FFPCM_DSP_PEAK) && (c->ops & FMED_DSP_STOPLEV)) {
+		// the peak is measured on the whole block, even if stop-level fires in the middle
+		c->pcm.ops = FFPCM_DSP_PEAK;
+		ops = 0;
+		ffpcm_dsp_process(&c->pcm, &c->fmt, dsp_data(c, d, 0), n);
+		dsp_peak(c, d);
+	}
+
+	if (c->ops & FMED_DSP_STOPLEV)
+		ops |= FFPCM_DSP_STOPLEV;
+
+	int db = d->audio.gain;
+	if ((c->ops & FMED_DSP_GAIN) && db != FMED_NULL && db != 0) {
+		if (db != c->db) {
+			c->db = db;
+			c->pcm.gain = ffpcm_db2gain((double)db / 100);
+		}
+		ops |= FFPCM_DSP_GAIN;
+	}
+
+	if (ops != 0) {
+		c->pcm.ops = ops;
+		r = ffpcm_dsp_process(&c->pcm, &c->fmt, dsp_data(c, d, off), n - off);
+		if (r == -2)
+			return FMED_RERR;
+		if (ops & FFPCM_DSP_PEAK)
+			dsp_peak(c, d);
+
+		if (r >= 0) {
+			stoplev_log(&c->pcm.stop, &c->fmt, d);
+			n = off + r;
+			stop = 1;
+		}
+	}
+
+	d->out = dsp_data(c, d, off);
+	d->outlen = (n - off) * c->samp_size;
+	d->datalen = 0;
+	if (stop)
+		return FMED_RLASTOUT;
+	if (d->flags & FMED_FLAST)
+		return FMED_RDONE;
+	return FMED_ROK;
+}
+
+static const fmed_filter fmed_sndmod_dsp = { dsp_open, dsp_process, dsp_close };
@@ -1136,3 +1136,156 @@ ssize_t ffpcm_process(const ffpcmex *fmt, const void *data, size_t samples, ffpc
 done:
 	return i;
 }
+
+
+static int pcm_stoplev(ffpcm_stoplev *c, double val)
+{
+	c->all_samples++;
+
+	switch (c->state) {
+	case 0:
+		if (val > c->level)
+			break;
+		c->val = val;
+		c->state = 1;
+		//fallthrough
+
+	case 1:
+		if (val > c->level) {
+			c->nsamples = 0;
+			c->state = 0;
+			break;
+		}
+		if (++c->nsamples != c->max_samples)
+			break;
+		c->state = 2;
+		//fallthrough
+
+	case 2:
+		if (c->min_stop_samples == 0
+			|| c->all_samples == c->min_stop_samples)
+			return 1;
+		break;
+	}
+	return 0;
+}
+
+#define dsp_16_get(p)  _ffpcm_16le_flt(*(short*)(p))
+#define dsp_16_set(p, f)  (*(short*)(p) = _ffpcm_flt_16le(f))
+#define dsp_24_get(p)  _ffpcm_24_flt(ffint_ltoh24s(p))
+#define dsp_24_set(p, f)  ffint_htol24(p, _ffpcm_flt_24(f))
+#define dsp_32_get(p)  _ffpcm_32_flt((int)ffint_le_cpu32_ptr(p))
+#define dsp_32_set(p, f)  (*(int*)(p) = _ffpcm_flt_32(f))
+#define dsp_flt_get(p)  (*(float*)(p))
+#define dsp_flt_set(p, f)  (*(float*)(p) = (f))
+
+/* ptr: pointers to the first sample of each channel
+step: distance between 2 samples of a channel (in bytes) */
+#define DSP_FUNC(name, get, set) \
+static ssize_t name(ffpcm_dsp *c, char **ptr, uint nch, size_t samples, uint step) \
+{ \
+	const uint ops = c->ops; \
+	const float gain = c->gain; \
+	double peak = 0; \
+	ssize_t r = -1; \
+	uint ich; \
+	size_t i; \
+	char *p; \
+\
+	for (ich = 0;  ich != nch;  ich++) { \
+		p = ptr[ich]; \
+		for (i = 0;  i != samples;  i++, p += step) { \
+			double f = get(p); \
+\
+			if (ops & (FFPCM_DSP_PEAK | FFPCM_DSP_STARTLEV | FFPCM_DSP_STOPLEV)) { \
+				double u = ffabs(f); \
+				if (peak < u) \
+					peak = u; \
+\
+				if ((ops & FFPCM_DSP_STARTLEV) && r == -1 && u > c->start_level) { \
+					c->start_val = u; \
+					r = i; \
+					if (!(ops & FFPCM_DSP_PEAK)) \
+						goto done; \
+				} \
+\
+				if ((ops & FFPCM_DSP_STOPLEV) && 0 != pcm_stoplev(&c->stop, u)) { \
+					r = i; \
+					goto stop; \
+				} \
+			} \
+\
+			if (ops & FFPCM_DSP_GAIN) \
+				set(p, f * gain); \
+		} \
+	} \
+	goto done; \
+\
+stop: \
+	/* the next channels are processed up to the stop position */ \
+	if (ops & FFPCM_DSP_GAIN) { \
+		for (ich++;  ich < nch;  ich++) { \
+			p = ptr[ich]; \
+			for (i = 0;  i != (size_t)r;  i++, p += step) { \
+				set(p, get(p) * gain); \
+			} \
+		} \
+	} \
+\
+done: \
+	c->maxpeak = peak; \
+	return r; \
+}
+
+DSP_FUNC(dsp_16, dsp_16_get, dsp_16_set)
+DSP_FUNC(dsp_24, dsp_24_get, dsp_24_set)
+DSP_FUNC(dsp_32, dsp_32_get, dsp_32_set)
+DSP_FUNC(dsp_flt, dsp_flt_get, dsp_flt_set)
+
+#undef DSP_FUNC
+
+ssize_t ffpcm_dsp_process(ffpcm_dsp *c, const ffpcmex *fmt, void *data, size_t samples)
+{
+	char *ptr[8];
+	uint ich, nch = fmt->channels, ssize = ffpcm_bits(fmt->format) / 8, step = ssize;
+
+	if (fmt->channels > 8)
+		return -2;
+
+	if (fmt->ileaved) {
+		for (ich = 0;  ich != nch;  ich++) {
+			ptr[ich] = (char*)data + ich * ssize;
+		}
+		step = ssize * nch;
+
+		if (!(c->ops & (FFPCM_DSP_STARTLEV | FFPCM_DSP_STOPLEV))) {
+			// the order doesn't matter: walk through the whole buffer sequentially
+			samples *= nch;
+			nch = 1;
+			step = ssize;
+		}
+
+	} else {
+		for (ich = 0;  ich != nch;  ich++) {
+			ptr[ich] = ((char**)data)[ich];
+		}
+	}
+
+	switch (fmt->format) {
+	case FFPCM_16:
+		return dsp_16(c, ptr, nch, samples, step);
+	case FFPCM_24:
+		return dsp_24(c, ptr, nch, samples, step);
+	case FFPCM_32:
+		return dsp_32(c, ptr, nch, samples, step);
+	case FFPCM_FLOAT:
+		return dsp_flt(c, ptr, nch, samples, step);
+	}
+
+	if (c->ops == FFPCM_DSP_GAIN) {
+		if (0 != ffpcm_gain(fmt, c->gain, data, data, samples))
+			return -2;
+		return -1;
+	}
+	return -2;
+}
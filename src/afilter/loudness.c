@@ -0,0 +1,620 @@
+/** fmedia: --loudness: EBU R128 loudness scan with ReplayGain tags write-back
+2023, Simon Zolin */
+
+/*
+INPUT -> ... -> afilter.autoconv -> afilter.loudness
+
+Each track is analyzed on its own worker (--parallel runs several tracks at once):
+ . K-weighting filter (ITU-R BS.1770): 2 biquads per channel
+ . mean square of every 100ms sub-block (weighted sum of channels)
+ . momentary loudness: 400ms block (4 sub-blocks) -> histogram for integrated loudness
+ . short-term loudness: 3s window (30 sub-blocks) -> histogram for loudness range (EBU Tech 3342)
+ . true peak: 4x oversampling by polyphase FIR (2x for 96kHz, none for >=192kHz)
+Histogram: 0.1 LU bins from -70 LUFS (absolute gate) to +10 LUFS.
+The gated mean is computed from the bins' central values,
+ so the results of several tracks are merged by just adding the counters.
+
+When a track is finished, its histograms are added to the album (tracks from the same directory).
+When fmedia stops, the module prints album results
+ and writes ReplayGain tags (reference: -18 LUFS) via fmt.edit-tags if requested.
+*/
+
+#include <fmedia.h>
+#include <ffbase/lock.h>
+#include <ffbase/map.h>
+#include <FFOS/path.h>
+#include <math.h>
+
+#undef errlog
+#undef warnlog
+#undef infolog
+#define errlog(trk, ...)  fmed_errlog(core, trk, "loudness", __VA_ARGS__)
+#define warnlog(trk, ...)  fmed_warnlog(core, trk, "loudness", __VA_ARGS__)
+#define infolog(trk, ...)  fmed_infolog(core, trk, "loudness", __VA_ARGS__)
+
+extern const fmed_core *core;
+
+enum {
+	LND_MAXCH = 8,
+	LND_HIST_MIN = -70, // LUFS
+	LND_HIST_MAX = 10,
+	LND_HIST_N = (LND_HIST_MAX - LND_HIST_MIN) * 10,
+	LND_ST_SUBBLOCKS = 30,
+	LND_TP_TAPS = 12, // FIR taps per phase
+	LND_TP_CHUNK = 4096, // samples
+	LND_LANES = 8,
+};
+
+#define LND_REF  (-18.0) // ReplayGain 2.0 reference level, LUFS
+
+struct lnd_hist {
+	uint n[LND_HIST_N];
+};
+
+static double lnd_energy_lufs(double e)
+{
+	return -0.691 + 10 * log10(e);
+}
+
+/** Mean square value of the bin's center */
+static double lnd_bin_energy(uint i)
+{
+	double lufs = LND_HIST_MIN + (i + 0.5) / 10;
+	return pow(10, (lufs + 0.691) / 10);
+}
+
+static void lnd_hist_add(struct lnd_hist *h, double e)
+{
+	if (!(e > 0))
+		return;
+	double lufs = lnd_energy_lufs(e);
+	if (lufs < LND_HIST_MIN)
+		return;
+	uint i = (uint)((lufs - LND_HIST_MIN) * 10);
+	if (i >= LND_HIST_N)
+		i = LND_HIST_N - 1;
+	h->n[i]++;
+}
+
+static void lnd_hist_merge(struct lnd_hist *dst, const struct lnd_hist *src)
+{
+	for (uint i = 0;  i != LND_HIST_N;  i++) {
+		dst->n[i] += src->n[i];
+	}
+}
+
+/** Apply relative gate.
+Return the index of the first bin above the gate;  -1: no data */
+static int lnd_hist_gate(const struct lnd_hist *h, double rel_lu)
+{
+	double sum = 0;
+	uint64 n = 0;
+	for (uint i = 0;  i != LND_HIST_N;  i++) {
+		sum += h->n[i] * lnd_bin_energy(i);
+		n += h->n[i];
+	}
+	if (n == 0)
+		return -1;
+
+	double gate = lnd_energy_lufs(sum / n) + rel_lu;
+	int i = (int)((gate - LND_HIST_MIN) * 10);
+	return ffmin(ffmax(i, 0), LND_HIST_N - 1);
+}
+
+/** Integrated loudness, LUFS.
+Return 0 on success. */
+static int lnd_integrated(const struct lnd_hist *h, double *lufs)
+{
+	int start = lnd_hist_gate(h, -10);
+	if (start < 0)
+		return -1;
+
+	double sum = 0;
+	uint64 n = 0;
+	for (uint i = start;  i != LND_HIST_N;  i++) {
+		sum += h->n[i] * lnd_bin_energy(i);
+		n += h->n[i];
+	}
+	if (n == 0)
+		return -1;
+	*lufs = lnd_energy_lufs(sum / n);
+	return 0;
+}
+
+/** Loudness range, LU: the difference between 95th and 10th percentiles of gated short-term loudness */
+static double lnd_range(const struct lnd_hist *h)
+{
+	int start = lnd_hist_gate(h, -20);
+	if (start < 0)
+		return 0;
+
+	uint64 n = 0;
+	for (uint i = start;  i != LND_HIST_N;  i++) {
+		n += h->n[i];
+	}
+	if (n == 0)
+		return 0;
+
+	uint64 lo_idx = (uint64)((n - 1) * 0.10), hi_idx = (uint64)((n - 1) * 0.95);
+	uint64 cum = 0;
+	int lo = -1, hi = -1;
+	for (uint i = start;  i != LND_HIST_N;  i++) {
+		cum += h->n[i];
+		if (lo < 0 && cum > lo_idx)
+			lo = i;
+		if (cum > hi_idx) {
+			hi = i;
+			break;
+		}
+	}
+	return (double)(hi - lo) / 10;
+}
+
+/** K-weighting filter coefficients for the sample rate */
+struct lnd_kw {
+	double b[2][3], a[2][3];
+};
+
+static void lnd_kw_init(struct lnd_kw *k, uint rate)
+{
+	// high shelf
+	double f0 = 1681.974450955533, G = 3.999843853973347, Q = 0.7071752369554196;
+	double K = tan(M_PI * f0 / rate);
+	double Vh = pow(10, G / 20);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1 + K / Q + K * K;
+	k->b[0][0] = (Vh + Vb * K / Q + K * K) / a0;
+	k->b[0][1] = 2 * (K * K - Vh) / a0;
+	k->b[0][2] = (Vh - Vb * K / Q + K * K) / a0;
+	k->a[0][1] = 2 * (K * K - 1) / a0;
+	k->a[0][2] = (1 - K / Q + K * K) / a0;
+
+	// high pass
+	f0 = 38.13547087602444;  Q = 0.5003270373238773;
+	K = tan(M_PI * f0 / rate);
+	a0 = 1 + K / Q + K * K;
+	k->b[1][0] = 1;
+	k->b[1][1] = -2;
+	k->b[1][2] = 1;
+	k->a[1][1] = 2 * (K * K - 1) / a0;
+	k->a[1][2] = (1 - K / Q + K * K) / a0;
+}
+
+struct lnd_chan {
+	double z[4]; // filter state
+	float tp_hist[LND_TP_TAPS - 1]; // the last input samples for true-peak FIR
+	double weight;
+};
+
+/** Filter the samples and return the sum of squares of the output.
+The filter is recursive, so the channel's samples are processed serially. */
+static double lnd_kw_process(struct lnd_chan *c, const struct lnd_kw *k, const float *in, size_t n)
+{
+	double z1 = c->z[0], z2 = c->z[1], z3 = c->z[2], z4 = c->z[3];
+	double sum = 0;
+	for (size_t i = 0;  i != n;  i++) {
+		double x = in[i];
+		double y = k->b[0][0] * x + z1;
+		z1 = k->b[0][1] * x - k->a[0][1] * y + z2;
+		z2 = k->b[0][2] * x - k->a[0][2] * y;
+		double y2 = k->b[1][0] * y + z3;
+		z3 = k->b[1][1] * y - k->a[1][1] * y2 + z4;
+		z4 = k->b[1][2] * y - k->a[1][2] * y2;
+		sum += y2 * y2;
+	}
+	c->z[0] = z1;  c->z[1] = z2;  c->z[2] = z3;  c->z[3] = z4;
+	return sum;
+}
+
+/** Maximum absolute value.
+Independent lanes let the compiler vectorize the loop. */
+static float lnd_maxabs(const float *x, size_t n)
+{
+	float m[LND_LANES] = {};
+	size_t i;
+	for (i = 0;  i + LND_LANES <= n;  i += LND_LANES) {
+		for (uint j = 0;  j != LND_LANES;  j++) {
+			float v = fabsf(x[i + j]);
+			m[j] = (m[j] < v) ? v : m[j];
+		}
+	}
+	for (;  i != n;  i++) {
+		float v = fabsf(x[i]);
+		m[0] = (m[0] < v) ? v : m[0];
+	}
+	float r = 0;
+	for (uint j = 0;  j != LND_LANES;  j++) {
+		r = (r < m[j]) ? m[j] : r;
+	}
+	return r;
+}
+
+typedef struct loudness {
+	uint state;
+	uint nch;
+	uint64 total;
+	struct lnd_kw kw;
+	struct lnd_chan ch[LND_MAXCH];
+
+	uint sub_len, sub_pos; // sub-block size and position, samples
+	double sub_sum;
+	double sub[LND_ST_SUBBLOCKS]; // mean square of the last sub-blocks
+	uint64 nsub;
+	struct lnd_hist momentary, shortterm;
+
+	uint tp_phases;
+	float tp_coef[4][LND_TP_TAPS];
+	float tp_peak;
+	float tp_in[LND_TP_TAPS - 1 + LND_TP_CHUNK];
+	float tp_out[LND_TP_CHUNK];
+
+	const char *fn;
+	uint done :1;
+	uint write_tags :1;
+} loudness;
+
+/** Interpolation filter: windowed sinc;  phase #0 passes the input samples as is (delayed) */
+static void lnd_tp_init(loudness *l, uint rate)
+{
+	l->tp_phases = (rate < 96000) ? 4 : (rate < 192000) ? 2 : 1;
+	const double D = LND_TP_TAPS / 2;
+	for (uint p = 0;  p != l->tp_phases;  p++) {
+		for (uint k = 0;  k != LND_TP_TAPS;  k++) {
+			double x = k - D + (double)p / l->tp_phases;
+			double sinc = (x == 0) ? 1 : sin(M_PI * x) / (M_PI * x);
+			double w = (fabs(x) < D) ? 0.5 * (1 + cos(M_PI * x / D)) : 0;
+			l->tp_coef[p][k] = sinc * w;
+		}
+	}
+}
+
+/** Get the highest absolute value of the oversampled signal */
+static float lnd_tp_process(loudness *l, struct lnd_chan *c, const float *in, size_t n)
+{
+	if (l->tp_phases == 1)
+		return lnd_maxabs(in, n);
+
+	const uint H = LND_TP_TAPS - 1;
+	float *x = l->tp_in, *y = l->tp_out;
+	ffmem_copy(x, c->tp_hist, H * sizeof(float));
+	ffmem_copy(x + H, in, n * sizeof(float));
+
+	float peak = 0;
+	for (uint p = 0;  p != l->tp_phases;  p++) {
+		const float *h = l->tp_coef[p];
+		ffmem_zero(y, n * sizeof(float));
+		for (uint k = 0;  k != LND_TP_TAPS;  k++) {
+			const float *xk = x + H - k;
+			float hk = h[k];
+			for (size_t i = 0;  i != n;  i++) {
+				y[i] += xk[i] * hk;
+			}
+		}
+		float m = lnd_maxabs(y, n);
+		peak = (peak < m) ? m : peak;
+	}
+
+	ffmem_copy(c->tp_hist, x + n, H * sizeof(float));
+	return peak;
+}
+
+/** Sub-block is complete: update momentary and short-term histograms */
+static void lnd_subblock(loudness *l, double e)
+{
+	l->sub[l->nsub % LND_ST_SUBBLOCKS] = e;
+	l->nsub++;
+
+	double sum = 0;
+	if (l->nsub >= 4) {
+		for (uint i = 1;  i <= 4;  i++) {
+			sum += l->sub[(l->nsub - i) % LND_ST_SUBBLOCKS];
+		}
+		lnd_hist_add(&l->momentary, sum / 4);
+	}
+
+	if (l->nsub >= LND_ST_SUBBLOCKS) {
+		sum = 0;
+		for (uint i = 0;  i != LND_ST_SUBBLOCKS;  i++) {
+			sum += l->sub[i];
+		}
+		lnd_hist_add(&l->shortterm, sum / LND_ST_SUBBLOCKS);
+	}
+}
+
+
+struct lnd_album {
+	ffstr dir;
+	uint ntracks;
+	float peak;
+	struct lnd_hist momentary, shortterm;
+};
+
+struct lnd_track {
+	char *fn;
+	struct lnd_album *album;
+	double gain;
+	float peak;
+};
+
+static struct lnd_global {
+	fflock lk;
+	ffmap album_map; // "dir" -> struct lnd_album*
+	ffvec albums; // struct lnd_album*[]
+	ffvec tracks; // struct lnd_track[]
+	uint incomplete; // tracks which weren't analyzed until the end
+	uint active; // tracks being analyzed now
+	uint init :1;
+	uint write_tags :1;
+} lg;
+
+static int lnd_album_keyeq(void *opaque, const void *key, ffsize keylen, void *val)
+{
+	const struct lnd_album *a = val;
+	return ffstr_eq(&a->dir, key, keylen);
+}
+
+/** Add the track's results to its album.  Thread: any */
+static void lnd_track_add(loudness *l, double gain)
+{
+	ffstr dir = {};
+	if (l->fn != NULL)
+		ffpath_splitpath(l->fn, ffsz_len(l->fn), &dir, NULL);
+
+	fflock_lock(&lg.lk);
+
+	if (!lg.init) {
+		lg.init = 1;
+		ffmap_init(&lg.album_map, lnd_album_keyeq);
+	}
+
+	struct lnd_album *a = ffmap_find(&lg.album_map, dir.ptr, dir.len, NULL);
+	if (a == NULL) {
+		a = ffmem_new(struct lnd_album);
+		ffstr_dupstr(&a->dir, &dir);
+		ffmap_add(&lg.album_map, a->dir.ptr, a->dir.len, a);
+		*ffvec_pushT(&lg.albums, struct lnd_album*) = a;
+	}
+	a->ntracks++;
+	a->peak = ffmax(a->peak, l->tp_peak);
+	lnd_hist_merge(&a->momentary, &l->momentary);
+	lnd_hist_merge(&a->shortterm, &l->shortterm);
+
+	if (l->write_tags && l->fn != NULL) {
+		lg.write_tags = 1;
+		struct lnd_track *t = ffvec_pushT(&lg.tracks, struct lnd_track);
+		t->fn = ffsz_dup(l->fn);
+		t->album = a;
+		t->gain = gain;
+		t->peak = l->tp_peak;
+	}
+
+	fflock_unlock(&lg.lk);
+}
+
+static void* loudness_open(fmed_filt *d)
+{
+	loudness *l = ffmem_new(loudness);
+	l->nch = d->audio.convfmt.channels;
+	if (l->nch > LND_MAXCH) {
+		errlog(d->trk, "channels > %u aren't supported", LND_MAXCH);
+		ffmem_free(l);
+		return NULL;
+	}
+
+	const char *fn = d->track->getvalstr(d->trk, "input");
+	if (fn != FMED_PNULL)
+		l->fn = fn;
+	l->write_tags = d->loudness_write_tags;
+
+	fflock_lock(&lg.lk);
+	lg.active++;
+	fflock_unlock(&lg.lk);
+	return l;
+}
+
+static void loudness_close(void *ctx)
+{
+	loudness *l = ctx;
+	fflock_lock(&lg.lk);
+	lg.active--;
+	if (!l->done)
+		lg.incomplete++;
+	fflock_unlock(&lg.lk);
+	ffmem_free(l);
+}
+
+/** Channel weights (BS.1770): LFE is excluded, surround channels are boosted */
+static void lnd_weights(loudness *l)
+{
+	for (uint i = 0;  i != l->nch;  i++) {
+		l->ch[i].weight = 1;
+	}
+	switch (l->nch) {
+	case 5:
+		l->ch[3].weight = l->ch[4].weight = 1.41;
+		break;
+	case 6:
+	case 8:
+		l->ch[3].weight = 0;
+		for (uint i = 4;  i != l->nch;  i++) {
+			l->ch[i].weight = 1.41;
+		}
+		break;
+	}
+}
+
+static void lnd_track_fin(loudness *l, fmed_filt *d)
+{
+	l->done = 1;
+	double lufs, range = lnd_range(&l->shortterm);
+	double peak_db = (l->tp_peak > 0) ? ffpcm_gain2db(l->tp_peak) : -INFINITY;
+
+	if (0 != lnd_integrated(&l->momentary, &lufs)) {
+		core->log(FMED_LOG_USER, d->trk, NULL, FF_NEWLN "Loudness: the track is too short or silent (%,U samples)"
+			, l->total);
+		return;
+	}
+
+	double gain = LND_REF - lufs;
+	core->log(FMED_LOG_USER, d->trk, NULL, FF_NEWLN "Loudness (%,U samples):" FF_NEWLN
+		"integrated: %.2F LUFS, range: %.2F LU, true peak: %.2F dBTP, track gain: %.2F dB"
+		, l->total, lufs, range, peak_db, gain);
+
+	lnd_track_add(l, gain);
+}
+
+static int loudness_process(void *ctx, fmed_filt *d)
+{
+	loudness *l = ctx;
+
+	switch (l->state) {
+	case 0:
+		d->audio.convfmt.ileaved = 0;
+		d->audio.convfmt.format = FFPCM_FLOAT;
+		l->state = 1;
+		return FMED_RMORE;
+
+	case 1:
+		if (d->audio.convfmt.ileaved
+			|| d->audio.convfmt.format != FFPCM_FLOAT) {
+			errlog(d->trk, "input must be non-interleaved float PCM");
+			return FMED_RERR;
+		}
+		lnd_kw_init(&l->kw, d->audio.convfmt.sample_rate);
+		lnd_tp_init(l, d->audio.convfmt.sample_rate);
+		lnd_weights(l);
+		l->sub_len = d->audio.convfmt.sample_rate / 10;
+		l->state = 2;
+		break;
+	}
+
+	const float **ch = (const float**)d->datani;
+	size_t samples = d->datalen / (sizeof(float) * l->nch);
+	l->total += samples;
+
+	for (size_t off = 0;  off != samples;  ) {
+		size_t n = ffmin(samples - off, l->sub_len - l->sub_pos);
+		n = ffmin(n, LND_TP_CHUNK);
+
+		for (uint i = 0;  i != l->nch;  i++) {
+			struct lnd_chan *c = &l->ch[i];
+			if (c->weight != 0)
+				l->sub_sum += c->weight * lnd_kw_process(c, &l->kw, ch[i] + off, n);
+			float tp = lnd_tp_process(l, c, ch[i] + off, n);
+			l->tp_peak = ffmax(l->tp_peak, tp);
+		}
+
+		off += n;
+		l->sub_pos += n;
+		if (l->sub_pos == l->sub_len) {
+			lnd_subblock(l, l->sub_sum / l->sub_len);
+			l->sub_pos = 0;
+			l->sub_sum = 0;
+		}
+	}
+
+	d->out = d->data;
+	d->outlen = d->datalen;
+	d->datalen = 0;
+
+	if (d->flags & FMED_FLAST) {
+		lnd_track_fin(l, d);
+		return FMED_RDONE;
+	}
+	return FMED_ROK;
+}
+
+const fmed_filter sndmod_loudness = { loudness_open, loudness_process, loudness_close };
+
+
+static void lnd_write_tags(const struct lnd_global *g, uint incomplete)
+{
+	if (incomplete != 0) {
+		warnlog(NULL, "%u tracks weren't analyzed completely: not writing ReplayGain tags"
+			, incomplete);
+		return;
+	}
+
+	const fmed_edittags *et = core->getmod("fmt.edit-tags");
+	if (et == NULL)
+		return;
+
+	ffvec meta = {};
+	struct lnd_track *t;
+	FFSLICE_WALK(&g->tracks, t) {
+		meta.len = 0;
+		ffvec_addfmt(&meta, "replaygain_track_gain=%.2F dB;replaygain_track_peak=%.6F"
+			, t->gain, (double)t->peak);
+		double lufs;
+		if (0 == lnd_integrated(&t->album->momentary, &lufs))
+			ffvec_addfmt(&meta, ";replaygain_album_gain=%.2F dB;replaygain_album_peak=%.6F"
+				, LND_REF - lufs, (double)t->album->peak);
+
+		struct fmed_edittags_conf conf = {};
+		conf.fn = t->fn;
+		ffstr_setstr(&conf.meta, &meta);
+		et->edit(&conf);
+	}
+	ffvec_free(&meta);
+}
+
+static void lnd_free(struct lnd_global *g)
+{
+	struct lnd_album **pa;
+	FFSLICE_WALK(&g->albums, pa) {
+		ffstr_free(&(*pa)->dir);
+		ffmem_free(*pa);
+	}
+	ffvec_free(&g->albums);
+	if (g->init)
+		ffmap_free(&g->album_map);
+
+	struct lnd_track *t;
+	FFSLICE_WALK(&g->tracks, t) {
+		ffmem_free(t->fn);
+	}
+	ffvec_free(&g->tracks);
+}
+
+void loudness_destroy(void)
+{
+	lnd_free(&lg);
+	ffmem_zero_obj(&lg);
+}
+
+/** fmedia is stopping: print album results and write tags.  Thread: main
+The tracks may still be running if the user has interrupted the processing:
+ take the results collected so far, so the workers may continue without affecting them. */
+void loudness_fin(void)
+{
+	fflock_lock(&lg.lk);
+	uint incomplete = lg.incomplete + lg.active;
+	struct lnd_global g = lg;
+	ffvec_null(&lg.albums);
+	ffvec_null(&lg.tracks);
+	lg.incomplete = 0;
+	lg.init = 0;
+	lg.write_tags = 0;
+	fflock_unlock(&lg.lk);
+
+	if (incomplete != 0 && g.albums.len != 0)
+		warnlog(NULL, "%u tracks weren't analyzed completely: album results are partial", incomplete);
+
+	struct lnd_album **pa;
+	FFSLICE_WALK(&g.albums, pa) {
+		const struct lnd_album *a = *pa;
+		double lufs;
+		if (0 != lnd_integrated(&a->momentary, &lufs))
+			continue;
+		double peak_db = (a->peak > 0) ? ffpcm_gain2db(a->peak) : -INFINITY;
+		core->log(FMED_LOG_USER, NULL, NULL, "Album loudness: %S (%u tracks):" FF_NEWLN
+			"integrated: %.2F LUFS, range: %.2F LU, true peak: %.2F dBTP, album gain: %.2F dB"
+			, &a->dir, a->ntracks
+			, lufs, lnd_range(&a->shortterm), peak_db, LND_REF - lufs);
+	}
+
+	if (g.write_tags)
+		lnd_write_tags(&g, incomplete);
+
+	lnd_free(&g);
+}
@@ -140,6 +140,43 @@ Return sample number at which user stopped;
  <0: error. */
 FF_EXTERN ssize_t ffpcm_process(const ffpcmex *fmt, const void *data, size_t samples, ffpcm_process_func func, void *udata);
 
+enum FFPCM_DSP {
+	FFPCM_DSP_PEAK = 1,
+	FFPCM_DSP_STARTLEV = 2,
+	FFPCM_DSP_STOPLEV = 4,
+	FFPCM_DSP_GAIN = 8,
+};
+
+/** Stop-level trigger: the signal stays below the level for some time. */
+typedef struct ffpcm_stoplev {
+	double level;
+	uint max_samples; //number of samples (of all channels) below the level
+	uint min_stop_samples; //don't stop before this number of samples (of all channels)
+	double val; //output: the level at which the signal went down
+
+	uint state;
+	uint all_samples;
+	uint nsamples;
+} ffpcm_stoplev;
+
+typedef struct ffpcm_dsp {
+	uint ops; //enum FFPCM_DSP
+	double maxpeak; //FFPCM_DSP_PEAK: output
+	double start_level; //FFPCM_DSP_STARTLEV
+	double start_val; //FFPCM_DSP_STARTLEV: output
+	ffpcm_stoplev stop; //FFPCM_DSP_STOPLEV
+	float gain; //FFPCM_DSP_GAIN
+} ffpcm_dsp;
+
+/** Perform several operations on PCM data in one pass: peak -> start-level -> stop-level -> gain.
+Samples are walked channel by channel as with ffpcm_process(),
+ so a trigger fires at the same sample as an analogous ffpcm_process() callback would.
+FFPCM_DSP_STARTLEV can't be combined with FFPCM_DSP_STOPLEV and FFPCM_DSP_GAIN.
+Return sample number at which a trigger has fired (gain is applied to the samples before it);
+ -1: done;
+ -2: unsupported format. */
+FF_EXTERN ssize_t ffpcm_dsp_process(ffpcm_dsp *c, const ffpcmex *fmt, void *data, size_t samples);
+
 static FFINL int ffint_ltoh24s(const void *p)
 {
 	const byte *b = (byte*)p;
@@ -17,6 +17,7 @@ Copyright (c) 2015 Simon Zolin */
 const fmed_core *core;
 const fmed_track *track;
 
+#include <afilter/dsp.h>
 #include <afilter/gain.h>
 #include <afilter/membuf.h>
 #include <afilter/rtpeak.h>
@@ -32,27 +33,30 @@ extern const fmed_filter fmed_sndmod_conv;
 extern const fmed_filter fmed_sndmod_autoconv;
 extern const fmed_filter fmed_sndmod_split;
 extern const fmed_filter fmed_sndmod_peaks;
-extern const fmed_filter sndmod_startlev;
-extern const fmed_filter sndmod_stoplev;
+extern const fmed_filter sndmod_loudness;
 extern const fmed_filter fmed_auto_attenuator;
 extern const fmed_filter fmed_mix_in;
 extern const fmed_filter fmed_mix_out;
+extern const fmed_filter fmed_tee;
+extern const fmed_filter fmed_tee_in;
 
 static const struct submod submods[] = {
 	{ "conv", (fmed_filter*)&fmed_sndmod_conv },
 	{ "autoconv", &fmed_sndmod_autoconv },
 	{ "gain", &fmed_sndmod_gain },
+	{ "dsp", &fmed_sndmod_dsp },
 	{ "until", &fmed_sndmod_until },
 	{ "split", &fmed_sndmod_split },
 	{ "peaks", &fmed_sndmod_peaks },
+	{ "loudness", &sndmod_loudness },
 	{ "rtpeak", &fmed_sndmod_rtpeak },
 	{ "silgen", &sndmod_silgen },
-	{ "startlevel", &sndmod_startlev },
-	{ "stoplevel", &sndmod_stoplev },
 	{ "membuf", &sndmod_membuf },
 	{ "auto-attenuator", &fmed_auto_attenuator },
 	{ "mixer-in", &fmed_mix_in },
 	{ "mixer-out", &fmed_mix_out },
+	{ "tee", &fmed_tee },
+	{ "tee-in", &fmed_tee_in },
 };
 
 static const void* sndmod_iface(const char *name)
@@ -65,18 +69,26 @@ static const void* sndmod_iface(const char *name)
 	return NULL;
 }
 
+extern void loudness_fin(void);
+extern void loudness_destroy(void);
+
 static int sndmod_sig(uint signo)
 {
 	switch (signo) {
 	case FMED_OPEN:
 		track = core->getmod("#core.track");
 		break;
+
+	case FMED_STOP:
+		loudness_fin();
+		break;
 	}
 	return 0;
 }
 
 static void sndmod_destroy(void)
 {
+	loudness_destroy();
 }
 
 int mix_out_conf(fmed_conf_ctx *ctx);
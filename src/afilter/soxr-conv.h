@@ -61,6 +61,49 @@ static void log_pcmconv(int r, const ffpcmex *in, const ffpcmex *out, void *trk)
 		, ffpcm_fmtstr(out->format), out->sample_rate, (out->channels & FFPCM_CHMASK), (out->ileaved) ? "i" : "ni");
 }
 
+static const char soxr_profile_str[][12] = {
+	"low-latency", "high", "vhq",
+};
+
+/** Apply quality/latency profile.
+Live audio (playback, recording) needs the shortest filter delay and low CPU usage;
+ offline conversion is limited only by CPU, so we use the best quality and all CPU cores. */
+static void soxr_profile(soxr *c, fmed_track_info *d)
+{
+	uint offline = (d->out_filename != NULL && d->type != FMED_TRK_TYPE_REC);
+	int prof = d->soxr.profile;
+	if (prof < 0 || prof > FMED_SOXR_VHQ)
+		prof = (offline) ? FMED_SOXR_VHQ : FMED_SOXR_LOWLATENCY;
+
+	switch (prof) {
+	case FMED_SOXR_LOWLATENCY:
+		c->soxr.quality = SOXR_MQ;
+		c->soxr.phase = SOXR_MINIMUM_PHASE;
+		c->soxr.rolloff = SOXR_ROLLOFF_MEDIUM;
+		break;
+
+	case FMED_SOXR_HQ:
+		c->soxr.quality = SOXR_HQ;
+		c->soxr.phase = SOXR_LINEAR_PHASE;
+		break;
+
+	case FMED_SOXR_VHQ:
+		c->soxr.quality = SOXR_VHQ;
+		c->soxr.phase = SOXR_LINEAR_PHASE;
+		c->soxr.dither = 1;
+		break;
+	}
+
+	c->soxr.threads = 1;
+	if (d->soxr.threads >= 0)
+		c->soxr.threads = d->soxr.threads;
+	else if (offline)
+		c->soxr.threads = 0;
+
+	dbglog1(d->trk, "profile:%s  threads:%u"
+		, soxr_profile_str[prof], c->soxr.threads);
+}
+
 /*
 This filter converts both format and sample rate.
 Previous filter must deal with channel conversion.
@@ -76,7 +119,7 @@ static int soxr_conv(void *ctx, fmed_track_info *d)
 		inpcm = c->inpcm;
 		outpcm = c->outpcm;
 
-		// c->soxr.dither = 1;
+		soxr_profile(c, d);
 		if (0 != (val = ffsoxr_create(&c->soxr, &inpcm, &outpcm))
 			|| (core->loglev == FMED_LOG_DEBUG)) {
 			log_pcmconv(val, &inpcm, &outpcm, d->trk);
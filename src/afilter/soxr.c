@@ -5,6 +5,7 @@ Copyright (c) 2017 Simon Zolin */
 
 static const fmed_core *core;
 #define errlog1(trk, ...)  fmed_errlog(core, trk, NULL, __VA_ARGS__)
+#define dbglog1(trk, ...)  fmed_dbglog(core, trk, NULL, __VA_ARGS__)
 
 #include <afilter/soxr-conv.h>
 
@@ -26,6 +26,9 @@ typedef struct ffsoxr {
 	uint outcap;
 
 	uint quality; // 0..4. default:3 (High quality)
+	uint phase; // SOXR_LINEAR_PHASE, SOXR_INTERMEDIATE_PHASE, SOXR_MINIMUM_PHASE
+	uint rolloff; // SOXR_ROLLOFF_*
+	uint threads; // number of worker threads (if libsoxr is built with OpenMP).  0:auto.  default:1
 	uint in_ileaved :1
 		, dither :1
 		, fin :1; // the last block of input data
@@ -35,6 +38,8 @@ static inline void ffsoxr_init(ffsoxr *soxr)
 {
 	ffmem_tzero(soxr);
 	soxr->quality = SOXR_HQ;
+	soxr->rolloff = SOXR_ROLLOFF_SMALL;
+	soxr->threads = 1;
 }
 
 #define ffsoxr_errstr(soxr)  soxr_strerror((soxr)->err)
@@ -62,6 +67,7 @@ int ffsoxr_create(ffsoxr *soxr, const ffpcmex *inpcm, const ffpcmex *outpcm)
 {
 	soxr_io_spec_t io;
 	soxr_quality_spec_t qual;
+	soxr_runtime_spec_t rt;
 
 	if (inpcm->channels != outpcm->channels)
 		return -1;
@@ -77,10 +83,11 @@ int ffsoxr_create(ffsoxr *soxr, const ffpcmex *inpcm, const ffpcmex *outpcm)
 	io.e = NULL;
 	io.flags = soxr->dither ? SOXR_TPDF : SOXR_NO_DITHER;
 
-	qual = soxr_quality_spec(soxr->quality, SOXR_ROLLOFF_SMALL);
+	qual = soxr_quality_spec(soxr->quality | soxr->phase, soxr->rolloff);
+	rt = soxr_runtime_spec(soxr->threads);
 
 	soxr->soxr = soxr_create(inpcm->sample_rate, outpcm->sample_rate, inpcm->channels, &soxr->err
-		, &io, &qual, NULL);
+		, &io, &qual, &rt);
 	if (soxr->err != NULL)
 		return -1;
 
@@ -0,0 +1,366 @@
+/** fmedia: --tee: pass audio data to several outputs at once
+2023, Simon Zolin */
+
+/*
+INPUT -> ... -> afilter.tee -> afilter.autoconv -> ENCODER -> OUTPUT
+                    |
+                    |  (separate track on its own worker)
+                    +-> afilter.tee-in -> afilter.autoconv -> ENCODER -> file.out
+                    +-> ...
+
+The main track copies each data block into the shared buffer and wakes up the branch tracks.
+The next block isn't published until all branches have finished processing the current one,
+ so memory usage is bounded by the size of 1 block.
+*/
+
+#include <fmedia.h>
+#include <util/path.h>
+#include <ffbase/lock.h>
+
+#undef errlog
+#undef dbglog
+#define errlog(trk, ...)  fmed_errlog(core, trk, "tee", __VA_ARGS__)
+#define dbglog(trk, ...)  fmed_dbglog(core, trk, "tee", __VA_ARGS__)
+
+extern const fmed_core *core;
+
+struct tee_branch {
+	struct tee *t;
+	void *trk;
+	fftask tsk_start;
+	uint seq; // sequence number of the last data block taken by this branch
+	uint busy :1; // the current data block isn't yet processed by this branch
+	uint waiting :1; // waiting for the next data block
+	uint closed :1;
+};
+
+struct tee {
+	fflock lk;
+	uint refs;
+	const fmed_track *track;
+	void *trk;
+
+	ffvec buf;
+	uint64 pos;
+	uint seq;
+	uint busy; // number of branches that are processing the current data block
+
+	struct tee_branch *branches;
+	uint nbranches;
+
+	uint input :1; // have new input data that isn't yet published
+	uint waiting :1; // main track waits for the branches
+	uint fin :1;
+	uint closed :1; // main track is closed
+};
+
+static void tee_unref(struct tee *t)
+{
+	fflock_lock(&t->lk);
+	uint refs = --t->refs;
+	fflock_unlock(&t->lk);
+	if (refs != 0)
+		return;
+
+	ffvec_free(&t->buf);
+	ffmem_free(t->branches);
+	ffmem_free(t);
+}
+
+/** Parse "FILE[;format=F][;rate=N][;channels=N]". */
+static int tee_spec(ffstr spec, ffstr *fn, ffpcmex *fmt)
+{
+	ffstr opt, name, val;
+	ffstr_splitby(&spec, ';', fn, &spec);
+
+	while (spec.len != 0) {
+		ffstr_splitby(&spec, ';', &opt, &spec);
+		ffstr_splitby(&opt, '=', &name, &val);
+
+		if (ffstr_eqz(&name, "format")) {
+			int r;
+			if (0 > (r = ffpcm_fmt(val.ptr, val.len)))
+				return -1;
+			fmt->format = r;
+
+		} else if (ffstr_eqz(&name, "rate")) {
+			if (!ffstr_to_uint32(&val, &fmt->sample_rate))
+				return -1;
+
+		} else if (ffstr_eqz(&name, "channels")) {
+			uint ch;
+			if (!ffstr_to_uint32(&val, &ch) || ch > 8)
+				return -1;
+			fmt->channels = ch;
+
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/** Start the branch track.  Thread: main */
+static void tee_branch_xstart(void *param)
+{
+	struct tee_branch *b = param;
+	b->t->track->cmd(b->trk, FMED_TRACK_XSTART);
+}
+
+/** Create a new track for the output branch and start it on the main thread. */
+static int tee_branch_start(struct tee *t, fmed_filt *d, ffstr spec, uint idx)
+{
+	ffstr fn, ext;
+	ffpcmex fmt = {};
+	if (0 != tee_spec(spec, &fn, &fmt) || fn.len == 0) {
+		errlog(d->trk, "bad --tee value: %S", &spec);
+		return -1;
+	}
+
+	ffpath_splitname(fn.ptr, fn.len, NULL, &ext);
+	const fmed_modinfo *mi = core->getmod2(FMED_MOD_OUTEXT, ext.ptr, ext.len);
+	if (mi == NULL) {
+		errlog(d->trk, "no module can write to this file format: %S", &ext);
+		return -1;
+	}
+
+	fmed_track_obj *trk;
+	if (NULL == (trk = d->track->create(FMED_TRK_TYPE_NONE, "")))
+		return -1;
+
+	fmed_trk *ti = d->track->conf(trk);
+	d->track->copy_info(ti, d);
+	ffmem_free(ti->out_filename);
+	ti->out_filename = ffsz_dupstr(&fn);
+	ti->datatype = d->datatype;
+	ti->audio.convfmt = fmt;
+	ti->audio.seek = FMED_NULL;
+	ti->audio.until = FMED_NULL;
+	ti->audio.split = FMED_NULL;
+	ti->audio.abs_seek = 0;
+	ti->out_seekable = 1;
+
+	const char *input = d->track->getvalstr(d->trk, "input");
+	if (input != FMED_PNULL)
+		d->track->setvalstr4(trk, "input", ffsz_dup(input), FMED_TRK_FACQUIRE);
+	d->track->setval(trk, "tee_ptr", (size_t)t);
+	d->track->setval(trk, "tee_idx", idx);
+	d->track->cmd2(trk, FMED_TRACK_META_COPYFROM, d->trk);
+
+	if (0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, "afilter.tee-in")
+		|| 0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, "afilter.autoconv")
+		|| 0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, mi->name)
+		|| 0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, "#file.out")) {
+		d->track->cmd(trk, FMED_TRACK_STOP);
+		return -1;
+	}
+
+	struct tee_branch *b = &t->branches[idx];
+	b->trk = trk;
+	fflock_lock(&t->lk);
+	t->refs++;
+	fflock_unlock(&t->lk);
+	dbglog(d->trk, "starting branch #%u: %S", idx, &fn);
+	fftask_set(&b->tsk_start, &tee_branch_xstart, b);
+	core->task(&b->tsk_start, FMED_TASK_POST);
+	return 0;
+}
+
+static void tee_close(void *ctx);
+
+static void* tee_open(fmed_filt *d)
+{
+	const char *val = d->track->getvalstr(d->trk, "tee");
+	if (val == FMED_PNULL)
+		return FMED_FILT_SKIP;
+
+	if (d->stream_copy) {
+		errlog(d->trk, "--tee doesn't work with --stream-copy");
+		return NULL;
+	}
+
+	struct tee *t = ffmem_new(struct tee);
+	fflock_init(&t->lk);
+	t->refs = 1;
+	t->track = d->track;
+	t->trk = d->trk;
+
+	ffstr s, spec;
+	ffstr_setz(&s, val);
+	t->nbranches = 1;
+	for (size_t i = 0;  i != s.len;  i++) {
+		if (s.ptr[i] == '\n')
+			t->nbranches++;
+	}
+	t->branches = ffmem_callocT(t->nbranches, struct tee_branch);
+	for (uint i = 0;  i != t->nbranches;  i++) {
+		t->branches[i].t = t;
+		t->branches[i].closed = 1;
+	}
+
+	for (uint i = 0;  i != t->nbranches;  i++) {
+		ffstr_splitby(&s, '\n', &spec, &s);
+		fflock_lock(&t->lk);
+		t->branches[i].closed = 0;
+		fflock_unlock(&t->lk);
+		if (0 != tee_branch_start(t, d, spec, i)) {
+			t->branches[i].closed = 1;
+			tee_close(t);
+			return NULL;
+		}
+	}
+	return t;
+}
+
+/** Publish the final (empty) block so the branches finish their work. */
+static void tee_close(void *ctx)
+{
+	struct tee *t = ctx;
+
+	fflock_lock(&t->lk);
+	t->closed = 1;
+	if (!t->fin) {
+		t->fin = 1;
+		t->buf.len = 0;
+		t->seq++;
+		for (uint i = 0;  i != t->nbranches;  i++) {
+			struct tee_branch *b = &t->branches[i];
+			if (b->closed)
+				continue;
+			if (b->busy) {
+				b->busy = 0;
+				t->busy--;
+			}
+			if (b->waiting) {
+				b->waiting = 0;
+				t->track->cmd(b->trk, FMED_TRACK_WAKE);
+			}
+		}
+	}
+	fflock_unlock(&t->lk);
+
+	tee_unref(t);
+}
+
+static int tee_process(void *ctx, fmed_filt *d)
+{
+	struct tee *t = ctx;
+
+	if (d->flags & FMED_FFWD)
+		t->input = 1;
+	if (!t->input)
+		return FMED_RMORE;
+
+	fflock_lock(&t->lk);
+
+	if (t->busy != 0) {
+		// the branches haven't yet finished processing the previous block
+		t->waiting = 1;
+		fflock_unlock(&t->lk);
+		return FMED_RASYNC;
+	}
+
+	t->buf.len = 0;
+	if (d->datalen != ffvec_add(&t->buf, d->data, d->datalen, 1)) {
+		fflock_unlock(&t->lk);
+		errlog(d->trk, "%s", ffmem_alloc_S);
+		return FMED_RERR;
+	}
+	t->pos = d->audio.pos;
+	t->fin = !!(d->flags & FMED_FLAST);
+	t->seq++;
+
+	for (uint i = 0;  i != t->nbranches;  i++) {
+		struct tee_branch *b = &t->branches[i];
+		if (b->closed)
+			continue;
+		b->busy = 1;
+		t->busy++;
+		if (b->waiting) {
+			b->waiting = 0;
+			t->track->cmd(b->trk, FMED_TRACK_WAKE);
+		}
+	}
+
+	fflock_unlock(&t->lk);
+
+	t->input = 0;
+	d->out = d->data;
+	d->outlen = d->datalen;
+	d->datalen = 0;
+	if (d->flags & FMED_FLAST)
+		return FMED_RDONE;
+	return FMED_RDATA;
+}
+
+const fmed_filter fmed_tee = { tee_open, tee_process, tee_close };
+
+
+struct tee_in {
+	struct tee *t;
+	struct tee_branch *b;
+};
+
+static void* teein_open(fmed_filt *d)
+{
+	struct tee_in *ti = ffmem_new(struct tee_in);
+	ti->t = (void*)d->track->getval(d->trk, "tee_ptr");
+	ti->b = &ti->t->branches[d->track->getval(d->trk, "tee_idx")];
+	return ti;
+}
+
+/** The branch has finished processing the current block: wake up the main track if it waits. */
+static void teein_release(struct tee *t, struct tee_branch *b)
+{
+	if (!b->busy)
+		return;
+	b->busy = 0;
+	if (--t->busy == 0 && t->waiting && !t->closed) {
+		t->waiting = 0;
+		t->track->cmd(t->trk, FMED_TRACK_WAKE);
+	}
+}
+
+static void teein_close(void *ctx)
+{
+	struct tee_in *ti = ctx;
+	struct tee *t = ti->t;
+
+	fflock_lock(&t->lk);
+	teein_release(t, ti->b);
+	ti->b->closed = 1;
+	fflock_unlock(&t->lk);
+
+	tee_unref(t);
+	ffmem_free(ti);
+}
+
+static int teein_process(void *ctx, fmed_filt *d)
+{
+	struct tee_in *ti = ctx;
+	struct tee *t = ti->t;
+	struct tee_branch *b = ti->b;
+
+	fflock_lock(&t->lk);
+
+	if (b->seq == t->seq) {
+		teein_release(t, b);
+		b->waiting = 1;
+		fflock_unlock(&t->lk);
+		return FMED_RASYNC;
+	}
+
+	b->seq = t->seq;
+	d->out = t->buf.ptr;
+	d->outlen = t->buf.len;
+	d->audio.pos = t->pos;
+	uint fin = t->fin;
+
+	fflock_unlock(&t->lk);
+
+	if (fin)
+		return FMED_RDONE;
+	return FMED_RDATA;
+}
+
+const fmed_filter fmed_tee_in = { teein_open, teein_process, teein_close };
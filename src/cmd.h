@@ -21,6 +21,8 @@ typedef struct fmed_cmd {
 	uint out_format;
 	uint out_rate;
 	byte out_channels;
+	byte resample_quality; // enum FMED_SOXR_PROFILE
+	byte resample_threads;
 	};
 
 	uint pl_heal_idx;
@@ -30,6 +32,7 @@ typedef struct fmed_cmd {
 	byte mix;
 	byte tags;
 	byte info;
+	byte seek_index;
 	uint seek_time;
 	uint until_time;
 	uint split_time;
@@ -49,6 +52,8 @@ typedef struct fmed_cmd {
 	byte volume;
 	byte pcm_peaks;
 	byte pcm_crc;
+	byte loudness;
+	byte loudness_tags;
 	byte dynanorm;
 
 	float vorbis_qual;
@@ -58,9 +63,12 @@ typedef struct fmed_cmd {
 	ushort mpeg_qual;
 	byte flac_complevel;
 	byte stream_copy;
+	byte pcm_cache;
 
 	ffstr globcmd;
 	char *globcmd_pipename;
+	char *globcmd_add_list;
+	byte globcmd_events;
 	char *http_ctl_options;
 	byte bground;
 	byte bgchild;
@@ -68,13 +76,18 @@ typedef struct fmed_cmd {
 	byte notui;
 	byte gui;
 	byte print_time;
+	char *trace_fn;
+	char *trace_print_fn;
 	byte cue_gaps;
+	byte cue_single_pass;
 	char *playlist_heal;
 
 	ffstr outfn;
+	ffvec tee; // "OUTPUT\nOUTPUT..."
 	char *outfnz;
 	byte overwrite;
 	byte out_copy;
+	uint timeshift;
 	byte preserve_date;
 	byte parallel;
 	byte edittags;
@@ -95,6 +108,8 @@ static inline int cmd_init(fmed_cmd *cmd)
 	cmd->lbdev_name = (uint)-1;
 	cmd->volume = 100;
 	cmd->cue_gaps = 255;
+	cmd->resample_quality = 0xff;
+	cmd->resample_threads = 0xff;
 	return 0;
 }
 
@@ -105,14 +120,18 @@ static inline void cmd_destroy(fmed_cmd *cmd)
 
 	FFARR_FREE_ALL_PTR(&cmd->in_files, ffmem_free, char*);
 	ffmem_free(cmd->outfnz);
+	ffmem_free(cmd->trace_fn);
+	ffmem_free(cmd->trace_print_fn);
 
 	ffstr_free(&cmd->meta);
 	ffstr_free(&cmd->meta_from_filename);
+	ffvec_free(&cmd->tee);
 	ffmem_safefree(cmd->aac_profile);
 	ffmem_safefree(cmd->trackno);
 	ffmem_safefree(cmd->conf_fn);
 
 	ffmem_safefree(cmd->globcmd_pipename);
+	ffmem_free(cmd->globcmd_add_list);
 	ffstr_free(&cmd->globcmd);
 	ffmem_free(cmd->http_ctl_options);
 	ffslice_free(&cmd->include_files);
@@ -143,6 +143,19 @@ static int arg_channels(ffcmdarg_scheme *as, void *obj, ffstr *val)
 	return 0;
 }
 
+static int arg_resample_quality(ffcmdarg_scheme *as, void *obj, const ffstr *val)
+{
+	fmed_cmd *cmd = obj;
+	static const char *const profiles[] = {
+		"low-latency", "high", "vhq", // enum FMED_SOXR_PROFILE
+	};
+	int r;
+	if (0 > (r = ffszarr_find(profiles, FF_COUNT(profiles), val->ptr, val->len)))
+		return FFCMDARG_ERROR;
+	cmd->resample_quality = r;
+	return 0;
+}
+
 static int arg_out_copycmd(ffcmdarg_scheme *as, void *obj)
 {
 	fmed_cmd *cmd = obj;
@@ -293,6 +306,16 @@ static int arg_split(ffcmdarg_scheme *as, void *obj, const ffstr *val)
 	return 0;
 }
 
+/** Add output for --tee: "FILE[;format=F][;rate=N][;channels=N]" */
+static int arg_tee(ffcmdarg_scheme *as, void *obj, const ffstr *val)
+{
+	fmed_cmd *cmd = obj;
+	if (cmd->tee.len != 0)
+		ffvec_addchar(&cmd->tee, '\n');
+	ffvec_addstr(&cmd->tee, val);
+	return 0;
+}
+
 static int arg_install(ffcmdarg_scheme *as, void *obj)
 {
 #ifdef FF_WIN
@@ -376,6 +399,8 @@ static const ffcmdarg_arg fmed_cmdline_args[] = {
 	{ 0, "format",	TSTR,	F(arg_format) },
 	{ 0, "rate",	TINT32,	O(out_rate) },
 	{ 0, "channels",	TSTR,	F(arg_channels) },
+	{ 0, "resample-quality",	TSTR,	F(arg_resample_quality) },
+	{ 0, "resample-threads",	FFCMDARG_TINT8,	O(resample_threads) },
 
 	//INPUT
 	{ 0, "record",	TSWITCH,	O(rec) },
@@ -391,6 +416,7 @@ static const ffcmdarg_arg fmed_cmdline_args[] = {
 	{ 0, "stop-dblevel",	TSTR,	F(arg_astoplev) },
 	{ 0, "fseek",	FFCMDARG_TINT64,	O(fseek) },
 	{ 'i', "info",	TSWITCH,	O(info) },
+	{ 0, "seek-index",	TSWITCH,	O(seek_index) },
 
 	// TAGS
 	{ 0, "tags",	TSWITCH,	O(tags) },
@@ -406,6 +432,8 @@ static const ffcmdarg_arg fmed_cmdline_args[] = {
 	{ 0, "dynanorm",	TSWITCH,	O(dynanorm) },
 	{ 'P', "pcm-peaks",	TSWITCH,	O(pcm_peaks) },
 	{ 0, "pcm-crc",	TSWITCH,	O(pcm_crc) },
+	{ 0, "loudness",	TSWITCH,	O(loudness) },
+	{ 0, "loudness-tags",	TSWITCH,	O(loudness_tags) },
 
 	//ENCODING
 	{ 0, "vorbis.quality",	TFLOAT32,	O(vorbis_qual) }, // obsolete
@@ -417,12 +445,15 @@ static const ffcmdarg_arg fmed_cmdline_args[] = {
 	{ 0, "aac-profile",	TSTRZ,	O(aac_profile) },
 	{ 0, "flac-compression",	FFCMDARG_TINT8,	O(flac_complevel) },
 	{ 0, "stream-copy",	TSWITCH,	O(stream_copy) },
+	{ 0, "pcm-cache",	TSWITCH,	O(pcm_cache) },
 
 	//OUTPUT
 	{ 'o', "out",	TSTRZ,	O(outfnz) },
+	{ 0, "tee",	TSTR | FFCMDARG_FMULTI,	F(arg_tee) },
 	{ 'y', "overwrite",	TSWITCH,	O(overwrite) },
 	{ 0, "out-copy",	TSWITCH,	O(out_copy) },
 	{ 0, "out-copy-cmd",	TSWITCH,	F(arg_out_copycmd) },
+	{ 0, "timeshift",	TINT32,	O(timeshift) },
 	{ 0, "preserve-date",	TSWITCH,	O(preserve_date) },
 
 	//OTHER OPTIONS
@@ -431,6 +462,8 @@ static const ffcmdarg_arg fmed_cmdline_args[] = {
 	{ 0, "background-child",	TSWITCH,	O(bgchild) },
 #endif
 	{ 0, "globcmd",	TSTR,	O(globcmd) },
+	{ 0, "globcmd.add-list",	TSTRZ,	O(globcmd_add_list) },
+	{ 0, "globcmd.events",	TSWITCH,	O(globcmd_events) },
 	{ 0, "globcmd.pipe-name",	TSTRZ,	O(globcmd_pipename) },
 	{ 0, "http-ctl",	FFCMDARG_TSTRZ,	O(http_ctl_options) },
 	{ 0, "conf",	FFCMDARG_TSTR,	F(arg_skipstr) },
@@ -438,8 +471,11 @@ static const ffcmdarg_arg fmed_cmdline_args[] = {
 	{ 0, "gui",	TSWITCH,	O(gui) },
 	{ 0, "print-time",	TSWITCH,	O(print_time) },
 	{ 'D', "debug",	TSWITCH,	F(arg_debug) },
+	{ 0, "trace",	TSTRZ,	O(trace_fn) },
+	{ 0, "trace-print",	TSTRZ,	O(trace_print_fn) },
 	{ 'h', "help",	TSWITCH,	F(arg_usage) },
 	{ 0, "cue-gaps",	FFCMDARG_TINT8,	O(cue_gaps) },
+	{ 0, "cue-single-pass",	TSWITCH,	O(cue_single_pass) },
 	{ 0, "parallel",	TSWITCH,	O(parallel) },
 	{ 0, "playlist-heal",	FFCMDARG_TSTRZ,	O(playlist_heal) },
 
@@ -0,0 +1,144 @@
+/** fmedia: core: binary cache for configuration files
+2023, Simon Zolin */
+
+/*
+The cache file contains the sequence of tokens produced by the config parser for the source file,
+ so the next time the file is processed without parsing its text.
+The cache is valid while the source file's size and modification time are unchanged.
+
+HDR ITEM...
+HDR: "fmedconf" VER[4] SIZE[8] MTIME_SEC[8] MTIME_NSEC[4] DATA_LEN[4] DATA_HASH[4] RESERVED[4]
+ITEM: TYPE[4] LINE[4] LEN[4] DATA[LEN] PADDING[0..3]
+Items are aligned to 4 bytes, so the file can be used in-place after it's mapped into memory.
+Numbers are in host byte order.
+DATA_LEN and DATA_HASH (murmurhash3) cover the items,
+ so a truncated or partially written file is never used.
+*/
+
+#include <ffbase/murmurhash3.h>
+#include <FFOS/file.h>
+
+#define CONFCACHE_MAGIC  "fmedconf"
+enum {
+	CONFCACHE_VER = 2,
+};
+
+struct confcache_hdr {
+	char magic[8];
+	uint ver;
+	uint64 size;
+	uint64 mtime_sec;
+	uint mtime_nsec;
+	uint data_len;
+	uint data_hash;
+	uint reserved;
+};
+
+struct confcache_item {
+	int type; // enum FFCONF_R
+	uint line;
+	uint len;
+	char data[0];
+};
+
+/** Get cache file name for the config file: "USER_PATH/cache/conf-HASH.bin" */
+static char* confcache_fn(const char *filename)
+{
+	if (core->props->user_path == NULL)
+		return NULL;
+	uint hash = murmurhash3(filename, ffsz_len(filename), 0x12345678);
+	return ffsz_allocfmt("%scache%cconf-%08xu.bin"
+		, core->props->user_path, FFPATH_SLASH, hash);
+}
+
+static void confcache_hdr_init(struct confcache_hdr *h, const fffileinfo *fi)
+{
+	ffmem_zero_obj(h);
+	ffmem_copy(h->magic, CONFCACHE_MAGIC, 8);
+	h->ver = CONFCACHE_VER;
+	h->size = fffileinfo_size(fi);
+	fftime t = fffileinfo_mtime(fi);
+	h->mtime_sec = t.sec;
+	h->mtime_nsec = t.nsec;
+}
+
+static inline uint confcache_itemsize(uint len)
+{
+	return ff_align_ceil2(sizeof(struct confcache_item) + len, 4);
+}
+
+/** Read cache data and check that it's valid for the source file.
+Return 0 on success;  'data' contains the items. */
+static int confcache_read(const char *cache_fn, const fffileinfo *fi, ffvec *buf, ffstr *data)
+{
+	if (0 != fffile_readwhole(cache_fn, buf, 1*1024*1024))
+		return -1;
+
+	struct confcache_hdr h, *ch = (void*)buf->ptr;
+	confcache_hdr_init(&h, fi);
+	if (buf->len < sizeof(h)
+		|| 0 != ffmem_cmp(&h, ch, FF_OFF(struct confcache_hdr, data_len)))
+		return -1;
+
+	ffstr d = FFSTR_INITN((char*)buf->ptr + sizeof(h), buf->len - sizeof(h));
+	if (d.len != ch->data_len
+		|| ch->data_hash != murmurhash3(d.ptr, d.len, 0x12345678))
+		return -1;
+	*data = d;
+
+	// validate the whole chain so that the items can be used without checks afterwards
+	while (d.len != 0) {
+		const struct confcache_item *it = (void*)d.ptr;
+		if (d.len < sizeof(*it)
+			|| it->len > d.len - sizeof(*it)
+			|| confcache_itemsize(it->len) > d.len
+			|| it->type < 0)
+			return -1;
+		ffstr_shift(&d, confcache_itemsize(it->len));
+	}
+	return 0;
+}
+
+/** Get next item. */
+static int confcache_next(ffstr *data, uint *line, ffstr *val)
+{
+	const struct confcache_item *it = (void*)data->ptr;
+	*line = it->line;
+	ffstr_set(val, it->data, it->len);
+	ffstr_shift(data, confcache_itemsize(it->len));
+	return it->type;
+}
+
+static void confcache_add(ffvec *buf, int type, uint line, ffstr val)
+{
+	uint n = confcache_itemsize(val.len);
+	if (NULL == ffvec_grow(buf, n, 1))
+		return;
+	struct confcache_item *it = (void*)((char*)buf->ptr + buf->len);
+	ffmem_zero(it, n);
+	it->type = type;
+	it->line = line;
+	it->len = val.len;
+	ffmem_copy(it->data, val.ptr, val.len);
+	buf->len += n;
+}
+
+static void confcache_write(const char *cache_fn, const fffileinfo *fi, ffvec *items)
+{
+	ffvec buf = {};
+	struct confcache_hdr h;
+	confcache_hdr_init(&h, fi);
+	h.data_len = items->len;
+	h.data_hash = murmurhash3(items->ptr, items->len, 0x12345678);
+	ffvec_add(&buf, &h, sizeof(h), 1);
+	ffvec_add2(&buf, items, 1);
+
+	if (0 != fmed_file_writewhole(cache_fn, buf.ptr, buf.len)) {
+		dbglog0("can't write config cache: %s: %E", cache_fn, fferr_last());
+		goto end;
+	}
+	dbglog0("written config cache %s", cache_fn);
+
+end:
+	ffvec_free(&buf);
+}
@@ -3,6 +3,7 @@ Copyright (c) 2019 Simon Zolin */
 
 #include <core/core-priv.h>
 #include <util/conf2-ltconf.h>
+#include <core/conf-cache.h>
 
 void usrconf_read(ffconf_scheme *sc, ffstr key, ffstr val);
 
@@ -252,8 +253,62 @@ end:
 	return r;
 }
 
+/** Parse list of CPU numbers: "0-3,8,10-11" */
+static int conf_cpuset(ffcpuset *cs, ffstr *val)
+{
+	ffstr s = *val, range, lo, hi;
+	uint a, b;
+	ffmem_zero_obj(cs);
+
+	while (s.len != 0) {
+		ffstr_splitby(&s, ',', &range, &s);
+		ffstr_trimwhite(&range);
+		if (ffstr_splitby(&range, '-', &lo, &hi) < 0)
+			hi = lo;
+		if (!ffstr_to_uint32(&lo, &a)
+			|| !ffstr_to_uint32(&hi, &b)
+			|| a > b
+			|| b >= FFCPUSET_MAX)
+			return FMC_EBADVAL;
+		for (;  a <= b;  a++) {
+			ffcpuset_add(cs, a);
+		}
+	}
+	return 0;
+}
+
+static int conf_cpus_batch(fmed_conf *fc, fmed_config *conf, ffstr *val)
+{
+	return conf_cpuset(&conf->cpus_batch, val);
+}
+
+static int conf_cpus_realtime(fmed_conf *fc, fmed_config *conf, ffstr *val)
+{
+	return conf_cpuset(&conf->cpus_realtime, val);
+}
+
+static int conf_cpus_io(fmed_conf *fc, fmed_config *conf, ffstr *val)
+{
+	return conf_cpuset(&conf->cpus_io, val);
+}
+
+static const fmed_conf_arg conf_cpus_args[] = {
+	{ "batch",	FMC_STRNE, FMC_F(conf_cpus_batch) },
+	{ "realtime",	FMC_STRNE, FMC_F(conf_cpus_realtime) },
+	{ "io",	FMC_STRNE, FMC_F(conf_cpus_io) },
+	{}
+};
+
+static int conf_worker_cpus(fmed_conf *fc, fmed_config *conf)
+{
+	ffconf_scheme_addctx(fc, conf_cpus_args, conf);
+	return 0;
+}
+
 static const fmed_conf_arg conf_args[] = {
 	{ "workers",	FMC_INT8, FMC_O(fmed_config, workers) },
+	{ "worker_cpus",	FMC_OBJ, FMC_F(conf_worker_cpus) },
+	{ "realtime_worker",	FMC_BOOL8, FMC_O(fmed_config, realtime_worker) },
 	{ "mod",	FMC_STRNE | FFCONF_FMULTI, FMC_F(conf_mod) },
 	{ "mod_conf",	FMC_OBJ | FFCONF_FNOTEMPTY | FFCONF_FMULTI, FMC_F(conf_modconf) },
 	{ "output",	FMC_STRNE | FFCONF_FMULTI, FMC_F(conf_output) },
@@ -406,7 +461,10 @@ int core_conf_parse(fmed_config *conf, const char *filename, uint flags)
 	fmed_conf ps = {};
 	int r = FMC_ESYS;
 	ffstr s;
-	ffvec buf = {};
+	ffvec buf = {}, cache = {};
+	char *cache_fn = NULL;
+	ffbool from_cache = 0;
+	fffileinfo fi;
 
 	ffltconf_init(&pconf);
 	ffconf_scheme_init(&ps, &pconf.ff);
@@ -415,25 +473,41 @@ int core_conf_parse(fmed_config *conf, const char *filename, uint flags)
 	else
 		ffconf_scheme_addctx(&ps, conf_args, conf);
 
-	if (0 != fffile_readwhole(filename, &buf, 1*1024*1024)) {
-		if (fferr_nofile(fferr_last()) && (flags & CONF_F_OPT)) {
-			r = 0;
+	if (0 == fffile_infofn(filename, &fi))
+		cache_fn = confcache_fn(filename);
+
+	if (cache_fn != NULL
+		&& 0 == confcache_read(cache_fn, &fi, &buf, &s)) {
+		from_cache = 1;
+		dbglog(core, NULL, "core", "reading config file %s from cache %s", filename, cache_fn);
+
+	} else {
+		buf.len = 0;
+		if (0 != fffile_readwhole(filename, &buf, 1*1024*1024)) {
+			if (fferr_nofile(fferr_last()) && (flags & CONF_F_OPT)) {
+				r = 0;
+				goto fail;
+			}
+			syserrlog("%s: %s", fffile_open_S, filename);
 			goto fail;
 		}
-		syserrlog("%s: %s", fffile_open_S, filename);
-		goto fail;
+		ffstr_setstr(&s, &buf);
+		dbglog(core, NULL, "core", "reading config file %s", filename);
 	}
 
-	dbglog(core, NULL, "core", "reading config file %s", filename);
-
 	{
-		ffstr_setstr(&s, &buf);
-
 		while (s.len != 0) {
 			ffstr val;
-			r = ffltconf_parse3(&pconf, &s, &val);
-			if (r < 0)
-				goto err;
+			if (from_cache) {
+				r = confcache_next(&s, &pconf.ff.line, &val);
+				pconf.ff.val = val;
+			} else {
+				r = ffltconf_parse3(&pconf, &s, &val);
+				if (r < 0)
+					goto err;
+				if (cache_fn != NULL && r != FFCONF_RMORE)
+					confcache_add(&cache, r, pconf.ff.line, val);
+			}
 
 			if (conf->conf_copy_mod != NULL) {
 				int r2 = ffconf_ctx_copy(&conf->conf_copy, val, r);
@@ -475,6 +549,9 @@ err:
 
 	r = 0;
 
+	if (!from_cache && cache_fn != NULL)
+		confcache_write(cache_fn, &fi, &cache);
+
 	if (!(flags & CONF_F_USR)) {
 		inout_ext_map_init(&conf->in_ext_map, (ffslice*)&conf->inmap);
 		inout_ext_map_init(&conf->out_ext_map, (ffslice*)&conf->outmap);
@@ -486,5 +563,7 @@ fail:
 	ffltconf_fin(&pconf);
 	ffconf_scheme_destroy(&ps);
 	ffvec_free(&buf);
+	ffvec_free(&cache);
+	ffmem_free(cache_fn);
 	return r;
 }
@@ -279,6 +279,19 @@ static const fmed_modinfo* _core_getmodinfo(ffstr name)
 	return NULL;
 }
 
+/** Check whether the module is known: either enlisted (possibly delayed)
+ or its binary module is enlisted, so it can be instantiated later.
+Note: nothing is loaded or created here. */
+static int core_mod_exists(ffstr name)
+{
+	if (NULL != _core_getmodinfo(name))
+		return 1;
+
+	ffstr soname, modname;
+	ffstr_splitby(&name, '.', &soname, &modname);
+	return (soname.len != 0 && NULL != core_findmod(&soname));
+}
+
 const fmed_modinfo* core_getmodinfo(ffstr name)
 {
 	const fmed_modinfo *mod = _core_getmodinfo(name);
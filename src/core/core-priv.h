@@ -12,6 +12,10 @@ typedef struct fmed_config {
 	byte instance_mode;
 	byte prevent_sleep;
 	byte workers;
+	byte realtime_worker;
+	ffcpuset cpus_batch; // CPU affinity for worker threads
+	ffcpuset cpus_realtime; // CPU affinity for real-time worker thread
+	ffcpuset cpus_io; // CPU affinity for file I/O threads
 	ffpcm inp_pcm;
 	const fmed_modinfo *audio_input, *audio_output;
 	ffvec inmap; //inmap_item[]
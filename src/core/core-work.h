@@ -47,7 +47,8 @@ static void wrk_destroy(struct worker *w)
 {
 	if (w->thd != FFTHD_INV) {
 		ffthd_join(w->thd, -1, NULL);
-		dbglog0("thread %xU exited", (int64)w->id);
+		dbglog0("thread %xU exited.  Busy: %Ums"
+			, (int64)w->id, w->busy_usec / 1000);
 		w->thd = FFTHD_INV;
 	}
 	fftimer_close(w->timer, w->kq);
@@ -66,13 +67,21 @@ static uint work_assign(uint flags)
 	struct worker *w, *ww = (void*)fmed->workers.ptr;
 	uint id = 0, j = -1;
 
-	if (flags == 0) {
+	if ((flags & FMED_WORKER_FREALTIME) && fmed->rt_wid != 0) {
+		id = fmed->rt_wid;
+		w = &ww[id];
+		goto init;
+	}
+
+	if (!(flags & FMED_WORKER_FPARALLEL)) {
 		id = 0;
 		w = &ww[0];
 		goto done;
 	}
 
 	FFSLICE_WALK(&fmed->workers, w) {
+		if (w - ww == fmed->rt_wid && fmed->rt_wid != 0)
+			break; // the real-time worker doesn't take batch jobs
 		uint nj = ffatom_get(&w->njobs);
 		if (nj < j) {
 			id = w - ww;
@@ -83,6 +92,7 @@ static uint work_assign(uint flags)
 	}
 	w = &ww[id];
 
+init:
 	if (!w->init
 		&& 0 != wrk_init(w, 1)) {
 		id = 0;
@@ -110,8 +120,10 @@ static void work_release(uint wid, uint flags)
 /** Get the number of available workers */
 static uint work_avail()
 {
-	struct worker *w;
+	struct worker *w, *ww = (void*)fmed->workers.ptr;
 	FFSLICE_WALK(&fmed->workers, w) {
+		if (w - ww == fmed->rt_wid && fmed->rt_wid != 0)
+			break;
 		if (ffatom_get(&w->njobs) == 0)
 			return 1;
 	}
@@ -187,18 +199,30 @@ static void core_task(fftask *task, uint cmd)
 	}
 }
 
-static int core_timer(fftimerqueue_node *t, int64 _interval, uint flags)
+/** Set up CPU affinity and priority for a worker thread */
+static void wrk_sched(struct worker *w)
+{
+	uint i = w - (struct worker*)fmed->workers.ptr;
+	ffbool rt = (i == fmed->rt_wid);
+	const ffcpuset *cpus = (rt) ? &fmed->conf.cpus_realtime : &fmed->conf.cpus_batch;
+
+	if (!ffcpuset_empty(cpus)
+		&& 0 != ffthread_affinity(cpus))
+		syserrlog("worker #%u: %s", i, "ffthread_affinity");
+
+	if (rt) {
+		if (0 != ffthread_rtprio())
+			syserrlog("worker #%u: %s", i, "ffthread_rtprio");
+		else
+			dbglog0("worker #%u: real-time priority", i);
+	}
+}
+
+/** Add or remove the timer.  Thread: main */
+static int timer_apply(fftimerqueue_node *t, int interval, fftimerqueue_func func, void *param)
 {
 	struct worker *w = (void*)fmed->workers.ptr;
-	int interval = _interval;
 	uint period = ffmin((uint)ffabs(interval), TMR_INT);
-	dbglog0("timer:%p  interval:%d  handler:%p  param:%p"
-		, t, interval, t->func, t->param);
-
-	if (w->kq == FF_BADFD) {
-		dbglog0("timer's not ready", 0);
-		return -1;
-	}
 
 	if (interval == 0) {
 		fftimerqueue_remove(&w->timerq, t);
@@ -224,10 +248,92 @@ static int core_timer(fftimerqueue_node *t, int64 _interval, uint flags)
 
 	fftime now = fftime_monotonic();
 	ffuint now_msec = now.sec*1000 + now.nsec/1000000;
-	fftimerqueue_add(&w->timerq, t, now_msec, interval, t->func, t->param);
+	fftimerqueue_add(&w->timerq, t, now_msec, interval, func, param);
 	return 0;
 }
 
+/** Find a pending change for the timer.  Thread: any (under timer_ops_lk) */
+static struct timer_op* timer_op_find(fftimerqueue_node *t)
+{
+	struct timer_op *op;
+	FFSLICE_WALK(&fmed->timer_ops, op) {
+		if (op->node == t)
+			return op;
+	}
+	return NULL;
+}
+
+/** Apply the timer changes requested by other threads.  Thread: main */
+static void timer_ops_run(void *param)
+{
+	ffvec ops = {};
+	fflk_lock(&fmed->timer_ops_lk);
+	ops = fmed->timer_ops;
+	ffvec_null(&fmed->timer_ops);
+	fmed->timer_ops_posted = 0;
+	fflk_unlock(&fmed->timer_ops_lk);
+
+	struct timer_op *op;
+	FFSLICE_WALK(&ops, op) {
+		if (op->node != NULL) // not cancelled
+			timer_apply(op->node, op->interval, op->func, op->param);
+	}
+	ffvec_free(&ops);
+}
+
+/**
+The timer queue is owned by the main worker.
+A change requested by another thread (e.g. an audio I/O module on the real-time worker)
+ is stored and applied on the main thread by a single task;
+ only the latest change for the same timer is kept.
+The lock protects the list of changes only: it's never held while the timer handlers are called.
+A change made on the main thread cancels the pending change for the same timer. */
+static int core_timer(fftimerqueue_node *t, int64 _interval, uint flags)
+{
+	struct worker *w = (void*)fmed->workers.ptr;
+	int interval = _interval;
+	dbglog0("timer:%p  interval:%d  handler:%p  param:%p"
+		, t, interval, t->func, t->param);
+
+	if (w->kq == FF_BADFD) {
+		dbglog0("timer's not ready", 0);
+		return -1;
+	}
+
+	if (core_ismainthr()) {
+		fflk_lock(&fmed->timer_ops_lk);
+		struct timer_op *op = timer_op_find(t);
+		if (op != NULL)
+			op->node = NULL; // cancel
+		fflk_unlock(&fmed->timer_ops_lk);
+		return timer_apply(t, interval, t->func, t->param);
+	}
+
+	int r = 0;
+	ffbool post = 0;
+	fflk_lock(&fmed->timer_ops_lk);
+	struct timer_op *op = timer_op_find(t);
+	if (op == NULL
+		&& NULL == (op = ffvec_pushT(&fmed->timer_ops, struct timer_op))) {
+		r = -1;
+		goto end;
+	}
+	op->node = t;
+	op->interval = interval;
+	op->func = t->func;
+	op->param = t->param;
+	if (!fmed->timer_ops_posted) {
+		fmed->timer_ops_posted = 1;
+		post = 1;
+	}
+
+end:
+	fflk_unlock(&fmed->timer_ops_lk);
+	if (post)
+		core_task(&fmed->timer_ops_task, FMED_TASK_POST);
+	return r;
+}
+
 static void on_timer(void *param)
 {
 	struct worker *w = param;
@@ -242,6 +348,8 @@ static int FFTHDCALL work_loop(void *param)
 {
 	struct worker *w = param;
 	w->id = ffthd_curid();
+	if (w != (struct worker*)fmed->workers.ptr)
+		wrk_sched(w);
 	ffkq_event *ents = ffmem_callocT(FMED_KQ_EVS, ffkq_event);
 	if (ents == NULL)
 		return -1;
@@ -260,12 +368,18 @@ static int FFTHDCALL work_loop(void *param)
 			continue;
 		}
 
+		fftime t0 = fftime_monotonic();
+
 		for (uint i = 0;  i != nevents;  i++) {
 			ffkq_event *ev = &ents[i];
 			ffkev_call(ev);
 
 			fftask_run(&w->taskmgr);
 		}
+
+		fftime t1 = fftime_monotonic();
+		fftime_sub(&t1, &t0);
+		FF_WRITEONCE(w->busy_usec, w->busy_usec + fftime_to_usec(&t1));
 	}
 
 	ffmem_free(ents);
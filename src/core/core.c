@@ -20,8 +20,22 @@ Copyright (c) 2015 Simon Zolin */
 	#define FMED_VER_SUF  "*"
 #endif
 
+struct timer_op {
+	fftimerqueue_node *node; // NULL: cancelled
+	int interval;
+	fftimerqueue_func func;
+	void *param;
+};
+
 typedef struct fmedia {
 	ffvec workers; //worker[]
+	uint rt_wid; // ID of the real-time worker;  0: disabled
+
+	// timer changes requested by other threads
+	fflock timer_ops_lk;
+	ffvec timer_ops; // struct timer_op[]
+	uint timer_ops_posted;
+	fftask timer_ops_task;
 	ffkqu_time kqutime;
 
 	uint stopped;
@@ -58,6 +72,7 @@ struct worker {
 	ffkevent timer_kev;
 
 	ffatomic njobs;
+	uint64 busy_usec; // time spent processing events
 	uint init :1;
 };
 
@@ -85,6 +100,7 @@ FF_EXP void core_free(void);
 
 extern int tracks_init(void);
 extern void tracks_destroy(void);
+extern void tracks_metrics(ffvec *buf);
 
 static const fmed_mod* fmed_getmod_core(const fmed_core *_core);
 extern const fmed_mod* fmed_getmod_file(const fmed_core *_core);
@@ -156,6 +172,7 @@ fmed_core* core_init(char **argv, char **env)
 	fmed = ffmem_tcalloc1(fmedia);
 	if (fmed == NULL)
 		return NULL;
+	fmed->props.start_time = fftime_monotonic();
 	fmed->log = &log_dummy;
 	if (0 != ffenv_init(&fmed->env, env))
 		goto err;
@@ -211,6 +228,7 @@ void core_free(void)
 	}
 	tracks_destroy();
 	ffvec_free(&fmed->workers);
+	ffvec_free(&fmed->timer_ops);
 
 	FFLIST_WALKSAFE(&fmed->mods, mod, sib, next) {
 		mod_freeiface(mod);
@@ -242,6 +260,15 @@ static int core_open(void)
 		ffsc_init(&sc);
 		n = ffsc_get(&sc, FFSYSCONF_NPROCESSORS_ONLN);
 	}
+	if (!ffcpuset_empty(&fmed->conf.cpus_io))
+		fmed->props.io_cpus = &fmed->conf.cpus_io;
+
+	if (fmed->conf.realtime_worker) {
+		fmed->rt_wid = n; // the last worker is reserved for real-time jobs
+		n++;
+	}
+	fflk_init(&fmed->timer_ops_lk);
+	fftask_set(&fmed->timer_ops_task, timer_ops_run, NULL);
 	if (NULL == ffvec_zallocT(&fmed->workers, n, struct worker))
 		return 1;
 	fmed->workers.len = n;
@@ -266,14 +293,18 @@ static char* core_env_expand(char *dst, size_t cap, const char *src)
 	return ffenv_expand(&fmed->env, dst, cap, src);
 }
 
+/** Get file type by extension.
+Note: the module isn't loaded here - it will be loaded when the track starts. */
 static int core_filetype_ext(const ffstr *ext)
 {
-	if (NULL == core_getmod2(FMED_MOD_INEXT, ext->ptr, ext->len))
+	if (NULL == modbyext(&fmed->conf.in_ext_map, ext)
+		&& !core_mod_exists(FFSTR_Z("fmt.detector")))
 		return FMED_FT_UKN;
 
 	if (ffstr_eqcz(ext, "m3u8")
 		|| ffstr_eqcz(ext, "m3u")
 		|| ffstr_eqcz(ext, "m3uz")
+		|| ffstr_eqcz(ext, "fmpl")
 		|| ffstr_eqcz(ext, "pls")
 		|| ffstr_eqcz(ext, "cue"))
 		return FMED_FT_PLIST;
@@ -331,8 +362,54 @@ static const char* const sig_str[] = {
 	"FMED_IFILTER_BYEXT",
 	"FMED_OFILTER_BYEXT",
 	"FMED_FILTER_BYNAME",
+	"FMED_XASSIGN",
+	"FMED_XADD",
+	"FMED_XDEL",
+	"FMED_METRICS",
 };
 
+/** Append core metrics in Prometheus text format. */
+static void core_metrics(ffvec *buf)
+{
+	const struct worker *w;
+	ffvec_addsz(buf, "# TYPE fmedia_worker_jobs gauge\n");
+	FFSLICE_WALK(&fmed->workers, w) {
+		if (!FF_READONCE(w->init))
+			continue;
+		ffvec_addfmt(buf, "fmedia_worker_jobs{worker=\"%L\"} %L\n"
+			, w - (struct worker*)fmed->workers.ptr, ffatom_get((ffatomic*)&w->njobs));
+	}
+	ffvec_addsz(buf, "# TYPE fmedia_worker_busy_seconds_total counter\n");
+	FFSLICE_WALK(&fmed->workers, w) {
+		if (!FF_READONCE(w->init))
+			continue;
+		uint64 us = FF_READONCE(w->busy_usec);
+		ffvec_addfmt(buf, "fmedia_worker_busy_seconds_total{worker=\"%L\"} %U.%06U\n"
+			, w - (struct worker*)fmed->workers.ptr, us / 1000000, us % 1000000);
+	}
+
+	tracks_metrics(buf);
+
+	static const char counters[][28] = {
+		"file_read_bytes",
+		"file_read_stalls",
+		"file_reads",
+		"file_read_cached",
+		"file_write_bytes",
+		"file_write_stalls",
+		"file_writes",
+		"net_read_bytes",
+		"net_reconnects",
+	};
+	const uint64 *val = (uint64*)&fmed->props.metrics;
+	FF_ASSERT(sizeof(fmed->props.metrics) == sizeof(counters) / sizeof(counters[0]) * sizeof(uint64));
+	for (uint i = 0;  i != FF_COUNT(counters);  i++) {
+		ffvec_addfmt(buf, "# TYPE fmedia_%s_total counter\n"
+			"fmedia_%s_total %U\n"
+			, counters[i], counters[i], FF_READONCE(val[i]));
+	}
+}
+
 static ssize_t core_cmd(uint signo, ...)
 {
 	ssize_t r = 0;
@@ -457,6 +534,10 @@ static ssize_t core_cmd(uint signo, ...)
 		r = (ffsize)ifilter_byext(va_arg(va, char*));
 		break;
 
+	case FMED_METRICS:
+		core_metrics(va_arg(va, ffvec*));
+		break;
+
 	case FMED_FILTER_BYNAME: {
 		const char *name = va_arg(va, char*);
 		r = (size_t)core->getmod(name);
@@ -503,11 +584,16 @@ static void core_logv(uint flags, void *trk, const char *module, const char *fmt
 		e = fferr_last();
 
 	fftime_now(&t);
-	t.sec += FFTIME_1970_SECONDS + fmed->tz.real_offset;
-	fftime_split1(&dt, &t);
-	r = fftime_tostr1(&dt, stime, sizeof(stime), FFTIME_HMS_MSEC);
-	stime[r] = '\0';
-	ld.stime = stime;
+	ld.time = t;
+	ld.stime = "";
+	if (core->props->log_text_level == 0 || lev <= core->props->log_text_level) {
+		// the text logger needs the local time string; the trace record uses ld.time
+		t.sec += FFTIME_1970_SECONDS + fmed->tz.real_offset;
+		fftime_split1(&dt, &t);
+		r = fftime_tostr1(&dt, stime, sizeof(stime), FFTIME_HMS_MSEC);
+		stime[r] = '\0';
+		ld.stime = stime;
+	}
 	ld.tid = ffthd_curid();
 
 	FF_ASSERT(lev != 0);
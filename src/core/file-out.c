@@ -349,6 +349,7 @@ static void fileout_close(void *ctx)
 	fffilewrite_stat st;
 	fffilewrite_getstat(f->fw, &st);
 	fffilewrite_free(f->fw);
+	ffint_fetch_add(&core->props->metrics.file_writes, st.nfwrite);
 
 	dbglog(f->d->trk, "%S: mem write#:%u  file write#:%u  prealloc#:%u"
 		, &f->fname, st.nmwrite, st.nfwrite, st.nprealloc);
@@ -412,6 +413,7 @@ static int fileout_write(void *ctx, fmed_filt *d)
 			d->datalen -= r;
 			ffstr_shift(&in, r);
 			f->wr += r;
+			ffint_fetch_add(&core->props->metrics.file_write_bytes, r);
 
 			if (in.len == 0 && !(d->flags & FMED_FLAST)) {
 				d->outlen = 0;
@@ -425,6 +427,7 @@ static int fileout_write(void *ctx, fmed_filt *d)
 			return FMED_RERR;
 
 		case FFFILEWRITE_RASYNC:
+			ffint_fetch_add(&core->props->metrics.file_write_stalls, 1);
 			return FMED_RASYNC;
 		}
 	}
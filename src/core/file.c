@@ -155,6 +155,7 @@ ffthpool* thpool_create()
 		ffthpoolconf ioconf = {};
 		ioconf.maxthreads = 2;
 		ioconf.maxqueue = 64;
+		ioconf.cpus = core->props->io_cpus;
 		if (NULL == (mod->thpool = ffthpool_create(&ioconf)))
 			syserrlog(NULL, "ffthpool_create", 0);
 	}
@@ -233,6 +234,7 @@ static void* file_open(fmed_filt *d)
 	dbglog(d->trk, "opened %s (%U kbytes)", f->fn, f->fsize / 1024);
 
 	d->input.size = f->fsize;
+	d->in_mtime = fffile_infomtime(&fi);
 
 	if (d->out_preserve_date) {
 		d->mtime = fffile_infomtime(&fi);
@@ -255,6 +257,8 @@ static void file_close(void *ctx)
 		fffileread_stat(f->fr, &stat);
 		dbglog(f->trk, "cache-hit#:%u  read#:%u  async#:%u  seek#:%u"
 			, stat.ncached, stat.nread, stat.nasync, f->nseek);
+		ffint_fetch_add(&core->props->metrics.file_reads, stat.nread);
+		ffint_fetch_add(&core->props->metrics.file_read_cached, stat.ncached);
 		fffileread_free(f->fr);
 	}
 
@@ -280,6 +284,7 @@ static int file_getdata(void *ctx, fmed_filt *d)
 	switch ((enum FFFILEREAD_R)r) {
 
 	case FFFILEREAD_RASYNC:
+		ffint_fetch_add(&core->props->metrics.file_read_stalls, 1);
 		return FMED_RASYNC; //wait until the buffer is full
 
 	case FFFILEREAD_RERR:
@@ -299,6 +304,7 @@ static int file_getdata(void *ctx, fmed_filt *d)
 	case FFFILEREAD_RREAD:
 		d->out = b.ptr,  d->outlen = b.len;
 		f->seek += b.len;
+		ffint_fetch_add(&core->props->metrics.file_read_bytes, b.len);
 		return FMED_ROK;
 	}
 	return FMED_RERR;
@@ -1,8 +1,28 @@
 /** Global commands.
 Copyright (c) 2016 Simon Zolin */
 
+/*
+A client sends text commands ("CMD [PARAMS]\n...") and closes the connection,
+ or it starts with GCMD_MAGIC and then uses the framed protocol:
+ it may send many requests without waiting for the replies,
+ each request is acknowledged in order,
+ and after GCMD_F_SUBSCRIBE the server also sends track events until the connection is closed.
+
+FRAME: LEN[4] TYPE[4] ID[4] PAYLOAD[LEN]
+Numbers are in host byte order (both sides are on the same machine).
+
+Client -> server:
+ GCMD_F_CMD: PAYLOAD: text commands
+ GCMD_F_ADD: PAYLOAD: file names separated by "\n"
+ GCMD_F_SUBSCRIBE: no payload
+Server -> client:
+ GCMD_F_ACK: ID: request ID;  PAYLOAD: struct gcmd_ack [ERROR_TEXT]
+ GCMD_F_EVENT: ID: 0;  PAYLOAD: struct gcmd_event URL
+*/
+
 #include <fmedia.h>
 #include <util/conf2.h>
+#include <FFOS/socket.h>
 
 
 static const fmed_core *core;
@@ -29,6 +49,55 @@ static const fmed_globcmd_iface fmed_globcmd = {
 
 enum {
 	GCMD_PIPE_IN_BUFSIZE = 1028,
+	GCMD_FRAME_MAXSIZE = 64*1024*1024,
+	GCMD_EVENTS_MAXBUF = 1*1024*1024, // max. unsent events per subscriber
+};
+
+#define GCMD_MAGIC  "\0FMC"
+
+enum GCMD_F {
+	GCMD_F_CMD = 1,
+	GCMD_F_ADD,
+	GCMD_F_SUBSCRIBE,
+	GCMD_F_ACK = 0x81,
+	GCMD_F_EVENT,
+};
+
+struct gcmd_frame_hdr {
+	uint len;
+	uint type; // enum GCMD_F
+	uint id;
+};
+
+struct gcmd_ack {
+	uint status; // 0:success
+	int index; // queue index of the first added item;  -1:none
+	uint count; // number of added items
+};
+
+enum GCMD_EV {
+	GCMD_EV_START = 1,
+	GCMD_EV_STOP,
+	GCMD_EV_DONE, // the last track is finished
+};
+
+struct gcmd_event {
+	uint event; // enum GCMD_EV
+	int index; // queue index;  -1:unknown
+	int error; // GCMD_EV_STOP: track error code
+};
+
+/** Connection with a client.
+The objects are reused, not freed until the module is destroyed:
+ the kernel may still return an event for a closed connection. */
+struct gcmd_conn {
+	ffkevent kev;
+	fffd fd;
+	ffvec in, out;
+	struct cmd_parser *text; // text mode parser
+	uint framed :1;
+	uint events :1;
+	uint eof :1;
 };
 
 typedef struct globcmd {
@@ -39,6 +108,10 @@ typedef struct globcmd {
 	ffarr pipename_full;
 	char *pipe_name;
 	const fmed_track *track;
+	const fmed_queue *qu;
+	ffvec conns; // struct gcmd_conn*[]
+	uint subscribers;
+	uint mon_set :1;
 } globcmd;
 
 static globcmd *g;
@@ -60,9 +133,18 @@ typedef struct cmd_parser {
 	ffconf conf;
 	const fmed_queue *qu;
 	const fmed_que_entry *first;
+	uint added;
+	const char *err;
 } cmd_parser;
 
 static int globcmd_parse(cmd_parser *c, const ffstr *in);
+static void conn_process(void *udata);
+static void conn_close(struct gcmd_conn *c);
+static void gcmd_mon_onsig(void *trk, uint sig);
+static const struct fmed_trk_mon gcmd_mon = { &gcmd_mon_onsig };
+static void gcmd_frame_add(ffvec *buf, uint type, uint id, const void *data, size_t len, ffstr text);
+static int gcmd_frame_next(ffstr *in, struct gcmd_frame_hdr *h, ffstr *payload);
+static int gcmd_request(const struct fmed_globcmd_req *req);
 
 
 const fmed_mod* fmed_getmod_globcmd(const fmed_core *_core)
@@ -120,6 +202,10 @@ static int globcmd_ctl(uint cmd, ...)
 			goto end;
 		if (NULL == (g->track = core->getmod("#core.track")))
 			goto end;
+		g->qu = core->getmod("#queue.queue");
+#ifdef FF_UNIX
+		ffsock_init(FFSOCK_INIT_SIGPIPE); // a client may close the connection while we're writing events
+#endif
 		r = 0;
 		break;
 	}
@@ -136,6 +222,12 @@ static int globcmd_ctl(uint cmd, ...)
 		r = 0;
 		break;
 	}
+
+	case FMED_GLOBCMD_REQUEST: {
+		const struct fmed_globcmd_req *req = va_arg(va, void*);
+		r = gcmd_request(req);
+		break;
+	}
 	}
 
 end:
@@ -151,6 +243,100 @@ static int globcmd_write(const void *data, size_t len)
 	return 0;
 }
 
+static void gcmd_reply_print(const struct gcmd_frame_hdr *h, ffstr payload)
+{
+	ffvec buf = {};
+	if (h->type == GCMD_F_ACK && payload.len >= sizeof(struct gcmd_ack)) {
+		const struct gcmd_ack *a = (void*)payload.ptr;
+		ffstr_shift(&payload, sizeof(*a));
+		if (a->status != 0)
+			ffvec_addfmt(&buf, "#%u: error: %S\n", h->id, &payload);
+		else if (a->count != 0)
+			ffvec_addfmt(&buf, "#%u: OK  index:%d  count:%u\n", h->id, a->index, a->count);
+		else
+			ffvec_addfmt(&buf, "#%u: OK\n", h->id);
+
+	} else if (h->type == GCMD_F_EVENT && payload.len >= sizeof(struct gcmd_event)) {
+		static const char ev_str[][8] = { "", "start", "stop", "done" };
+		const struct gcmd_event *ev = (void*)payload.ptr;
+		ffstr_shift(&payload, sizeof(*ev));
+		if (ev->event == GCMD_EV_DONE)
+			ffvec_addfmt(&buf, "done\n");
+		else if (ev->event < FF_COUNT(ev_str))
+			ffvec_addfmt(&buf, "%s #%d %S%s\n"
+				, ev_str[ev->event], ev->index, &payload, (ev->error) ? "  (error)" : "");
+	}
+	fffile_write(ffstdout, buf.ptr, buf.len);
+	ffvec_free(&buf);
+}
+
+/** Send requests and print the replies. */
+static int gcmd_request(const struct fmed_globcmd_req *req)
+{
+	int rc = -1;
+	uint id = 0, pending = 0, errors = 0;
+	ffvec buf = {};
+	ffstr empty = {};
+
+	ffvec_add(&buf, GCMD_MAGIC, FFS_LEN(GCMD_MAGIC), 1);
+	if (req->events) {
+		gcmd_frame_add(&buf, GCMD_F_SUBSCRIBE, ++id, NULL, 0, empty);
+		pending++;
+	}
+	if (req->add_list.len != 0) {
+		gcmd_frame_add(&buf, GCMD_F_ADD, ++id, NULL, 0, req->add_list);
+		pending++;
+	}
+	if (req->cmd.len != 0) {
+		gcmd_frame_add(&buf, GCMD_F_CMD, ++id, NULL, 0, req->cmd);
+		pending++;
+	}
+	if (0 != globcmd_write(buf.ptr, buf.len))
+		goto end;
+
+	buf.len = 0;
+	while (pending != 0 || req->events) {
+		if (NULL == ffvec_grow(&buf, GCMD_PIPE_IN_BUFSIZE, 1))
+			goto end;
+		ssize_t r = ffpipe_read(g->opened_fd, (char*)buf.ptr + buf.len, buf.cap - buf.len);
+		if (r < 0) {
+			syserrlog(core, NULL, "globcmd", "%s", fffile_read_S);
+			goto end;
+		} else if (r == 0) {
+			if (pending != 0)
+				goto end;
+			break;
+		}
+		buf.len += r;
+
+		ffstr in = FFSTR_INITN(buf.ptr, buf.len);
+		for (;;) {
+			struct gcmd_frame_hdr h;
+			ffstr payload;
+			int r2 = gcmd_frame_next(&in, &h, &payload);
+			if (r2 == 1)
+				break;
+			else if (r2 < 0)
+				goto end;
+			if (h.type == GCMD_F_ACK) {
+				pending--;
+				if (payload.len < sizeof(struct gcmd_ack)
+					|| ((struct gcmd_ack*)payload.ptr)->status != 0)
+					errors++;
+			}
+			gcmd_reply_print(&h, payload);
+		}
+		ffmem_move(buf.ptr, in.ptr, in.len);
+		buf.len = in.len;
+	}
+
+	rc = (errors == 0) ? 0 : -1;
+
+end:
+	ffvec_free(&buf);
+	return rc;
+}
+
 
 static int globcmd_init(void)
 {
@@ -182,6 +368,17 @@ static int globcmd_prep(const char *pipename)
 
 static void globcmd_free(void)
 {
+	struct gcmd_conn **pc;
+	FFSLICE_WALK(&g->conns, pc) {
+		conn_close(*pc);
+		ffvec_free(&(*pc)->in);
+		ffvec_free(&(*pc)->out);
+		ffmem_free(*pc);
+	}
+	ffvec_free(&g->conns);
+	if (g->mon_set)
+		g->track->cmd(NULL, FMED_TRACK_MONITOR_RM, &gcmd_mon);
+
 	if (g->lpipe != FFPIPE_NULL) {
 		ffpipe_close(g->lpipe);
 #ifdef FF_UNIX
@@ -238,51 +435,391 @@ static int globcmd_accept1(void)
 		return -1;
 	}
 	globcmd_onaccept(peer);
-	ffpipe_peer_close(peer);
 	return 0;
 }
 
-static void globcmd_onaccept(fffd peer)
+/** Get a free connection object. */
+static struct gcmd_conn* conn_alloc(void)
 {
-	ffarr buf = {0};
-	ffstr in;
-	ssize_t r;
-	cmd_parser c = {};
+	struct gcmd_conn **pc, *c;
+	FFSLICE_WALK(&g->conns, pc) {
+		if ((*pc)->fd == FF_BADFD)
+			return *pc;
+	}
+	if (NULL == (c = ffmem_new(struct gcmd_conn)))
+		return NULL;
+	c->fd = FF_BADFD;
+	ffkev_init(&c->kev);
+	*ffvec_pushT(&g->conns, struct gcmd_conn*) = c;
+	return c;
+}
 
+/*
+UNIX: the connection is processed asynchronously within the main thread.
+Windows: the connection is processed synchronously until the client closes it,
+ so events aren't supported.
+*/
+static void globcmd_onaccept(fffd peer)
+{
 	dbglog(core, NULL, "globcmd", "accepted client");
 
-	c.qu = core->getmod("#queue.queue");
-	ffconf_init(&c.conf);
+	struct gcmd_conn *c = conn_alloc();
+	if (c == NULL) {
+		ffpipe_peer_close(peer);
+		return;
+	}
+	c->fd = peer;
+	c->in.len = 0;
+	c->out.len = 0;
+	c->framed = 0;
+	c->events = 0;
+	c->eof = 0;
 
-	if (NULL == ffarr_alloc(&buf, GCMD_PIPE_IN_BUFSIZE)) {
-		syserrlog(core, NULL, "globcmd", "mem alloc", 0);
-		goto done;
+#ifdef FF_UNIX
+	if (0 != ffpipe_nonblock(peer, 1)) {
+		syserrlog(core, NULL, "globcmd", "%s", "ffpipe_nonblock");
+		conn_close(c);
+		return;
 	}
+	ffkev_init(&c->kev);
+	c->kev.oneshot = 0;
+	c->kev.fd = peer;
+	c->kev.handler = conn_process;
+	c->kev.udata = c;
+	if (0 != ffkev_attach(&c->kev, core->kq, FFKQU_READ | FFKQU_WRITE)) {
+		syserrlog(core, NULL, "globcmd", "%s", "pipe kq attach");
+		conn_close(c);
+		return;
+	}
+#endif
 
+	conn_process(c);
+}
+
+static void conn_close(struct gcmd_conn *c)
+{
+	if (c->fd == FF_BADFD)
+		return;
+	if (c->text != NULL) {
+		ffconf_fin(&c->text->conf);
+		ffmem_free(c->text);
+		c->text = NULL;
+	}
+	if (c->events)
+		g->subscribers--;
+	ffkev_fin(&c->kev);
+	ffpipe_peer_close(c->fd);
+	c->fd = FF_BADFD;
+	dbglog(core, NULL, "globcmd", "done with client");
+}
+
+/** Write the pending output data.
+Return 0 if all data is written. */
+static int conn_flush(struct gcmd_conn *c)
+{
+	size_t off = 0;
+	while (off != c->out.len) {
+		ssize_t r = fffile_write(c->fd, (char*)c->out.ptr + off, c->out.len - off);
+		if (r < 0) {
+			if (fferr_again(fferr_last()))
+				break;
+			syserrlog(core, NULL, "globcmd", "%s", fffile_write_S);
+			return -1;
+		}
+		off += r;
+	}
+	ffmem_move(c->out.ptr, (char*)c->out.ptr + off, c->out.len - off);
+	c->out.len -= off;
+	return (c->out.len == 0) ? 0 : 1;
+}
+
+static void gcmd_frame_add(ffvec *buf, uint type, uint id, const void *data, size_t len, ffstr text)
+{
+	struct gcmd_frame_hdr h = {
+		.len = len + text.len,
+		.type = type,
+		.id = id,
+	};
+	ffvec_add(buf, &h, sizeof(h), 1);
+	ffvec_add(buf, data, len, 1);
+	ffvec_add(buf, text.ptr, text.len, 1);
+}
+
+/** Get the next complete frame.
+Return 0: frame is ready;  1: need more data;  -1: bad frame */
+static int gcmd_frame_next(ffstr *in, struct gcmd_frame_hdr *h, ffstr *payload)
+{
+	if (in->len < sizeof(*h))
+		return 1;
+	ffmem_copy(h, in->ptr, sizeof(*h));
+	if (h->len > GCMD_FRAME_MAXSIZE)
+		return -1;
+	if (in->len - sizeof(*h) < h->len)
+		return 1;
+	ffstr_set(payload, in->ptr + sizeof(*h), h->len);
+	ffstr_shift(in, sizeof(*h) + h->len);
+	return 0;
+}
+
+static void gcmd_ack(struct gcmd_conn *c, uint id, const cmd_parser *p)
+{
+	struct gcmd_ack a = {
+		.status = (p->err != NULL),
+		.index = (p->first != NULL) ? (int)g->qu->cmd2(FMED_QUE_ID, (void*)p->first, 0) : -1,
+		.count = p->added,
+	};
+	ffstr text = {};
+	if (p->err != NULL)
+		ffstr_setz(&text, p->err);
+	gcmd_frame_add(&c->out, GCMD_F_ACK, id, &a, sizeof(a), text);
+}
+
+/** Add all files from the list to the current queue. */
+static void gcmd_add_bulk(cmd_parser *p, ffstr list)
+{
+	while (list.len != 0) {
+		ffstr ln;
+		ffstr_splitby(&list, '\n', &ln, &list);
+		ffstr_rskipchar1(&ln, '\r');
+		if (ln.len == 0)
+			continue;
+		fmed_que_entry e = {}, *ent;
+		e.url = ln;
+		ent = (void*)g->qu->cmd2(FMED_QUE_ADD | FMED_QUE_MORE, &e, 0);
+		if (ent == NULL)
+			continue;
+		if (p->first == NULL)
+			p->first = ent;
+		p->added++;
+	}
+	g->qu->cmd2(FMED_QUE_ADD | FMED_QUE_ADD_DONE, NULL, 0);
+	dbglog(core, NULL, "globcmd", "added %u items", p->added);
+}
+
+static void gcmd_frame_process(struct gcmd_conn *c, const struct gcmd_frame_hdr *h, ffstr payload)
+{
+	cmd_parser p = {};
+	p.qu = g->qu;
+
+	switch (h->type) {
+	case GCMD_F_CMD: {
+		ffconf_init(&p.conf);
+		if (0 == globcmd_parse(&p, &payload)) {
+			ffstr nl = FFSTR_INIT("\n");
+			globcmd_parse(&p, &nl);
+		}
+		ffconf_fin(&p.conf);
+		break;
+	}
+
+	case GCMD_F_ADD:
+		gcmd_add_bulk(&p, payload);
+		break;
+
+	case GCMD_F_SUBSCRIBE:
+#ifdef FF_UNIX
+		if (c->events)
+			break;
+		if (!g->mon_set) {
+			g->track->cmd(NULL, FMED_TRACK_MONITOR, &gcmd_mon);
+			g->mon_set = 1;
+		}
+		c->events = 1;
+		g->subscribers++;
+#else
+		p.err = "not supported";
+#endif
+		break;
+
+	default:
+		p.err = "unknown request";
+	}
+
+	gcmd_ack(c, h->id, &p);
+}
+
+/** Process the framed input data. */
+static int conn_framed(struct gcmd_conn *c)
+{
+	ffstr in = FFSTR_INITN(c->in.ptr, c->in.len);
 	for (;;) {
-		r = ffpipe_read(peer, buf.ptr, buf.cap);
+		struct gcmd_frame_hdr h;
+		ffstr payload;
+		int r = gcmd_frame_next(&in, &h, &payload);
+		if (r == 1)
+			break;
+		else if (r < 0) {
+			warnlog(core, NULL, "globcmd", "bad frame: type:%u  len:%u", h.type, h.len);
+			return -1;
+		}
+		dbglog(core, NULL, "globcmd", "frame: type:%u  id:%u  len:%u", h.type, h.id, h.len);
+		gcmd_frame_process(c, &h, payload);
+	}
+	ffmem_move(c->in.ptr, in.ptr, in.len);
+	c->in.len = in.len;
+	return 0;
+}
+
+/** Process the text input data. */
+static int conn_text(struct gcmd_conn *c)
+{
+	if (c->text == NULL) {
+		if (NULL == (c->text = ffmem_new(cmd_parser)))
+			return -1;
+		c->text->qu = g->qu;
+		ffconf_init(&c->text->conf);
+	}
+	ffstr in = FFSTR_INITN(c->in.ptr, c->in.len);
+	c->in.len = 0;
+	if (c->eof)
+		ffstr_setcz(&in, "\n");
+	return globcmd_parse(c->text, &in);
+}
+
+/** Read input data, execute requests and send replies. */
+static void conn_process(void *udata)
+{
+	struct gcmd_conn *c = udata;
+
+	while (!c->eof) {
+		if (NULL == ffvec_grow(&c->in, GCMD_PIPE_IN_BUFSIZE, 1)) {
+			syserrlog(core, NULL, "globcmd", "%s", ffmem_alloc_S);
+			goto close;
+		}
+		ssize_t r = ffpipe_read(c->fd, (char*)c->in.ptr + c->in.len, c->in.cap - c->in.len);
 		if (r < 0) {
+			if (fferr_again(fferr_last()))
+				break;
 			syserrlog(core, NULL, "globcmd", "%s", fffile_read_S);
-			break;
+			goto close;
 		} else if (r == 0) {
-			ffstr_setcz(&in, "\n");
-			r = globcmd_parse(&c, &in);
-			if (r < 0)
-				goto done;
-			break;
+			c->eof = 1;
 		}
-		ffstr_set(&in, buf.ptr, r);
+		c->in.len += r;
 		dbglog(core, NULL, "globcmd", "read %L bytes", r);
 
-		r = globcmd_parse(&c, &in);
-		if (r < 0)
-			goto done;
+		if (!c->framed && c->text == NULL) {
+			if (c->in.len == 0)
+				continue;
+			if (((char*)c->in.ptr)[0] == '\0') {
+				if (c->in.len < FFS_LEN(GCMD_MAGIC))
+					continue;
+				if (ffmem_cmp(c->in.ptr, GCMD_MAGIC, FFS_LEN(GCMD_MAGIC)))
+					goto close;
+				c->framed = 1;
+				ffmem_move(c->in.ptr, (char*)c->in.ptr + FFS_LEN(GCMD_MAGIC), c->in.len - FFS_LEN(GCMD_MAGIC));
+				c->in.len -= FFS_LEN(GCMD_MAGIC);
+			}
+		}
+
+		if (c->framed) {
+			if (0 != conn_framed(c))
+				goto close;
+		} else {
+			if (0 != conn_text(c))
+				goto close;
+		}
+
+		if (c->framed && c->out.len > 0 && conn_flush(c) < 0)
+			goto close;
 	}
 
-done:
-	ffarr_free(&buf);
-	ffconf_fin(&c.conf);
-	dbglog(core, NULL, "globcmd", "done with client");
+	if (c->out.len > 0 && conn_flush(c) < 0)
+		goto close;
+
+	// keep the connection while there's pending output or the client waits for events
+	if (c->eof && c->out.len == 0 && !c->events)
+		goto close;
+	return;
+
+close:
+	conn_close(c);
+}
+
+static void gcmd_event(uint event, int index, int error, ffstr url)
+{
+	struct gcmd_event ev = {
+		.event = event,
+		.index = index,
+		.error = error,
+	};
+	struct gcmd_conn **pc;
+	FFSLICE_WALK(&g->conns, pc) {
+		struct gcmd_conn *c = *pc;
+		if (c->fd == FF_BADFD || !c->events)
+			continue;
+		if (c->out.len > GCMD_EVENTS_MAXBUF) {
+			// the client doesn't read the events
+			warnlog(core, NULL, "globcmd", "subscriber doesn't read events: closing connection", 0);
+			conn_close(c);
+			continue;
+		}
+		gcmd_frame_add(&c->out, GCMD_F_EVENT, 0, &ev, sizeof(ev), url);
+		if (conn_flush(c) < 0)
+			conn_close(c);
+	}
+}
+
+struct gcmd_evtask {
+	fftask tsk;
+	int index;
+	ffstr url;
+};
+
+/** Send GCMD_EV_START.  Thread: main */
+static void gcmd_onstart(void *param)
+{
+	struct gcmd_evtask *et = param;
+	gcmd_event(GCMD_EV_START, et->index, 0, et->url);
+	ffstr_free(&et->url);
+	ffmem_free(et);
+}
+
+/**
+FMED_TRK_ONSTART is signalled on the thread which starts the track:
+ the event is passed to main thread, which owns the connections. */
+static void gcmd_mon_onsig(void *trk, uint sig)
+{
+	if (g->subscribers == 0)
+		return;
+
+	if (sig == FMED_TRK_ONSTART) {
+		const fmed_que_entry *qent = (void*)g->track->getval(trk, "queue_item");
+		if (qent == FMED_PNULL)
+			return; // not a queue track
+		// the queue item may be removed before the task is run: copy its data
+		struct gcmd_evtask *et = ffmem_new(struct gcmd_evtask);
+		if (et == NULL)
+			return;
+		et->index = g->qu->cmd2(FMED_QUE_ID, (void*)qent, 0);
+		ffstr_dupstr(&et->url, &qent->url);
+		fftask_set(&et->tsk, &gcmd_onstart, et);
+		core->task(&et->tsk, FMED_TASK_POST);
+		return;
+	}
+
+	ffstr url = {};
+	int index = -1;
+	const fmed_que_entry *qent = NULL;
+	if (sig != FMED_TRK_ONLAST) {
+		qent = (void*)g->track->getval(trk, "queue_item");
+		if (qent == FMED_PNULL)
+			return; // not a queue track
+		url = qent->url;
+		index = g->qu->cmd2(FMED_QUE_ID, (void*)qent, 0);
+	}
+
+	switch (sig) {
+	case FMED_TRK_ONCLOSE: {
+		const fmed_track_info *ti = g->track->conf(trk);
+		gcmd_event(GCMD_EV_STOP, index, ti->err, url);
+		break;
+	}
+
+	case FMED_TRK_ONLAST:
+		gcmd_event(GCMD_EV_DONE, -1, 0, url);
+		break;
+	}
 }
 
 enum CMD {
@@ -325,6 +862,9 @@ static void exec_cmd(cmd_parser *c, int cmd, ffstr *val)
 		fmed_que_entry e = {}, *ent;
 		e.url = *val;
 		ent = c->qu->add(&e);
+		if (c->first == NULL)
+			c->first = ent;
+		c->added++;
 		if (cmd == CMD_PLAY)
 			c->qu->cmd(FMED_QUE_PLAY_EXCL, (void*)ent);
 		break;
@@ -370,6 +910,7 @@ static int globcmd_parse(cmd_parser *c, const ffstr *in)
 			r = ffszarr_findsorted(cmds_sorted_str, FFCNT(cmds_sorted_str), val.ptr, val.len);
 			if (r < 0) {
 				warnlog(core, NULL, "globcmd", "unsupported command: %S", &val);
+				c->err = "unsupported command";
 				return -1;
 			}
 			dbglog(core, NULL, "globcmd", "received pipe command: %S", &val);
@@ -384,6 +925,7 @@ static int globcmd_parse(cmd_parser *c, const ffstr *in)
 
 		default:
 			warnlog(core, NULL, "globcmd", "pipe command parse: (%d) %s", r, ffconf_errstr(r));
+			c->err = ffconf_errstr(r);
 			return -1;
 		}
 	}
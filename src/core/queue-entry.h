@@ -11,14 +11,22 @@ struct entry {
 	ffslice tmeta; //ffstr[]. transient meta - reset before every start of this item.
 	ffslice dict; //ffstr[]
 
-	size_t list_pos; //position number within playlist.  May be invalid.
+	struct {
+		entry *left, *right, *parent;
+		size_t size; // number of nodes in subtree;  0: the item isn't in the list index
+		uint prio;
+	} node; // node in the list index (queue-index.h)
+	fflist_item probe_sib; // in LRU list of the probed items (queue-probe.h)
 	uint refcount;
+	uint search_id; // document ID in the search index + 1
+	byte search_dirty; // meta data has changed after the item was indexed
 	uint rm :1 // marked to remove
 		, stop_after :1
 		, no_tmeta :1
 		, trk_stopped :1
 		, trk_err :1
 		, trk_mixed :1
+		, probed :1 // in LRU list of the probed items (queue-probe.h)
 		;
 
 	char url[0];
@@ -43,6 +51,7 @@ static entry* ent_new(const fmed_que_entry *info)
 
 static void ent_free(entry *e)
 {
+	qp_ent_rm(e);
 	FFSLICE_FOREACH_T(&e->meta, ffstr_free, ffstr);
 	ffslice_free(&e->meta);
 	FFSLICE_FOREACH_T(&e->dict, ffstr_free, ffstr);
@@ -56,6 +65,7 @@ static void ent_free(entry *e)
 
 static void ent_rm(entry *e)
 {
+	qp_ent_rm(e);
 	ffbool unindex_once = !e->rm;
 	if (e->refcount != 0) {
 		e->rm = 1;
@@ -196,6 +206,8 @@ static void que_meta_set(fmed_que_entry *ent, const ffstr *name, const ffstr *va
 			ar.cap = a->len;
 			ffslice_rmT((ffslice*)&ar, i, 2, ffstr);
 			a->len -= 2;
+			if (a != &e->dict)
+				qs_touch(e);
 			if (!(flags & FMED_QUE_NOLOCK))
 				fflk_unlock(&qu->plist_lock);
 
@@ -208,6 +220,8 @@ static void que_meta_set(fmed_que_entry *ent, const ffstr *name, const ffstr *va
 			ffstr *arr = a->ptr;
 			ffstr_free(&arr[i + 1]);
 			ffstr_set(&arr[i + 1], sval, val->len);
+			if (a != &e->dict)
+				qs_touch(e);
 			if (!(flags & FMED_QUE_NOLOCK))
 				fflk_unlock(&qu->plist_lock);
 		}
@@ -246,6 +260,8 @@ static void que_meta_set(fmed_que_entry *ent, const ffstr *name, const ffstr *va
 	if ((flags & (FMED_QUE_TRKDICT | FMED_QUE_NUM)) == (FMED_QUE_TRKDICT | FMED_QUE_NUM))
 		arr[a->len + 1].len = -(ssize_t)arr[a->len + 1].len;
 	a->len += 2;
+	if (a != &e->dict)
+		qs_touch(e);
 	ok = 1;
 
 end:
@@ -0,0 +1,198 @@
+/** fmedia: queue: order-statistic tree of list items
+2023, Simon Zolin */
+
+/*
+The items of a list are kept in the user-visible order in a treap
+ (binary search tree with random priorities, balanced on average) keyed implicitly by position:
+ each node stores the number of nodes in its subtree.
+So getting an item by its position, getting the position of an item,
+ inserting and removing an item take O(log n).
+The tree node is embedded in entry (entry.node).
+*/
+
+static uint pli_rnd = 0x12345678;
+
+/** Get random priority for a new node (xorshift32) */
+static inline uint pli_prio(void)
+{
+	pli_rnd ^= pli_rnd << 13;
+	pli_rnd ^= pli_rnd >> 17;
+	pli_rnd ^= pli_rnd << 5;
+	return pli_rnd;
+}
+
+static inline size_t pli_size(const entry *t)
+{
+	return (t != NULL) ? t->node.size : 0;
+}
+
+static inline void pli_fix(entry *t)
+{
+	t->node.size = 1 + pli_size(t->node.left) + pli_size(t->node.right);
+}
+
+/** Join two trees: all nodes of 'a' go before the nodes of 'b' */
+static entry* pli_merge(entry *a, entry *b)
+{
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+
+	if (a->node.prio >= b->node.prio) {
+		entry *r = pli_merge(a->node.right, b);
+		a->node.right = r;
+		r->node.parent = a;
+		pli_fix(a);
+		return a;
+	}
+
+	entry *l = pli_merge(a, b->node.left);
+	b->node.left = l;
+	l->node.parent = b;
+	pli_fix(b);
+	return b;
+}
+
+/** Split tree: the first 'n' nodes go to 'l', the rest - to 'r' */
+static void pli_split(entry *t, size_t n, entry **l, entry **r)
+{
+	if (t == NULL) {
+		*l = NULL;
+		*r = NULL;
+		return;
+	}
+
+	size_t nl = pli_size(t->node.left);
+	if (n <= nl) {
+		pli_split(t->node.left, n, l, &t->node.left);
+		if (t->node.left != NULL)
+			t->node.left->node.parent = t;
+		*r = t;
+	} else {
+		pli_split(t->node.right, n - nl - 1, &t->node.right, r);
+		if (t->node.right != NULL)
+			t->node.right->node.parent = t;
+		*l = t;
+	}
+	pli_fix(t);
+}
+
+/** Insert item at position 'i' */
+static void pli_insert(entry **root, size_t i, entry *e)
+{
+	e->node.left = e->node.right = e->node.parent = NULL;
+	e->node.size = 1;
+	e->node.prio = pli_prio();
+
+	entry *l, *r;
+	pli_split(*root, i, &l, &r);
+	if (l != NULL)
+		l->node.parent = NULL;
+	if (r != NULL)
+		r->node.parent = NULL;
+	*root = pli_merge(pli_merge(l, e), r);
+	(*root)->node.parent = NULL;
+}
+
+/** Remove item from tree */
+static void pli_remove(entry **root, entry *e)
+{
+	entry *p = e->node.parent;
+	if (e->node.left != NULL)
+		e->node.left->node.parent = NULL;
+	if (e->node.right != NULL)
+		e->node.right->node.parent = NULL;
+	entry *m = pli_merge(e->node.left, e->node.right);
+	if (m != NULL)
+		m->node.parent = p;
+
+	if (p == NULL)
+		*root = m;
+	else if (p->node.left == e)
+		p->node.left = m;
+	else
+		p->node.right = m;
+
+	for (;  p != NULL;  p = p->node.parent) {
+		p->node.size--;
+	}
+
+	ffmem_zero_obj(&e->node);
+}
+
+/** Get item by its position */
+static entry* pli_at(entry *t, size_t i)
+{
+	while (t != NULL) {
+		size_t nl = pli_size(t->node.left);
+		if (i < nl) {
+			t = t->node.left;
+		} else if (i == nl) {
+			return t;
+		} else {
+			i -= nl + 1;
+			t = t->node.right;
+		}
+	}
+	return NULL;
+}
+
+/** Get position of the item */
+static size_t pli_index(const entry *e)
+{
+	size_t i = pli_size(e->node.left);
+	for (const entry *c = e, *p = e->node.parent;  p != NULL;  c = p, p = p->node.parent) {
+		if (p->node.right == c)
+			i += pli_size(p->node.left) + 1;
+	}
+	return i;
+}
+
+static entry* pli_first(entry *t)
+{
+	if (t == NULL)
+		return NULL;
+	while (t->node.left != NULL) {
+		t = t->node.left;
+	}
+	return t;
+}
+
+/** Get the next item in order */
+static entry* pli_next(entry *e)
+{
+	if (e->node.right != NULL)
+		return pli_first(e->node.right);
+
+	entry *p = e->node.parent;
+	while (p != NULL && p->node.right == e) {
+		e = p;
+		p = p->node.parent;
+	}
+	return p;
+}
+
+/** Copy all items in order to array */
+static void pli_toarray(entry *root, ffvec *arr)
+{
+	ffvec_allocT(arr, pli_size(root), entry*);
+	for (entry *e = pli_first(root);  e != NULL;  e = pli_next(e)) {
+		*ffvec_pushT(arr, entry*) = e;
+	}
+}
+
+/** Create a new tree from array */
+static entry* pli_fromarray(entry **arr, size_t n)
+{
+	entry *root = NULL;
+	for (size_t i = 0;  i != n;  i++) {
+		entry *e = arr[i];
+		e->node.left = e->node.right = e->node.parent = NULL;
+		e->node.size = 1;
+		e->node.prio = pli_prio();
+		root = pli_merge(root, e);
+		root->node.parent = NULL;
+	}
+	return root;
+}
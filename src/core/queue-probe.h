@@ -0,0 +1,275 @@
+/** fmedia: queue: read meta data of the items visible in GUI list
+2023, Simon Zolin */
+
+/*
+GUI reports the range of visible rows (FMED_QUE_PROBE) on any thread;
+ the request is stored and processed on the main thread by a single task.
+The items are probed (FMED_TRK_TYPE_EXPAND tracks) in the order:
+
+  [first..last] (visible) -> [last+1..last+page] (below) -> [first-1..first-page] (above)
+
+Only QP_TRACKS probes run at the same time;
+ the next item is chosen by walking the same order again after a probe is finished,
+ so the items scrolled out of view are never started,
+ and the running probes for such items are stopped.
+The probed items are kept in LRU list (without holding a reference):
+ the oldest item is removed from the list and its transient meta data is freed,
+ so it's probed again when it becomes visible.
+An item is unlinked from LRU list when it's removed from its playlist.
+*/
+
+enum {
+	QP_TRACKS = 2,
+	QP_PAGE_MAX = 200, // max. number of rows above and below the visible range
+	QP_LRU_MAX = 1000,
+};
+
+struct qp_slot {
+	entry *e;
+	void *trk;
+	uint idx;
+};
+
+struct qprobe {
+	fflock lock;
+	uint req_first, req_last; // the latest request from user
+	uint posted :1;
+	fftask tsk;
+
+	uint first, last; // visible range.  Thread: main
+
+	struct qp_slot slots[QP_TRACKS];
+	fflist lru; // entry[]
+};
+
+static struct qprobe *qp;
+
+static void qp_next(void);
+
+static void qp_init(void)
+{
+	qp = ffmem_new(struct qprobe);
+	fflk_init(&qp->lock);
+	fflist_init(&qp->lru);
+}
+
+/** Note: call after the lists are freed */
+static void qp_free(void)
+{
+	if (qp == NULL)
+		return;
+	core->task(&qp->tsk, FMED_TASK_DEL);
+	ffmem_free0(qp);
+}
+
+/** Free transient meta data of the item */
+static void qp_tmeta_free(entry *e)
+{
+	fflk_lock(&qu->plist_lock);
+	FFSLICE_FOREACH_T(&e->tmeta, ffstr_free, ffstr);
+	ffslice_free(&e->tmeta);
+	fflk_unlock(&qu->plist_lock);
+}
+
+/** Move the item to the end of LRU list */
+static void qp_lru_touch(entry *e)
+{
+	fflist_rm(&qp->lru, &e->probe_sib);
+	fflist_ins(&qp->lru, &e->probe_sib);
+}
+
+/** Remove the item from LRU list before it's removed from its list or freed.
+The list doesn't hold a reference to the item, so the item is never kept alive by it. */
+static void qp_ent_rm(entry *e)
+{
+	if (!e->probed || qp == NULL)
+		return;
+	fflist_rm(&qp->lru, &e->probe_sib);
+	e->probed = 0;
+}
+
+static void qp_lru_add(entry *e)
+{
+	if (qp->lru.len == QP_LRU_MAX) {
+		entry *old = FF_GETPTR(entry, probe_sib, fflist_first(&qp->lru));
+		qp_ent_rm(old);
+		if (old->refcount == 0) // the item isn't used by any track
+			qp_tmeta_free(old);
+	}
+
+	e->probed = 1;
+	fflist_ins(&qp->lru, &e->probe_sib);
+}
+
+/** Get the item by the position in priority order.
+Return NULL if there are no more items */
+static entry* qp_at(plist *pl, uint n, uint *idx)
+{
+	uint total = plist_count(pl);
+	if (qp->first >= total)
+		return NULL;
+	uint last = ffmin(qp->last, total - 1);
+	uint visible = last - qp->first + 1;
+	uint page = ffmin(visible, QP_PAGE_MAX);
+
+	if (n < visible) {
+		*idx = qp->first + n;
+	} else if (n < visible + page) {
+		*idx = last + 1 + (n - visible);
+		if (*idx >= total)
+			return NULL;
+	} else if (n < visible + page * 2) {
+		n -= visible + page;
+		if (n >= qp->first)
+			return NULL;
+		*idx = qp->first - 1 - n;
+	} else {
+		return NULL;
+	}
+	return plist_ent(pl, *idx);
+}
+
+/** Return TRUE if the item needs to be probed */
+static int qp_need(entry *e)
+{
+	return !e->probed
+		&& !e->rm
+		&& e->refcount == 0 // no active track
+		&& e->tmeta.len == 0 // the item was already played or expanded
+		&& !(e->meta.len != 0 && e->e.dur != 0); // everything is known from playlist
+}
+
+/** Stop the probes for the items that are too far from the visible range or are in another list */
+static void qp_cancel(void)
+{
+	uint visible = qp->last - qp->first + 1;
+	uint page = ffmin(visible, QP_PAGE_MAX);
+	uint lo = (qp->first > page) ? qp->first - page : 0;
+	uint hi = qp->last + page;
+
+	for (uint i = 0;  i != QP_TRACKS;  i++) {
+		struct qp_slot *s = &qp->slots[i];
+		if (s->trk == NULL
+			|| (s->e->plist == qu->curlist && s->idx >= lo && s->idx <= hi))
+			continue;
+		dbglog0("probe: stopping %S (#%u)", &s->e->e.url, s->idx);
+		qu->track->cmd(s->trk, FMED_TRACK_STOP);
+		s->trk = NULL; // the track will be closed asynchronously
+	}
+}
+
+static void qp_taskfunc(void *param)
+{
+	fflk_lock(&qp->lock);
+	qp->first = qp->req_first;
+	qp->last = qp->req_last;
+	qp->posted = 0;
+	fflk_unlock(&qp->lock);
+
+	qp_cancel();
+	qp_next();
+}
+
+/** Set the visible range.
+Thread: any */
+static void qp_range(uint first, uint last)
+{
+	if (last < first)
+		return;
+
+	fflk_lock(&qp->lock);
+	qp->req_first = first;
+	qp->req_last = last;
+	uint post = !qp->posted;
+	qp->posted = 1;
+	fflk_unlock(&qp->lock);
+
+	if (post) {
+		fftask_set(&qp->tsk, &qp_taskfunc, NULL);
+		core->task(&qp->tsk, FMED_TASK_POST);
+	}
+}
+
+/** Start probing the next items */
+static void qp_next(void)
+{
+	plist *pl = qu->curlist;
+	if (pl == NULL || pl->expand_all)
+		return;
+	if (pl->filtered_plist != NULL)
+		pl = pl->filtered_plist;
+
+	struct qp_slot *s = NULL;
+	entry *e;
+	uint idx;
+	for (uint n = 0;  ;  n++) {
+
+		if (s == NULL) {
+			for (uint i = 0;  i != QP_TRACKS;  i++) {
+				if (qp->slots[i].e == NULL) {
+					s = &qp->slots[i];
+					break;
+				}
+			}
+			if (s == NULL)
+				break; // all slots are busy
+		}
+
+		if (NULL == (e = qp_at(pl, n, &idx)))
+			break;
+
+		if (e->probed) {
+			qp_lru_touch(e);
+			continue;
+		}
+		if (!qp_need(e))
+			continue;
+
+		fmed_track_obj *trk = qu->track->create(FMED_TRK_TYPE_EXPAND, e->e.url.ptr);
+		if (trk == NULL || trk == FMED_TRK_EFMT) {
+			qp_lru_add(e); // don't try again
+			continue;
+		}
+		qu->track->setval(trk, "queue-probe", 1);
+		ent_start_prepare(e, trk);
+		qu->track->cmd(trk, FMED_TRACK_START);
+
+		dbglog0("probe: started %S (#%u)", &e->e.url, idx);
+		s->e = e;
+		s->trk = trk;
+		s->idx = idx;
+		s = NULL;
+	}
+}
+
+/** The track is being closed.
+Thread: main */
+static void qp_trk_closed(entry *e)
+{
+	for (uint i = 0;  i != QP_TRACKS;  i++) {
+		if (qp->slots[i].e == e) {
+			qp->slots[i].trk = NULL;
+			break;
+		}
+	}
+}
+
+/** Called after a probe has been finished.
+stopped: partial meta data (the track was stopped) */
+static void qp_trk_fin(entry *e, uint stopped)
+{
+	for (uint i = 0;  i != QP_TRACKS;  i++) {
+		if (qp->slots[i].e == e) {
+			ffmem_zero_obj(&qp->slots[i]);
+			break;
+		}
+	}
+
+	if (!stopped && !e->rm)
+		qp_lru_add(e);
+	else if (stopped && e->refcount == 1) // the item isn't used by another track
+		qp_tmeta_free(e);
+	ent_unref(e);
+
+	qp_next();
+}
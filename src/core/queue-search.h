@@ -0,0 +1,321 @@
+/** fmedia: queue: text search index
+2023, Simon Zolin */
+
+/*
+Case-insensitive search of a substring in URL and meta data values of the items in a list.
+The index is created for a list on the first search request:
+
+  trigram (3 lower-case characters) -> IDs of the documents containing it (in ascending order)
+  document ID -> entry (NULL: removed or re-indexed)
+
+The items are modified from different threads: they are just marked as 'dirty',
+ and on the next search request the new and the modified items are indexed again under a new document ID.
+When the search text contains the text of the previous search (e.g. the user types one more character),
+ only the items from the previous result and the documents indexed after it are checked.
+*/
+
+struct qs_post {
+	uint key;
+	ffvec ids; // uint[]
+};
+
+struct qsearch {
+	ffmap posts; // trigram -> struct qs_post*
+	ffvec docs; // entry*[]
+	uint ndead; // number of NULL items in 'docs'
+
+	// previous search
+	ffvec text; // lower-case
+	uint flags;
+	uint ndocs; // 'docs.len' at the time of search
+	ffvec result; // uint[]: document IDs
+};
+
+static int qs_post_keyeq(void *opaque, const void *key, ffsize keylen, void *val)
+{
+	const struct qs_post *p = val;
+	return p->key == *(uint*)key;
+}
+
+static void qs_index_free(struct qsearch *s)
+{
+	struct _ffmap_item *it;
+	FFMAP_WALK(&s->posts, it) {
+		if (!_ffmap_item_occupied(it))
+			continue;
+		struct qs_post *p = it->val;
+		ffvec_free(&p->ids);
+		ffmem_free(p);
+	}
+	ffmap_free(&s->posts);
+	ffvec_free(&s->docs);
+	s->ndead = 0;
+	s->text.len = 0;
+	s->result.len = 0;
+}
+
+static void qs_free(struct qsearch *s)
+{
+	if (s == NULL)
+		return;
+	qs_index_free(s);
+	ffvec_free(&s->text);
+	ffvec_free(&s->result);
+	ffmem_free(s);
+}
+
+/** Schedule the item for reindexing after its meta data has changed.
+The caller must hold qu->plist_lock. */
+static void qs_touch(entry *e)
+{
+	if (e->plist->search != NULL)
+		e->search_dirty = 1;
+}
+
+/** Remove the item from index after it's removed from the list */
+static void qs_rm(entry *e)
+{
+	struct qsearch *s = e->plist->search;
+	if (s == NULL)
+		return;
+
+	if (e->search_id != 0) {
+		((entry**)s->docs.ptr)[e->search_id - 1] = NULL;
+		s->ndead++;
+		e->search_id = 0;
+	}
+}
+
+static inline uint qs_lower(uint c)
+{
+	return (c >= 'A' && c <= 'Z') ? (c | 0x20) : c;
+}
+
+static inline uint qs_key(const char *p)
+{
+	return qs_lower((byte)p[0])
+		| (qs_lower((byte)p[1]) << 8)
+		| (qs_lower((byte)p[2]) << 16);
+}
+
+static void qs_index_str(struct qsearch *s, ffstr str, uint id)
+{
+	for (ffsize i = 0;  i + 3 <= str.len;  i++) {
+		uint key = qs_key(&str.ptr[i]);
+		struct qs_post *p = ffmap_find(&s->posts, &key, 4, NULL);
+		if (p == NULL) {
+			p = ffmem_new(struct qs_post);
+			p->key = key;
+			ffmap_add(&s->posts, &p->key, 4, p);
+		}
+
+		if (p->ids.len != 0 && ((uint*)p->ids.ptr)[p->ids.len - 1] == id)
+			continue; // this trigram occurs several times in the document
+		*ffvec_pushT(&p->ids, uint) = id;
+	}
+}
+
+/** Call func() for URL and each meta value the user can see */
+#define QS_WALK_STRINGS(e, flags, func, ...) \
+do { \
+	if (flags & FMED_QUE_SEARCH_URL) \
+		func(__VA_ARGS__, (e)->e.url); \
+	if (flags & FMED_QUE_SEARCH_META) { \
+		for (uint k = 0;  k != 2;  k++) { \
+			const ffstr *m = (k == 0) ? (e)->meta.ptr : (e)->tmeta.ptr; \
+			ffsize n = (k == 0) ? (e)->meta.len : (e)->tmeta.len; \
+			for (ffsize i = 0;  i != n;  i += 2) { \
+				if (!ffstr_matchz(&m[i], "__")) \
+					func(__VA_ARGS__, m[i + 1]); \
+			} \
+		} \
+	} \
+} while (0)
+
+/** Index the item under a new document ID */
+static void qs_index(struct qsearch *s, entry *e)
+{
+	if (e->search_id != 0) {
+		((entry**)s->docs.ptr)[e->search_id - 1] = NULL;
+		s->ndead++;
+	}
+
+	*ffvec_pushT(&s->docs, entry*) = e;
+	uint id = s->docs.len - 1;
+	e->search_id = id + 1;
+
+	QS_WALK_STRINGS(e, FMED_QUE_SEARCH_URL | FMED_QUE_SEARCH_META, qs_index_str, s, id);
+}
+
+static void qs_match_str(int *found, ffstr text, ffstr str)
+{
+	if (!*found && 0 <= ffstr_ifind(&str, text.ptr, text.len))
+		*found = 1;
+}
+
+static int qs_match(entry *e, ffstr text, uint flags)
+{
+	int found = 0;
+	QS_WALK_STRINGS(e, flags, qs_match_str, &found, text);
+	return found;
+}
+
+/** Index all items in the list */
+static void qs_index_all(plist *pl)
+{
+	struct qsearch *s = pl->search;
+	ffmap_init(&s->posts, qs_post_keyeq);
+	for (entry *e = pli_first(pl->index_root);  e != NULL;  e = pli_next(e)) {
+		e->search_id = 0;
+		e->search_dirty = 0;
+		qs_index(s, e);
+	}
+	dbglog0("search: indexed %L items, %L trigrams", s->docs.len, s->posts.len);
+}
+
+/** Update index with the new and modified items */
+static void qs_update(plist *pl)
+{
+	struct qsearch *s = pl->search;
+	ffvec dirty = {};
+	entry **it;
+
+	fflk_lock(&qu->plist_lock);
+	for (entry *e = pli_first(pl->index_root);  e != NULL;  e = pli_next(e)) {
+		if (e->search_id == 0 || e->search_dirty) {
+			e->search_dirty = 0;
+			*ffvec_pushT(&dirty, entry*) = e;
+		}
+	}
+	fflk_unlock(&qu->plist_lock);
+
+	FFSLICE_WALK(&dirty, it) {
+		qs_index(s, *it);
+	}
+	ffvec_free(&dirty);
+
+	if (s->ndead > 1000 && s->ndead > s->docs.len / 2) {
+		// too many stale document IDs: rebuild index
+		dbglog0("search: rebuilding index: %u/%L stale documents", s->ndead, s->docs.len);
+		qs_index_free(s);
+		qs_index_all(pl);
+	}
+}
+
+static int qs_post_cmp(const void *a, const void *b, void *udata)
+{
+	const struct qs_post *pa = *(struct qs_post**)a, *pb = *(struct qs_post**)b;
+	return (pa->ids.len > pb->ids.len) - (pa->ids.len < pb->ids.len);
+}
+
+/** Get IDs of the documents that contain all trigrams of the text */
+static void qs_candidates(struct qsearch *s, ffstr text, ffvec *ids)
+{
+	ffvec posts = {};
+
+	for (ffsize i = 0;  i + 3 <= text.len;  i++) {
+		uint key = qs_key(&text.ptr[i]);
+		struct qs_post *p = ffmap_find(&s->posts, &key, 4, NULL);
+		if (p == NULL)
+			goto end; // no document contains this trigram
+		*ffvec_pushT(&posts, struct qs_post*) = p;
+	}
+
+	// start with the shortest list, then remove the IDs missing in the other lists
+	struct qs_post **pp = posts.ptr;
+	ffsort(pp, posts.len, sizeof(void*), qs_post_cmp, NULL);
+	ffvec_addT(ids, pp[0]->ids.ptr, pp[0]->ids.len, uint);
+
+	for (ffsize k = 1;  k != posts.len && ids->len != 0;  k++) {
+		const uint *b = pp[k]->ids.ptr;
+		ffsize nb = pp[k]->ids.len, ib = 0, n = 0;
+		uint *a = ids->ptr;
+		for (ffsize i = 0;  i != ids->len;  i++) {
+			while (ib != nb && b[ib] < a[i])
+				ib++;
+			if (ib == nb)
+				break;
+			if (b[ib] == a[i])
+				a[n++] = a[i];
+		}
+		ids->len = n;
+	}
+
+end:
+	ffvec_free(&posts);
+}
+
+/** Find the items containing text.
+result: entry*[] in the list order
+Return the number of items found */
+static ffsize qs_search(plist *pl, ffstr text, uint flags, ffvec *result)
+{
+	if (pl->search == NULL) {
+		pl->search = ffmem_new(struct qsearch);
+		qs_index_all(pl);
+	} else {
+		qs_update(pl);
+	}
+
+	struct qsearch *s = pl->search;
+	ffvec ids = {};
+	ffvec ltext = {};
+	ffvec_addT(&ltext, text.ptr, text.len, char);
+	ffs_lower(ltext.ptr, ltext.len, text.ptr, text.len);
+	text = *(ffstr*)&ltext;
+	const entry **docs = s->docs.ptr;
+
+	if (s->text.len != 0 && flags == s->flags
+		&& 0 <= ffstr_find(&text, s->text.ptr, s->text.len)) {
+		// narrow down the previous result
+		ffvec_addT(&ids, s->result.ptr, s->result.len, uint);
+		for (uint i = s->ndocs;  i != s->docs.len;  i++) {
+			*ffvec_pushT(&ids, uint) = i;
+		}
+		dbglog0("search: '%S': narrowing %L items", &text, ids.len);
+
+	} else if (text.len >= 3) {
+		qs_candidates(s, text, &ids);
+
+	} else {
+		ffvec_allocT(&ids, s->docs.len, uint);
+		for (uint i = 0;  i != s->docs.len;  i++) {
+			*ffvec_pushT(&ids, uint) = i;
+		}
+	}
+
+	// check the candidates and mark the matching documents
+	ffvec mark = {};
+	ffvec_allocT(&mark, s->docs.len, byte);
+	ffmem_zero(mark.ptr, s->docs.len);
+	uint *id = ids.ptr;
+	ffsize n = 0;
+	for (ffsize i = 0;  i != ids.len;  i++) {
+		const entry *e = docs[id[i]];
+		if (e == NULL
+			|| !qs_match((entry*)e, text, flags))
+			continue;
+		((byte*)mark.ptr)[id[i]] = 1;
+		id[n++] = id[i];
+	}
+	ids.len = n;
+
+	result->len = 0;
+	ffvec_allocT(result, n, entry*);
+	for (entry *e = pli_first(pl->index_root);  e != NULL;  e = pli_next(e)) {
+		if (e->search_id != 0
+			&& ((byte*)mark.ptr)[e->search_id - 1])
+			*ffvec_pushT(result, entry*) = e;
+	}
+	ffvec_free(&mark);
+
+	ffvec_free(&s->result);
+	s->result = ids;
+	ffvec_free(&s->text);
+	s->text = ltext;
+	s->flags = flags;
+	s->ndocs = s->docs.len;
+
+	dbglog0("search: '%S': found %L items", &text, result->len);
+	return result->len;
+}
@@ -0,0 +1,312 @@
+/** fmedia: queue: sorting of list items
+2023, Simon Zolin */
+
+/*
+The sort keys are extracted from each item once before sorting, so the comparison is just memcmp():
+
+  KEY = (FIELD)...
+  FIELD = 0x01 VALUE | 0x02 (value is missing: such items go last)
+  VALUE (string) = (CHAR | DIGITS)... 0x00
+    CHAR: lower-case ASCII character
+    DIGITS: "0" LENGTH[1] DIGIT...: a number without leading zeros, so that "2" < "10"
+  VALUE (duration) = 8 bytes, big-endian
+
+A large list is split into parts which are sorted by several threads,
+ then the adjacent parts are merged, also in parallel.
+Merge sort is stable: the items with equal keys keep their order.
+*/
+
+#include <FFOS/thread.h>
+#include <FFOS/sysconf.h>
+
+enum {
+	QSORT_PARALLEL_MIN = 32*1024, // min. number of items per thread
+	QSORT_THREADS_MAX = 8,
+	QSORT_FIELDS_MAX = 8,
+};
+
+struct qsort_item {
+	entry *e;
+	const byte *key;
+	size_t len;
+};
+
+struct qsort_field {
+	ffstr meta;
+	uint url :1
+		, dur :1;
+};
+
+static void qsort_key_str(ffvec *key, ffstr s)
+{
+	ffvec_grow(key, s.len + 2, 1);
+	for (size_t i = 0;  i != s.len;  ) {
+		uint c = (byte)s.ptr[i];
+
+		if (c >= '0' && c <= '9') {
+			while (i != s.len && s.ptr[i] == '0') {
+				i++; // leading zeros
+			}
+			size_t n = 0;
+			while (i + n != s.len && s.ptr[i + n] >= '0' && s.ptr[i + n] <= '9') {
+				n++;
+			}
+			size_t len = ffmin(n, 255);
+			ffvec_grow(key, 2 + len + s.len - i, 1);
+			char *d = ffslice_end(key, 1);
+			d[0] = '0';
+			d[1] = len;
+			ffmem_copy(&d[2], &s.ptr[i], len);
+			key->len += 2 + len;
+			i += n;
+			continue;
+		}
+
+		if (c >= 'A' && c <= 'Z')
+			c |= 0x20;
+		else if (c < 0x02)
+			c = 0x01; // don't confuse with the terminator
+		*ffvec_pushT(key, byte) = c;
+		i++;
+	}
+	*ffvec_pushT(key, byte) = 0x00;
+}
+
+/** Append sort key for the item */
+static void qsort_key(ffvec *key, entry *e, const struct qsort_field *f, uint nf)
+{
+	for (uint i = 0;  i != nf;  i++) {
+		if (f[i].dur) {
+			uint64 d = (uint64)(int64)e->e.dur + 0x8000000000000000ULL;
+			ffvec_grow(key, 9, 1);
+			byte *p = ffslice_end(key, 1);
+			p[0] = 0x01;
+			*(uint64*)&p[1] = ffint_be_cpu64(d);
+			key->len += 9;
+			continue;
+		}
+
+		const ffstr *s = &e->e.url;
+		if (!f[i].url)
+			s = que_meta_find(&e->e, f[i].meta.ptr, f[i].meta.len);
+		if (s == NULL) {
+			*ffvec_pushT(key, byte) = 0x02;
+			continue;
+		}
+		*ffvec_pushT(key, byte) = 0x01;
+		qsort_key_str(key, *s);
+	}
+}
+
+static inline int qsort_cmp(const struct qsort_item *a, const struct qsort_item *b, uint reverse)
+{
+	int r = ffmem_cmp(a->key, b->key, ffmin(a->len, b->len));
+	if (r == 0)
+		r = (a->len > b->len) - (a->len < b->len);
+	return (reverse) ? -r : r;
+}
+
+/** Merge 2 sorted adjacent ranges [lo..mid) and [mid..hi) */
+static void qsort_merge(struct qsort_item *a, struct qsort_item *tmp, size_t lo, size_t mid, size_t hi, uint reverse)
+{
+	size_t i = lo, j = mid, k = lo;
+	while (i != mid && j != hi) {
+		if (qsort_cmp(&a[j], &a[i], reverse) < 0)
+			tmp[k++] = a[j++];
+		else
+			tmp[k++] = a[i++];
+	}
+	while (i != mid) {
+		tmp[k++] = a[i++];
+	}
+	// the rest of the right part is already in place
+	ffmem_copy(&a[lo], &tmp[lo], (k - lo) * sizeof(*a));
+}
+
+static void qsort_range(struct qsort_item *a, struct qsort_item *tmp, size_t lo, size_t hi, uint reverse)
+{
+	if (hi - lo <= 16) {
+		// insertion sort
+		for (size_t i = lo + 1;  i < hi;  i++) {
+			struct qsort_item it = a[i];
+			size_t j = i;
+			for (;  j != lo && qsort_cmp(&it, &a[j - 1], reverse) < 0;  j--) {
+				a[j] = a[j - 1];
+			}
+			a[j] = it;
+		}
+		return;
+	}
+
+	size_t mid = lo + (hi - lo) / 2;
+	qsort_range(a, tmp, lo, mid, reverse);
+	qsort_range(a, tmp, mid, hi, reverse);
+	if (qsort_cmp(&a[mid], &a[mid - 1], reverse) >= 0)
+		return; // already in order
+	qsort_merge(a, tmp, lo, mid, hi, reverse);
+}
+
+struct qsort_job {
+	struct qsort_item *a, *tmp;
+	size_t lo, mid, hi;
+	uint reverse;
+	ffthread th;
+};
+
+static int FFTHREAD_PROCCALL qsort_job_run(void *param)
+{
+	struct qsort_job *j = param;
+	if (j->mid == 0)
+		qsort_range(j->a, j->tmp, j->lo, j->hi, j->reverse);
+	else
+		qsort_merge(j->a, j->tmp, j->lo, j->mid, j->hi, j->reverse);
+	return 0;
+}
+
+/** Run the jobs: the first one on the current thread, the others - on new threads */
+static void qsort_jobs_run(struct qsort_job *jobs, uint n)
+{
+	for (uint i = 1;  i < n;  i++) {
+		jobs[i].th = ffthread_create(&qsort_job_run, &jobs[i], 0);
+		if (jobs[i].th == FFTHREAD_NULL)
+			qsort_job_run(&jobs[i]);
+	}
+
+	qsort_job_run(&jobs[0]);
+
+	for (uint i = 1;  i < n;  i++) {
+		if (jobs[i].th != FFTHREAD_NULL)
+			ffthread_join(jobs[i].th, -1, NULL);
+	}
+}
+
+static uint qsort_nthreads(size_t n)
+{
+	ffsysconf sc;
+	ffsysconf_init(&sc);
+	uint ncpu = ffsysconf_get(&sc, FFSYSCONF_NPROCESSORS_ONLN);
+	uint nt = ffmin(ffmin(ncpu, QSORT_THREADS_MAX), n / QSORT_PARALLEL_MIN);
+	return ffmax(nt, 1);
+}
+
+/** Sort items by 'nparts' threads
+Return 0 on success */
+static int qsort_items(struct qsort_item *a, size_t n, uint nparts, uint reverse)
+{
+	struct qsort_job jobs[QSORT_THREADS_MAX] = {};
+	size_t bounds[QSORT_THREADS_MAX + 1];
+	struct qsort_item *tmp;
+	if (NULL == (tmp = ffmem_alloc(n * sizeof(*a))))
+		return -1;
+
+	for (uint i = 0;  i <= nparts;  i++) {
+		bounds[i] = n * i / nparts;
+	}
+
+	for (uint i = 0;  i != nparts;  i++) {
+		jobs[i].a = a;
+		jobs[i].tmp = tmp;
+		jobs[i].lo = bounds[i];
+		jobs[i].hi = bounds[i + 1];
+		jobs[i].reverse = reverse;
+	}
+	qsort_jobs_run(jobs, nparts);
+
+	// merge the adjacent parts until there's only 1 part
+	while (nparts > 1) {
+		uint nj = 0;
+		for (uint i = 0;  i + 1 < nparts;  i += 2) {
+			struct qsort_job *j = &jobs[nj++];
+			j->lo = bounds[i];
+			j->mid = bounds[i + 1];
+			j->hi = bounds[i + 2];
+		}
+		qsort_jobs_run(jobs, nj);
+
+		uint k = 0;
+		for (uint i = 0;  i <= nparts;  i += 2) {
+			bounds[k++] = bounds[i];
+		}
+		if (nparts % 2)
+			bounds[k++] = bounds[nparts];
+		nparts = k - 1;
+	}
+
+	ffmem_free(tmp);
+	return 0;
+}
+
+/** Parse "key1,key2,...".
+Return the number of fields */
+static uint qsort_fields(const char *by, struct qsort_field *f)
+{
+	uint n = 0;
+	ffstr s = FFSTR_INITZ(by), name;
+	while (s.len != 0 && n != QSORT_FIELDS_MAX) {
+		ffstr_splitby(&s, ',', &name, &s);
+		ffstr_trimwhite(&name);
+		if (name.len == 0)
+			continue;
+
+		ffmem_zero_obj(&f[n]);
+		if (ffstr_eqz(&name, "__url"))
+			f[n].url = 1;
+		else if (ffstr_eqz(&name, "__dur"))
+			f[n].dur = 1;
+		else
+			f[n].meta = name;
+		n++;
+	}
+	return n;
+}
+
+/** Sort items by key.
+arr: entry*[];  the order isn't changed if there's not enough memory */
+static void qsort_entries(ffvec *arr, const char *by, uint reverse)
+{
+	struct qsort_field f[QSORT_FIELDS_MAX];
+	uint nf = qsort_fields(by, f);
+	if (nf == 0 || arr->len < 2)
+		return;
+
+	entry **ents = arr->ptr;
+	size_t n = arr->len;
+	ffvec keys = {};
+	struct qsort_item *items;
+	if (NULL == (items = ffmem_alloc(n * sizeof(struct qsort_item)))
+		|| NULL == ffvec_alloc(&keys, n * 16, 1))
+		goto err;
+
+	for (size_t i = 0;  i != n;  i++) {
+		items[i].e = ents[i];
+		items[i].len = keys.len; // offset until all keys are extracted
+		qsort_key(&keys, ents[i], f, nf);
+	}
+	for (size_t i = 0;  i != n;  i++) {
+		size_t off = items[i].len;
+		size_t end = (i + 1 != n) ? items[i + 1].len : keys.len;
+		items[i].key = (byte*)keys.ptr + off;
+		items[i].len = end - off;
+	}
+
+	uint nthreads = qsort_nthreads(n);
+	fftime t1 = fftime_monotonic();
+	if (0 != qsort_items(items, n, nthreads, reverse))
+		goto err;
+	fftime t2 = fftime_monotonic();
+	fftime_sub(&t2, &t1);
+	dbglog0("sort: '%s': %L items, keys:%LKB, threads:%u, %Ums"
+		, by, n, keys.len / 1024, nthreads, (int64)fftime_to_msec(&t2));
+
+	for (size_t i = 0;  i != n;  i++) {
+		ents[i] = items[i].e;
+	}
+	goto end;
+
+err:
+	syserrlog("%s", ffmem_alloc_S);
+
+end:
+	ffmem_free(items);
+	ffvec_free(&keys);
+}
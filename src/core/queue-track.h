@@ -7,6 +7,7 @@ static void que_trk_close(void *ctx);
 enum CMD {
 	CMD_TRKFIN = 0x010000,
 	CMD_TRKFIN_EXPAND,
+	CMD_TRKFIN_PROBE,
 };
 
 struct quetask {
@@ -33,6 +34,10 @@ static void que_taskfunc(void *udata)
 		break;
 	}
 
+	case CMD_TRKFIN_PROBE:
+		qp_trk_fin((void*)qt->param, qt->flags);
+		break;
+
 	default:
 		que_cmd(qt->cmd, (void*)qt->param);
 	}
@@ -97,7 +102,7 @@ static void que_play2(entry *ent, uint flags)
 {
 	fmed_que_entry *e = &ent->e;
 	int type = FMED_TRK_TYPE_PLAYBACK;
-	if (ent->trk != NULL && ent->trk->pcm_peaks)
+	if (ent->trk != NULL && (ent->trk->pcm_peaks || ent->trk->loudness))
 		type = FMED_TRK_TYPE_PCMINFO;
 	else if (ent->trk != NULL && ent->trk->input_info)
 		type = FMED_TRK_TYPE_METAINFO;
@@ -216,6 +221,11 @@ static void que_trk_close(void *ctx)
 	if (t->d->type == FMED_TRK_TYPE_EXPAND && e->plist->expand_all)
 		qt->cmd = CMD_TRKFIN_EXPAND;
 	qt->flags = t->d->error;
+	if (t->track->getval(t->trk, "queue-probe") == 1) {
+		qt->cmd = CMD_TRKFIN_PROBE;
+		qt->flags = !!(t->d->flags & FMED_FSTOP);
+		qp_trk_closed(e);
+	}
 	qt->param = (size_t)t->e;
 	que_task_add(qt);
 
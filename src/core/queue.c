@@ -32,9 +32,11 @@ typedef struct plist plist;
 struct plist {
 	fflist_item sib;
 	fflist ents; //entry[]
-	ffarr indexes; //entry*[]  Get an entry by its number;  find a number by an entry pointer.
+	entry *index_root; // order-statistic tree of the items in list order (queue-index.h)
+	ffarr indexes; //entry*[]  The filtered list only: get an entry by its number;  find a number by an entry pointer.
 	entry *cur, *xcursor;
 	struct plist *filtered_plist; //list with the filtered tracks
+	struct qsearch *search; // text search index; created on the first search request
 	uint nerrors; // number of consecutive errors
 	uint rm :1;
 	uint allow_random :1;
@@ -47,6 +49,7 @@ static void plist_free(plist *pl);
 static ssize_t plist_ent_idx(plist *pl, entry *e);
 static struct entry* plist_ent(struct plist *pl, size_t idx);
 static entry* pl_first(plist *pl);
+static size_t plist_count(plist *pl);
 
 struct que_conf {
 	byte next_if_err;
@@ -107,9 +110,19 @@ static void rnd_init();
 static void plist_remove_entry(entry *e, ffbool from_index, ffbool remove);
 static entry* que_getnext(entry *from);
 static void pl_expand_next(plist *pl, entry *e);
+static void qs_touch(entry *e);
+static void qs_rm(entry *e);
+static void qs_free(struct qsearch *s);
+static void qp_ent_rm(entry *e);
+static void qp_trk_closed(entry *e);
+static void qp_trk_fin(entry *e, uint stopped);
 
 #include <core/queue-entry.h>
+#include <core/queue-index.h>
 #include <core/queue-track.h>
+#include <core/queue-search.h>
+#include <core/queue-sort.h>
+#include <core/queue-probe.h>
 
 static const fmed_conf_arg que_conf_args[] = {
 	{ "next_if_error",	FMC_BOOL8,  FMC_O(struct que_conf, next_if_err) },
@@ -155,6 +168,7 @@ static int que_sig(uint signo)
 	case FMED_SIG_INIT:
 		qu = ffmem_new(struct que);
 		fflist_init(&qu->plists);
+		qp_init();
 		break;
 
 	case FMED_OPEN:
@@ -174,8 +188,11 @@ static int que_sig(uint signo)
 /** Prepare the item before starting a track. */
 static void ent_start_prepare(entry *e, void *trk)
 {
+	fflk_lock(&qu->plist_lock);
 	FFSLICE_FOREACH_T(&e->tmeta, ffstr_free, ffstr);
 	ffslice_free(&e->tmeta);
+	qs_touch(e);
+	fflk_unlock(&qu->plist_lock);
 	qu->track->setval(trk, "queue_item", (int64)e);
 	ent_ref(e);
 }
@@ -184,13 +201,14 @@ static void plist_remove_entry(entry *e, ffbool from_index, ffbool remove)
 {
 	plist *pl = e->plist;
 
+	qs_rm(e);
+
 	if (from_index) {
-		ssize_t i = plist_ent_idx(pl, e);
-		if (i >= 0)
-			ffslice_rmT((ffslice*)&pl->indexes, i, 1, entry*);
+		if (e->node.size != 0)
+			pli_remove(&pl->index_root, e);
 
 		if (pl->filtered_plist != NULL) {
-			i = plist_ent_idx(pl->filtered_plist, e);
+			ssize_t i = plist_ent_idx(pl->filtered_plist, e);
 			if (i >= 0)
 				ffslice_rmT((ffslice*)&pl->filtered_plist->indexes, i, 1, entry*);
 		}
@@ -215,27 +233,23 @@ static void plist_free(plist *pl)
 	FFLIST_ENUMSAFE(&pl->ents, ent_free, entry, sib);
 	ffarr_free(&pl->indexes);
 	plist_free(pl->filtered_plist);
+	qs_free(pl->search);
 	ffmem_free(pl);
 }
 
 /** Find a number by an entry pointer. */
 static ssize_t plist_ent_idx(plist *pl, entry *e)
 {
-	int update = 0;
 	if (!pl->filtered) {
-		entry *e2 = plist_ent(pl, e->list_pos);
-		if (e == e2)
-			return e->list_pos;
-		update = 1;
+		if (e->plist != pl || e->node.size == 0)
+			return -1;
+		return pli_index(e);
 	}
 
 	entry **p;
 	FFARR_WALKT(&pl->indexes, p, entry*) {
-		if (*p == e) {
-			if (update)
-				e->list_pos = p - (entry**)pl->indexes.ptr;
+		if (*p == e)
 			return p - (entry**)pl->indexes.ptr;
-		}
 	}
 	return -1;
 }
@@ -243,18 +257,30 @@ static ssize_t plist_ent_idx(plist *pl, entry *e)
 /** Get an entry pointer by its index. */
 static struct entry* plist_ent(struct plist *pl, size_t idx)
 {
+	if (!pl->filtered)
+		return pli_at(pl->index_root, idx);
+
 	if (idx >= pl->indexes.len)
 		return NULL;
 	struct entry *e = ((entry**)pl->indexes.ptr) [idx];
 	return e;
 }
 
+/** Get the number of entries */
+static size_t plist_count(plist *pl)
+{
+	if (!pl->filtered)
+		return pli_size(pl->index_root);
+	return pl->indexes.len;
+}
+
 
 static void que_destroy(void)
 {
 	if (qu == NULL)
 		return;
 	FFLIST_ENUMSAFE(&qu->plists, plist_free, plist, sib);
+	qp_free();
 	ffmem_free0(qu);
 }
 
@@ -318,10 +344,18 @@ static fmed_track_obj* que_export(plist *pl, const char *fn)
 
 	entry *first = pl_first(pl);
 	ti->que_cur = &first->e;
-	qu->track->cmd(t, add_cmd, "plist.m3u-out");
 
 	ffstr ext;
 	ffpath_split3_str(FFSTR_Z(fn), NULL, NULL, &ext);
+	if (ffstr_eqz(&ext, "fmpl")) {
+		// the filter writes to the file by itself, appending to the existing file if possible
+		ti->out_filename = ffsz_dup(fn);
+		qu->track->cmd(t, add_cmd, "plist.fmpl-out");
+		qu->track->cmd(t, FMED_TRACK_START);
+		return t;
+	}
+
+	qu->track->cmd(t, add_cmd, "plist.m3u-out");
 	if (ffstr_eqz(&ext, "m3uz"))
 		qu->track->cmd(t, add_cmd, "zstd.compress");
 
@@ -366,7 +400,7 @@ static entry* pl_prev(plist *pl, entry *e)
 /** Get random playlist index */
 static ffsize pl_random(plist *pl)
 {
-	ffsize n = pl->indexes.len;
+	ffsize n = plist_count(pl);
 	if (n == 1)
 		return 0;
 	rnd_init();
@@ -396,9 +430,9 @@ static entry* que_getnext(entry *from)
 	if (from != NULL)
 		pl = from->plist;
 
-	if (pl->allow_random && qu->random && pl->indexes.len != 0) {
+	if (pl->allow_random && qu->random && plist_count(pl) != 0) {
 		ffsize i = pl_random(pl);
-		entry *e = ((entry**)pl->indexes.ptr) [i];
+		entry *e = plist_ent(pl, i);
 		return e;
 	}
 
@@ -468,48 +502,6 @@ static plist* plist_by_useridx(int idx)
 	return pl;
 }
 
-struct plist_sortdata {
-	ffstr meta; // meta key by which to sort
-	uint url :1
-		, dur :1
-		, reverse :1;
-};
-
-#define ffint_cmp(a, b) \
-	(((a) == (b)) ? 0 : ((a) < (b)) ? -1 : 1)
-
-/** Compare two entries. */
-static int plist_entcmp(const void *a, const void *b, void *udata)
-{
-	struct plist_sortdata *ps = udata;
-	struct entry *e1 = *(void**)a, *e2 = *(void**)b;
-	ffstr *s1, *s2;
-	int r = 0;
-
-	if (ps->url) {
-		r = ffstr_cmp2(&e1->e.url, &e2->e.url);
-
-	} else if (ps->dur) {
-		r = ffint_cmp(e1->e.dur, e2->e.dur);
-
-	} else if (ps->meta.len != 0) {
-		s1 = que_meta_find(&e1->e, ps->meta.ptr, ps->meta.len);
-		s2 = que_meta_find(&e2->e, ps->meta.ptr, ps->meta.len);
-		if (s1 == NULL && s2 == NULL)
-			r = 0;
-		else if (s1 == NULL)
-			r = 1;
-		else if (s2 == NULL)
-			r = -1;
-		else
-			r = ffstr_cmp2(s1, s2);
-	}
-
-	if (ps->reverse)
-		r = -r;
-	return r;
-}
-
 /** Initialize random number generator */
 static void rnd_init()
 {
@@ -522,38 +514,38 @@ static void rnd_init()
 }
 
 /** Sort indexes randomly */
-static void sort_random(plist *pl)
+static void sort_random(ffvec *v)
 {
 	rnd_init();
-	entry **arr = (void*)pl->indexes.ptr;
-	for (size_t i = 0;  i != pl->indexes.len;  i++) {
-		size_t to = ffrnd_get() % pl->indexes.len;
-		*arr[i] = FF_SWAP(arr[i], *arr[to]);
+	entry **arr = (void*)v->ptr;
+	for (size_t i = 0;  i != v->len;  i++) {
+		size_t to = ffrnd_get() % v->len;
+		entry *tmp = arr[i];
+		arr[i] = arr[to];
+		arr[to] = tmp;
 	}
 }
 
 /** Sort playlist entries. */
 static void plist_sort(struct plist *pl, const char *by, uint flags)
 {
+	ffvec v = {};
+	pli_toarray(pl->index_root, &v);
+
 	if (ffsz_eq(by, "__random")) {
-		sort_random(pl);
+		sort_random(&v);
 	} else {
-		struct plist_sortdata ps = {};
-		if (ffsz_eq(by, "__url"))
-			ps.url = 1;
-		else if (ffsz_eq(by, "__dur"))
-			ps.dur = 1;
-		else
-			ffstr_setz(&ps.meta, by);
-		ps.reverse = !!(flags & 1);
-		ffsort(pl->indexes.ptr, pl->indexes.len, sizeof(void*), &plist_entcmp, &ps);
+		qsort_entries(&v, by, !!(flags & 1));
 	}
 
+	pl->index_root = pli_fromarray(v.ptr, v.len);
+
 	fflist_init(&pl->ents);
-	entry **arr = (void*)pl->indexes.ptr;
-	for (size_t i = 0;  i != pl->indexes.len;  i++) {
+	entry **arr = (void*)v.ptr;
+	for (size_t i = 0;  i != v.len;  i++) {
 		fflist_ins(&pl->ents, &arr[i]->sib);
 	}
+	ffvec_free(&v);
 }
 
 static plist* pl_sel(plist *sel)
@@ -644,6 +636,8 @@ static const char *const scmds[] = {
 	"FMED_QUE_SETCURID",
 	"FMED_QUE_N_LISTS",
 	"FMED_QUE_FLIP_RANDOM",
+	"FMED_QUE_SEARCH",
+	"FMED_QUE_PROBE",
 };
 
 static ssize_t que_cmdv(uint cmd, ...)
@@ -708,7 +702,32 @@ static ssize_t que_cmdv(uint cmd, ...)
 		}
 		if (pl->filtered_plist != NULL)
 			pl = pl->filtered_plist;
-		r = pl->indexes.len;
+		r = plist_count(pl);
+		goto end;
+	}
+
+	case FMED_QUE_SEARCH: {
+		const ffstr *text = va_arg(va, ffstr*);
+		uint flags = va_arg(va, uint);
+		pl = qu->curlist;
+		if (pl == NULL)
+			goto end;
+		dbglog0("received command:%s  text:'%S'  flags:%xu", scmds[cmd], text, flags);
+
+		if (pl->filtered_plist != NULL)
+			que_cmdv(FMED_QUE_DEL_FILTERED);
+		plist *fpl = ffmem_new(struct plist);
+		fflist_init(&fpl->ents);
+		fpl->filtered = 1;
+		r = qs_search(pl, *text, flags, (ffvec*)&fpl->indexes);
+		pl->filtered_plist = fpl;
+		goto end;
+	}
+
+	case FMED_QUE_PROBE: {
+		uint first = va_arg(va, uint);
+		uint last = va_arg(va, uint);
+		qp_range(first, last);
 		goto end;
 	}
 
@@ -720,7 +739,7 @@ static ssize_t que_cmdv(uint cmd, ...)
 		}
 		if (pl->filtered_plist != NULL)
 			pl = pl->filtered_plist;
-		r = pl->indexes.len;
+		r = plist_count(pl);
 		goto end;
 	}
 
@@ -1137,18 +1156,6 @@ static fmed_que_entry* _que_add(fmed_que_entry *ent)
 	return (void*)que_cmd2(FMED_QUE_ADD, ent, 0);
 }
 
-/** Shift elements to the right.
-A[0]...  ( A[i]... )  A[i+n]... ->
-A[0]...  ( ... )  A[i]...
-*/
-static inline void _ffvec_shiftr(ffvec *v, size_t i, size_t n, size_t elsz)
-{
-	char *dst = v->ptr + (i + n) * elsz;
-	const char *src = v->ptr + i * elsz;
-	const char *end = v->ptr + v->len * elsz;
-	ffmem_move(dst, src, end - src);
-}
-
 static fmed_que_entry* que_add(plist *pl, fmed_que_entry *ent, entry *prev, uint flags)
 {
 	entry *e = NULL;
@@ -1174,26 +1181,17 @@ static fmed_que_entry* que_add(plist *pl, fmed_que_entry *ent, entry *prev, uint
 
 	ffchain_append(&e->sib, (prev != NULL) ? &prev->sib : fflist_last(&e->plist->ents));
 	e->plist->ents.len++;
-	if (NULL == ffvec_growT(&e->plist->indexes, 16, entry*)) {
-		ent_rm(e);
-		fflk_unlock(&qu->plist_lock);
-		return NULL;
-	}
-	ssize_t i = e->plist->indexes.len;
+	size_t i = pli_size(pl->index_root);
 	if (prev != NULL) {
 		ssize_t i2 = plist_ent_idx(e->plist, prev);
-		if (i2 != -1) {
+		if (i2 != -1)
 			i = i2 + 1;
-			_ffvec_shiftr(&e->plist->indexes, i, 1, sizeof(entry*));
-		}
 	}
-	e->list_pos = i;
-	((entry**)e->plist->indexes.ptr) [i] = e;
-	e->plist->indexes.len++;
+	pli_insert(&pl->index_root, i, e);
 	fflk_unlock(&qu->plist_lock);
 
 	dbglog0("added: [%L/%L] '%S' (%d: %d-%d) after:'%s'"
-		, e->list_pos+1, e->plist->indexes.len
+		, i+1, pli_size(pl->index_root)
 		, &ent->url
 		, ent->dur, ent->from, ent->to
 		, (prev != NULL) ? prev->url : NULL);
@@ -0,0 +1,171 @@
+/** fmedia: core: per-track values for FMED_METRICS
+2023, Simon Zolin */
+
+/*
+Each active track owns a slot in a static table.
+The slot is taken on the thread which starts the track (CAS on 'id'),
+ and released on the main thread (track close);
+ the values are written only by the track's worker,
+ and any thread may read them at any time.
+A reader never waits: it takes a consistent copy of the slot using the sequence counter
+ (odd value: the writer is updating the slot), and skips the slot if it keeps changing.
+*/
+
+enum {
+	TRKSTAT_MAX = 64,
+	TRKSTAT_BUSY = (uint)-1, // the slot is being initialized
+};
+
+struct trk_stat {
+	uint seq;
+	uint id; // track number;  0: the slot is free;  TRKSTAT_BUSY
+	uint type; // enum FMED_TRK_TYPE
+	uint buf_fill_msec;
+	uint64 pos_msec;
+	uint64 start_pos_msec; // position when the track started
+	uint64 start_time_msec, update_time_msec; // monotonic time
+};
+
+static struct trk_stat trk_stats[TRKSTAT_MAX];
+
+static uint64 trkstat_now_msec(void)
+{
+	fftime t = fftime_monotonic();
+	return fftime_to_msec(&t);
+}
+
+/** Take a free slot.  Thread: any. */
+static void trkstat_open(fm_trk *t)
+{
+	for (uint i = 0;  i != TRKSTAT_MAX;  i++) {
+		struct trk_stat *st = &trk_stats[i];
+		if (FF_READONCE(st->id) != 0
+			|| 0 != ffint_cmpxchg(&st->id, 0, TRKSTAT_BUSY))
+			continue;
+
+		FF_WRITEONCE(st->seq, st->seq + 1);
+		ffcpu_fence_release();
+		st->type = t->props.type;
+		st->buf_fill_msec = 0;
+		st->pos_msec = 0;
+		st->start_pos_msec = (uint64)-1;
+		st->start_time_msec = st->update_time_msec = trkstat_now_msec();
+		st->id = t->num;
+		ffcpu_fence_release();
+		FF_WRITEONCE(st->seq, st->seq + 1);
+
+		t->stat = st;
+		return;
+	}
+}
+
+/** Release the slot.  Thread: main. */
+static void trkstat_close(fm_trk *t)
+{
+	struct trk_stat *st = t->stat;
+	if (st == NULL)
+		return;
+	FF_WRITEONCE(st->seq, st->seq + 1);
+	ffcpu_fence_release();
+	st->id = 0;
+	ffcpu_fence_release();
+	FF_WRITEONCE(st->seq, st->seq + 1);
+	t->stat = NULL;
+}
+
+/** Publish the current values.  Thread: track's worker. */
+static void trkstat_update(fm_trk *t)
+{
+	struct trk_stat *st = t->stat;
+	if (st == NULL)
+		return;
+
+	const fmed_track_info *ti = &t->props;
+	uint64 pos = 0;
+	if ((int64)ti->audio.pos != FMED_NULL && ti->audio.fmt.sample_rate != 0)
+		pos = ffpcm_time(ti->audio.pos, ti->audio.fmt.sample_rate);
+
+	FF_WRITEONCE(st->seq, st->seq + 1);
+	ffcpu_fence_release();
+	if (st->start_pos_msec == (uint64)-1)
+		st->start_pos_msec = pos;
+	st->pos_msec = pos;
+	st->buf_fill_msec = ti->a_out_buf_fill;
+	st->update_time_msec = trkstat_now_msec();
+	ffcpu_fence_release();
+	FF_WRITEONCE(st->seq, st->seq + 1);
+}
+
+/** Get a consistent copy of the slot.
+Return 0 if the slot is in use. */
+static int trkstat_read(const struct trk_stat *st, struct trk_stat *dst)
+{
+	for (uint i = 0;  i != 3;  i++) {
+		uint seq = FF_READONCE(st->seq);
+		if (seq & 1)
+			continue;
+		ffcpu_fence_acquire();
+		*dst = *st;
+		ffcpu_fence_acquire();
+		if (seq == FF_READONCE(st->seq))
+			return (dst->id != 0 && dst->id != TRKSTAT_BUSY) ? 0 : -1;
+	}
+	return -1;
+}
+
+static const char trk_type_str[][12] = {
+	"none", "playback", "record", "mixin", "mixout", "netin",
+	"expand", "plist", "pcminfo", "convert", "metainfo", "plheal",
+};
+
+static const char* trkstat_type_str(uint type)
+{
+	if (type >= FF_COUNT(trk_type_str))
+		return "unknown";
+	return trk_type_str[type];
+}
+
+/** Append per-track metrics in Prometheus text format. */
+void tracks_metrics(ffvec *buf)
+{
+	struct trk_stat stats[TRKSTAT_MAX];
+	uint n = 0;
+	uint ntype[_FMED_TRK_TYPE_END] = {};
+	for (uint i = 0;  i != TRKSTAT_MAX;  i++) {
+		if (0 != trkstat_read(&trk_stats[i], &stats[n]))
+			continue;
+		if (stats[n].type < _FMED_TRK_TYPE_END)
+			ntype[stats[n].type]++;
+		n++;
+	}
+
+	ffvec_addsz(buf, "# TYPE fmedia_tracks gauge\n");
+	for (uint i = 0;  i != _FMED_TRK_TYPE_END;  i++) {
+		ffvec_addfmt(buf, "fmedia_tracks{type=\"%s\"} %u\n", trkstat_type_str(i), ntype[i]);
+	}
+
+	ffvec_addsz(buf, "# TYPE fmedia_track_position_seconds gauge\n");
+	for (uint i = 0;  i != n;  i++) {
+		ffvec_addfmt(buf, "fmedia_track_position_seconds{track=\"%u\",type=\"%s\"} %u.%03u\n"
+			, stats[i].id, trkstat_type_str(stats[i].type)
+			, (uint)(stats[i].pos_msec / 1000), (uint)(stats[i].pos_msec % 1000));
+	}
+
+	// realtime factor: the amount of audio processed per 1 second of real time
+	ffvec_addsz(buf, "# TYPE fmedia_track_realtime_factor gauge\n");
+	for (uint i = 0;  i != n;  i++) {
+		uint64 audio = stats[i].pos_msec - ffmin(stats[i].start_pos_msec, stats[i].pos_msec);
+		uint64 real = stats[i].update_time_msec - stats[i].start_time_msec;
+		double rtf = (real != 0) ? (double)audio / real : 0;
+		ffvec_addfmt(buf, "fmedia_track_realtime_factor{track=\"%u\",type=\"%s\"} %.3F\n"
+			, stats[i].id, trkstat_type_str(stats[i].type), rtf);
+	}
+
+	ffvec_addsz(buf, "# TYPE fmedia_track_buffer_fill_seconds gauge\n");
+	for (uint i = 0;  i != n;  i++) {
+		if (stats[i].type != FMED_TRK_TYPE_PLAYBACK)
+			continue;
+		ffvec_addfmt(buf, "fmedia_track_buffer_fill_seconds{track=\"%u\"} %u.%03u\n"
+			, stats[i].id, stats[i].buf_fill_msec / 1000, stats[i].buf_fill_msec % 1000);
+	}
+}
@@ -20,15 +20,17 @@ Copyright (c) 2016 Simon Zolin */
 
 enum {
 	N_FILTERS = 32, //allow up to this number of filters to be added while track is running
+	N_MONITORS = 4,
 };
 
 struct tracks {
 	ffatomic trkid;
 	fflist trks; //fm_trk[]
-	const struct fmed_trk_mon *mon;
+	const struct fmed_trk_mon *mon[N_MONITORS];
 	const fmed_queue *qu;
 	uint stop_sig :1;
 	uint last :1;
+	uint startup_printed :1;
 };
 
 static struct tracks *g;
@@ -93,11 +95,16 @@ typedef struct fm_trk {
 
 	uint state; //enum TRK_ST
 	uint wflags;
+	uint num;
+	struct trk_stat *stat;
 } fm_trk;
 
+#include <core/track-metrics.h>
+
 
 static int trk_setout_file(fm_trk *t);
 static int trk_opened(fm_trk *t);
+static void trk_mon_sig(fm_trk *t, uint sig);
 static int trk_open(fm_trk *t, const char *fn);
 static void trk_open_capt(fm_trk *t);
 static void trk_free(fm_trk *t);
@@ -198,7 +205,7 @@ static int trk_open(fm_trk *t, const char *fn)
 		ffpath_splitname(name.ptr, name.len, &name, &ext);
 		if (!have_path && ffstr_eqcz(&name, "@stdin"))
 			addfilter(t, "#file.stdin");
-		else
+		else if (!ffstr_eqz(&ext, "fmpl")) // .fmpl file is mapped into memory by plist.fmpl
 			addfilter(t, "#file.in");
 
 		if (ffstr_eqz(&ext, "m3uz"))
@@ -213,6 +220,17 @@ static int trk_open(fm_trk *t, const char *fn)
 	return 0;
 }
 
+/** Add afilter.dsp instance which performs several operations in one pass.
+ops: enum FMED_DSP */
+static void trk_add_dsp(fm_trk *t, uint ops)
+{
+	uint shift = 0;
+	while (t->props.dsp_ops >> shift)
+		shift += 8;
+	t->props.dsp_ops |= ops << shift;
+	addfilter(t, "afilter.dsp");
+}
+
 static void trk_open_capt(fm_trk *t)
 {
 	filt_add_optional(t, "#winsleep.sleep");
@@ -228,8 +246,7 @@ static void trk_open_capt(fm_trk *t)
 	const fmed_modinfo *record_module = core->getmod2(FMED_MOD_INFO_ADEV_IN, NULL, 0);
 	addfilter1(t, record_module);
 
-	addfilter(t, "afilter.until");
-	addfilter(t, "afilter.rtpeak");
+	trk_add_dsp(t, FMED_DSP_UNTIL | FMED_DSP_RTPEAK);
 }
 
 static void filter_add_ui(fm_trk *t)
@@ -240,8 +257,56 @@ static void filter_add_ui(fm_trk *t)
 		addfilter(t, "tui.tui");
 }
 
+/** Use the cache of decoded PCM data.
+Return 1: the input filters are replaced with zstd.pcmcache-in;
+ 0: zstd.pcmcache-out must be added;
+ -1: the track isn't cached */
+static int trk_pcm_cache(fm_trk *t)
+{
+	const fmed_trk *ti = &t->props;
+	if (ti->use_dynanorm
+		|| ti->a_start_level != 0 || ti->a_stop_level != 0
+		|| ti->stream_copy
+		|| ti->audio.abs_seek != 0
+		|| (int64)ti->audio.split != FMED_NULL
+		|| FMED_PNULL != trk_getvalstr(t, "tee")
+		|| FMED_PNULL != trk_getvalstr(t, "cue_tracks"))
+		return -1;
+
+	const fmed_pcmcache *pc = core->getmod("zstd.pcmcache");
+	if (pc == NULL)
+		return -1;
+	int r = pc->open(&t->props);
+	if (r < 0)
+		return -1;
+
+	if (r == 1) {
+		// the cached data must be complete
+		if ((int64)ti->audio.seek != FMED_NULL || (int64)ti->audio.until != FMED_NULL)
+			return -1;
+		return 0;
+	}
+
+	// remove file.in and demuxer which aren't opened yet
+	fmed_f *f;
+	uint input = 0;
+	FFSLICE_WALK(&t->filters, f) {
+		if (input && !f->closed) {
+			ffchain_unlink(&f->sib);
+			f->closed = 1;
+		} else if (ffsz_eq(f->name, "#queue.track")) {
+			input = 1;
+		}
+	}
+	addfilter(t, "zstd.pcmcache-in");
+	return 1;
+}
+
 static int trk_addfilters(fm_trk *t)
 {
+	int pcm_cache = -1;
+	uint dsp_ops;
+
 	switch (t->props.type) {
 	case FMED_TRK_TYPE_PLAYBACK:
 	case FMED_TRK_TYPE_CONVERT:
@@ -287,7 +352,7 @@ static int trk_addfilters(fm_trk *t)
 			addfilter(t, "dynanorm.filter");
 		addfilter(t, "afilter.gain");
 		addfilter(t, "afilter.autoconv");
-		addfilter(t, "afilter.peaks");
+		addfilter(t, (t->props.loudness) ? "afilter.loudness" : "afilter.peaks");
 		return 0;
 
 	case FMED_TRK_TYPE_MIXIN:
@@ -300,44 +365,74 @@ static int trk_addfilters(fm_trk *t)
 	case FMED_TRK_TYPE_REC:
 		filter_add_ui(t);
 
+		dsp_ops = 0;
 		if (t->props.a_start_level != 0)
-			addfilter(t, "afilter.startlevel");
+			dsp_ops |= FMED_DSP_STARTLEV;
 		if (t->props.a_stop_level != 0)
-			addfilter(t, "afilter.stoplevel");
+			dsp_ops |= FMED_DSP_STOPLEV;
 
-		if (t->props.a_prebuffer != 0)
+		if (t->props.a_prebuffer != 0) {
+			if (dsp_ops != 0)
+				trk_add_dsp(t, dsp_ops);
+			dsp_ops = 0;
 			addfilter(t, "afilter.membuf");
+		}
 
-		addfilter(t, "afilter.gain");
+		trk_add_dsp(t, dsp_ops | FMED_DSP_GAIN);
 		addfilter(t, "afilter.autoconv");
 		goto output;
 	}
 
+	if (t->props.pcm_cache
+		&& t->props.type == FMED_TRK_TYPE_CONVERT
+		&& t->props.out_filename != NULL)
+		pcm_cache = trk_pcm_cache(t);
+
 	if (t->props.type != FMED_TRK_TYPE_NETIN) {
 		addfilter(t, "afilter.until");
 		filter_add_ui(t);
 	}
 
+	dsp_ops = 0;
 	if (t->props.a_start_level != 0)
-		addfilter(t, "afilter.startlevel");
+		dsp_ops |= FMED_DSP_STARTLEV;
 	if (t->props.a_stop_level != 0)
-		addfilter(t, "afilter.stoplevel");
+		dsp_ops |= FMED_DSP_STOPLEV;
 
-	if (t->props.use_dynanorm)
+	if (t->props.use_dynanorm) {
+		if (dsp_ops != 0)
+			trk_add_dsp(t, dsp_ops);
+		dsp_ops = 0;
 		addfilter(t, "dynanorm.filter");
+	}
 
-	if (t->props.type != FMED_TRK_TYPE_MIXOUT && !t->props.stream_copy) {
+	if (t->props.type != FMED_TRK_TYPE_MIXOUT && !t->props.stream_copy
+		&& pcm_cache != 1) {
 		ffbool playback = (t->props.type == FMED_TRK_TYPE_PLAYBACK);
 		if (!(playback && t->props.audio.auto_attenuate_ceiling != 0.0))
-			addfilter(t, "afilter.gain");
+			dsp_ops |= FMED_DSP_GAIN;
 	}
 
+	if (dsp_ops != 0)
+		trk_add_dsp(t, dsp_ops);
+
+	if (FMED_PNULL != trk_getvalstr(t, "tee"))
+		addfilter(t, "afilter.tee");
+
 	if ((int64)t->props.audio.split != FMED_NULL) {
 		addfilter(t, "afilter.split");
 		return 0;
 	}
 
+	if (t->props.out_filename != NULL
+		&& FMED_PNULL != trk_getvalstr(t, "cue_tracks")) {
+		addfilter(t, "plist.cuesplit");
+		return 0;
+	}
+
 	addfilter(t, "afilter.autoconv");
+	if (pcm_cache == 0)
+		addfilter(t, "zstd.pcmcache-out");
 
 output:
 	if (t->props.out_filename != NULL) {
@@ -361,16 +456,27 @@ static int trk_opened(fm_trk *t)
 	}
 
 	fflist_ins(&g->trks, &t->sib);
+	trkstat_open(t);
 	t->state = TRK_ST_ACTIVE;
 	t->cur = ffchain_first(&t->filt_chain);
+	trk_mon_sig(t, FMED_TRK_ONSTART);
 	return 0;
 }
 
+/** Notify all monitors. */
+static void trk_mon_sig(fm_trk *t, uint sig)
+{
+	for (uint i = 0;  i != N_MONITORS;  i++) {
+		if (g->mon[i] != NULL)
+			g->mon[i]->onsig(t, sig);
+	}
+}
+
 /*
 Example of a typical chain:
  #queue.track
  -> INPUT
- -> DECODER -> (afilter.until) -> UI -> afilter.gain -> (afilter.conv/conv-soxr) -> (ENCODER)
+ -> DECODER -> (afilter.until) -> UI -> afilter.dsp -> (afilter.conv/conv-soxr) -> (ENCODER)
  -> OUTPUT
 */
 static void* trk_create(uint cmd, const char *fn)
@@ -390,7 +496,8 @@ static void* trk_create(uint cmd, const char *fn)
 	t->props.handler = &trk_process;
 	t->props.trk = t;
 
-	t->id.len = ffs_fmt(t->sid, t->sid + sizeof(t->sid), "*%L", ffatom_incret(&g->trkid));
+	t->num = ffatom_incret(&g->trkid);
+	t->id.len = ffs_fmt(t->sid, t->sid + sizeof(t->sid), "*%u", t->num);
 	t->id.ptr = t->sid;
 
 	dbglog(t, "new track:%p  cmd:%u", t, cmd);
@@ -500,6 +607,8 @@ static void trk_copy_info(fmed_trk *dst, const fmed_trk *src)
 	if (src->out_filename != NULL)
 		dst->out_filename = ffsz_dup(src->out_filename);
 	dst->net_out_filename = src->net_out_filename;
+	dst->net_timeshift = src->net_timeshift;
+	dst->pcm_cache = src->pcm_cache;
 	dst->bits = src->bits;
 }
 
@@ -516,6 +625,15 @@ static void trk_onstop(void *p)
 		trk_fin(t);
 }
 
+/** Continue processing the track on its worker */
+static void trk_resume(fm_trk *t)
+{
+	if (t->wid == 0 && core_ismainthr())
+		trk_process(t);
+	else
+		core->cmd(FMED_TASK_XPOST, &t->tsk, t->wid);
+}
+
 /** Submit track stop event. */
 static void trk_stop(fm_trk *t, uint flags)
 {
@@ -619,16 +737,15 @@ static void trk_free(fm_trk *t)
 	ffrbt_freeall(&t->dict, (ffrbt_free_t)&dict_ent_free, FFOFF(dict_ent, nod));
 	ffrbt_freeall(&t->meta, (ffrbt_free_t)&dict_ent_free, FFOFF(dict_ent, nod));
 
+	trkstat_close(t);
 	if (fflist_exists(&g->trks, &t->sib)) {
 		fflist_rm(&g->trks, &t->sib);
 		core->cmd(FMED_WORKER_RELEASE, t->wid, t->wflags);
 	}
 
-	if (g->mon != NULL) {
-		g->mon->onsig(t, FMED_TRK_ONCLOSE);
-		if (g->last && g->trks.len == 0)
-			g->mon->onsig(t, FMED_TRK_ONLAST);
-	}
+	trk_mon_sig(t, FMED_TRK_ONCLOSE);
+	if (g->last && g->trks.len == 0)
+		trk_mon_sig(t, FMED_TRK_ONLAST);
 
 	ffmem_free(t->props.out_filename);
 	dbglog(t, "closed");
@@ -704,6 +821,15 @@ static int filt_call(fm_trk *t, fmed_f *f)
 
 	t->props.data = f->d.data,  t->props.datalen = f->d.datalen;
 
+	if (t->props.print_time && !g->startup_printed
+		&& f->d.datalen != 0 && filt_islast(t, &f->sib)) {
+		g->startup_printed = 1;
+		fftime d = fftime_monotonic();
+		fftime_sub(&d, &core->props->start_time);
+		infolog1(t, "startup: first data reached %s in %u.%06u sec"
+			, f->name, (int)fftime_sec(&d), (int)fftime_usec(&d));
+	}
+
 	if (!f->opened) {
 		extralog1(t, "creating context for %s...", f->name);
 		f->ctx = f->filt->open(&t->props);
@@ -831,6 +957,7 @@ static void trk_process(void *udata)
 		}
 
 		if (core_job_shouldyield(t->wid, &jobdata)) {
+			trkstat_update(t);
 			trk_cmd(t, FMED_TRACK_WAKE);
 			return;
 		}
@@ -848,6 +975,7 @@ static void trk_process(void *udata)
 			goto fin;
 
 		case FMED_RASYNC:
+			trkstat_update(t);
 			return;
 
 		case FMED_RMORE:
@@ -1264,6 +1392,8 @@ static const char* const cmd_str[] = {
 	"FMED_TRACK_KQ",
 	"FMED_TRACK_XSTART",
 	"FMED_TRACK_STOPPED",
+	"FMED_TRACK_XPOST",
+	"FMED_TRACK_MONITOR_RM",
 };
 
 static ssize_t trk_cmd(void *trk, uint cmd, ...)
@@ -1324,6 +1454,8 @@ static ssize_t trk_cmd(void *trk, uint cmd, ...)
 		}
 
 		t->wflags = (cmd == FMED_TRACK_XSTART) ? FMED_WORKER_FPARALLEL : 0;
+		if (t->props.type == FMED_TRK_TYPE_PLAYBACK || t->props.type == FMED_TRK_TYPE_REC)
+			t->wflags |= FMED_WORKER_FREALTIME;
 		t->wid = core->cmd(FMED_WORKER_ASSIGN, &t->kq, t->wflags);
 
 		core->cmd(FMED_TASK_XPOST, &t->tsk, t->wid);
@@ -1347,7 +1479,7 @@ static ssize_t trk_cmd(void *trk, uint cmd, ...)
 			FFLIST_WALKSAFE(&g->trks, t, sib, next) {
 				if (t->state == TRK_ST_PAUSED) {
 					t->state = TRK_ST_ACTIVE;
-					trk_process(t);
+					trk_resume(t);
 				}
 			}
 			break;
@@ -1355,7 +1487,7 @@ static ssize_t trk_cmd(void *trk, uint cmd, ...)
 
 		if (t->state == TRK_ST_PAUSED) {
 			t->state = TRK_ST_ACTIVE;
-			trk_process(t);
+			trk_resume(t);
 		}
 		break;
 
@@ -1363,14 +1495,19 @@ static ssize_t trk_cmd(void *trk, uint cmd, ...)
 		g->last = 1;
 		if (g->trks.len != 0)
 			break;
-		if (g->mon != NULL)
-			g->mon->onsig(&t->props, FMED_TRK_ONLAST);
+		trk_mon_sig(t, FMED_TRK_ONLAST);
 		break;
 
 	case FMED_TRACK_WAKE:
 		core->cmd(FMED_TASK_XPOST, &t->tsk, t->wid);
 		break;
 
+	case FMED_TRACK_XPOST: {
+		fftask *task = va_arg(va, fftask*);
+		core->cmd(FMED_TASK_XPOST, task, t->wid);
+		break;
+	}
+
 	case FMED_TRACK_FILT_ADDFIRST:
 	case FMED_TRACK_FILT_ADDLAST:
 	case FMED_TRACK_FILT_ADD:
@@ -1458,8 +1595,22 @@ static ssize_t trk_cmd(void *trk, uint cmd, ...)
 	}
 
 	case FMED_TRACK_MONITOR:
-		g->mon = va_arg(va, void*);
+	case FMED_TRACK_MONITOR_RM: {
+		const struct fmed_trk_mon *mon = va_arg(va, void*);
+		r = -1;
+		for (uint i = 0;  i != N_MONITORS;  i++) {
+			if (cmd == FMED_TRACK_MONITOR && g->mon[i] == NULL) {
+				g->mon[i] = mon;
+				r = 0;
+				break;
+			} else if (cmd == FMED_TRACK_MONITOR_RM && g->mon[i] == mon) {
+				g->mon[i] = NULL;
+				r = 0;
+				break;
+			}
+		}
 		break;
+	}
 
 	case FMED_TRACK_KQ:
 		r = (size_t)t->kq;
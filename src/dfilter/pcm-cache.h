@@ -0,0 +1,676 @@
+/** fmedia: --pcm-cache: cache of decoded PCM data
+2023, Simon Zolin */
+
+/*
+Convert:
+#queue.track -> #file.in -> DEMUXER -> DECODER -> ... -> afilter.autoconv -> (afilter.conv) -> zstd.pcmcache-out -> ENCODER
+                                                                                                     |
+                                                                       "USER_PATH/cache/pcm-HASH.bin"
+Convert again with the same settings:
+#queue.track -> zstd.pcmcache-in -> ... -> afilter.autoconv -> ENCODER
+
+The key is the input file name, the requested output format, gain, resampler profile
+ and the output file extension (the encoder defines the format of its input data):
+ every setting that changes the samples written to cache.
+The cache is valid while the source file's size and modification time are unchanged.
+PCM data is split into chunks of 1 second, each chunk is compressed as a separate zstd frame,
+ so seeking requires decompression of 1 chunk only.
+
+HDR KEY META CHUNK... INDEX
+HDR: "fmedpcmc" VER[4] FORMAT[4] CHANNELS[4] RATE[4] ILEAVED[4] NCHUNKS[4]
+  SIZE[8] MTIME_SEC[8] MTIME_NSEC[4] KEY_LEN[4] META_LEN[4] TOTAL_SAMPLES[8] INDEX_OFF[8]
+META: (NAME_LEN[4] NAME VAL_LEN[4] VAL)...
+CHUNK: zstd frame: interleaved samples or channel planes one after another
+INDEX: (OFFSET[8] SAMPLE[8])...
+Numbers are in host byte order.
+The file is written to "pcm-HASH.bin.PID-PTR.tmp" file (unique per process and track)
+ which is renamed after the header is complete.
+
+The total size of "pcm-*.bin" files is limited by "max_size":
+ after a new file is written, the least recently used files are removed.
+ A file's modification time is updated each time it's used.
+*/
+
+#include <FFOS/dirscan.h>
+#include <FFOS/process.h>
+#include <ffbase/murmurhash3.h>
+
+#define PCMC_MAGIC  "fmedpcmc"
+enum {
+	PCMC_VER = 1,
+	PCMC_CHUNK_SEC = 1,
+};
+
+struct pcmc_hdr {
+	char magic[8];
+	uint ver;
+	uint format, channels, rate, ileaved;
+	uint nchunks;
+	uint64 size;
+	uint64 mtime_sec;
+	uint mtime_nsec;
+	uint key_len;
+	uint meta_len;
+	uint reserved;
+	uint64 total;
+	uint64 index_off;
+};
+
+struct pcmc_point {
+	uint64 off;
+	uint64 sample;
+};
+
+static struct pcmc_conf_t {
+	size_t max_size;
+} pcmc_conf;
+
+static const fmed_conf_arg pcmc_conf_args[] = {
+	{ "max_size",	FMC_SIZE,  FMC_O(struct pcmc_conf_t, max_size) },
+	{}
+};
+
+static int pcmc_config(fmed_conf_ctx *ctx)
+{
+	pcmc_conf.max_size = 1024*1024*1024;
+	fmed_conf_addctx(ctx, &pcmc_conf, pcmc_conf_args);
+	return 0;
+}
+
+/** Get the cache key and file name for the track */
+static int pcmc_key(fmed_track_info *ti, ffvec *key, char **name)
+{
+	const char *fn = ti->track->getvalstr(ti->trk, "input");
+	if (fn == FMED_PNULL
+		|| core->props->user_path == NULL
+		|| ti->out_filename == NULL)
+		return -1;
+
+	ffstr ext;
+	ffpath_split3_str(FFSTR_Z(ti->out_filename), NULL, NULL, &ext);
+
+	// soxr.conv uses its offline default for a conversion track
+	int soxr_prof = ti->soxr.profile;
+	if (soxr_prof < 0 || soxr_prof > FMED_SOXR_VHQ)
+		soxr_prof = FMED_SOXR_VHQ;
+
+	ffvec_addfmt(key, "%s|%u/%u/%u|%d|soxr:%d|%S"
+		, fn, ti->audio.fmt.format, ti->audio.fmt.channels, ti->audio.fmt.sample_rate
+		, ti->audio.gain, soxr_prof, &ext);
+
+	uint hash = murmurhash3(key->ptr, key->len, 0x12345678);
+	*name = ffsz_allocfmt("%scache%cpcm-%08xu.bin"
+		, core->props->user_path, FFPATH_SLASH, hash);
+	return 0;
+}
+
+/** Read and check the header and the key */
+static int pcmc_hdr_read(fffd f, const ffstr *key, const fffileinfo *src, struct pcmc_hdr *h)
+{
+	if ((ssize_t)sizeof(*h) != fffile_readat(f, h, sizeof(*h), 0))
+		return -1;
+
+	fftime mt = fffileinfo_mtime(src);
+	if (ffmem_cmp(h->magic, PCMC_MAGIC, 8)
+		|| h->ver != PCMC_VER
+		|| h->nchunks == 0
+		|| h->channels == 0 || h->channels > 8
+		|| h->rate == 0
+		|| h->size != fffileinfo_size(src)
+		|| h->mtime_sec != (uint64)mt.sec || h->mtime_nsec != mt.nsec
+		|| h->key_len != key->len)
+		return -1;
+
+	int rc = -1;
+	ffvec k = {};
+	ffvec_alloc(&k, key->len, 1);
+	if ((ssize_t)key->len == fffile_readat(f, k.ptr, key->len, sizeof(*h))
+		&& !ffmem_cmp(k.ptr, key->ptr, key->len))
+		rc = 0;
+	ffvec_free(&k);
+	return rc;
+}
+
+/** Prepare the cache for the track.  Thread: main. */
+static int pcmc_open(fmed_track_info *ti)
+{
+	int rc = -1;
+	fffd f = FFFILE_NULL;
+	ffvec key = {};
+	char *name = NULL;
+	if (0 != pcmc_key(ti, &key, &name))
+		goto end;
+
+	const char *fn = ti->track->getvalstr(ti->trk, "input");
+	fffileinfo fi;
+	if (0 != fffile_infofn(fn, &fi))
+		goto end;
+
+	rc = 1;
+	struct pcmc_hdr h;
+	ffstr k;
+	ffstr_setstr(&k, &key);
+	if (FFFILE_NULL != (f = fffile_open(name, FFFILE_READONLY))
+		&& 0 == pcmc_hdr_read(f, &k, &fi, &h)) {
+		dbglog1(ti->trk, "PCM cache: using %s", name);
+		fftime now;
+		fftime_now(&now);
+		fffile_set_mtime_path(name, &now); // LRU
+		rc = 0;
+	}
+
+	ti->track->setvalstr4(ti->trk, "pcm_cache", name, FMED_TRK_FACQUIRE);
+	ti->track->setvalstr4(ti->trk, "pcm_cache_key", ffsz_dupn(key.ptr, key.len), FMED_TRK_FACQUIRE);
+	name = NULL;
+
+end:
+	if (f != FFFILE_NULL)
+		fffile_close(f);
+	ffvec_free(&key);
+	ffmem_free(name);
+	return rc;
+}
+
+struct pcmc_file {
+	char *name;
+	uint64 size;
+	fftime mtime;
+};
+
+/** Remove the least recently used cache files until their total size is within the limit */
+static void pcmc_trim(fmed_track_info *ti, const char *keep)
+{
+	ffdirscan ds = {};
+	ffvec files = {}; // struct pcmc_file[]
+	uint64 total = 0;
+	char *dir = ffsz_allocfmt("%scache", core->props->user_path);
+	if (0 != ffdirscan_open(&ds, dir, FFDIRSCAN_NOSORT))
+		goto end;
+
+	const char *fn;
+	while (NULL != (fn = ffdirscan_next(&ds))) {
+		ffstr name = FFSTR_INITZ(fn);
+		if (!(ffstr_matchz(&name, "pcm-") && ffstr_irmatchcz(&name, ".bin")))
+			continue;
+
+		char *full = ffsz_allocfmt("%s%c%s", dir, FFPATH_SLASH, fn);
+		fffileinfo fi;
+		if (ffsz_eq(full, keep)
+			|| 0 != fffile_infofn(full, &fi)) {
+			ffmem_free(full);
+			continue;
+		}
+		struct pcmc_file *f = ffvec_pushT(&files, struct pcmc_file);
+		f->name = full;
+		f->size = fffileinfo_size(&fi);
+		f->mtime = fffileinfo_mtime(&fi);
+		total += f->size;
+	}
+
+	fffileinfo fi;
+	if (0 == fffile_infofn(keep, &fi))
+		total += fffileinfo_size(&fi);
+
+	while (total > pcmc_conf.max_size) {
+		struct pcmc_file *f, *old = NULL;
+		FFSLICE_WALK(&files, f) {
+			if (f->name != NULL
+				&& (old == NULL
+					|| f->mtime.sec < old->mtime.sec
+					|| (f->mtime.sec == old->mtime.sec && f->mtime.nsec < old->mtime.nsec)))
+				old = f;
+		}
+		if (old == NULL)
+			break;
+
+		dbglog1(ti->trk, "PCM cache: removing %s (%U bytes)", old->name, old->size);
+		fffile_remove(old->name);
+		total -= old->size;
+		ffmem_free(old->name);
+		old->name = NULL;
+	}
+
+end:
+	ffdirscan_close(&ds);
+	struct pcmc_file *f;
+	FFSLICE_WALK(&files, f) {
+		ffmem_free(f->name);
+	}
+	ffvec_free(&files);
+	ffmem_free(dir);
+}
+
+static const fmed_pcmcache pcmcache_iface = {
+	pcmc_open
+};
+
+
+struct pcmcw {
+	uint state;
+	fffd f;
+	const char *name;
+	char *tmpname;
+	zstd_encoder *zst;
+	ffstr key;
+	struct pcmc_hdr hdr;
+	uint ss; // sample size (1 channel)
+	uint chunk_samples;
+	uint nsamples; // samples in chunk buffer
+	ffvec buf; // uncompressed chunk
+	ffvec zbuf;
+	ffvec index; // struct pcmc_point[]
+	uint64 off;
+	uint done :1;
+};
+
+static void pcmcw_close(void *ctx)
+{
+	struct pcmcw *c = ctx;
+	if (c->f != FFFILE_NULL) {
+		fffile_close(c->f);
+		if (!c->done)
+			fffile_remove(c->tmpname);
+	}
+	if (c->zst != NULL)
+		zstd_encode_free(c->zst);
+	ffmem_free(c->tmpname);
+	ffvec_free(&c->buf);
+	ffvec_free(&c->zbuf);
+	ffvec_free(&c->index);
+	ffmem_free(c);
+}
+
+static void* pcmcw_open(fmed_track_info *ti)
+{
+	struct pcmcw *c = ffmem_new(struct pcmcw);
+	c->f = FFFILE_NULL;
+	c->name = ti->track->getvalstr(ti->trk, "pcm_cache");
+	const char *key = ti->track->getvalstr(ti->trk, "pcm_cache_key");
+	if (c->name == FMED_PNULL || key == FMED_PNULL)
+		goto err;
+	ffstr_setz(&c->key, key);
+
+	const char *fn = ti->track->getvalstr(ti->trk, "input");
+	fffileinfo fi;
+	if (0 != fffile_infofn(fn, &fi))
+		goto err;
+	ffmem_copy(c->hdr.magic, PCMC_MAGIC, 8);
+	c->hdr.ver = PCMC_VER;
+	c->hdr.size = fffileinfo_size(&fi);
+	fftime mt = fffileinfo_mtime(&fi);
+	c->hdr.mtime_sec = mt.sec;
+	c->hdr.mtime_nsec = mt.nsec;
+	c->hdr.key_len = c->key.len;
+
+	c->tmpname = ffsz_allocfmt("%s.%u-%p.tmp", c->name, ffps_curid(), c);
+	uint flags = FFFILE_CREATE | FFFILE_TRUNCATE | FFFILE_WRITEONLY;
+	if (FFFILE_NULL == (c->f = fmed_file_create(c->tmpname, flags))) {
+		dbglog1(ti->trk, "PCM cache: can't create file: %s: %E", c->tmpname, fferr_last());
+		goto err;
+	}
+
+	zstd_enc_conf zc = {};
+	zc.level = 1;
+	zc.workers = 1;
+	if (0 != zstd_encode_init(&c->zst, &zc))
+		goto err;
+	return c;
+
+err:
+	pcmcw_close(c);
+	return FMED_FILT_SKIP;
+}
+
+/** Write header, key and meta data */
+static int pcmcw_hdr(struct pcmcw *c, fmed_track_info *ti)
+{
+	const ffpcmex *f = &ti->audio.convfmt;
+	c->hdr.format = f->format;
+	c->hdr.channels = f->channels;
+	c->hdr.rate = f->sample_rate;
+	c->hdr.ileaved = f->ileaved;
+	c->ss = ffpcm_size(f->format, 1);
+	c->chunk_samples = f->sample_rate * PCMC_CHUNK_SEC;
+	if (c->ss == 0 || c->hdr.channels == 0 || c->hdr.channels > 8 || c->chunk_samples == 0)
+		return -1;
+	ffvec_alloc(&c->buf, c->chunk_samples * c->ss * c->hdr.channels, 1);
+
+	ffvec d = {};
+	ffvec_add(&d, &c->hdr, sizeof(c->hdr), 1);
+	ffvec_addstr(&d, &c->key);
+
+	fmed_trk_meta meta = {};
+	meta.flags = FMED_QUE_UNIQ;
+	while (0 == ti->track->cmd2(ti->trk, FMED_TRACK_META_ENUM, &meta)) {
+		uint n = meta.name.len;
+		ffvec_add(&d, &n, 4, 1);
+		ffvec_addstr(&d, &meta.name);
+		n = meta.val.len;
+		ffvec_add(&d, &n, 4, 1);
+		ffvec_addstr(&d, &meta.val);
+	}
+	c->hdr.meta_len = d.len - sizeof(c->hdr) - c->key.len;
+
+	int r = fffile_writeat(c->f, d.ptr, d.len, 0);
+	c->off = d.len;
+	ffvec_free(&d);
+	return (r >= 0) ? 0 : -1;
+}
+
+/** Compress and write the data in chunk buffer */
+static int pcmcw_flush(struct pcmcw *c)
+{
+	if (c->nsamples == 0)
+		return 0;
+
+	uint nch = c->hdr.channels;
+	if (!c->hdr.ileaved && c->nsamples != c->chunk_samples) {
+		// move channel planes together
+		for (uint i = 1;  i != nch;  i++) {
+			ffmem_move((char*)c->buf.ptr + i * c->nsamples * c->ss
+				, (char*)c->buf.ptr + i * c->chunk_samples * c->ss
+				, c->nsamples * c->ss);
+		}
+	}
+	size_t n = c->nsamples * c->ss * nch;
+
+	ffvec_alloc(&c->zbuf, n + n / 8 + 64*1024, 1);
+	zstd_buf in, out;
+	zstd_buf_set(&in, c->buf.ptr, n);
+	zstd_buf_set(&out, c->zbuf.ptr, c->zbuf.cap);
+	for (;;) {
+		int r = zstd_encode(c->zst, &in, &out, ZSTD_FFINISH);
+		if (r < 0)
+			return -1;
+		if (r == 0)
+			break;
+		if (out.pos == c->zbuf.cap) {
+			c->zbuf.len = out.pos;
+			ffvec_grow(&c->zbuf, c->zbuf.cap, 1);
+			zstd_buf_set(&out, c->zbuf.ptr, c->zbuf.cap);
+			out.pos = c->zbuf.len;
+		}
+	}
+
+	if (0 > fffile_writeat(c->f, c->zbuf.ptr, out.pos, c->off))
+		return -1;
+
+	struct pcmc_point *p = ffvec_pushT(&c->index, struct pcmc_point);
+	p->off = c->off;
+	p->sample = c->hdr.total;
+	c->off += out.pos;
+	c->hdr.total += c->nsamples;
+	c->nsamples = 0;
+	return 0;
+}
+
+static int pcmcw_add(struct pcmcw *c, fmed_track_info *ti)
+{
+	uint nch = c->hdr.channels, frame = c->ss * nch;
+	size_t samples = ti->datalen / frame, off = 0;
+	while (off != samples) {
+		size_t n = ffmin(samples - off, c->chunk_samples - c->nsamples);
+		if (c->hdr.ileaved) {
+			ffmem_copy((char*)c->buf.ptr + c->nsamples * frame, ti->data + off * frame, n * frame);
+		} else {
+			for (uint i = 0;  i != nch;  i++) {
+				ffmem_copy((char*)c->buf.ptr + (i * c->chunk_samples + c->nsamples) * c->ss
+					, (char*)ti->datani[i] + off * c->ss, n * c->ss);
+			}
+		}
+		c->nsamples += n;
+		off += n;
+		if (c->nsamples == c->chunk_samples
+			&& 0 != pcmcw_flush(c))
+			return -1;
+	}
+	return 0;
+}
+
+static int pcmcw_fin(struct pcmcw *c, fmed_track_info *ti)
+{
+	if (0 != pcmcw_flush(c))
+		return -1;
+
+	c->hdr.nchunks = c->index.len;
+	c->hdr.index_off = c->off;
+	if (c->hdr.nchunks == 0
+		|| 0 > fffile_writeat(c->f, c->index.ptr, c->index.len * sizeof(struct pcmc_point), c->off)
+		|| 0 > fffile_writeat(c->f, &c->hdr, sizeof(c->hdr), 0))
+		return -1;
+
+	fffile_close(c->f);
+	c->f = FFFILE_NULL;
+	if (0 != fffile_rename(c->tmpname, c->name)) {
+		fffile_remove(c->tmpname);
+		return -1;
+	}
+	dbglog1(ti->trk, "PCM cache: written %U samples (%u chunks) to %s"
+		, c->hdr.total, c->hdr.nchunks, c->name);
+	c->done = 1;
+	pcmc_trim(ti, c->name);
+	return 0;
+}
+
+static int pcmcw_process(void *ctx, fmed_track_info *ti)
+{
+	struct pcmcw *c = ctx;
+
+	if (ti->datalen != 0 && c->state != 2) {
+		if (c->state == 0 && 0 != pcmcw_hdr(c, ti))
+			c->state = 2;
+		else
+			c->state = 1;
+	}
+
+	if (c->state == 1 && ti->datalen != 0 && 0 != pcmcw_add(c, ti)) {
+		dbglog1(ti->trk, "PCM cache: write error: %E", fferr_last());
+		c->state = 2;
+	}
+
+	if (c->state == 1 && (ti->flags & FMED_FLAST)
+		&& !(ti->flags & FMED_FSTOP)
+		&& 0 != pcmcw_fin(c, ti)) {
+		dbglog1(ti->trk, "PCM cache: write error: %E", fferr_last());
+		c->state = 2;
+	}
+
+	ti->out = ti->data;
+	ti->outlen = ti->datalen;
+	ti->datalen = 0;
+	return (ti->flags & FMED_FLAST) ? FMED_RDONE : FMED_ROK;
+}
+
+const fmed_filter pcmcache_write = { pcmcw_open, pcmcw_process, pcmcw_close };
+
+
+struct pcmcr {
+	fffd f;
+	zstd_decoder *zst;
+	struct pcmc_hdr hdr;
+	ffvec index; // struct pcmc_point[]
+	ffvec zbuf;
+	ffvec buf;
+	uint ss;
+	uint ichunk;
+	uint skip; // samples to skip in the current chunk after seek
+	void *planes[8];
+};
+
+static void pcmcr_close(void *ctx)
+{
+	struct pcmcr *c = ctx;
+	if (c->f != FFFILE_NULL)
+		fffile_close(c->f);
+	if (c->zst != NULL)
+		zstd_decode_free(c->zst);
+	ffvec_free(&c->index);
+	ffvec_free(&c->zbuf);
+	ffvec_free(&c->buf);
+	ffmem_free(c);
+}
+
+/** Pass meta data to the track */
+static int pcmcr_meta(struct pcmcr *c, fmed_track_info *ti)
+{
+	ffvec d = {};
+	int rc = -1;
+	ffvec_alloc(&d, c->hdr.meta_len, 1);
+	if ((ssize_t)c->hdr.meta_len != fffile_readat(c->f, d.ptr, c->hdr.meta_len, sizeof(c->hdr) + c->hdr.key_len))
+		goto end;
+
+	ffstr m = FFSTR_INITN(d.ptr, c->hdr.meta_len), name, val;
+	while (m.len != 0) {
+		uint n;
+		if (m.len < 4 || m.len - 4 < (n = *(uint*)m.ptr))
+			goto end;
+		ffstr_set(&name, m.ptr + 4, n);
+		ffstr_shift(&m, 4 + n);
+		if (m.len < 4 || m.len - 4 < (n = *(uint*)m.ptr))
+			goto end;
+		ffstr_set(&val, m.ptr + 4, n);
+		ffstr_shift(&m, 4 + n);
+		ti->track->meta_set(ti->trk, &name, &val, FMED_QUE_TMETA);
+	}
+	rc = 0;
+
+end:
+	ffvec_free(&d);
+	return rc;
+}
+
+static void* pcmcr_open(fmed_track_info *ti)
+{
+	struct pcmcr *c = ffmem_new(struct pcmcr);
+	c->f = FFFILE_NULL;
+	const char *name = ti->track->getvalstr(ti->trk, "pcm_cache");
+	const char *key = ti->track->getvalstr(ti->trk, "pcm_cache_key");
+	const char *fn = ti->track->getvalstr(ti->trk, "input");
+	fffileinfo fi;
+	ffstr k = FFSTR_INITZ(key);
+	if (name == FMED_PNULL || key == FMED_PNULL
+		|| 0 != fffile_infofn(fn, &fi)
+		|| FFFILE_NULL == (c->f = fffile_open(name, FFFILE_READONLY))
+		|| 0 != pcmc_hdr_read(c->f, &k, &fi, &c->hdr)) {
+		errlog1(ti->trk, "PCM cache: invalid file: %s", name);
+		goto err;
+	}
+
+	size_t n = c->hdr.nchunks * sizeof(struct pcmc_point);
+	ffvec_alloc(&c->index, n, 1);
+	if ((ssize_t)n != fffile_readat(c->f, c->index.ptr, n, c->hdr.index_off)) {
+		errlog1(ti->trk, "PCM cache: file read: %s", name);
+		goto err;
+	}
+	c->index.len = c->hdr.nchunks;
+
+	if (0 != pcmcr_meta(c, ti)) {
+		errlog1(ti->trk, "PCM cache: bad meta data: %s", name);
+		goto err;
+	}
+
+	zstd_dec_conf zc = {};
+	if (0 != zstd_decode_init(&c->zst, &zc))
+		goto err;
+
+	c->ss = ffpcm_size(c->hdr.format, 1);
+	ffvec_alloc(&c->buf, c->hdr.rate * PCMC_CHUNK_SEC * c->ss * c->hdr.channels, 1);
+
+	ti->audio.decoder = "PCM cache";
+	ti->audio.fmt.format = c->hdr.format;
+	ti->audio.fmt.channels = c->hdr.channels;
+	ti->audio.fmt.sample_rate = c->hdr.rate;
+	ti->audio.fmt.ileaved = c->hdr.ileaved;
+	ti->audio.total = c->hdr.total;
+	ti->datatype = "pcm";
+	return c;
+
+err:
+	pcmcr_close(c);
+	return NULL;
+}
+
+/** Read and decompress the chunk */
+static int pcmcr_chunk(struct pcmcr *c, uint i, size_t *samples)
+{
+	const struct pcmc_point *p = c->index.ptr;
+	uint64 end_off = (i + 1 != c->index.len) ? p[i + 1].off : c->hdr.index_off;
+	uint64 end_sample = (i + 1 != c->index.len) ? p[i + 1].sample : c->hdr.total;
+	size_t n = end_off - p[i].off;
+	*samples = end_sample - p[i].sample;
+	size_t size = *samples * c->ss * c->hdr.channels;
+	if (size > c->buf.cap)
+		return -1;
+
+	ffvec_alloc(&c->zbuf, n, 1);
+	if ((ssize_t)n != fffile_readat(c->f, c->zbuf.ptr, n, p[i].off))
+		return -1;
+
+	zstd_buf in, out;
+	zstd_buf_set(&in, c->zbuf.ptr, n);
+	zstd_buf_set(&out, c->buf.ptr, size);
+	while (out.pos != size) {
+		size_t ipos = in.pos, opos = out.pos;
+		if (0 > zstd_decode(c->zst, &in, &out))
+			return -1;
+		if (in.pos == ipos && out.pos == opos)
+			return -1; // incomplete data
+	}
+	return 0;
+}
+
+static int pcmcr_process(void *ctx, fmed_track_info *ti)
+{
+	struct pcmcr *c = ctx;
+
+	if (ti->flags & FMED_FSTOP) {
+		ti->outlen = 0;
+		return FMED_RLASTOUT;
+	}
+
+	if (ti->seek_req && (int64)ti->audio.seek != FMED_NULL) {
+		ti->seek_req = 0;
+		uint64 sample = ffpcm_samples(ti->audio.seek, c->hdr.rate);
+		const struct pcmc_point *p = c->index.ptr;
+		size_t lo = 0, hi = c->index.len;
+		while (hi - lo > 1) {
+			size_t i = lo + (hi - lo) / 2;
+			if (p[i].sample <= sample)
+				lo = i;
+			else
+				hi = i;
+		}
+		c->ichunk = lo;
+		c->skip = ffmin(sample - p[lo].sample, (uint64)c->hdr.rate * PCMC_CHUNK_SEC);
+	}
+
+	if (c->ichunk == c->index.len) {
+		ti->outlen = 0;
+		return FMED_RDONE;
+	}
+
+	size_t samples;
+	if (0 != pcmcr_chunk(c, c->ichunk, &samples)) {
+		errlog1(ti->trk, "PCM cache: bad chunk #%u", c->ichunk);
+		return FMED_RERR;
+	}
+	const struct pcmc_point *p = ffslice_itemT(&c->index, c->ichunk, struct pcmc_point);
+	uint skip = ffmin(c->skip, samples);
+	ti->audio.pos = p->sample + skip;
+	c->ichunk++;
+	c->skip = 0;
+
+	uint nch = c->hdr.channels;
+	if (c->hdr.ileaved) {
+		ti->out = (char*)c->buf.ptr + skip * c->ss * nch;
+	} else {
+		for (uint i = 0;  i != nch;  i++) {
+			c->planes[i] = (char*)c->buf.ptr + (i * samples + skip) * c->ss;
+		}
+		ti->outni = c->planes;
+	}
+	ti->outlen = (samples - skip) * c->ss * nch;
+	return FMED_RDATA;
+}
+
+const fmed_filter pcmcache_read = { pcmcr_open, pcmcr_process, pcmcr_close };
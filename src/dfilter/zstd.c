@@ -6,9 +6,11 @@
 
 static const fmed_core *core;
 #define errlog1(trk, ...)  fmed_errlog(core, trk, NULL, __VA_ARGS__)
+#define dbglog1(trk, ...)  fmed_dbglog(core, trk, NULL, __VA_ARGS__)
 
 #include <dfilter/zstd-comp.h>
 #include <dfilter/zstd-decomp.h>
+#include <dfilter/pcm-cache.h>
 
 static const void* fmzstd_iface(const char *name)
 {
@@ -16,13 +18,25 @@ static const void* fmzstd_iface(const char *name)
 		return &fmed_zstdw;
 	else if (ffsz_eq(name, "decompress"))
 		return &fmed_zstdr;
+	else if (ffsz_eq(name, "pcmcache"))
+		return &pcmcache_iface;
+	else if (ffsz_eq(name, "pcmcache-in"))
+		return &pcmcache_read;
+	else if (ffsz_eq(name, "pcmcache-out"))
+		return &pcmcache_write;
 	return NULL;
 }
+static int fmzstd_conf(const char *name, fmed_conf_ctx *ctx)
+{
+	if (ffsz_eq(name, "pcmcache"))
+		return pcmc_config(ctx);
+	return -1;
+}
 static int fmzstd_sig(uint signo) { return 0; }
 static void fmzstd_destroy(void) {}
 static const fmed_mod fmed_zstd = {
 	.ver = FMED_VER_FULL, .ver_core = FMED_VER_CORE,
-	fmzstd_iface, fmzstd_sig, fmzstd_destroy, NULL
+	fmzstd_iface, fmzstd_sig, fmzstd_destroy, fmzstd_conf
 };
 
 FF_EXP const fmed_mod* fmed_getmod(const fmed_core *_core)
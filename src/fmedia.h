@@ -9,6 +9,8 @@ Copyright (c) 2015 Simon Zolin */
 #include <util/ffos-compat/asyncio.h>
 #include <afilter/pcm.h>
 #include <FFOS/file.h>
+#include <FFOS/dir.h>
+#include <FFOS/process.h>
 #include <FFOS/error.h>
 #include <FFOS/timerqueue.h>
 #include <util/util.h>
@@ -141,10 +143,17 @@ enum FMED_CMD {
 	/** Delete task from worker thread's queue.
 	core->cmd(FMED_XDEL, fmed_worker_task *w); */
 	FMED_XDEL,
+
+	/** Append the current values of the counters in Prometheus text format.
+	The values are read without locking, so the call never blocks the workers.
+	Thread: any.
+	core->cmd(FMED_METRICS, ffvec *buf) */
+	FMED_METRICS,
 };
 
 enum FMED_WORKER_F {
 	FMED_WORKER_FPARALLEL = 1,
+	FMED_WORKER_FREALTIME = 2, // use the real-time worker (playback, recording) if it's enabled
 };
 
 enum FMED_FT {
@@ -223,6 +232,8 @@ struct fmed_core {
 	void (*task)(fftask *task, uint cmd);
 
 	/** Set timer on the main worker.
+	The handler is always called on the main thread.
+	A call from another thread is applied asynchronously by the main thread.
 	@interval:  >0: periodic;  <0: one-shot;  0: disable.
 	Return 0 on success. */
 	int (*timer)(fftimerqueue_node *tmr, int64 interval, uint flags);
@@ -234,6 +245,53 @@ static inline void fmed_timer_set(fftimerqueue_node *t, fftimerqueue_func func,
 	t->param = param;
 }
 
+/** Open or create a file (e.g. a cache file in user directory);
+ create the parent directories if they don't exist.
+Return FFFILE_NULL on error (fferr_last() is set). */
+static inline fffd fmed_file_create(const char *fn, uint flags)
+{
+	fffd f = fffile_open(fn, flags);
+	if (f == FFFILE_NULL
+		&& fferr_nofile(fferr_last())
+		&& !(0 != ffdir_make_path((char*)fn, 0) && fferr_last() != EEXIST))
+		f = fffile_open(fn, flags);
+	return f;
+}
+
+/** Write a file via "FILE.PID.tmp" which is then renamed, so a reader never sees partial data
+ (and the processes writing the same file at once don't write to the same temporary file);
+ create the parent directories if they don't exist.
+Return 0 on success;  -1 on error (fferr_last() is set). */
+static inline int fmed_file_writewhole(const char *fn, const void *data, size_t len)
+{
+	int rc = -1;
+	char *tmpname = ffsz_allocfmt("%s.%u.tmp", fn, ffps_curid());
+	fffd f = fmed_file_create(tmpname, FFFILE_CREATE | FFFILE_TRUNCATE | FFFILE_WRITEONLY);
+	if (f == FFFILE_NULL)
+		goto end;
+
+	if ((ffssize)len != fffile_write(f, data, len)) {
+		fffile_close(f);
+		goto fail;
+	}
+	fffile_close(f);
+
+	if (0 != fffile_rename(tmpname, fn))
+		goto fail;
+	rc = 0;
+	goto end;
+
+fail: {
+	int e = fferr_last();
+	fffile_remove(tmpname);
+	fferr_set(e);
+	}
+
+end:
+	ffmem_free(tmpname);
+	return rc;
+}
+
 enum FMED_INSTANCE_MODE {
 	FMED_IM_OFF,
 	FMED_IM_ADD,
@@ -250,6 +308,7 @@ struct fmed_props {
 	uint tui :1; // TUI is enabled
 	uint stdout_color :1;
 	uint stderr_color :1;
+	uint log_text_level; // messages with a higher level go only to the binary trace;  0: all messages are printed as text
 	char *version_str; // "X.XX[.XX]"
 
 	/** Path to user configuration directory (with the trailing slash).
@@ -263,6 +322,23 @@ struct fmed_props {
 
 	char language[8];
 	uint codepage;
+
+	fftime start_time; // monotonic time when core was initialized
+	const ffcpuset *io_cpus; // CPU affinity for file I/O threads;  NULL: not set
+
+	/** Process-wide counters.
+	Modules update them with ffint_fetch_add(); FMED_METRICS reads them without locking. */
+	struct {
+		uint64 file_read_bytes;
+		uint64 file_read_stalls; // processing waited for asynchronous read
+		uint64 file_reads; // read requests (fffileread_stat)
+		uint64 file_read_cached; // cache hits (fffileread_stat)
+		uint64 file_write_bytes;
+		uint64 file_write_stalls; // processing waited for asynchronous write
+		uint64 file_writes; // fffilewrite_getstat
+		uint64 net_read_bytes;
+		uint64 net_reconnects;
+	} metrics;
 };
 
 typedef ffconf_arg fmed_conf_arg;
@@ -399,6 +475,8 @@ enum FMED_TRACK_CMD {
 	track->cmd(trk, FMED_TRACK_WAKE); */
 	FMED_TRACK_WAKE,
 
+	/** Associate monitor interface with tracks.  Several monitors may be set.
+	track->cmd(NULL, FMED_TRACK_MONITOR, const struct fmed_trk_mon *mon) */
 	FMED_TRACK_MONITOR,
 
 	/** Get kernel queue associated with this track.
@@ -412,6 +490,15 @@ enum FMED_TRACK_CMD {
 	/** Mark the track as stopped (as if user has pressed Stop button).
 	'queue' module won't start the next track. */
 	FMED_TRACK_STOPPED,
+
+	/** Run a function within the worker thread which processes the track.
+	Use it to modify the track's data from another thread.
+	track->cmd(trk, FMED_TRACK_XPOST, fftask *task) */
+	FMED_TRACK_XPOST,
+
+	/** Remove monitor interface.
+	track->cmd(NULL, FMED_TRACK_MONITOR_RM, const struct fmed_trk_mon *mon) */
+	FMED_TRACK_MONITOR_RM,
 };
 
 enum FMED_TRK_TYPE {
@@ -507,11 +594,14 @@ typedef struct fmed_trk_meta {
 } fmed_trk_meta;
 
 enum FMED_TRK_MON {
-	FMED_TRK_ONCLOSE,
-	FMED_TRK_ONLAST,
+	FMED_TRK_ONCLOSE, // track object is about to be destroyed
+	FMED_TRK_ONLAST, // the last track is closed
+	FMED_TRK_ONSTART, // track is started
 };
 struct fmed_trk_mon {
-	/** Called within the worker thread when track object is about to be destroyed. */
+	/** FMED_TRK_ONSTART: called within the thread which starts the track (not always the main thread);
+	 the other signals: called within the main thread.
+	sig: enum FMED_TRK_MON */
 	void (*onsig)(fmed_track_obj *trk, uint sig);
 };
 /** Associate monitor interface with tracks. */
@@ -609,8 +699,10 @@ struct fmed_track_info {
 	float a_stop_level; //dB
 	uint a_stop_level_time; //msec
 	uint a_stop_level_mintime; //msec
+	uint dsp_ops; // operations for afilter.dsp instances: 8 bits (enum FMED_DSP) per instance in chain order
 	ushort a_in_buf_time; // buffer size for audio input (msec)  0:default
 	ushort a_out_buf_time; // buffer size for audio output (msec)  0:default
+	uint a_out_buf_fill; // audio output: estimated amount of queued audio data (msec)
 	uint a_enc_delay;
 	uint a_end_padding;
 	uint a_frame_samples;
@@ -624,6 +716,11 @@ struct fmed_track_info {
 	fftime out_mtime;
 	/** net.in sets out_filename from this. */
 	const char *net_out_filename;
+	uint net_timeshift; // time-shift buffer size for live streams (MB);  0:disabled
+	int net_tshift_seek; // UI -> net.httpcli: move time-shift read position (msec);  0:none
+	byte net_tshift_on; // net.httpcli -> UI: time-shift buffer is active
+	byte net_tshift_save; // UI -> net.httpcli: mark the start of range or save the range
+	byte pcm_cache; // convert: read decoded PCM data from cache or write it (zstd.pcmcache)
 	const char *playlist_heal_options;
 
 	ffvec meta; // {char*, char*}[]
@@ -680,7 +777,12 @@ struct fmed_track_info {
 	} flac;
 	struct {
 		signed char gaps;
+		signed char single_pass; // 1: decode .cue image once and split it into output files
 	} cue;
+	struct {
+		signed char profile; // enum FMED_SOXR_PROFILE
+		signed char threads; // 0:auto
+	} soxr;
 
 	struct {
 		uint64 size;
@@ -728,7 +830,13 @@ struct fmed_track_info {
 		/** Write data to ".tmp" file, then rename file on completion */
 		uint out_name_tmp :1;
 
-		uint reserve :3;
+		/** Demuxer reads the whole file to build the seek index (with 'input_info') */
+		uint seek_index_build :1;
+
+		/** afilter.loudness is used instead of afilter.peaks in PCMINFO track */
+		uint loudness :1;
+		/** afilter.loudness writes ReplayGain tags when all tracks are finished */
+		uint loudness_write_tags :1;
 	};
 	};
 
@@ -754,6 +862,15 @@ struct fmed_track_info {
 	};
 };
 
+/** Operations performed by afilter.dsp in one pass over PCM data */
+enum FMED_DSP {
+	FMED_DSP_UNTIL = 1, // --until
+	FMED_DSP_RTPEAK = 2, // set audio.maxpeak
+	FMED_DSP_STARTLEV = 4, // --start-level
+	FMED_DSP_STOPLEV = 8, // --stop-level
+	FMED_DSP_GAIN = 0x10, // audio.gain
+};
+
 enum FMED_R {
 	FMED_ROK //output data is ready.  The module will be called again if there's unprocessed input data.
 	, FMED_RDATA //output data is ready, the module will be called again
@@ -816,6 +933,14 @@ struct fmed_aconv {
 	ffpcmex in, out;
 };
 
+/** Sample rate conversion profiles (soxr.conv).
+Default: LOWLATENCY for playback and recording;  VHQ for conversion into a file. */
+enum FMED_SOXR_PROFILE {
+	FMED_SOXR_LOWLATENCY, // medium quality, minimum phase: short filter delay
+	FMED_SOXR_HQ, // high quality, linear phase
+	FMED_SOXR_VHQ, // very high quality, linear phase, dither, multi-threaded
+};
+
 static FFINL int64 fmed_popval_def(fmed_filt *d, const char *name, int64 def)
 {
 	int64 n;
@@ -890,6 +1015,7 @@ typedef struct fmed_logdata {
 	const char *fmt;
 	va_list va;
 	fmed_track_obj *trk;
+	fftime time; // UTC
 } fmed_logdata;
 
 typedef struct fmed_log {
@@ -1075,6 +1201,8 @@ enum FMED_QUE {
 	void sort(int plist, const char *by, uint reverse)
 	plist: list index or -1g
 	by: meta name or "__dur" (duration) or "__url" or "__random"
+	 or several keys separated by comma, e.g. "album,discnumber,tracknumber".
+	 Strings are compared case-insensitively, numbers inside strings - by their value ("2" < "10").
 	reverse: reverse order (0/1) */
 	FMED_QUE_SORT,
 
@@ -1150,9 +1278,31 @@ enum FMED_QUE {
 	random_enabled = cmdv(FMED_QUE_FLIP_RANDOM) */
 	FMED_QUE_FLIP_RANDOM,
 
+	/** Fill the filtered queue (see FMED_QUE_NEW_FILTERED) with the items of the current list
+	 containing text (case-insensitive).
+	The first request creates a search index for the list, which is then updated as the list changes.
+	If the text contains the text of the previous request, only the previous results are checked.
+	size_t n = qu->cmdv(FMED_QUE_SEARCH, const ffstr *text, uint flags)
+	flags: enum FMED_QUE_SEARCH_F
+	Return the number of items found */
+	FMED_QUE_SEARCH,
+
+	/** Read meta data of the items in the current list which are visible in GUI, and of the nearby items.
+	The items closer to the visible range are probed first;
+	 probes for the items outside of the range set by the previous call are stopped.
+	FMED_QUE_ONUPDATE is signalled after an item is probed.
+	Thread: any
+	qu->cmdv(FMED_QUE_PROBE, uint first, uint last) */
+	FMED_QUE_PROBE,
+
 	_FMED_QUE_LAST
 };
 
+enum FMED_QUE_SEARCH_F {
+	FMED_QUE_SEARCH_URL = 1,
+	FMED_QUE_SEARCH_META = 2,
+};
+
 enum FMED_QUE_REPEAT {
 	FMED_QUE_REPEAT_NONE,
 	FMED_QUE_REPEAT_ALL,
@@ -1240,6 +1390,17 @@ Return fmed_que_entry*. */
 enum FMED_GLOBCMD {
 	FMED_GLOBCMD_OPEN, //connect to another instance.  Arguments: "char *pipename"
 	FMED_GLOBCMD_START, //listen for connections.  Arguments: "char *pipename"
+
+	/** Send requests to the connected instance using framed protocol and print the replies.
+	Block until all requests are acknowledged (and until the connection is closed if 'events' is set).
+	Arguments: "const struct fmed_globcmd_req *req" */
+	FMED_GLOBCMD_REQUEST,
+};
+
+struct fmed_globcmd_req {
+	ffstr cmd; // text commands: "CMD [PARAMS]\n..."
+	ffstr add_list; // file names to add to queue, one per line
+	ffuint events; // subscribe to track events
 };
 
 typedef struct fmed_globcmd_iface {
@@ -1283,6 +1444,10 @@ typedef struct fmed_net_http {
 	May be called only before the first send().
 	flags: enum FFHTTPCL_CONF_F */
 	void (*conf)(void *con, struct ffhttpcl_conf *conf, uint flags);
+
+	/** Read response body directly from socket (see ffhttpcl_rawbody()).
+	Return FF_BADSKT if not supported. */
+	ffskt (*rawbody)(void *con, ffstr *data);
 } fmed_net_http;
 
 
@@ -1295,3 +1460,14 @@ struct fmed_edittags_conf {
 typedef struct fmed_edittags {
 	void (*edit)(struct fmed_edittags_conf *conf);
 } fmed_edittags;
+
+
+/** zstd.pcmcache: cache of decoded PCM data */
+typedef struct fmed_pcmcache {
+	/** Prepare the cache for the track.  Thread: main.
+	Set "pcm_cache" and "pcm_cache_key" track values.
+	Return 0: valid cache exists: use zstd.pcmcache-in instead of input filters;
+	 1: write the cache with zstd.pcmcache-out;
+	 <0: the track can't be cached */
+	int (*open)(fmed_track_info *ti);
+} fmed_pcmcache;
@@ -1,10 +1,52 @@
 /** fmedia: AAC ADTS (.aac) writer
 2019, Simon Zolin */
 
+/*
+Input data:
+. "aac": ADTS frames (aac.encode, .aac reader) are written as is
+. "mp4": raw AAC frames from a container (--stream-copy);
+   the first block is AudioSpecificConfig, each frame gets an ADTS header built from it
+*/
+
 struct aac_adts_out {
 	uint state;
+	byte hdr[7]; // ADTS header template
+	ffvec buf;
 };
 
+/** Prepare ADTS header from AudioSpecificConfig.
+Return 0 on success. */
+static int adts_hdr_init(byte *h, ffstr asc)
+{
+	if (asc.len < 2)
+		return -1;
+	const byte *d = (byte*)asc.ptr;
+	uint aot = d[0] >> 3;
+	uint freq_idx = ((d[0] & 0x07) << 1) | (d[1] >> 7);
+	uint chan_conf = (d[1] >> 3) & 0x0f;
+	if (!(aot >= 1 && aot <= 4) // ADTS supports Main, LC, SSR, LTP
+		|| freq_idx >= 13
+		|| !(chan_conf >= 1 && chan_conf <= 7))
+		return -1;
+
+	h[0] = 0xff;
+	h[1] = 0xf1; // MPEG-4, layer 0, no CRC
+	h[2] = ((aot - 1) << 6) | (freq_idx << 2) | (chan_conf >> 2);
+	h[3] = (chan_conf & 3) << 6;
+	h[4] = 0;
+	h[5] = 0x1f; // buffer fullness: 0x7ff (VBR)
+	h[6] = 0xfc;
+	return 0;
+}
+
+/** Set frame length (header + data) in ADTS header. */
+static void adts_hdr_setlen(byte *h, uint len)
+{
+	h[3] = (h[3] & 0xfc) | ((len >> 11) & 0x03);
+	h[4] = (len >> 3) & 0xff;
+	h[5] = ((len & 0x07) << 5) | 0x1f;
+}
+
 static void* aac_adts_out_open(fmed_filt *d)
 {
 	struct aac_adts_out *a;
@@ -16,6 +58,7 @@ static void* aac_adts_out_open(fmed_filt *d)
 static void aac_adts_out_close(void *ctx)
 {
 	struct aac_adts_out *a = ctx;
+	ffvec_free(&a->buf);
 	ffmem_free(a);
 }
 
@@ -23,23 +66,56 @@ static int aac_adts_out_process(void *ctx, fmed_filt *d)
 {
 	struct aac_adts_out *a = ctx;
 
+	enum { I_INIT, I_ADTS, I_RAW };
+
 	switch (a->state) {
-	case 0:
-		if (!ffsz_eq(d->datatype, "aac")) {
+	case I_INIT:
+		if (ffsz_eq(d->datatype, "aac")) {
+			// if (d->datalen != 0) {
+			// skip ASC
+			// }
+			a->state = I_ADTS;
+
+		} else if (ffsz_eq(d->datatype, "mp4")) {
+			ffstr asc = FFSTR_INITN(d->data, d->datalen);
+			if (0 != adts_hdr_init(a->hdr, asc)) {
+				errlog1(d->trk, "can't write ADTS stream: unsupported codec configuration: %*xb"
+					, (size_t)ffmin(asc.len, 8), asc.ptr);
+				d->error = FMED_E_INCOMPATFMT;
+				return FMED_RERR;
+			}
+			a->state = I_RAW;
+			d->datalen = 0;
+
+		} else {
 			errlog1(d->trk, "unsupported data type: %s", d->datatype);
 			return FMED_RERR;
 		}
-		// if (d->datalen != 0) {
-		// skip ASC
-		// }
-		a->state = 1;
 		return FMED_RMORE;
-	case 1:
+
+	case I_ADTS:
+	case I_RAW:
 		break;
 	}
 
 	if (d->datalen == 0 && !(d->flags & FMED_FLAST))
 		return FMED_RMORE;
+
+	if (a->state == I_RAW && d->datalen != 0) {
+		uint len = sizeof(a->hdr) + d->datalen;
+		if (len > 0x1fff) {
+			errlog1(d->trk, "AAC frame is too large: %L", d->datalen);
+			return FMED_RERR;
+		}
+		adts_hdr_setlen(a->hdr, len);
+		a->buf.len = 0;
+		ffvec_add(&a->buf, a->hdr, sizeof(a->hdr), 1);
+		ffvec_add(&a->buf, d->data, d->datalen, 1);
+		d->out = a->buf.ptr,  d->outlen = a->buf.len;
+		d->datalen = 0;
+		return (d->flags & FMED_FLAST) ? FMED_RDONE : FMED_RDATA;
+	}
+
 	d->out = d->data,  d->outlen = d->datalen;
 	d->datalen = 0;
 	return (d->flags & FMED_FLAST) ? FMED_RDONE : FMED_RDATA;
@@ -77,8 +77,48 @@ end:
 	return rc;
 }
 
+/** User-defined tags: ID3v2 TXXX frames */
+static const char *const txxx_str[] = {
+	"REPLAYGAIN_TRACK_GAIN",
+	"REPLAYGAIN_TRACK_PEAK",
+	"REPLAYGAIN_ALBUM_GAIN",
+	"REPLAYGAIN_ALBUM_PEAK",
+};
+enum {
+	TAG_TXXX = 0x100, // TAG_TXXX + index in txxx_str[]
+};
+
+static int txxx_find(ffstr name)
+{
+	for (uint i = 0;  i != FF_COUNT(txxx_str);  i++) {
+		if (ffstr_ieqz(&name, txxx_str[i]))
+			return TAG_TXXX + i;
+	}
+	return -1;
+}
+
+/** Add TXXX frame with ISO-8859-1 text.
+Frame size is a syncsafe integer, which is the same as a plain integer for ID3v2.3 frames <128 bytes. */
+static void id3v2_txxx_add(ffvec *buf, const char *desc, ffstr val)
+{
+	uint n = 1 + ffsz_len(desc) + 1 + val.len;
+	ffvec_grow(buf, 10 + n, 1);
+	char *p = (char*)buf->ptr + buf->len;
+	ffmem_copy(p, "TXXX", 4);
+	p[4] = (n >> 21) & 0x7f;
+	p[5] = (n >> 14) & 0x7f;
+	p[6] = (n >> 7) & 0x7f;
+	p[7] = n & 0x7f;
+	p[8] = p[9] = 0;
+	p += 10;
+	*p++ = 0; // encoding
+	p = ffmem_copy(p, desc, ffsz_len(desc) + 1);
+	ffmem_copy(p, val.ptr, val.len);
+	buf->len += 10 + n;
+}
+
 /**
-Return >0: tag
+Return >0: tag (MMTAG_* or TAG_TXXX+i)
  =0: done
  <0: error */
 int meta_next(ffstr *m, ffstr *k, ffstr *v)
@@ -99,8 +139,11 @@ int meta_next(ffstr *m, ffstr *k, ffstr *v)
 	}
 
 	int tag;
-	if (-1 == (tag = ffs_findarrz(ffmmtag_str, FF_COUNT(ffmmtag_str), k->ptr, k->len)))
+	if (-1 == (tag = ffs_findarrz(ffmmtag_str, FF_COUNT(ffmmtag_str), k->ptr, k->len))
+		&& -1 == (tag = txxx_find(*k))) {
+		errlog("unsupported tag: %S", k);
 		return -1;
+	}
 	return tag;
 }
 
@@ -129,7 +172,10 @@ int mp3_id3v2(struct edittags *c)
 		else if (tag < 0)
 			goto end;
 		dbglog("id3v2: writing %S = %S", &k, &v);
-		id3v2write_add(&w, tag, v);
+		if (tag >= TAG_TXXX)
+			id3v2_txxx_add(&w.buf, txxx_str[tag - TAG_TXXX], v);
+		else
+			id3v2write_add(&w, tag, v);
 	}
 
 	ffstr_setstr(&in, &c->buf);
@@ -140,6 +186,8 @@ int mp3_id3v2(struct edittags *c)
 	if (!c->meta_clear) {
 		// copy existing tags
 		while (r <= 0) {
+			// user-defined tag is identified by its name
+			int tag2 = (r == 0) ? txxx_find(k2) : -r;
 			m = c->conf.meta;
 			for (;;) {
 				int tag = meta_next(&m, &k, &v);
@@ -148,7 +196,7 @@ int mp3_id3v2(struct edittags *c)
 					id3v2write_add(&w, -r, v2);
 					break;
 				}
-				if (tag == -r)
+				if (tag == tag2)
 					break;
 			}
 
@@ -229,6 +277,8 @@ int mp3_id3v1(struct edittags *c)
 			break;
 		else if (tag < 0)
 			return FMED_RERR;
+		if (tag >= TAG_TXXX)
+			continue; // not supported by ID3v1
 		r = id3v1write_set(&w, tag, v);
 		if (r != 0)
 			dbglog("id3v1: written %S = %S", &k, &v);
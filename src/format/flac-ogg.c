@@ -28,6 +28,13 @@ struct flacogg_in {
 	ffstr in;
 	uint fr_samples;
 	uint sample_rate;
+	uint state;
+};
+
+enum {
+	FOI_DECODE,
+	FOI_COPY_INFO, // --stream-copy: pass STREAMINFO to flac.write
+	FOI_COPY,
 };
 
 static void* flacogg_in_create(fmed_filt *d)
@@ -54,6 +61,47 @@ static void flacogg_meta(struct flacogg_in *f, fmed_filt *d)
 	d->track->meta_set(d->trk, &name, &val, FMED_QUE_TMETA);
 }
 
+/** Get the number of samples in FLAC frame from its header.
+Return 0 if the header is invalid. */
+static uint flac_frame_samples(ffstr fr)
+{
+	const ffbyte *d = (void*)fr.ptr;
+	if (fr.len < 5
+		|| !(d[0] == 0xff && (d[1] & 0xfe) == 0xf8))
+		return 0;
+
+	uint bs = d[2] >> 4;
+	switch (bs) {
+	case 0:
+		return 0;
+	case 1:
+		return 192;
+	case 2: case 3: case 4: case 5:
+		return 576 << (bs - 2);
+	case 6: case 7:
+		break;
+	default:
+		return 0x100 << (bs - 8);
+	}
+
+	// skip UTF-8 coded frame/sample number
+	uint i = 4, n = 0;
+	for (uint c = d[i];  c & 0x80;  c <<= 1)
+		n++;
+	if (n == 1 || n > 7)
+		return 0;
+	i += (n != 0) ? n : 1;
+
+	if (bs == 6) {
+		if (i + 1 > fr.len)
+			return 0;
+		return d[i] + 1;
+	}
+	if (i + 2 > fr.len)
+		return 0;
+	return ffint_be_cpu16_ptr(&d[i]) + 1;
+}
+
 static int flacogg_in_read(void *ctx, fmed_filt *d)
 {
 	struct flacogg_in *f = ctx;
@@ -109,6 +157,14 @@ static int flacogg_in_read(void *ctx, fmed_filt *d)
 			d->flac_maxblock = info->maxblock;
 			f->fr_samples = info->minblock;
 
+			if (d->stream_copy) {
+				// pass FLAC frames to flac.write as is
+				d->audio.convfmt = d->audio.fmt;
+				f->state = FOI_COPY_INFO;
+				d->out = (void*)info,  d->outlen = sizeof(struct flac_info);
+				return FMED_RDATA;
+			}
+
 			if (0 != d->track->cmd2(d->trk, FMED_TRACK_ADDFILT, "flac.decode"))
 				return FMED_RERR;
 			break;
@@ -118,8 +174,14 @@ static int flacogg_in_read(void *ctx, fmed_filt *d)
 			goto data;
 
 		case FLACOGGREAD_MORE:
-			if (d->flags & FMED_FLAST)
+			if (d->flags & FMED_FLAST) {
+				if (f->state == FOI_COPY) {
+					// flac.write expects STREAMINFO as the last block
+					d->out = (void*)flacoggread_info(&f->fo),  d->outlen = sizeof(struct flac_info);
+					return FMED_RLASTOUT;
+				}
 				return FMED_RDONE;
+			}
 			return FMED_RMORE;
 
 		case FLACOGGREAD_ERROR:
@@ -132,7 +194,12 @@ static int flacogg_in_read(void *ctx, fmed_filt *d)
 		}
 	}
 
-data:
+data: {
+	// the last frame is usually shorter than STREAMINFO's block size
+	uint n = flac_frame_samples(out);
+	f->fr_samples = (n != 0) ? n : d->flac_minblock;
+	}
+
 	if (d->seek_req && (int64)d->audio.seek != FMED_NULL) {
 		uint64 seek = ffpcm_samples(d->audio.seek, f->sample_rate);
 		dbglog(d->trk, "seek: %U @%U", seek, f->apos);
@@ -146,6 +213,9 @@ data:
 	dbglog(d->trk, "frame size:%L  @%U", out.len, f->apos);
 	d->audio.pos = f->apos;
 	d->flac_samples = f->fr_samples;
+	if (f->state == FOI_COPY_INFO)
+		f->state = FOI_COPY;
+	d->flac_frame_samples = f->fr_samples;
 	f->apos += f->fr_samples;
 	d->out = out.ptr,  d->outlen = out.len;
 	return FMED_RDATA;
@@ -2,12 +2,14 @@
 2021, Simon Zolin */
 
 #include <avpack/flac-read.h>
+#include <format/seek-index.h>
 
 struct flac {
 	flacread fl;
 	ffstr in;
 	void *trk;
 	uint sample_rate;
+	struct seekidx sidx;
 };
 
 void flac_in_log(void *udata, const char *fmt, va_list va)
@@ -37,6 +39,7 @@ static void flac_in_free(void *ctx)
 {
 	struct flac *f = ctx;
 	flacread_close(&f->fl);
+	seekidx_close(&f->sidx);
 	ffmem_free(f);
 }
 
@@ -52,6 +55,24 @@ static void flac_meta(struct flac *f, fmed_filt *d)
 	d->track->meta_set(d->trk, &name, &val, FMED_QUE_TMETA);
 }
 
+/** Use seek index as the file's seek table.
+The reader frees the table on close. */
+static void flac_sktab_from_index(struct flac *f)
+{
+	uint n = f->sidx.points.len;
+	struct flac_seekpoint *sp;
+	if (NULL == (sp = ffmem_allocT(n, struct flac_seekpoint)))
+		return;
+
+	const struct seekidx_point *p = f->sidx.points.ptr;
+	for (uint i = 0;  i != n;  i++) {
+		sp[i].sample = p[i].sample;
+		sp[i].off = p[i].off - f->fl.frame1_off; // seek table offsets are relative to the first frame
+	}
+	f->fl.sktab.ptr = sp;
+	f->fl.sktab.len = n;
+}
+
 static int flac_in_read(void *ctx, fmed_filt *d)
 {
 	struct flac *f = ctx;
@@ -82,6 +103,7 @@ static int flac_in_read(void *ctx, fmed_filt *d)
 		switch (r) {
 		case FLACREAD_MORE:
 			if (d->flags & FMED_FLAST) {
+				seekidx_cancel(&f->sidx);
 				warnlog1(d->trk, "file is incomplete");
 				d->outlen = 0;
 				return FMED_RDONE;
@@ -112,6 +134,16 @@ static int flac_in_read(void *ctx, fmed_filt *d)
 				, i->md5, (int)f->fl.sktab.len, (int)f->fl.frame1_off, i->total_samples);
 			d->audio.bitrate = i->bitrate;
 
+			if (f->fl.sktab.len == 0) {
+				seekidx_open(&f->sidx, d, i->sample_rate, d->seek_index_build);
+				if (f->sidx.state == SEEKIDX_READY) {
+					flac_sktab_from_index(f);
+					dbglog1(d->trk, "using seek index as seek table");
+				}
+				if (d->seek_index_build && f->sidx.state == SEEKIDX_RECORD)
+					break; // read the whole file
+			}
+
 			if (d->input_info)
 				return FMED_RLASTOUT;
 
@@ -124,14 +156,21 @@ static int flac_in_read(void *ctx, fmed_filt *d)
 		}
 
 		case FLACREAD_DATA:
+			seekidx_add(&f->sidx, flacread_cursample(&f->fl), flacread_offset(&f->fl) - out.len);
+			if (d->seek_index_build)
+				break;
 			goto data;
 
 		case FLACREAD_SEEK:
+			seekidx_cancel(&f->sidx);
 			d->input.seek = flacread_offset(&f->fl);
 			return FMED_RMORE;
 
 		case FLACREAD_DONE:
+			seekidx_fin(&f->sidx, d->trk);
 			d->outlen = 0;
+			if (d->seek_index_build)
+				return FMED_RLASTOUT;
 			return FMED_RDONE;
 
 		case FLACREAD_ERROR:
@@ -146,10 +146,14 @@ static int flac_out_encode(void *ctx, fmed_track_info *d)
 
 	switch (f->state) {
 	case I_FIRST:
-		if (0 == d->track->cmd(d->trk, FMED_TRACK_FILT_ADDPREV, "flac.encode"))
-			return FMED_RERR;
 		f->state = I_INIT;
-		return FMED_RMORE;
+		if (!(d->stream_copy && ffsz_eq(d->datatype, "flac"))) {
+			if (0 == d->track->cmd(d->trk, FMED_TRACK_FILT_ADDPREV, "flac.encode"))
+				return FMED_RERR;
+			return FMED_RMORE;
+		}
+		// FLAC frames from another container (--stream-copy)
+		// fallthrough
 
 	case I_INIT:
 		if (!ffsz_eq(d->datatype, "flac")) {
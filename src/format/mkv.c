@@ -116,6 +116,33 @@ static const struct mkvread_audio_info* get_first_audio_track(struct mkvin *m)
 	return NULL;
 }
 
+/** Set the properties of the audio stream passed to a writer as is (--stream-copy):
+. AAC: "mp4" data type (codec config + raw frames) is accepted by mp4 and ADTS writers
+. Opus, Vorbis: packets (headers + data) are accepted by ogg writer */
+static void mkv_remux_init(fmed_filt *d, uint codec)
+{
+	switch (codec) {
+	case MKV_A_AAC:
+		d->datatype = "mp4";
+		d->audio.decoder = "AAC";
+		d->audio.fmt.format = FFPCM_16;
+		d->a_frame_samples = 1024;
+		break;
+
+	case MKV_A_OPUS:
+		d->datatype = "Opus";
+		d->audio.fmt.format = FFPCM_FLOAT;
+		d->ogg_gen_opus_tag = 1;
+		break;
+
+	case MKV_A_VORBIS:
+		d->datatype = "Vorbis";
+		d->audio.fmt.format = FFPCM_FLOAT;
+		break;
+	}
+	d->audio.convfmt = d->audio.fmt;
+}
+
 int mkv_process(void *ctx, fmed_filt *d)
 {
 	enum { I_HDR, I_VORBIS_HDR, I_DATA, };
@@ -212,19 +239,15 @@ again:
 			if ((ffint64)d->input.size != FMED_NULL && ai->duration_msec != 0)
 				d->audio.bitrate = (d->input.size * 8 * 1000) / ai->duration_msec;
 
+			if (d->stream_copy)
+				mkv_remux_init(d, ai->codec);
+
 			if (ai->codec == MKV_A_VORBIS) {
 				ffstr_set2(&m->vorb_in, &ai->codec_conf);
 				m->state = I_VORBIS_HDR;
 				goto again;
 			} else if (ai->codec == MKV_A_MPEGL3) {
 				//
-			} else if (ai->codec == MKV_A_OPUS) {
-				if (d->stream_copy) {
-					d->datatype = "Opus";
-					d->audio.fmt.format = FFPCM_FLOAT;
-					d->ogg_gen_opus_tag = 1;
-				}
-				d->data_out = ai->codec_conf;
 			} else
 				d->data_out = ai->codec_conf;
 
@@ -108,6 +108,7 @@ void mod_destroy()
 
 extern int flac_out_config(fmed_conf_ctx *ctx);
 extern int mpeg_out_config(fmed_conf_ctx *ctx);
+extern int mp4_out_config(fmed_conf_ctx *ctx);
 extern int ogg_in_conf(fmed_conf_ctx *ctx);
 extern int ogg_out_conf(fmed_conf_ctx *ctx);
 int mod_conf(const char *name, fmed_conf_ctx *ctx)
@@ -118,6 +119,8 @@ int mod_conf(const char *name, fmed_conf_ctx *ctx)
 		return ogg_out_conf(ctx);
 	else if (ffsz_eq(name, "mp3-write"))
 		return mpeg_out_config(ctx);
+	else if (ffsz_eq(name, "mp4-write"))
+		return mp4_out_config(ctx);
 	else if (ffsz_eq(name, "flac-write"))
 		return flac_out_config(ctx);
 	return -1;
@@ -2,6 +2,7 @@
 2021, Simon Zolin */
 
 #include <avpack/mp3-read.h>
+#include <format/seek-index.h>
 
 typedef struct mp3_in {
 	mp3read mpg;
@@ -10,7 +11,10 @@ typedef struct mp3_in {
 	uint sample_rate;
 	uint nframe;
 	char codec_name[9];
+	struct seekidx sidx;
+	uint64 sidx_base; // sample position of the frame the reader was restarted from
 	uint have_id32tag :1;
+	uint restarted :1; // the reader was restarted from the frame found in seek index
 } mp3_in;
 
 static void mp3_log(void *udata, const char *fmt, va_list va)
@@ -19,6 +23,15 @@ static void mp3_log(void *udata, const char *fmt, va_list va)
 	fmed_dbglogv(core, m->trk, NULL, fmt, va);
 }
 
+static void mp3_reader_open(mp3_in *m, uint64 total_size)
+{
+	mp3read_open(&m->mpg, total_size);
+	m->mpg.log = mp3_log;
+	m->mpg.udata = m;
+	m->mpg.id3v1.codepage = core->props->codepage;
+	m->mpg.id3v2.codepage = core->props->codepage;
+}
+
 static void* mp3_open(fmed_track_info *d)
 {
 	if (d->stream_copy && 1 != d->track->cmd(d->trk, FMED_TRACK_META_HAVEUSER)) {
@@ -34,11 +47,7 @@ static void* mp3_open(fmed_track_info *d)
 	if ((int64)d->input.size != FMED_NULL) {
 		total_size = d->input.size;
 	}
-	mp3read_open(&m->mpg, total_size);
-	m->mpg.log = mp3_log;
-	m->mpg.udata = m;
-	m->mpg.id3v1.codepage = core->props->codepage;
-	m->mpg.id3v2.codepage = core->props->codepage;
+	mp3_reader_open(m, total_size);
 	return m;
 }
 
@@ -46,9 +55,29 @@ static void mp3_close(void *ctx)
 {
 	mp3_in *m = ctx;
 	mp3read_close(&m->mpg);
+	seekidx_close(&m->sidx);
 	ffmem_free(m);
 }
 
+/** Seek using the index: restart the reader from the frame before the target position.
+The reader doesn't know the file size after restart, so it won't look for the tags at the end of file. */
+static int mp3_index_seek(mp3_in *m, fmed_track_info *d, uint64 sample)
+{
+	const struct seekidx_point *p;
+	if (NULL == (p = seekidx_find(&m->sidx, sample)))
+		return -1;
+
+	mp3read_close(&m->mpg);
+	mp3_reader_open(m, 0);
+	m->in.len = 0;
+	m->sidx_base = p->sample;
+	m->restarted = 1;
+	d->input.seek = p->off;
+	dbglog1(d->trk, "seek: %Ums: using index: frame @%U  offset:%xU"
+		, d->audio.seek, p->sample, p->off);
+	return 0;
+}
+
 static void mp3_meta(mp3_in *m, fmed_track_info *d, uint type)
 {
 	if (type == MP3READ_ID32) {
@@ -88,7 +117,11 @@ static int mp3_process(void *ctx, fmed_track_info *d)
 
 		if (d->seek_req && (int64)d->audio.seek != FMED_NULL && m->sample_rate != 0) {
 			d->seek_req = 0;
-			mp3read_seek(&m->mpg, ffpcm_samples(d->audio.seek, m->sample_rate));
+			uint64 sample = ffpcm_samples(d->audio.seek, m->sample_rate);
+			if (0 == mp3_index_seek(m, d, sample))
+				return FMED_RMORE;
+			seekidx_cancel(&m->sidx);
+			mp3read_seek(&m->mpg, sample);
 			dbglog1(d->trk, "seek: %Ums", d->audio.seek);
 		}
 
@@ -96,20 +129,30 @@ static int mp3_process(void *ctx, fmed_track_info *d)
 
 		switch (r) {
 		case MPEG1READ_DATA:
+			seekidx_add(&m->sidx, m->sidx_base + mp3read_cursample(&m->mpg), mp3read_offset(&m->mpg) - out.len);
+			if (d->seek_index_build)
+				break;
 			goto data;
 
 		case MPEG1READ_MORE:
 			if (d->flags & FMED_FLAST) {
+				seekidx_fin(&m->sidx, d->trk);
 				d->outlen = 0;
+				if (d->seek_index_build)
+					return FMED_RLASTOUT;
 				return FMED_RDONE;
 			}
 			return FMED_RMORE;
 
 		case MP3READ_DONE:
+			seekidx_fin(&m->sidx, d->trk);
 			d->outlen = 0;
 			return FMED_RLASTOUT;
 
 		case MPEG1READ_HEADER: {
+			if (m->restarted)
+				break;
+
 			const struct mpeg1read_info *info = mp3read_info(&m->mpg);
 			d->audio.fmt.format = FFPCM_16;
 			m->sample_rate = info->sample_rate;
@@ -124,6 +167,10 @@ static int mp3_process(void *ctx, fmed_track_info *d)
 			d->mpeg1_padding = info->padding;
 			d->mpeg1_vbr_scale = info->vbr_scale + 1;
 
+			seekidx_open(&m->sidx, d, info->sample_rate, d->seek_index_build);
+			if (d->seek_index_build && m->sidx.state == SEEKIDX_RECORD)
+				break; // read the whole file
+
 			if (d->input_info)
 				return FMED_RLASTOUT;
 
@@ -137,7 +184,8 @@ static int mp3_process(void *ctx, fmed_track_info *d)
 		case MP3READ_ID31:
 		case MP3READ_ID32:
 		case MP3READ_APETAG:
-			mp3_meta(m, d, r);
+			if (!m->restarted)
+				mp3_meta(m, d, r);
 			break;
 
 		case MPEG1READ_SEEK:
@@ -158,7 +206,7 @@ static int mp3_process(void *ctx, fmed_track_info *d)
 	}
 
 data:
-	d->audio.pos = mp3read_cursample(&m->mpg);
+	d->audio.pos = m->sidx_base + mp3read_cursample(&m->mpg);
 	dbglog1(d->trk, "passing frame #%u  samples:%u[%U]  size:%u  br:%u  off:%xU"
 		, ++m->nframe, mpeg1_samples(out.ptr), d->audio.pos, (uint)out.len
 		, mpeg1_bitrate(out.ptr), (ffint64)mp3read_offset(&m->mpg) - out.len);
@@ -0,0 +1,656 @@
+/** fmedia: .mp4 write: fragmented and "fast start" modes
+2023, Simon Zolin */
+
+/*
+Fragmented MP4 doesn't need a seekable output - it can be streamed to stdout or a pipe:
+
+  ftyp moov(... mvex) [moof(mfhd traf(tfhd tfdt trun)) mdat]...
+
+'moov' has no sample tables; the audio frames are collected until the fragment duration is reached,
+ then 'moof' describing them is written followed by 'mdat' with their data.
+Memory usage is limited to 1 fragment.
+
+"Fast start" MP4 has 'moov' before 'mdat', so a player can start playback after reading the beginning of file:
+
+  ftyp free(RESERVED) mdat(FRAMES...)  ->  ftyp moov free mdat(FRAMES...)
+
+The space for 'moov' is reserved at the beginning of file by estimating the number of frames from the total duration.
+The frames are written directly to the output (only their sizes are kept in memory),
+ and after the last frame 'moov' is written in place of the reserved space.
+If 'moov' doesn't fit, it's written after 'mdat', as usual.
+*/
+
+enum MP4FW_R {
+	MP4FW_MORE,
+	MP4FW_DATA,
+	MP4FW_SEEK, // seek to 'mp4fw.off'
+	MP4FW_DONE,
+	MP4FW_ERROR,
+};
+
+enum MP4FW_F {
+	MP4FW_FRAGMENTED = 1,
+	MP4FW_FASTSTART = 2,
+};
+
+struct mp4fw_info {
+	uint rate, channels;
+	uint frame_samples;
+	uint enc_delay;
+	uint bitrate;
+	uint64 total_samples; // required for MP4FW_FASTSTART
+	uint frag_msec; // fragment duration
+	ffstr conf; // AAC decoder config
+};
+
+typedef struct mp4fw {
+	uint state;
+	uint flags;
+	struct mp4fw_info info;
+	ffvec conf;
+	ffvec tags; // ffstr[]: name, value
+	ffvec buf;
+	ffvec sizes; // uint[]: sizes of the frames in fragment (or in file for MP4FW_FASTSTART)
+	ffvec frames; // data of the frames in fragment
+	uint64 frag_start; // decode time of the first frame in fragment
+	uint frag_samples;
+	uint seq;
+	uint64 off; // output offset
+	uint64 data_off; // offset of the first audio frame
+	uint64 end_off;
+	uint moov_off, moov_reserved;
+	const char *err;
+	uint fin :1;
+} mp4fw;
+
+#define mp4fw_error(w)  ((w)->err)
+
+static void mp4fw_close(mp4fw *w)
+{
+	ffstr *t;
+	FFSLICE_WALK(&w->tags, t) {
+		ffstr_free(t);
+	}
+	ffvec_free(&w->tags);
+	ffvec_free(&w->conf);
+	ffvec_free(&w->buf);
+	ffvec_free(&w->sizes);
+	ffvec_free(&w->frames);
+}
+
+static void mp4fw_addtag(mp4fw *w, ffstr name, ffstr val)
+{
+	ffstr *t = ffvec_pushT(&w->tags, ffstr);
+	ffstr_dupstr(t, &name);
+	t = ffvec_pushT(&w->tags, ffstr);
+	ffstr_dupstr(t, &val);
+}
+
+static void mp4fw_w8(ffvec *v, uint n)
+{
+	*ffvec_pushT(v, byte) = n;
+}
+
+static void mp4fw_w16(ffvec *v, uint n)
+{
+	ushort d = ffint_be_cpu16(n);
+	ffvec_add(v, &d, 2, 1);
+}
+
+static void mp4fw_w32(ffvec *v, uint n)
+{
+	uint d = ffint_be_cpu32(n);
+	ffvec_add(v, &d, 4, 1);
+}
+
+static void mp4fw_w64(ffvec *v, uint64 n)
+{
+	uint64 d = ffint_be_cpu64(n);
+	ffvec_add(v, &d, 8, 1);
+}
+
+static void mp4fw_zero(ffvec *v, uint n)
+{
+	ffvec_grow(v, n, 1);
+	ffmem_zero(ffslice_end(v, 1), n);
+	v->len += n;
+}
+
+/** Begin box.  Return its offset */
+static size_t mp4fw_box(ffvec *v, const char *type)
+{
+	size_t off = v->len;
+	mp4fw_w32(v, 0);
+	ffvec_add(v, type, 4, 1);
+	return off;
+}
+
+static size_t mp4fw_fullbox(ffvec *v, const char *type, uint ver, uint flags)
+{
+	size_t off = mp4fw_box(v, type);
+	mp4fw_w32(v, (ver << 24) | flags);
+	return off;
+}
+
+/** End box: set its size */
+static void mp4fw_box_end(ffvec *v, size_t off)
+{
+	*(uint*)((char*)v->ptr + off) = ffint_be_cpu32(v->len - off);
+}
+
+static void mp4fw_matrix(ffvec *v)
+{
+	static const uint m[] = { 0x00010000,0,0, 0,0x00010000,0, 0,0,0x40000000 };
+	for (uint i = 0;  i != FF_COUNT(m);  i++) {
+		mp4fw_w32(v, m[i]);
+	}
+}
+
+/** MPEG-4 descriptor header */
+static void mp4fw_desc(ffvec *v, uint tag, uint size)
+{
+	mp4fw_w8(v, tag);
+	mp4fw_w8(v, 0x80 | ((size >> 21) & 0x7f));
+	mp4fw_w8(v, 0x80 | ((size >> 14) & 0x7f));
+	mp4fw_w8(v, 0x80 | ((size >> 7) & 0x7f));
+	mp4fw_w8(v, size & 0x7f);
+}
+
+static void mp4fw_esds(mp4fw *w, ffvec *v)
+{
+	// the size of each descriptor including its 5-byte header
+	uint dsi = 5 + w->conf.len;
+	uint dcd = 5 + 13 + dsi;
+	uint sl = 5 + 1;
+
+	size_t box = mp4fw_fullbox(v, "esds", 0, 0);
+	mp4fw_desc(v, 0x03, 3 + dcd + sl); // ES_Descriptor
+	mp4fw_w16(v, 0); // ES_ID
+	mp4fw_w8(v, 0); // flags
+
+	mp4fw_desc(v, 0x04, 13 + dsi); // DecoderConfigDescriptor
+	mp4fw_w8(v, 0x40); // object type: MPEG-4 Audio
+	mp4fw_w8(v, (0x05 << 2) | 1); // stream type: audio
+	mp4fw_w8(v, 0); // buffer size
+	mp4fw_w16(v, 0);
+	mp4fw_w32(v, w->info.bitrate); // max. bitrate
+	mp4fw_w32(v, w->info.bitrate); // avg. bitrate
+
+	mp4fw_desc(v, 0x05, w->conf.len); // DecoderSpecificInfo
+	ffvec_add(v, w->conf.ptr, w->conf.len, 1);
+
+	mp4fw_desc(v, 0x06, 1); // SLConfigDescriptor
+	mp4fw_w8(v, 0x02);
+	mp4fw_box_end(v, box);
+}
+
+static const char mp4fw_tagnames[][2][12] = {
+	{ "album", "\xa9" "alb" },
+	{ "albumartist", "aART" },
+	{ "artist", "\xa9" "ART" },
+	{ "comment", "\xa9" "cmt" },
+	{ "composer", "\xa9" "wrt" },
+	{ "copyright", "cprt" },
+	{ "date", "\xa9" "day" },
+	{ "genre", "\xa9" "gen" },
+	{ "lyrics", "\xa9" "lyr" },
+	{ "title", "\xa9" "nam" },
+};
+
+static ffstr* mp4fw_tag(mp4fw *w, const char *name)
+{
+	ffstr *t = w->tags.ptr;
+	for (size_t i = 0;  i != w->tags.len;  i += 2) {
+		if (ffstr_eqz(&t[i], name))
+			return &t[i + 1];
+	}
+	return NULL;
+}
+
+/** "N/TOTAL" pair: 'trkn' or 'disk' */
+static void mp4fw_ilst_num(mp4fw *w, ffvec *v, const char *type, const char *name, const char *total_name)
+{
+	ffstr *s = mp4fw_tag(w, name), *st;
+	uint n = 0, total = 0;
+	if (s == NULL)
+		return;
+	ffstr val = *s;
+	ffs_toint(val.ptr, val.len, &n, FFS_INT32); // "N" or "N/TOTAL"
+	ssize_t i = ffstr_findchar(&val, '/');
+	if (i >= 0) {
+		ffstr_shift(&val, i + 1);
+		ffs_toint(val.ptr, val.len, &total, FFS_INT32);
+	}
+	if (total_name != NULL && NULL != (st = mp4fw_tag(w, total_name)))
+		ffs_toint(st->ptr, st->len, &total, FFS_INT32);
+	if (n == 0)
+		return;
+
+	size_t box = mp4fw_box(v, type);
+	size_t data = mp4fw_box(v, "data");
+	mp4fw_w32(v, 0); // type: implicit
+	mp4fw_w32(v, 0); // locale
+	mp4fw_w16(v, 0);
+	mp4fw_w16(v, n);
+	mp4fw_w16(v, total);
+	if (type[0] == 't')
+		mp4fw_w16(v, 0);
+	mp4fw_box_end(v, data);
+	mp4fw_box_end(v, box);
+}
+
+/** udta(meta(hdlr ilst(TAG(data)...))) */
+static void mp4fw_udta(mp4fw *w, ffvec *v)
+{
+	if (w->tags.len == 0)
+		return;
+
+	size_t udta = mp4fw_box(v, "udta");
+	size_t meta = mp4fw_fullbox(v, "meta", 0, 0);
+
+	size_t hdlr = mp4fw_fullbox(v, "hdlr", 0, 0);
+	mp4fw_w32(v, 0);
+	ffvec_add(v, "mdir", 4, 1);
+	ffvec_add(v, "appl", 4, 1);
+	mp4fw_zero(v, 8 + 1);
+	mp4fw_box_end(v, hdlr);
+
+	size_t ilst = mp4fw_box(v, "ilst");
+	for (uint i = 0;  i != FF_COUNT(mp4fw_tagnames);  i++) {
+		const ffstr *val = mp4fw_tag(w, mp4fw_tagnames[i][0]);
+		if (val == NULL)
+			continue;
+		size_t box = mp4fw_box(v, mp4fw_tagnames[i][1]);
+		size_t data = mp4fw_box(v, "data");
+		mp4fw_w32(v, 1); // type: UTF-8
+		mp4fw_w32(v, 0); // locale
+		ffvec_add(v, val->ptr, val->len, 1);
+		mp4fw_box_end(v, data);
+		mp4fw_box_end(v, box);
+	}
+	mp4fw_ilst_num(w, v, "trkn", "tracknumber", "tracktotal");
+	mp4fw_ilst_num(w, v, "disk", "discnumber", NULL);
+
+	const char *vendor = "fmedia";
+	size_t too = mp4fw_box(v, "\xa9" "too");
+	size_t data = mp4fw_box(v, "data");
+	mp4fw_w32(v, 1);
+	mp4fw_w32(v, 0);
+	ffvec_addsz(v, vendor);
+	mp4fw_box_end(v, data);
+	mp4fw_box_end(v, too);
+
+	mp4fw_box_end(v, ilst);
+	mp4fw_box_end(v, meta);
+	mp4fw_box_end(v, udta);
+}
+
+static void mp4fw_ftyp(mp4fw *w, ffvec *v)
+{
+	size_t box = mp4fw_box(v, "ftyp");
+	ffvec_add(v, "M4A ", 4, 1);
+	mp4fw_w32(v, 0);
+	ffvec_add(v, "M4A ", 4, 1);
+	ffvec_add(v, "mp42", 4, 1);
+	ffvec_add(v, "isom", 4, 1);
+	if (w->flags & MP4FW_FRAGMENTED)
+		ffvec_add(v, "iso6", 4, 1);
+	mp4fw_box_end(v, box);
+}
+
+/** stbl: sample tables (empty for MP4FW_FRAGMENTED) */
+static void mp4fw_stbl(mp4fw *w, ffvec *v)
+{
+	size_t stbl = mp4fw_box(v, "stbl");
+
+	size_t stsd = mp4fw_fullbox(v, "stsd", 0, 0);
+	mp4fw_w32(v, 1);
+	size_t mp4a = mp4fw_box(v, "mp4a");
+	mp4fw_zero(v, 6);
+	mp4fw_w16(v, 1); // data reference index
+	mp4fw_zero(v, 8);
+	mp4fw_w16(v, w->info.channels);
+	mp4fw_w16(v, 16); // sample size
+	mp4fw_w32(v, 0);
+	mp4fw_w32(v, (w->info.rate <= 0xffff) ? w->info.rate << 16 : 0);
+	mp4fw_esds(w, v);
+	mp4fw_box_end(v, mp4a);
+	mp4fw_box_end(v, stsd);
+
+	uint n = w->sizes.len;
+	if (w->flags & MP4FW_FRAGMENTED)
+		n = 0;
+
+	size_t stts = mp4fw_fullbox(v, "stts", 0, 0);
+	mp4fw_w32(v, (n != 0) ? 1 : 0);
+	if (n != 0) {
+		mp4fw_w32(v, n);
+		mp4fw_w32(v, w->info.frame_samples);
+	}
+	mp4fw_box_end(v, stts);
+
+	// all frames are in 1 chunk
+	size_t stsc = mp4fw_fullbox(v, "stsc", 0, 0);
+	mp4fw_w32(v, (n != 0) ? 1 : 0);
+	if (n != 0) {
+		mp4fw_w32(v, 1);
+		mp4fw_w32(v, n);
+		mp4fw_w32(v, 1);
+	}
+	mp4fw_box_end(v, stsc);
+
+	size_t stsz = mp4fw_fullbox(v, "stsz", 0, 0);
+	mp4fw_w32(v, 0);
+	mp4fw_w32(v, n);
+	const uint *sizes = w->sizes.ptr;
+	for (uint i = 0;  i != n;  i++) {
+		mp4fw_w32(v, sizes[i]);
+	}
+	mp4fw_box_end(v, stsz);
+
+	if (w->data_off > 0xffffffff) {
+		size_t co64 = mp4fw_fullbox(v, "co64", 0, 0);
+		mp4fw_w32(v, (n != 0) ? 1 : 0);
+		if (n != 0)
+			mp4fw_w64(v, w->data_off);
+		mp4fw_box_end(v, co64);
+	} else {
+		size_t stco = mp4fw_fullbox(v, "stco", 0, 0);
+		mp4fw_w32(v, (n != 0) ? 1 : 0);
+		if (n != 0)
+			mp4fw_w32(v, w->data_off);
+		mp4fw_box_end(v, stco);
+	}
+
+	mp4fw_box_end(v, stbl);
+}
+
+static void mp4fw_moov(mp4fw *w, ffvec *v)
+{
+	uint64 dur = 0, total = 0;
+	if (!(w->flags & MP4FW_FRAGMENTED)) {
+		dur = (uint64)w->sizes.len * w->info.frame_samples;
+		total = ffmin(w->info.total_samples, dur - ffmin(dur, w->info.enc_delay));
+	}
+	size_t moov = mp4fw_box(v, "moov");
+
+	size_t mvhd = mp4fw_fullbox(v, "mvhd", 1, 0);
+	mp4fw_w64(v, 0); // creation time
+	mp4fw_w64(v, 0); // modification time
+	mp4fw_w32(v, w->info.rate);
+	mp4fw_w64(v, total);
+	mp4fw_w32(v, 0x00010000); // rate
+	mp4fw_w16(v, 0x0100); // volume
+	mp4fw_zero(v, 10);
+	mp4fw_matrix(v);
+	mp4fw_zero(v, 24);
+	mp4fw_w32(v, 2); // next track ID
+	mp4fw_box_end(v, mvhd);
+
+	size_t trak = mp4fw_box(v, "trak");
+
+	size_t tkhd = mp4fw_fullbox(v, "tkhd", 1, 0x07); // enabled, in movie, in preview
+	mp4fw_w64(v, 0);
+	mp4fw_w64(v, 0);
+	mp4fw_w32(v, 1); // track ID
+	mp4fw_w32(v, 0);
+	mp4fw_w64(v, total);
+	mp4fw_zero(v, 8);
+	mp4fw_w16(v, 0); // layer
+	mp4fw_w16(v, 0); // alternate group
+	mp4fw_w16(v, 0x0100); // volume
+	mp4fw_w16(v, 0);
+	mp4fw_matrix(v);
+	mp4fw_w32(v, 0); // width
+	mp4fw_w32(v, 0); // height
+	mp4fw_box_end(v, tkhd);
+
+	if (w->info.enc_delay != 0) {
+		// skip encoder delay
+		size_t edts = mp4fw_box(v, "edts");
+		size_t elst = mp4fw_fullbox(v, "elst", 1, 0);
+		mp4fw_w32(v, 1);
+		mp4fw_w64(v, total); // segment duration (0: fragmented)
+		mp4fw_w64(v, w->info.enc_delay); // media time
+		mp4fw_w32(v, 0x00010000); // media rate
+		mp4fw_box_end(v, elst);
+		mp4fw_box_end(v, edts);
+	}
+
+	size_t mdia = mp4fw_box(v, "mdia");
+
+	size_t mdhd = mp4fw_fullbox(v, "mdhd", 1, 0);
+	mp4fw_w64(v, 0);
+	mp4fw_w64(v, 0);
+	mp4fw_w32(v, w->info.rate);
+	mp4fw_w64(v, dur);
+	mp4fw_w16(v, 0x55c4); // "und"
+	mp4fw_w16(v, 0);
+	mp4fw_box_end(v, mdhd);
+
+	size_t hdlr = mp4fw_fullbox(v, "hdlr", 0, 0);
+	mp4fw_w32(v, 0);
+	ffvec_add(v, "soun", 4, 1);
+	mp4fw_zero(v, 12);
+	ffvec_add(v, "SoundHandler", 13, 1);
+	mp4fw_box_end(v, hdlr);
+
+	size_t minf = mp4fw_box(v, "minf");
+	size_t smhd = mp4fw_fullbox(v, "smhd", 0, 0);
+	mp4fw_w32(v, 0); // balance
+	mp4fw_box_end(v, smhd);
+
+	size_t dinf = mp4fw_box(v, "dinf");
+	size_t dref = mp4fw_fullbox(v, "dref", 0, 0);
+	mp4fw_w32(v, 1);
+	size_t url = mp4fw_fullbox(v, "url ", 0, 1); // data is in this file
+	mp4fw_box_end(v, url);
+	mp4fw_box_end(v, dref);
+	mp4fw_box_end(v, dinf);
+
+	mp4fw_stbl(w, v);
+	mp4fw_box_end(v, minf);
+	mp4fw_box_end(v, mdia);
+	mp4fw_box_end(v, trak);
+
+	if (w->flags & MP4FW_FRAGMENTED) {
+		size_t mvex = mp4fw_box(v, "mvex");
+		size_t trex = mp4fw_fullbox(v, "trex", 0, 0);
+		mp4fw_w32(v, 1); // track ID
+		mp4fw_w32(v, 1); // default sample description index
+		mp4fw_w32(v, w->info.frame_samples); // default sample duration
+		mp4fw_w32(v, 0); // default sample size
+		mp4fw_w32(v, 0); // default sample flags
+		mp4fw_box_end(v, trex);
+		mp4fw_box_end(v, mvex);
+	}
+
+	mp4fw_udta(w, v);
+	mp4fw_box_end(v, moov);
+}
+
+/** Write moof and mdat with the frames collected so far */
+static void mp4fw_fragment(mp4fw *w, ffvec *v)
+{
+	uint n = w->sizes.len;
+	size_t moof = mp4fw_box(v, "moof");
+
+	size_t mfhd = mp4fw_fullbox(v, "mfhd", 0, 0);
+	mp4fw_w32(v, ++w->seq);
+	mp4fw_box_end(v, mfhd);
+
+	size_t traf = mp4fw_box(v, "traf");
+	size_t tfhd = mp4fw_fullbox(v, "tfhd", 0, 0x020000 | 0x08); // default-base-is-moof, default-sample-duration
+	mp4fw_w32(v, 1);
+	mp4fw_w32(v, w->info.frame_samples);
+	mp4fw_box_end(v, tfhd);
+
+	size_t tfdt = mp4fw_fullbox(v, "tfdt", 1, 0);
+	mp4fw_w64(v, w->frag_start);
+	mp4fw_box_end(v, tfdt);
+
+	size_t trun = mp4fw_fullbox(v, "trun", 0, 0x01 | 0x0200); // data-offset, sample-size
+	mp4fw_w32(v, n);
+	size_t data_off = v->len;
+	mp4fw_w32(v, 0);
+	const uint *sizes = w->sizes.ptr;
+	for (uint i = 0;  i != n;  i++) {
+		mp4fw_w32(v, sizes[i]);
+	}
+	mp4fw_box_end(v, trun);
+	mp4fw_box_end(v, traf);
+	mp4fw_box_end(v, moof);
+
+	// data offset is relative to the beginning of 'moof'
+	*(uint*)((char*)v->ptr + data_off) = ffint_be_cpu32(v->len - moof + 8);
+
+	mp4fw_w32(v, 8 + w->frames.len);
+	ffvec_add(v, "mdat", 4, 1);
+	ffvec_add(v, w->frames.ptr, w->frames.len, 1);
+
+	w->frag_start += w->frag_samples;
+	w->frag_samples = 0;
+	w->sizes.len = 0;
+	w->frames.len = 0;
+}
+
+/**
+flags: enum MP4FW_F
+Return 0 on success */
+static int mp4fw_create(mp4fw *w, const struct mp4fw_info *info, uint flags)
+{
+	if (info->frame_samples == 0 || info->rate == 0
+		|| ((flags & MP4FW_FASTSTART) && info->total_samples == 0)) {
+		w->err = "bad parameters";
+		return -1;
+	}
+	w->info = *info;
+	w->flags = flags;
+	ffvec_add2T(&w->conf, &info->conf, byte);
+	ffstr_null(&w->info.conf);
+	if (w->info.frag_msec == 0)
+		w->info.frag_msec = 1000;
+	return 0;
+}
+
+static int mp4fw_process(mp4fw *w, ffstr *in, ffstr *out)
+{
+	enum { W_HDR, W_FRAMES, W_MDAT_SIZE, W_MDAT_SIZE_DATA, W_MOOV, W_MOOV_DATA, W_DONE };
+
+	for (;;) {
+		switch (w->state) {
+		case W_HDR:
+			w->buf.len = 0;
+			mp4fw_ftyp(w, &w->buf);
+			if (w->flags & MP4FW_FRAGMENTED) {
+				mp4fw_moov(w, &w->buf);
+			} else {
+				// reserve space for moov: the tables are 4 bytes per frame
+				w->moov_off = w->buf.len;
+				uint64 nframes = w->info.total_samples / w->info.frame_samples;
+				nframes += nframes / 64 + 16;
+				mp4fw_moov(w, &w->buf);
+				uint64 n = (w->buf.len - w->moov_off) + nframes * 4 + 64;
+				if (n > 0x7fffffff) {
+					w->err = "too many frames";
+					return MP4FW_ERROR;
+				}
+				w->moov_reserved = n;
+				w->buf.len = w->moov_off;
+				mp4fw_w32(&w->buf, w->moov_reserved);
+				ffvec_add(&w->buf, "free", 4, 1);
+				mp4fw_zero(&w->buf, w->moov_reserved - 8);
+
+				// mdat with 64-bit size
+				mp4fw_w32(&w->buf, 1);
+				ffvec_add(&w->buf, "mdat", 4, 1);
+				mp4fw_w64(&w->buf, 0);
+				w->data_off = w->buf.len;
+			}
+			w->end_off = w->buf.len;
+			w->state = W_FRAMES;
+			ffstr_set2(out, &w->buf);
+			return MP4FW_DATA;
+
+		case W_FRAMES:
+			if (in->len != 0) {
+				if (in->len > 0xffffffff) {
+					w->err = "frame is too large";
+					return MP4FW_ERROR;
+				}
+				*ffvec_pushT(&w->sizes, uint) = in->len;
+
+				if (!(w->flags & MP4FW_FRAGMENTED)) {
+					*out = *in;
+					in->len = 0;
+					w->end_off += out->len;
+					return MP4FW_DATA;
+				}
+
+				ffvec_add2T(&w->frames, in, byte);
+				in->len = 0;
+				w->frag_samples += w->info.frame_samples;
+				if (!w->fin
+					&& (uint64)w->frag_samples * 1000 / w->info.rate < w->info.frag_msec)
+					return MP4FW_MORE;
+
+			} else if (!w->fin) {
+				return MP4FW_MORE;
+			}
+
+			if (!(w->flags & MP4FW_FRAGMENTED)) {
+				w->state = W_MDAT_SIZE;
+				continue;
+			}
+
+			if (w->fin)
+				w->state = W_DONE;
+			if (w->sizes.len == 0)
+				continue;
+			w->buf.len = 0;
+			mp4fw_fragment(w, &w->buf);
+			w->end_off += w->buf.len;
+			ffstr_set2(out, &w->buf);
+			return MP4FW_DATA;
+
+		case W_MDAT_SIZE:
+			w->buf.len = 0;
+			mp4fw_w32(&w->buf, 1);
+			ffvec_add(&w->buf, "mdat", 4, 1);
+			mp4fw_w64(&w->buf, w->end_off - w->data_off + 16);
+			w->off = w->data_off - 16;
+			w->state = W_MDAT_SIZE_DATA;
+			return MP4FW_SEEK;
+
+		case W_MDAT_SIZE_DATA:
+			w->state = W_MOOV;
+			ffstr_set2(out, &w->buf);
+			return MP4FW_DATA;
+
+		case W_MOOV:
+			w->buf.len = 0;
+			mp4fw_moov(w, &w->buf);
+			if (w->buf.len == w->moov_reserved
+				|| w->buf.len + 8 <= w->moov_reserved) {
+				if (w->buf.len != w->moov_reserved) {
+					mp4fw_w32(&w->buf, w->moov_reserved - w->buf.len);
+					ffvec_add(&w->buf, "free", 4, 1);
+				}
+				w->off = w->moov_off;
+			} else {
+				// the estimated number of frames was too small: moov goes after mdat
+				w->off = w->end_off;
+			}
+			w->state = W_MOOV_DATA;
+			return MP4FW_SEEK;
+
+		case W_MOOV_DATA:
+			w->state = W_DONE;
+			ffstr_set2(out, &w->buf);
+			return MP4FW_DATA;
+
+		case W_DONE:
+			return MP4FW_DONE;
+		}
+	}
+}
@@ -2,12 +2,35 @@
 2021, Simon Zolin */
 
 #include <avpack/mp4-write.h>
+#include <format/mp4-frag.h>
+
+struct mp4_out_conf_t {
+	byte fragmented;
+	byte faststart;
+	uint fragment_duration;
+} mp4_out_conf;
+
+const fmed_conf_arg mp4_out_conf_args[] = {
+	{ "fragmented",	FMC_BOOL8,  FMC_O(struct mp4_out_conf_t, fragmented) },
+	{ "faststart",	FMC_BOOL8,  FMC_O(struct mp4_out_conf_t, faststart) },
+	{ "fragment_duration",	FMC_INT32,  FMC_O(struct mp4_out_conf_t, fragment_duration) },
+	{}
+};
+
+int mp4_out_config(fmed_conf_ctx *ctx)
+{
+	mp4_out_conf.fragment_duration = 1000;
+	fmed_conf_addctx(ctx, &mp4_out_conf, mp4_out_conf_args);
+	return 0;
+}
 
 typedef struct mp4_out {
 	uint state;
 	mp4write mp;
+	mp4fw fw;
 	ffstr in;
 	uint stmcopy :1;
+	uint fw_active :1; // use 'fw' instead of 'mp'
 } mp4_out;
 
 static void* mp4_out_create(fmed_track_info *d)
@@ -20,6 +43,7 @@ static void mp4_out_free(void *ctx)
 {
 	mp4_out *m = ctx;
 	mp4write_close(&m->mp);
+	mp4fw_close(&m->fw);
 	ffmem_free(m);
 }
 
@@ -39,6 +63,11 @@ static int mp4_out_addmeta(mp4_out *m, fmed_track_info *d)
 			continue;
 		}
 
+		if (m->fw_active) {
+			mp4fw_addtag(&m->fw, name, meta.val);
+			continue;
+		}
+
 		if (0 != mp4write_addtag(&m->mp, tag, meta.val)) {
 			warnlog1(d->trk, "can't add tag: %S", &name);
 		}
@@ -46,6 +75,34 @@ static int mp4_out_addmeta(mp4_out *m, fmed_track_info *d)
 	return 0;
 }
 
+static int mp4_out_frag(mp4_out *m, fmed_track_info *d)
+{
+	ffstr out;
+	for (;;) {
+		int r = mp4fw_process(&m->fw, &m->in, &out);
+		switch (r) {
+		case MP4FW_MORE:
+			return FMED_RMORE;
+
+		case MP4FW_SEEK:
+			d->output.seek = m->fw.off;
+			continue;
+
+		case MP4FW_DATA:
+			d->data_out = out;
+			return FMED_RDATA;
+
+		case MP4FW_DONE:
+			d->outlen = 0;
+			return FMED_RDONE;
+
+		case MP4FW_ERROR:
+			errlog1(d->trk, "mp4fw_process(): %s", mp4fw_error(&m->fw));
+			return FMED_RERR;
+		}
+	}
+}
+
 /* Encoding process:
 . Add encoder filter to the chain
 . Get encoder config data
@@ -100,7 +157,35 @@ static int mp4_out_encode(void *ctx, fmed_track_info *d)
 		info.enc_delay = d->a_enc_delay;
 		info.bitrate = d->a_enc_bitrate;
 
-		if (0 != (r = mp4write_create_aac(&m->mp, &info))) {
+		uint fwflags = 0;
+		if (!d->out_seekable || mp4_out_conf.fragmented) {
+			fwflags = MP4FW_FRAGMENTED;
+		} else if (mp4_out_conf.faststart) {
+			if (info.total_samples != 0)
+				fwflags = MP4FW_FASTSTART;
+			else
+				warnlog1(d->trk, "faststart: total duration is unknown");
+		}
+
+		if (fwflags != 0) {
+			struct mp4fw_info fi = {
+				.rate = info.fmt.rate,
+				.channels = info.fmt.channels,
+				.frame_samples = info.frame_samples,
+				.enc_delay = info.enc_delay,
+				.bitrate = info.bitrate,
+				.total_samples = info.total_samples,
+				.frag_msec = mp4_out_conf.fragment_duration,
+				.conf = info.conf,
+			};
+			if (0 != mp4fw_create(&m->fw, &fi, fwflags)) {
+				errlog1(d->trk, "mp4fw_create(): %s", mp4fw_error(&m->fw));
+				return FMED_RERR;
+			}
+			m->fw_active = 1;
+			dbglog1(d->trk, "%s MP4", (fwflags == MP4FW_FRAGMENTED) ? "fragmented" : "faststart");
+
+		} else if (0 != (r = mp4write_create_aac(&m->mp, &info))) {
 			errlog1(d->trk, "ffmp4_create_aac(): %s", mp4write_error(&m->mp));
 			return FMED_RERR;
 		}
@@ -113,8 +198,10 @@ static int mp4_out_encode(void *ctx, fmed_track_info *d)
 	}
 	}
 
-	if (d->flags & FMED_FLAST)
+	if (d->flags & FMED_FLAST) {
 		m->mp.fin = 1;
+		m->fw.fin = 1;
+	}
 
 	if (d->datalen != 0) {
 		m->in = d->data_in;
@@ -122,6 +209,9 @@ static int mp4_out_encode(void *ctx, fmed_track_info *d)
 	}
 
 	ffstr out;
+	if (m->fw_active)
+		return mp4_out_frag(m, d);
+
 	for (;;) {
 		r = mp4write_process(&m->mp, &m->in, &out);
 		switch (r) {
@@ -2,6 +2,7 @@
 2021, Simon Zolin */
 
 #include <avpack/ogg-read.h>
+#include <format/seek-index.h>
 
 struct ogg_in_conf_t {
 	byte seekable;
@@ -25,7 +26,12 @@ struct ogg_in {
 	void *trk;
 	uint sample_rate;
 	uint state;
+	struct seekidx sidx;
+	uint64 restart_pos; // audio position of the page the reader was restarted from
+	uint restart_page;
 	uint stmcopy :1;
+	uint restarted :1; // the reader was restarted from the page found in seek index
+	uint building :1; // reading the whole file to build seek index
 };
 
 static void ogg_log(void *udata, const char *fmt, va_list va)
@@ -34,17 +40,22 @@ static void ogg_log(void *udata, const char *fmt, va_list va)
 	fmed_dbglogv(core, o->trk, NULL, fmt, va);
 }
 
-static void* ogg_open(fmed_track_info *d)
+static void ogg_reader_open(struct ogg_in *o, fmed_track_info *d)
 {
-	struct ogg_in *o = ffmem_new(struct ogg_in);
-	o->trk = d->trk;
-
 	ffuint64 total_size = 0;
 	if (conf.seekable && (int64)d->input.size != FMED_NULL)
 		total_size = d->input.size;
 	oggread_open(&o->og, total_size);
 	o->og.log = ogg_log;
 	o->og.udata = o;
+}
+
+static void* ogg_open(fmed_track_info *d)
+{
+	struct ogg_in *o = ffmem_new(struct ogg_in);
+	o->trk = d->trk;
+
+	ogg_reader_open(o, d);
 
 	if (d->stream_copy) {
 		d->datatype = "OGG";
@@ -57,13 +68,65 @@ static void ogg_close(void *ctx)
 {
 	struct ogg_in *o = ctx;
 	oggread_close(&o->og);
+	seekidx_close(&o->sidx);
 	ffmem_free(o);
 }
 
+/** Seek using the index: restart the reader from the page before the target position.
+The reader doesn't know the file size after restart, so it won't try to bisect. */
+static int ogg_index_seek(struct ogg_in *o, fmed_track_info *d, uint64 sample)
+{
+	const struct seekidx_point *p;
+	if (NULL == (p = seekidx_find(&o->sidx, sample)))
+		return -1;
+
+	oggread_close(&o->og);
+	oggread_open(&o->og, 0);
+	o->og.log = ogg_log;
+	o->og.udata = o;
+	o->in.len = 0;
+	o->restart_pos = p->sample;
+	o->restart_page = (uint)-1;
+	o->restarted = 1;
+	d->input.seek = p->off;
+	dbglog1(d->trk, "seek: %Ums: using index: page @%U  offset:%xU"
+		, d->audio.seek, p->sample, p->off);
+	return 0;
+}
+
+/** Add the page to seek index if it starts with audio data. */
+static void ogg_index_page(struct ogg_in *o)
+{
+	if (oggread_pkt_num(&o->og) != 0)
+		return;
+	seekidx_add(&o->sidx, oggread_page_pos(&o->og), oggread_offset(&o->og) - o->og.chunk.len);
+}
+
+/** The whole file is read: save seek index and start reading the file from the beginning again. */
+static void ogg_index_built(struct ogg_in *o, fmed_track_info *d)
+{
+	seekidx_fin(&o->sidx, d->trk);
+	o->building = 0;
+	oggread_close(&o->og);
+	ogg_reader_open(o, d);
+	o->in.len = 0;
+	d->input.seek = 0;
+}
+
 #define VORBIS_HEAD_STR  "\x01vorbis"
 #define FLAC_HEAD_STR  "\x7f""FLAC"
 #define OPUS_HEAD_STR  "OpusHead"
 
+static int ogg_out_is_ogg(fmed_track_info *d)
+{
+	if (d->out_filename == NULL)
+		return 0;
+	ffstr name, ext;
+	ffpath_splitpath(d->out_filename, ffsz_len(d->out_filename), NULL, &name);
+	ffstr_rsplitby(&name, '.', NULL, &ext);
+	return ffstr_ieqz(&ext, "ogg") || ffstr_ieqz(&ext, "oga") || ffstr_ieqz(&ext, "opus");
+}
+
 static int add_decoder(struct ogg_in *o, fmed_track_info *d, ffstr data)
 {
 	const char *dec = NULL, *meta_filter_name = NULL;
@@ -78,7 +141,9 @@ static int add_decoder(struct ogg_in *o, fmed_track_info *d, ffstr data)
 			dec = "opus.decode";
 
 	} else if (ffstr_matchz(&data, FLAC_HEAD_STR)) {
-		dec = "fmt.flacogg";
+		// OGG->OGG copy passes the pages as is, otherwise FLAC frames are extracted
+		if (!(d->stream_copy && ogg_out_is_ogg(d)))
+			dec = "fmt.flacogg";
 	} else {
 		errlog1(d->trk, "Unknown codec in OGG packet: %*xb"
 			, ffmin(data.len, 16), data.ptr);
@@ -134,7 +199,11 @@ static int ogg_decode(void *ctx, fmed_track_info *d)
 
 		if (d->seek_req && (int64)d->audio.seek != FMED_NULL && o->sample_rate != 0) {
 			d->seek_req = 0;
-			oggread_seek(&o->og, ffpcm_samples(d->audio.seek, o->sample_rate));
+			uint64 sample = ffpcm_samples(d->audio.seek, o->sample_rate);
+			if (0 == ogg_index_seek(o, d, sample))
+				return FMED_RMORE;
+			seekidx_cancel(&o->sidx);
+			oggread_seek(&o->og, sample);
 			dbglog1(d->trk, "seek: %Ums", d->audio.seek);
 		}
 
@@ -142,6 +211,10 @@ static int ogg_decode(void *ctx, fmed_track_info *d)
 		switch (r) {
 		case OGGREAD_MORE:
 			if (d->flags & FMED_FLAST) {
+				if (o->building) {
+					ogg_index_built(o, d);
+					return FMED_RMORE;
+				}
 				dbglog1(d->trk, "no eos page");
 				d->outlen = 0;
 				return FMED_RLASTOUT;
@@ -150,15 +223,33 @@ static int ogg_decode(void *ctx, fmed_track_info *d)
 
 		case OGGREAD_HEADER:
 		case OGGREAD_DATA:
+			if (r == OGGREAD_DATA)
+				ogg_index_page(o);
+			if (o->building)
+				break;
+
 			if (o->state == I_HDR) {
-				o->state = I_INFO;
 				d->audio.total = oggread_info(&o->og)->total_samples;
+				if (o->sidx.fn == NULL && !o->stmcopy) {
+					seekidx_open(&o->sidx, d, 0, d->seek_index_build);
+					if (d->seek_index_build && o->sidx.state == SEEKIDX_RECORD) {
+						o->building = 1;
+						break; // read the whole file
+					}
+				}
+
+				o->state = I_INFO;
 				if (0 != add_decoder(o, d, d->data_out))
 					return FMED_RERR;
 			}
 			goto data;
 
 		case OGGREAD_DONE:
+			if (o->building) {
+				ogg_index_built(o, d);
+				return FMED_RMORE;
+			}
+			seekidx_fin(&o->sidx, d->trk);
 			d->data_out.len = 0;
 			return FMED_RLASTOUT;
 
@@ -175,6 +266,13 @@ static int ogg_decode(void *ctx, fmed_track_info *d)
 
 data:
 	d->audio.pos = oggread_page_pos(&o->og);
+	if (o->restarted) {
+		// the position of the first page after restart is unknown to the reader
+		if (o->restart_page == (uint)-1)
+			o->restart_page = oggread_page_num(&o->og);
+		if (o->restart_page == oggread_page_num(&o->og))
+			d->audio.pos = o->restart_pos;
+	}
 	dbglog1(d->trk, "packet#%u.%u  length:%L  page-start-pos:%U"
 		, (int)oggread_page_num(&o->og), (int)oggread_pkt_num(&o->og)
 		, d->data_out.len
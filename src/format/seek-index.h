@@ -0,0 +1,196 @@
+/** fmedia: seek index for files without a usable seek table
+2023, Simon Zolin */
+
+/*
+While a file is read sequentially from the beginning, the demuxer records
+ the positions of the frames (or pages) it passes, every SEEKIDX_INTERVAL samples.
+When the end of file is reached, the index is saved to "USER_PATH/cache/seek-HASH.bin".
+Next time the file is opened the index is loaded,
+ and seeking is performed by a single read from the offset of the nearest frame
+ instead of estimating or bisecting the position.
+The index is valid while the source file's size and modification time are unchanged.
+
+HDR POINT...
+HDR: "fmedsidx" VER[4] NPOINTS[4] SIZE[8] MTIME_SEC[8] MTIME_NSEC[4] RESERVED[4]
+POINT: SAMPLE[8] OFFSET[8]
+Numbers are in host byte order.
+*/
+
+#include <ffbase/murmurhash3.h>
+#include <FFOS/file.h>
+
+#define SEEKIDX_MAGIC  "fmedsidx"
+enum {
+	SEEKIDX_VER = 1,
+	SEEKIDX_INTERVAL_SEC = 1, // distance between points
+	SEEKIDX_MIN_SEC = 60, // don't index short files
+};
+
+struct seekidx_hdr {
+	char magic[8];
+	uint ver;
+	uint npoints;
+	uint64 size;
+	uint64 mtime_sec;
+	uint mtime_nsec;
+	uint reserved;
+};
+
+struct seekidx_point {
+	uint64 sample;
+	uint64 off; // absolute file offset of the frame
+};
+
+enum SEEKIDX_ST {
+	SEEKIDX_OFF,
+	SEEKIDX_RECORD, // recording the index while reading the file
+	SEEKIDX_READY, // index is loaded
+};
+
+struct seekidx {
+	uint state; // enum SEEKIDX_ST
+	uint interval; // samples
+	uint64 next; // record the next point at this sample
+	ffvec points; // struct seekidx_point[]
+	char *fn; // cache file name
+	uint64 size;
+	fftime mtime;
+};
+
+static void seekidx_hdr_init(struct seekidx *si, struct seekidx_hdr *h, uint npoints)
+{
+	ffmem_zero_obj(h);
+	ffmem_copy(h->magic, SEEKIDX_MAGIC, 8);
+	h->ver = SEEKIDX_VER;
+	h->npoints = npoints;
+	h->size = si->size;
+	h->mtime_sec = si->mtime.sec;
+	h->mtime_nsec = si->mtime.nsec;
+}
+
+static int seekidx_load(struct seekidx *si)
+{
+	ffvec buf = {};
+	int rc = -1;
+	if (0 != fffile_readwhole(si->fn, &buf, 64*1024*1024))
+		goto end;
+
+	struct seekidx_hdr h, *fh = (void*)buf.ptr;
+	if (buf.len < sizeof(h))
+		goto end;
+	seekidx_hdr_init(si, &h, fh->npoints);
+	if (0 != ffmem_cmp(&h, fh, sizeof(h))
+		|| h.npoints == 0
+		|| (buf.len - sizeof(h)) / sizeof(struct seekidx_point) != h.npoints)
+		goto end;
+
+	ffvec_add(&si->points, (char*)buf.ptr + sizeof(h), h.npoints, sizeof(struct seekidx_point));
+	rc = 0;
+
+end:
+	ffvec_free(&buf);
+	return rc;
+}
+
+/** Prepare the index for the input file: load it from cache or start recording.
+rate: sample rate;  0:unknown
+build: the user requested to build the index */
+static void seekidx_open(struct seekidx *si, fmed_track_info *d, uint rate, uint build)
+{
+	const char *fn = d->track->getvalstr(d->trk, "input");
+	if (fn == FMED_PNULL
+		|| core->props->user_path == NULL
+		|| (int64)d->input.size == FMED_NULL
+		|| d->stream_copy)
+		return;
+
+	if (rate == 0)
+		rate = 48000;
+	if (!build
+		&& d->audio.total != 0 && (int64)d->audio.total != FMED_NULL
+		&& d->audio.total < (uint64)SEEKIDX_MIN_SEC * rate)
+		return;
+
+	uint hash = murmurhash3(fn, ffsz_len(fn), 0x12345678);
+	si->fn = ffsz_allocfmt("%scache%cseek-%08xu.bin"
+		, core->props->user_path, FFPATH_SLASH, hash);
+	si->size = d->input.size;
+	si->mtime = d->in_mtime;
+	si->interval = SEEKIDX_INTERVAL_SEC * rate;
+
+	if (0 == seekidx_load(si)) {
+		si->state = SEEKIDX_READY;
+		dbglog1(d->trk, "seek index: loaded %L points from %s", si->points.len, si->fn);
+		return;
+	}
+
+	si->state = SEEKIDX_RECORD;
+}
+
+static void seekidx_close(struct seekidx *si)
+{
+	ffvec_free(&si->points);
+	ffmem_free(si->fn);
+}
+
+/** Add point for the frame which starts at the specified position. */
+static inline void seekidx_add(struct seekidx *si, uint64 sample, uint64 off)
+{
+	if (si->state != SEEKIDX_RECORD || sample < si->next)
+		return;
+	struct seekidx_point *p = ffvec_pushT(&si->points, struct seekidx_point);
+	p->sample = sample;
+	p->off = off;
+	si->next = sample + si->interval;
+}
+
+/** Stop recording: the file isn't read sequentially anymore. */
+static inline void seekidx_cancel(struct seekidx *si)
+{
+	if (si->state != SEEKIDX_RECORD)
+		return;
+	si->state = SEEKIDX_OFF;
+	ffvec_free(&si->points);
+}
+
+/** The whole file is read: save the index. */
+static void seekidx_fin(struct seekidx *si, void *trk)
+{
+	if (si->state != SEEKIDX_RECORD || si->points.len == 0)
+		return;
+	si->state = SEEKIDX_READY;
+
+	ffvec buf = {};
+	struct seekidx_hdr h;
+	seekidx_hdr_init(si, &h, si->points.len);
+	ffvec_add(&buf, &h, sizeof(h), 1);
+	ffvec_add(&buf, si->points.ptr, si->points.len * sizeof(struct seekidx_point), 1);
+
+	if (0 != fmed_file_writewhole(si->fn, buf.ptr, buf.len)) {
+		dbglog1(trk, "can't write seek index: %s: %E", si->fn, fferr_last());
+		goto end;
+	}
+	dbglog1(trk, "seek index: written %L points to %s", si->points.len, si->fn);
+
+end:
+	ffvec_free(&buf);
+}
+
+/** Find the nearest point before the target sample.
+Return NULL if the index isn't ready. */
+static const struct seekidx_point* seekidx_find(struct seekidx *si, uint64 sample)
+{
+	if (si->state != SEEKIDX_READY)
+		return NULL;
+
+	const struct seekidx_point *p = si->points.ptr;
+	size_t lo = 0, hi = si->points.len;
+	while (hi - lo > 1) {
+		size_t i = lo + (hi - lo) / 2;
+		if (p[i].sample <= sample)
+			lo = i;
+		else
+			hi = i;
+	}
+	return &p[lo];
+}
@@ -7,6 +7,7 @@ struct wavout {
 	wavwrite wav;
 	ffstr in;
 	uint state;
+	uint stream :1;
 };
 
 void* wavout_open(fmed_filt *d)
@@ -48,8 +49,13 @@ int wavout_process(void *ctx, fmed_filt *d)
 			info.format = WAV_FLOAT;
 		info.sample_rate = d->audio.convfmt.sample_rate;
 		info.channels = d->audio.convfmt.channels;
-		if ((int64)d->audio.total != FMED_NULL)
+		if ((int64)d->audio.total != FMED_NULL) {
 			info.total_samples = ((d->audio.total - d->audio.pos) * d->audio.convfmt.sample_rate / d->audio.fmt.sample_rate);
+		} else if (!d->out_seekable) {
+			// the header can't be updated later: set the maximum data size, so the readers read until EOF
+			info.total_samples = (0xffffffff - 4096) / (ffpcm_bits(d->audio.convfmt.format) / 8 * info.channels);
+			w->stream = 1;
+		}
 		wavwrite_create(&w->wav, &info);
 		w->state = 2;
 	}
@@ -85,7 +91,10 @@ int wavout_process(void *ctx, fmed_filt *d)
 
 		case WAVWRITE_SEEK:
 			if (!d->out_seekable) {
-				warnlog1(d->trk, "can't seek to finalize WAV header");
+				if (w->stream)
+					dbglog1(d->trk, "streaming WAV: the header has the maximum data size");
+				else
+					warnlog1(d->trk, "can't seek to finalize WAV header");
 				d->data_out.len = 0;
 				return FMED_RDONE;
 			}
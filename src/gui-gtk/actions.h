@@ -93,6 +93,7 @@
 	A(A_ONDROPFILE),
 	A(LOADLISTS),
 	A(LIST_DISPINFO),
+	A(LIST_SCROLL),
 	A(_A_PLAY_REPEAT),
 	A(_A_LIST_RANDOM),
 	A(_A_URLS_ADD_PLAY),
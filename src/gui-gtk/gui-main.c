@@ -21,6 +21,7 @@ struct gui_wmain {
 	ffui_trayicon tray_icon;
 
 	fmed_que_entry *active_qent;
+	uint probe_first, probe_last; // visible range reported to queue
 
 	ffstr exp_path; // path with trailing '/'
 	ffvec exp_files; // struct exp_file[]
@@ -54,6 +55,7 @@ static void list_del();
 static void list_save();
 static void hidetotray();
 static void list_dispinfo(struct ffui_view_disp *disp);
+static void list_probe(void);
 static void list_cols_width_load();
 
 enum LIST_HDR {
@@ -75,6 +77,8 @@ void wmain_init()
 	struct gui_wmain *w = ffmem_new(struct gui_wmain);
 	gg->wmain = w;
 	w->vlist.dispinfo_id = LIST_DISPINFO;
+	w->vlist.scroll_id = LIST_SCROLL;
+	w->probe_first = -1;
 	w->wnd.on_action = &wmain_action;
 	w->wnd.onclose_id = A_ONCLOSE;
 }
@@ -306,6 +310,11 @@ static void wmain_action(ffui_wnd *wnd, int id)
 			list_dispinfo(&w->vlist.disp);
 		return;
 
+	case LIST_SCROLL:
+		if (ffui_tab_active(&w->tabs) != w->exp_tab)
+			list_probe();
+		return;
+
 	default:
 		FF_ASSERT(0);
 		return;
@@ -384,6 +393,20 @@ static void list_dispinfo(struct ffui_view_disp *disp)
 	gg->qu->cmdv(FMED_QUE_ITEMUNLOCK, ent);
 }
 
+/** Request meta data for the visible rows */
+static void list_probe(void)
+{
+	struct gui_wmain *w = gg->wmain;
+	uint first, last;
+	if (!ffui_view_visible_range(&w->vlist, &first, &last))
+		return;
+	if (first == w->probe_first && last == w->probe_last)
+		return;
+	w->probe_first = first;
+	w->probe_last = last;
+	gg->qu->cmdv(FMED_QUE_PROBE, first, last);
+}
+
 void wmain_list_update(uint idx, int delta)
 {
 	struct gui_wmain *w = gg->wmain;
@@ -397,6 +420,7 @@ static void list_setdata_scroll(void *param)
 {
 	struct gui_wmain *w = gg->wmain;
 	ffui_view_clear(&w->vlist);
+	w->probe_first = -1; // the list is new
 	// dbglog("ffui_view_setdata =%L", (ffsize)param);
 	ffui_view_setdata(&w->vlist, 0, (size_t)param);
 }
@@ -160,6 +160,7 @@ static int gui_sig(uint signo)
 	case FMED_SIG_INIT:
 		if (NULL == (gg = ffmem_new(ggui)))
 			return -1;
+		fflk_init(&gg->lktrk);
 		gg->vol = 100;
 		gg->go_pos = -1;
 		gg->kqsig = FFKQSIG_NULL;
@@ -790,12 +791,18 @@ static void lists_load(void)
 	const char *fn = core->props->user_path;
 	ffarr buf = {};
 
-	if (NULL == ffarr_alloc(&buf, ffsz_len(fn) + FFSLEN(AUTOPLIST_FN) + FFINT_MAXCHARS + 1))
+	if (NULL == ffarr_alloc(&buf, ffsz_len(fn) + FFSLEN(AUTOPLIST_FN_OLD) + FFINT_MAXCHARS + 1))
 		goto end;
 
+	// load the lists saved by the previous version if there are no lists in the new format
+	const char *name_fmt = "%s" AUTOPLIST_FN "%Z";
+	ffstr_catfmt(&buf, name_fmt, fn, 1);
+	if (!fffile_exists(buf.ptr))
+		name_fmt = "%s" AUTOPLIST_FN_OLD "%Z";
+
 	for (uint i = 1;  ;  i++) {
 		buf.len = 0;
-		ffstr_catfmt(&buf, "%s" AUTOPLIST_FN "%Z", fn, i);
+		ffstr_catfmt(&buf, name_fmt, fn, i);
 		buf.len--;
 		if (!fffile_exists(buf.ptr))
 			break;
@@ -22,7 +22,8 @@ enum {
 
 #define CTL_CONF_FN  "fmedia.gui.conf"
 #define FMED_USERCONF  "fmedia-user.conf"
-#define AUTOPLIST_FN  "list%u.m3uz"
+#define AUTOPLIST_FN  "list%u.fmpl"
+#define AUTOPLIST_FN_OLD  "list%u.m3uz" // the format used by the previous versions
 
 enum FILE_DEL_METHOD {
 	FDM_TRASH,
@@ -74,7 +75,8 @@ typedef struct ggui {
 	const fmed_queue *qu;
 	const fmed_track *track;
 	ffthd th;
-	struct gtrk *curtrk;
+	fflock lktrk;
+	struct gtrk *curtrk; // Thread: set by the track's worker, cleared by main
 	int focused;
 	uint vol; //0..MAXVOL
 	uint go_pos;
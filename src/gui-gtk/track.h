@@ -33,22 +33,16 @@ static double gtrk_vol2(gtrk *t, uint pos)
 	return db;
 }
 
-/** Set volume. */
-static void gtrk_vol(uint pos)
+/** Thread: worker */
+static void gtrk_vol_set(gtrk *t, uint pos)
 {
-	if (gg->curtrk == NULL)
-		return;
-
-	double db = gtrk_vol2(gg->curtrk, pos);
+	double db = gtrk_vol2(t, pos);
 	wmain_status("Volume: %.02FdB", db);
 }
 
-/** Set seek position. */
-static void gtrk_seek(uint cmd, uint val)
+/** Thread: worker */
+static void gtrk_seek_set(gtrk *t, uint cmd, uint val)
 {
-	if (gg->curtrk == NULL)
-		return;
-	gtrk *t = gg->curtrk;
 	int delta, seek = -1;
 	switch (cmd) {
 	case A_SEEK:
@@ -84,6 +78,70 @@ use_delta:
 		t->d->adev->cmd(FMED_ADEV_CMD_CLEAR, t->d->adev_ctx);
 }
 
+struct gtrk_cmd {
+	fftask tsk;
+	void *trk;
+	uint cmd;
+	uint val;
+};
+
+/** Execute the command for the current track.
+Thread: worker */
+static void gtrk_cmd_run(void *param)
+{
+	struct gtrk_cmd *c = param;
+
+	fflk_lock(&gg->lktrk);
+	gtrk *t = gg->curtrk;
+	if (t == NULL || t->trk != c->trk)
+		goto done; // the track has been closed
+
+	if (c->cmd == A_VOL)
+		gtrk_vol_set(t, c->val);
+	else
+		gtrk_seek_set(t, c->cmd, c->val);
+
+done:
+	fflk_unlock(&gg->lktrk);
+	ffmem_free(c);
+}
+
+/** Pass the command to the worker thread which processes the current track:
+ the track's data may be modified only there. */
+static void gtrk_xcmd(uint cmd, uint val)
+{
+	struct gtrk_cmd *c = ffmem_new(struct gtrk_cmd);
+	if (c == NULL)
+		return;
+	c->cmd = cmd;
+	c->val = val;
+	fftask_set(&c->tsk, &gtrk_cmd_run, c);
+
+	// post while holding the lock: the track can't be closed (and freed) meanwhile
+	fflk_lock(&gg->lktrk);
+	if (gg->curtrk != NULL) {
+		c->trk = gg->curtrk->trk;
+		gg->track->cmd(c->trk, FMED_TRACK_XPOST, &c->tsk);
+		c = NULL;
+	}
+	fflk_unlock(&gg->lktrk);
+	ffmem_free(c);
+}
+
+/** Set volume.
+Thread: main */
+static void gtrk_vol(uint pos)
+{
+	gtrk_xcmd(A_VOL, pos);
+}
+
+/** Set seek position.
+Thread: main */
+static void gtrk_seek(uint cmd, uint val)
+{
+	gtrk_xcmd(cmd, val);
+}
+
 static void* gtrk_open(fmed_filt *d)
 {
 	fmed_que_entry *ent = (void*)d->track->getval(d->trk, "queue_item");
@@ -97,6 +155,7 @@ static void* gtrk_open(fmed_filt *d)
 	t->qent = ent;
 	t->d = d;
 	t->seek_msec = -1;
+	t->trk = d->trk;
 
 	if (d->type == FMED_TRK_TYPE_CONVERT) {
 		t->conversion = 1;
@@ -108,10 +167,11 @@ static void* gtrk_open(fmed_filt *d)
 		if (gg->conf.auto_attenuate_ceiling < 0) {
 			d->audio.auto_attenuate_ceiling = gg->conf.auto_attenuate_ceiling;
 		}
+		fflk_lock(&gg->lktrk);
 		gg->curtrk = t;
+		fflk_unlock(&gg->lktrk);
 	}
 
-	t->trk = d->trk;
 	return t;
 }
 
@@ -122,7 +182,9 @@ static void gtrk_close(void *ctx)
 		gui_timer_stop();
 
 	} else if (gg->curtrk == t) {
+		fflk_lock(&gg->lktrk);
 		gg->curtrk = NULL;
+		fflk_unlock(&gg->lktrk);
 		wmain_fintrack();
 	}
 	ffmem_free(t);
@@ -42,12 +42,12 @@ enum LIST_HDR {
 
 static const char* const list_colname[] = {
 	NULL,
-	"artist",
+	"artist,album,discnumber,tracknumber",
 	"title",
 	"__dur",
 	NULL,
 	"date",
-	"album",
+	"album,discnumber,tracknumber",
 	"__url",
 };
 
@@ -91,6 +91,7 @@ void wmain_init()
 	w->wnd.on_dropfiles = &gui_on_dropfiles;
 	w->vlist.colclick_id = A_LIST_SORT;
 	w->vlist.dispinfo_id = LIST_DISPINFO;
+	w->probe_first = -1;
 }
 
 void wmain_destroy()
@@ -209,6 +210,22 @@ const struct cmd* getcmd(uint cmd, const struct cmd *cmds, uint n)
 	return NULL;
 }
 
+/** Request meta data for the visible rows when the list is scrolled to the item */
+static void list_probe(uint idx)
+{
+	struct gui_wmain *w = gg->wmain;
+	if (idx >= w->probe_first && idx <= w->probe_last)
+		return;
+
+	uint first = ffui_view_topindex(&w->vlist);
+	uint last = first + ffui_view_countperpage(&w->vlist); // +1 partially visible item
+	if (first == w->probe_first && last == w->probe_last)
+		return;
+	w->probe_first = first;
+	w->probe_last = last;
+	gg->qu->cmdv(FMED_QUE_PROBE, first, last);
+}
+
 /** Provide GUI subsystem with the information it needs for a playlist item. */
 static void list_setdata(void)
 {
@@ -222,6 +239,8 @@ static void list_setdata(void)
 	if (!(it->mask & LVIF_TEXT))
 		return;
 
+	list_probe(it->iItem);
+
 	ent = (fmed_que_entry*)gg->qu->fmed_queue_item_locked(-1, it->iItem);
 	if (ent == NULL)
 		return;
@@ -840,6 +859,7 @@ void gui_showque(uint i)
 	gg->qu->cmd(FMED_QUE_SEL, (void*)(size_t)i);
 	uint n = gg->qu->cmdv(FMED_QUE_COUNT);
 	ffui_view_setcount(&w->vlist, n);
+	w->probe_first = -1; // the list is new
 
 	if (ffui_tab_active(&w->tabs) == 0 && gg->list_scroll_pos != 0) {
 		ffui_view_makevisible(&w->vlist, gg->list_scroll_pos);
@@ -1096,9 +1116,7 @@ err:
 void gui_filter(const ffstr *text, uint flags)
 {
 	struct gui_wmain *w = gg->wmain;
-	fmed_que_entry *e = NULL;
-	ffstr *meta, name;
-	uint nfilt = 0, nall = 0, inc;
+	uint nfilt, nall;
 
 	if (!gg->list_filter && text->len < 2)
 		return; //too small filter text
@@ -1111,36 +1129,14 @@ void gui_filter(const ffstr *text, uint flags)
 		return;
 	}
 
-	gg->qu->cmdv(FMED_QUE_NEW_FILTERED);
-
-	for (;;) {
-
-		if (0 == gg->qu->cmd2(FMED_QUE_LIST_NOFILTER, &e, 0))
-			break;
-		inc = 0;
-
-		if ((flags & GUI_FILT_URL) && -1 != ffstr_ifind(&e->url, text->ptr, text->len))
-			inc = 1;
-
-		else if (flags & GUI_FILT_META) {
-
-			for (uint i = 0;  NULL != (meta = gg->qu->meta(e, i, &name, 0));  i++) {
-				if (meta == FMED_QUE_SKIP)
-					continue;
-				if (-1 != ffstr_ifind(meta, text->ptr, text->len)) {
-					inc = 1;
-					break;
-				}
-			}
-		}
-
-		if (inc) {
-			gg->qu->cmdv(FMED_QUE_ADD_FILTERED, e);
-			nfilt++;
-		}
-
-		nall++;
-	}
+	uint qflags = 0;
+	if (flags & GUI_FILT_URL)
+		qflags |= FMED_QUE_SEARCH_URL;
+	if (flags & GUI_FILT_META)
+		qflags |= FMED_QUE_SEARCH_META;
+	gg->qu->cmdv(FMED_QUE_DEL_FILTERED);
+	nall = gg->qu->cmdv(FMED_QUE_COUNT2, -1);
+	nfilt = gg->qu->cmdv(FMED_QUE_SEARCH, text, qflags);
 
 	list_update(0, 0);
 	ffui_ctl_invalidate(&w->vlist);
@@ -1334,6 +1330,7 @@ void wmain_list_clear()
 {
 	struct gui_wmain *w = gg->wmain;
 	ffui_view_clear(&w->vlist);
+	w->probe_first = -1;
 	ffui_view_redraw(&w->vlist, 0, 0);
 }
 
@@ -312,12 +312,6 @@ void gui_corecmd_op(uint cmd, void *udata)
 		int focused;
 		if (-1 == (focused = ffui_view_focused(&gg->wmain->vlist)))
 			break;
-		/* Note: we should use 'gg->lktrk' here,
-		 but because it's only relevant for non-conversion tracks,
-		 and 'curtrk' is modified only within main thread,
-		 and this function always runs within main thread,
-		 nothing will break here without the lock.
-		*/
 		gg->qu->cmd(FMED_QUE_PLAY_EXCL, (void*)gg->qu->fmed_queue_item(-1, focused));
 		break;
 	}
@@ -361,13 +355,11 @@ void gui_corecmd_op(uint cmd, void *udata)
 
 
 	case A_PLAY_SEEK:
-		gtrk_seek((size_t)udata);
+		gtrk_xcmd(A_PLAY_SEEK, (size_t)udata);
 		break;
 
 	case A_PLAY_VOL:
-		if (gg->curtrk == NULL)
-			break;
-		gg->curtrk->d->audio.gain = gg->vol;
+		gtrk_xcmd(A_PLAY_VOL, 0);
 		break;
 
 	case A_PLAY_REPEAT: {
@@ -747,12 +739,18 @@ static void gui_loadlists(void)
 	const char *fn = core->props->user_path;
 	ffarr buf = {};
 
-	if (NULL == ffarr_alloc(&buf, ffsz_len(fn) + FFSLEN(GUI_PLIST_NAME) + FFINT_MAXCHARS + 1))
+	if (NULL == ffarr_alloc(&buf, ffsz_len(fn) + FFSLEN(GUI_PLIST_NAME_OLD) + FFINT_MAXCHARS + 1))
 		goto end;
 
+	// load the lists saved by the previous version if there are no lists in the new format
+	const char *name_fmt = "%s" GUI_PLIST_NAME "%Z";
+	ffstr_catfmt(&buf, name_fmt, fn, 1);
+	if (!fffile_exists(buf.ptr))
+		name_fmt = "%s" GUI_PLIST_NAME_OLD "%Z";
+
 	for (uint i = 1;  ;  i++) {
 		buf.len = 0;
-		ffstr_catfmt(&buf, "%s" GUI_PLIST_NAME "%Z", fn, i);
+		ffstr_catfmt(&buf, name_fmt, fn, i);
 		if (!fffile_exists(buf.ptr))
 			break;
 		if (i != 1)
@@ -33,6 +33,7 @@ struct gui_wmain {
 	ffui_icon ico_rec;
 
 	int actv_tab;
+	uint probe_first, probe_last; // visible range reported to queue
 };
 
 typedef struct gui_trk gui_trk;
@@ -147,7 +148,8 @@ enum {
 
 #define GUI_USERCONF  "fmedia.gui.conf"
 #define FMED_USERCONF  "fmedia-user.conf"
-#define GUI_PLIST_NAME  "list%u.m3uz"
+#define GUI_PLIST_NAME  "list%u.fmpl"
+#define GUI_PLIST_NAME_OLD  "list%u.m3uz" // the format used by the previous versions
 #define GUI_FAV_NAME  "fav.m3u8"
 
 enum ST {
@@ -169,7 +171,7 @@ struct gui_trk {
 	uint conversion :1;
 };
 
-void gtrk_seek(uint pos_sec);
+void gtrk_xcmd(uint cmd, size_t param);
 
 
 enum CMDS {
@@ -1,12 +1,9 @@
 /** fmedia: gui-winapi: track filter - a bridge between GUI and Core
 2021, Simon Zolin */
 
-void gtrk_seek(uint pos_sec)
+/** Thread: worker */
+static void gtrk_seek(gui_trk *t, uint pos_sec)
 {
-	if (gg->curtrk == NULL)
-		return;
-	gui_trk *t = gg->curtrk;
-
 	t->seek_msec = pos_sec * 1000;
 	t->d->seek_req = 1;
 	fmed_dbglog(core, t->d->trk, "gui", "seek: %U", t->seek_msec);
@@ -14,6 +11,62 @@ void gtrk_seek(uint pos_sec)
 		t->d->adev->cmd(FMED_ADEV_CMD_CLEAR, t->d->adev_ctx);
 }
 
+struct gtrk_cmd {
+	fftask tsk;
+	void *trk;
+	uint cmd;
+	size_t param;
+};
+
+/** Execute the command for the current track.
+Thread: worker */
+static void gtrk_cmd_run(void *param)
+{
+	struct gtrk_cmd *c = param;
+
+	fflk_lock(&gg->lktrk);
+	gui_trk *t = gg->curtrk;
+	if (t == NULL || t->trk != c->trk)
+		goto done; // the track has been closed
+
+	switch (c->cmd) {
+	case A_PLAY_SEEK:
+		gtrk_seek(t, c->param);
+		break;
+
+	case A_PLAY_VOL:
+		t->d->audio.gain = gg->vol;
+		break;
+	}
+
+done:
+	fflk_unlock(&gg->lktrk);
+	ffmem_free(c);
+}
+
+/** Pass the command to the worker thread which processes the current track:
+ the track's data may be modified only there.
+Thread: main */
+void gtrk_xcmd(uint cmd, size_t param)
+{
+	struct gtrk_cmd *c = ffmem_new(struct gtrk_cmd);
+	if (c == NULL)
+		return;
+	c->cmd = cmd;
+	c->param = param;
+	fftask_set(&c->tsk, &gtrk_cmd_run, c);
+
+	// post while holding the lock: the track can't be closed (and freed) meanwhile
+	fflk_lock(&gg->lktrk);
+	if (gg->curtrk != NULL) {
+		c->trk = gg->curtrk->trk;
+		gg->track->cmd(c->trk, FMED_TRACK_XPOST, &c->tsk);
+		c = NULL;
+	}
+	fflk_unlock(&gg->lktrk);
+	ffmem_free(c);
+}
+
 void* gtrk_open(fmed_filt *d)
 {
 	gui_trk *g = ffmem_tcalloc1(gui_trk);
@@ -41,7 +94,7 @@ void* gtrk_open(fmed_filt *d)
 		gg->curtrk = g;
 		fflk_unlock(&gg->lktrk);
 
-		gui_corecmd_op(A_PLAY_VOL, NULL);
+		d->audio.gain = gg->vol;
 	}
 
 	g->state = ST_PLAYING;
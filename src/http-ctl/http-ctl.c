@@ -18,6 +18,7 @@ struct htsv {
 	const fmed_track *track;
 	const fmed_queue *queue;
 	char *www_path;
+	ffvec metrics; // response data for /api/metrics
 	fftask t;
 	ffthread thr;
 	uint cmd;
@@ -70,10 +71,27 @@ static void api_next(alphahttpd_client *c)
 	core->task(&h->t, FMED_TASK_POST);
 }
 
+/** Return the counters in Prometheus text format.
+The data is collected on the server's thread without locking, so scraping doesn't affect the workers.
+The buffer is reused: the server processes requests on 1 thread. */
+static void api_metrics(alphahttpd_client *c)
+{
+	struct htsv *h = c->conf->opaque;
+	h->metrics.len = 0;
+	core->cmd(FMED_METRICS, &h->metrics);
+
+	c->resp.code = 200;
+	ffstr_setz(&c->resp.msg, "OK");
+	ffstr_setz(&c->resp.content_type, "text/plain; version=0.0.4");
+	c->resp.content_length = h->metrics.len;
+	ffstr_set(&c->output, h->metrics.ptr, h->metrics.len);
+}
+
 static const struct alphahttpd_virtdoc routes[] = {
 	{ "/api/pause", "POST", api_pause },
 	{ "/api/unpause", "POST", api_unpause },
 	{ "/api/next", "POST", api_next },
+	{ "/api/metrics", "GET", api_metrics },
 	{}
 };
 
@@ -199,6 +217,7 @@ static void htsv_destroy(void)
 	alphahttpd_free(h->ah);
 	alphahttpd_filter_virtspace_uninit(&h->conf);
 	ffmem_free(h->www_path);
+	ffvec_free(&h->metrics);
 	ffmem_free(g);
 }
 
@@ -2,6 +2,428 @@
 2015, Simon Zolin */
 
 #include <FFOS/std.h>
+#include <FFOS/thread.h>
+#include <FFOS/semaphore.h>
+#include <ffbase/murmurhash3.h>
+#include <util/ring.h>
+
+/*
+Asynchronous log (enabled with --debug or --trace):
+Each thread puts its messages into its own lock-free ring buffer (1 writer, 1 reader);
+ the log thread drains all buffers and writes the data with 1 system call per output.
+A thread claims a free slot on its first message and releases it on exit (TLS destructor),
+ so the slots of short-lived threads are reused by the new threads;
+ the messages left in the ring are still written by the log thread.
+
+Binary trace (--trace=FILE):
+Messages are stored without formatting time, colors and file names,
+ so the cost per message is low enough to keep debug tracing always enabled.
+"fmedtrc1" RECORD...
+RECORD: SIZE[2] LEVEL[1] MODULE_LEN[1] TIME_USEC[8] TID[4] TRACK_ID[4] EVENT_ID[4] MODULE[] TEXT[]
+EVENT_ID: hash of the message format string (equal for all messages of one kind)
+Numbers are little-endian.
+Decode with --trace-print=FILE.
+*/
+
+#define TRACE_MAGIC  "fmedtrc1"
+
+enum {
+	LOGA_THREADS = 64,
+	LOGA_RING_SIZE = 1024, // messages per thread
+};
+
+enum LOGA_DST {
+	LOGA_STDOUT,
+	LOGA_STDERR,
+	LOGA_TRACE,
+};
+
+struct logmsg {
+	uint dst; // enum LOGA_DST
+	uint len;
+	char data[0];
+};
+
+struct logring {
+	ffatomic tid; // owner thread
+	ffatomic ready;
+	ffring ring; // struct logmsg*[]
+};
+
+#ifdef FF_WIN
+typedef DWORD loga_tls_key;
+#else
+#include <pthread.h>
+typedef pthread_key_t loga_tls_key;
+#endif
+
+struct logasync {
+	struct logring rings[LOGA_THREADS];
+	loga_tls_key tls; // struct logring* owned by the current thread
+	ffthd thd;
+	ffsem sem;
+	ffatomic sleeping;
+	uint stop;
+	fffd trace_fd;
+	uint std_level; // print messages with this level and lower to stdout/stderr
+	uint std_async :1; // pass stdout/stderr messages to the log thread (debug mode)
+	ffvec buf[3]; // enum LOGA_DST
+};
+static struct logasync *gla;
+
+static fffd loga_fd(uint dst)
+{
+	switch (dst) {
+	case LOGA_STDOUT:
+		return ffstdout;
+	case LOGA_STDERR:
+		return ffstderr;
+	}
+	return gla->trace_fd;
+}
+
+/** Release the slot on thread exit */
+#ifdef FF_WIN
+static void NTAPI loga_thread_exit(void *param)
+#else
+static void loga_thread_exit(void *param)
+#endif
+{
+	struct logring *r = param;
+	if (r == NULL)
+		return;
+	ffcpu_fence_release(); // the new owner sees our messages in the ring
+	ffatom_set(&r->tid, 0);
+}
+
+static int loga_tls_init()
+{
+#ifdef FF_WIN
+	return (FLS_OUT_OF_INDEXES == (gla->tls = FlsAlloc(&loga_thread_exit))) ? -1 : 0;
+#else
+	return pthread_key_create(&gla->tls, &loga_thread_exit);
+#endif
+}
+
+static void loga_tls_free()
+{
+#ifdef FF_WIN
+	FlsFree(gla->tls);
+#else
+	pthread_key_delete(gla->tls);
+#endif
+}
+
+static struct logring* loga_tls_get()
+{
+#ifdef FF_WIN
+	return FlsGetValue(gla->tls);
+#else
+	return pthread_getspecific(gla->tls);
+#endif
+}
+
+static void loga_tls_set(struct logring *r)
+{
+#ifdef FF_WIN
+	FlsSetValue(gla->tls, r);
+#else
+	pthread_setspecific(gla->tls, r);
+#endif
+}
+
+/** Get the ring buffer owned by the current thread.
+Claim a free slot if the thread doesn't have one yet. */
+static struct logring* loga_ring()
+{
+	struct logring *r;
+	if (NULL != (r = loga_tls_get()))
+		return r;
+
+	size_t tid = ffthd_curid();
+	for (uint i = 0;  i != LOGA_THREADS;  i++) {
+		r = &gla->rings[i];
+		if (ffatom_get(&r->tid) != 0
+			|| !ffatom_cmpset(&r->tid, 0, tid))
+			continue;
+		ffcpu_fence_acquire();
+
+		if (!ffatom_get(&r->ready)) {
+			// the slot is used for the first time
+			if (0 != ffring_create(&r->ring, LOGA_RING_SIZE, 64)) {
+				ffatom_set(&r->tid, 0);
+				return NULL;
+			}
+			ffcpu_fence_release();
+			ffatom_set(&r->ready, 1);
+		}
+		loga_tls_set(r);
+		return r;
+	}
+	return NULL;
+}
+
+/** Pass data to the log thread. */
+static void loga_put(uint dst, const void *data, size_t len)
+{
+	struct logring *r;
+	struct logmsg *m;
+	if (NULL == (r = loga_ring())
+		|| NULL == (m = ffmem_alloc(sizeof(struct logmsg) + len))) {
+		fffile_write(loga_fd(dst), data, len);
+		return;
+	}
+	m->dst = dst;
+	m->len = len;
+	ffmem_copy(m->data, data, len);
+
+	while (0 != ffring_write(&r->ring, m)) {
+		// the log thread doesn't keep up with us
+		ffsem_post(gla->sem);
+		ffthd_sleep(1);
+	}
+
+	if (ffatom_get(&gla->sleeping))
+		ffsem_post(gla->sem);
+}
+
+/** Read messages from all threads and write them out.
+Return the number of messages. */
+static uint loga_drain()
+{
+	uint n = 0;
+	for (uint i = 0;  i != LOGA_THREADS;  i++) {
+		struct logring *r = &gla->rings[i];
+		if (!ffatom_get(&r->ready))
+			continue;
+		ffcpu_fence_acquire();
+
+		void *p;
+		while (0 == ffring_read(&r->ring, &p)) {
+			struct logmsg *m = p;
+			ffvec_add(&gla->buf[m->dst], m->data, m->len, 1);
+			ffmem_free(m);
+			n++;
+		}
+	}
+
+	for (uint i = 0;  i != FF_COUNT(gla->buf);  i++) {
+		if (gla->buf[i].len == 0)
+			continue;
+		fffile_write(loga_fd(i), gla->buf[i].ptr, gla->buf[i].len);
+		gla->buf[i].len = 0;
+	}
+	return n;
+}
+
+static int FFTHDCALL loga_worker(void *param)
+{
+	for (;;) {
+		if (0 != loga_drain())
+			continue;
+		if (FF_READONCE(gla->stop))
+			break;
+
+		ffatom_set(&gla->sleeping, 1);
+		if (0 == loga_drain())
+			ffsem_wait(gla->sem, 1000);
+		ffatom_set(&gla->sleeping, 0);
+	}
+	return 0;
+}
+
+/** Write the messages pending in the ring buffers.
+Called by crash handler: only system calls, no locks or memory allocations.
+The log thread may be running: the rings support several readers. */
+static void loga_crash_flush()
+{
+	for (uint i = 0;  i != LOGA_THREADS;  i++) {
+		struct logring *r = &gla->rings[i];
+		if (!ffatom_get(&r->ready))
+			continue;
+		ffcpu_fence_acquire();
+
+		void *p;
+		while (0 == ffring_read(&r->ring, &p)) {
+			const struct logmsg *m = p;
+			fffile_write(loga_fd(m->dst), m->data, m->len);
+		}
+	}
+}
+
+/** Start the log thread.
+trace_fn: (optional) write all messages to this file in binary format */
+static int log_async_init(const char *trace_fn)
+{
+	gla = ffmem_new(struct logasync);
+	gla->trace_fd = FFFILE_NULL;
+	gla->std_level = core->loglev;
+	// Note: in normal mode, keep the order of log messages and the data printed by UI
+	gla->std_async = (core->loglev == FMED_LOG_DEBUG);
+
+	if (trace_fn != NULL) {
+		if (FFFILE_NULL == (gla->trace_fd = fffile_open(trace_fn, FFFILE_CREATE | FFFILE_TRUNCATE | FFFILE_WRITEONLY))) {
+			syserrlog(core, NULL, "main", "trace: %s: %s", trace_fn, fffile_open_S);
+			goto err;
+		}
+		fffile_write(gla->trace_fd, TRACE_MAGIC, 8);
+		core->props->log_text_level = gla->std_level;
+		core->loglev = FMED_LOG_DEBUG;
+	}
+
+	if (0 != loga_tls_init())
+		goto err;
+	if (FFSEM_INV == (gla->sem = ffsem_open(NULL, 0, 0))) {
+		loga_tls_free();
+		goto err;
+	}
+	if (FFTHD_INV == (gla->thd = ffthd_create(&loga_worker, NULL, 0))) {
+		ffsem_close(gla->sem);
+		loga_tls_free();
+		goto err;
+	}
+	return 0;
+
+err:
+	if (gla->trace_fd != FFFILE_NULL)
+		fffile_close(gla->trace_fd);
+	core->props->log_text_level = 0;
+	ffmem_free(gla);
+	gla = NULL;
+	return -1;
+}
+
+/** Write all pending messages and stop the log thread. */
+static void log_async_close()
+{
+	if (gla == NULL)
+		return;
+
+	FF_WRITEONCE(gla->stop, 1);
+	ffsem_post(gla->sem);
+	ffthd_join(gla->thd, (uint)-1, NULL);
+	loga_tls_free(); // the exiting threads won't touch the slots anymore
+
+	struct logasync *la = gla;
+	gla = NULL;
+	core->props->log_text_level = 0; // std_log prints all messages now
+	for (uint i = 0;  i != LOGA_THREADS;  i++) {
+		if (ffatom_get(&la->rings[i].ready))
+			ffring_destroy(&la->rings[i].ring);
+	}
+	for (uint i = 0;  i != FF_COUNT(la->buf);  i++) {
+		ffvec_free(&la->buf[i]);
+	}
+	if (la->trace_fd != FFFILE_NULL)
+		fffile_close(la->trace_fd);
+	ffsem_close(la->sem);
+	ffmem_free(la);
+}
+
+struct trace_rec {
+	ushort size;
+	byte level;
+	byte module_len;
+	byte time_usec[8];
+	byte tid[4];
+	byte trk_id[4];
+	byte event_id[4];
+	char data[0]; // MODULE TEXT
+};
+
+static void trace_log(uint flags, fmed_logdata *ld)
+{
+	char buf[4096];
+	struct trace_rec *t = (void*)buf;
+	ffstr s = FFSTR_INITN(buf, sizeof(*t));
+	ffuint cap = sizeof(buf);
+
+	uint trk_id = 0;
+	if (ld->ctx != NULL) {
+		ffstr id = *ld->ctx;
+		ffstr_skipchar(&id, '*');
+		ffstr_to_uint32(&id, &trk_id);
+	}
+
+	const char *mod = (ld->module != NULL) ? ld->module : "";
+	uint mod_len = ffmin(ffsz_len(mod), 255);
+	ffstr_add(&s, cap, mod, mod_len);
+
+	va_list va;
+	va_copy(va, ld->va);
+	ffstr_addfmtv(&s, cap, ld->fmt, va);
+	va_end(va);
+	if (flags & FMED_LOG_SYS)
+		ffstr_addfmt(&s, cap, ": %E", fferr_last());
+
+	t->size = ffint_le_cpu16(s.len);
+	t->level = flags & _FMED_LOG_LEVMASK;
+	t->module_len = mod_len;
+	uint64 usec = (uint64)ld->time.sec * 1000000 + ld->time.nsec / 1000;
+	*(uint64*)t->time_usec = ffint_le_cpu64(usec);
+	*(uint*)t->tid = ffint_le_cpu32(ld->tid);
+	*(uint*)t->trk_id = ffint_le_cpu32(trk_id);
+	*(uint*)t->event_id = ffint_le_cpu32(murmurhash3(ld->fmt, ffsz_len(ld->fmt), 0x12345678));
+	loga_put(LOGA_TRACE, s.ptr, s.len);
+}
+
+/** Print the contents of binary trace file. */
+static int log_trace_print(const char *fn)
+{
+	static const char levels[][6] = {
+		"", "error", "warn", "info", "info", "debug",
+	};
+	int rc = 1;
+	ffvec buf = {}, out = {};
+	if (0 != fffile_readwhole(fn, &buf, -1)) {
+		syserrlog(core, NULL, "main", "trace: %s: %s", fn, fffile_read_S);
+		goto end;
+	}
+
+	ffstr d = FFSTR_INITN(buf.ptr, buf.len);
+	if (!ffstr_match(&d, TRACE_MAGIC, 8)) {
+		errlog(core, NULL, "main", "trace: %s: bad file format", fn);
+		goto end;
+	}
+	ffstr_shift(&d, 8);
+
+	while (d.len >= sizeof(struct trace_rec)) {
+		const struct trace_rec *t = (void*)d.ptr;
+		uint size = ffint_le_cpu16(t->size);
+		if (size < sizeof(*t) + t->module_len || size > d.len)
+			break;
+
+		uint64 usec = ffint_le_cpu64(*(uint64*)t->time_usec);
+		fftime tm;
+		tm.sec = usec / 1000000 + FFTIME_1970_SECONDS;
+		tm.nsec = (usec % 1000000) * 1000;
+		ffdatetime dt;
+		fftime_split1(&dt, &tm);
+		char stime[64];
+		stime[fftime_tostr1(&dt, stime, sizeof(stime), FFTIME_DATE_YMD | FFTIME_HMS_MSEC)] = '\0';
+
+		ffstr mod = FFSTR_INITN(t->data, t->module_len);
+		ffstr text = FFSTR_INITN(t->data + t->module_len, size - sizeof(*t) - t->module_len);
+		ffvec_addfmt(&out, "%s :%u [%s] %S: *%u: #%08xu %S\n"
+			, stime, ffint_le_cpu32(*(uint*)t->tid)
+			, levels[ffmin(t->level, FMED_LOG_DEBUG)], &mod
+			, ffint_le_cpu32(*(uint*)t->trk_id), ffint_le_cpu32(*(uint*)t->event_id)
+			, &text);
+		ffstr_shift(&d, size);
+
+		if (out.len >= 64*1024) {
+			ffstd_write(ffstdout, out.ptr, out.len);
+			out.len = 0;
+		}
+	}
+	ffstd_write(ffstdout, out.ptr, out.len);
+	rc = 0;
+
+end:
+	ffvec_free(&buf);
+	ffvec_free(&out);
+	return rc;
+}
 
 static const char* color_get(uint level)
 {
@@ -24,6 +446,14 @@ static const char* color_get(uint level)
 static void std_log(uint flags, fmed_logdata *ld)
 {
 	uint level = flags & _FMED_LOG_LEVMASK;
+
+	if (gla != NULL) {
+		if (gla->trace_fd != FFFILE_NULL)
+			trace_log(flags, ld);
+		if (level > gla->std_level)
+			return;
+	}
+
 	uint std_out = !!(level > FMED_LOG_USER && !core->props->stdout_busy);
 
 	char buf[4096];
@@ -68,6 +498,11 @@ static void std_log(uint flags, fmed_logdata *ld)
 
 	s.ptr[s.len++] = '\n';
 
+	if (gla != NULL && gla->std_async) {
+		loga_put((std_out) ? LOGA_STDOUT : LOGA_STDERR, s.ptr, s.len);
+		return;
+	}
+
 	fffd fd = (std_out) ? ffstdout : ffstderr;
 	ffstd_write(fd, s.ptr, s.len);
 }
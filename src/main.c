@@ -199,12 +199,19 @@ static void qu_setprops(fmed_cmd *fmed, const fmed_queue *qu, fmed_que_entry *qe
 
 	if (fmed->meta.len != 0)
 		qu->meta_set(qe, FFSTR("meta"), fmed->meta.ptr, fmed->meta.len, FMED_QUE_TRKDICT);
+
+	if (fmed->tee.len != 0)
+		qu->meta_set(qe, FFSTR("tee"), fmed->tee.ptr, fmed->tee.len, FMED_QUE_TRKDICT);
 }
 
 static void trk_prep(fmed_cmd *fmed, fmed_trk *trk)
 {
 	const fmed_cmd *cmd = fmed;
 	trk->input_info = fmed->info;
+	if (fmed->seek_index) {
+		trk->input_info = 1;
+		trk->seek_index_build = 1;
+	}
 	trk->show_tags = fmed->tags;
 	trk->include_files = fmed->include_files;
 	trk->exclude_files = fmed->exclude_files;
@@ -232,6 +239,8 @@ static void trk_prep(fmed_cmd *fmed, fmed_trk *trk)
 
 	trk->pcm_peaks = fmed->pcm_peaks;
 	trk->pcm_peaks_crc = fmed->pcm_crc;
+	trk->loudness = fmed->loudness || fmed->loudness_tags;
+	trk->loudness_write_tags = fmed->loudness_tags;
 	trk->use_dynanorm = fmed->dynanorm;
 	trk->a_start_level = ffabs(fmed->start_level);
 	trk->a_stop_level = ffabs(fmed->stop_level);
@@ -265,9 +274,16 @@ static void trk_prep(fmed_cmd *fmed, fmed_trk *trk)
 		trk->flac.compression = fmed->flac_complevel;
 	if (fmed->cue_gaps != 0xff)
 		trk->cue.gaps = fmed->cue_gaps;
+	if (fmed->cue_single_pass)
+		trk->cue.single_pass = 1;
+	if (fmed->resample_quality != 0xff)
+		trk->soxr.profile = fmed->resample_quality;
+	if (fmed->resample_threads != 0xff)
+		trk->soxr.threads = fmed->resample_threads;
 
 	if (fmed->stream_copy && fmed->out_copy == 0)
 		trk->stream_copy = 1;
+	trk->pcm_cache = fmed->pcm_cache;
 
 	if (fmed->out_copy != 0) {
 		trk->net_out_copy = fmed->out_copy;
@@ -277,6 +293,7 @@ static void trk_prep(fmed_cmd *fmed, fmed_trk *trk)
 			trk->net_out_filename = fmed->outfnz;
 	}
 
+	trk->net_timeshift = fmed->timeshift;
 	trk->print_time = fmed->print_time;
 }
 
@@ -335,7 +352,7 @@ static void open_input(void *udata)
 
 	ffstr ext;
 	ffpath_split3(fmed->outfn.ptr, fmed->outfn.len, NULL, NULL, &ext);
-	if (ffstr_eqz(&ext, "m3u8") || ffstr_eqz(&ext, "m3u")) {
+	if (ffstr_eqz(&ext, "m3u8") || ffstr_eqz(&ext, "m3u") || ffstr_eqz(&ext, "fmpl")) {
 		g->pl_export = (fmed_track_obj*)qu->fmed_queue_save(0, fmed->outfn.ptr);
 		goto end;
 	}
@@ -343,7 +360,8 @@ static void open_input(void *udata)
 	if (first != NULL) {
 		if (fmed->mix)
 			qu->cmd(FMED_QUE_MIX, NULL);
-		else if (fmed->outfn.len != 0 && fmed->parallel) {
+		else if (fmed->parallel
+			&& (fmed->outfn.len != 0 || fmed->loudness || fmed->loudness_tags)) {
 			core->props->parallel = 1;
 			qu->cmdv(FMED_QUE_XPLAY, first);
 		} else
@@ -501,11 +519,30 @@ end:
 
 static int gcmd_send(const fmed_globcmd_iface *globcmd)
 {
-	if (0 != globcmd->write(g->cmd->globcmd.ptr, g->cmd->globcmd.len)) {
-		return -1;
+	if (g->cmd->globcmd_add_list == NULL && !g->cmd->globcmd_events) {
+		if (0 != globcmd->write(g->cmd->globcmd.ptr, g->cmd->globcmd.len)) {
+			return -1;
+		}
+		return 0;
 	}
 
-	return 0;
+	int rc = -1;
+	ffvec list = {};
+	struct fmed_globcmd_req req = {};
+	req.cmd = g->cmd->globcmd;
+	req.events = g->cmd->globcmd_events;
+	if (g->cmd->globcmd_add_list != NULL) {
+		if (0 != fffile_readwhole(g->cmd->globcmd_add_list, &list, -1)) {
+			syserrlog(core, NULL, "main", "file read: %s", g->cmd->globcmd_add_list);
+			goto end;
+		}
+		ffstr_set2(&req.add_list, &list);
+	}
+	rc = globcmd->ctl(FMED_GLOBCMD_REQUEST, &req);
+
+end:
+	ffvec_free(&list);
+	return rc;
 }
 
 static int loadcore(char *argv0)
@@ -572,6 +609,9 @@ extern void _crash_handler(const char *fullname, const char *version, struct ffs
 /** Called by FFOS on program crash. */
 static void crash_handler(struct ffsig_info *inf)
 {
+	if (gla != NULL)
+		loga_crash_flush();
+
 #ifdef FMED_CRASH_HANDLER
 	const char *ver = (core != NULL) ? core->props->version_str : "";
 	_crash_handler("fmedia (" OS_STR "-" CPU_STR ")", ver, inf);
@@ -662,6 +702,16 @@ int main(int argc, char **argv, char **env)
 		goto end;
 	}
 
+	if (gcmd->trace_print_fn != NULL) {
+		rc = log_trace_print(gcmd->trace_print_fn);
+		goto end;
+	}
+
+	if (core->loglev == FMED_LOG_DEBUG || gcmd->trace_fn != NULL) {
+		if (0 != log_async_init(gcmd->trace_fn))
+			goto end;
+	}
+
 	if (gcmd->bground) {
 		if (gcmd->bgchild)
 			ffterm_detach();
@@ -691,15 +741,14 @@ int main(int argc, char **argv, char **env)
 
 	const fmed_globcmd_iface *globcmd = NULL;
 	ffbool gcmd_listen = 0;
-	if (gcmd->globcmd.len != 0
+	if ((gcmd->globcmd.len != 0 || gcmd->globcmd_add_list != NULL || gcmd->globcmd_events)
 		&& NULL != (globcmd = core->getmod("#globcmd.globcmd"))) {
 
 		if (ffstr_eqcz(&gcmd->globcmd, "listen"))
 			gcmd_listen = 1;
 
 		else if (0 == globcmd->ctl(FMED_GLOBCMD_OPEN, g->cmd->globcmd_pipename)) {
-			gcmd_send(globcmd);
-			rc = 0;
+			rc = (0 == gcmd_send(globcmd)) ? 0 : 1;
 			goto end;
 		}
 	}
@@ -743,6 +792,7 @@ end:
 	if (core != NULL) {
 		g->core_free();
 	}
+	log_async_close();
 	FF_SAFECLOSE(g->core_dl, NULL, ffdl_close);
 	cmd_destroy(g->cmd);
 	ffmem_free(win_argv);
@@ -117,12 +117,13 @@ int icy_process(void *ctx, fmed_filt *d)
 	}
 }
 
-int icy_setmeta(icy *c, const ffstr *_data)
+/** Parse ICY meta block and set artist/title meta for the track's queue item. */
+static void icy_meta_store(fmed_filt *d, const ffstr *_data, ffstr *_artist, ffstr *_title)
 {
 	ffstr artist = {0}, title = {0}, data = *_data, pair[2];
 	fmed_que_entry *qent;
 
-	dbglog(c->d->trk, "meta: [%L] %S", data.len, &data);
+	dbglog(d->trk, "meta: [%L] %S", data.len, &data);
 
 	for (;;) {
 		ffstr k, v;
@@ -133,33 +134,38 @@ int icy_setmeta(icy *c, const ffstr *_data)
 			icymeta_artist_title(v, &artist, &title);
 	}
 
-	qent = (void*)c->d->track->getval(c->d->trk, "queue_item");
+	qent = (void*)d->track->getval(d->trk, "queue_item");
 	ffarr utf = {0};
 
 	if (ffutf8_valid(artist.ptr, artist.len))
 		ffarr_append(&utf, artist.ptr, artist.len);
 	else
 		ffstr_growadd_codepage((ffstr*)&utf, &utf.cap, artist.ptr, artist.len, FFUNICODE_WIN1252);
-	ffstr_free(&c->artist);
-	ffstr_acqstr3(&c->artist, &utf);
+	ffstr_free(_artist);
+	ffstr_acqstr3(_artist, &utf);
 
 	ffarr_null(&utf);
 	if (ffutf8_valid(title.ptr, title.len))
 		ffarr_append(&utf, title.ptr, title.len);
 	else
 		ffstr_growadd_codepage((ffstr*)&utf, &utf.cap, title.ptr, title.len, FFUNICODE_WIN1252);
-	ffstr_free(&c->title);
-	ffstr_acqstr3(&c->title, &utf);
+	ffstr_free(_title);
+	ffstr_acqstr3(_title, &utf);
 
 	ffstr_setcz(&pair[0], "artist");
-	ffstr_set2(&pair[1], &c->artist);
+	ffstr_set2(&pair[1], _artist);
 	net->qu->cmd2(FMED_QUE_METASET | ((FMED_QUE_TMETA | FMED_QUE_OVWRITE) << 16), qent, (size_t)pair);
 
 	ffstr_setcz(&pair[0], "title");
-	ffstr_set2(&pair[1], &c->title);
+	ffstr_set2(&pair[1], _title);
 	net->qu->cmd2(FMED_QUE_METASET | ((FMED_QUE_TMETA | FMED_QUE_OVWRITE) << 16), qent, (size_t)pair);
 
-	c->d->meta_changed = 1;
+	d->meta_changed = 1;
+}
+
+int icy_setmeta(icy *c, const ffstr *data)
+{
+	icy_meta_store(c->d, data, &c->artist, &c->title);
 
 	if (c->netin != NULL && c->netin->fn_dyn) {
 		netin_write(c->netin, NULL);
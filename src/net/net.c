@@ -1,6 +1,9 @@
 /** HTTP, ICY input;  ICY stream-copy filter;  HTTP client interface.
 Copyright (c) 2016 Simon Zolin */
 
+#if defined __linux__ && !defined _GNU_SOURCE
+#define _GNU_SOURCE // splice()
+#endif
 #include <net/net.h>
 #include <util/url.h>
 #include <util/path.h>
@@ -57,9 +60,10 @@ static void http_if_send(void *con, const ffstr *data);
 static int http_if_recv(void *con, ffhttp_response **resp, ffstr *data);
 static void http_if_header(void *con, const ffstr *name, const ffstr *val, uint flags);
 static void http_if_conf(void *con, struct ffhttpcl_conf *conf, uint flags);
+static ffskt http_if_rawbody(void *con, ffstr *data);
 const fmed_net_http http_iface = {
 	&http_if_request, &http_if_close, &http_if_sethandler, &http_if_send, &http_if_recv, &http_if_header,
-	&http_if_conf,
+	&http_if_conf, &http_if_rawbody,
 };
 
 //PASS-THROUGH
@@ -106,6 +110,7 @@ static const fmed_conf_arg net_conf_args[] = {
 	{ "max_redirect",	FMC_INT8,  FMC_O(net_conf, max_redirect) },
 	{ "max_reconnect",	FMC_INT8,  FMC_O(net_conf, max_reconnect) },
 	{ "proxy",	FMC_STR,  FMC_F(http_conf_proxy) },
+	{ "splice_record",	FMC_BOOL8,  FMC_O(net_conf, splice_record) },
 	{ NULL,	FMC_ONCLOSE,	FMC_F(http_conf_done) },
 };
 
@@ -289,6 +294,10 @@ static void http_if_conf(void *con, struct ffhttpcl_conf *conf, uint flags)
 {
 	ffhttpcl_conf(con, conf, flags);
 }
+static ffskt http_if_rawbody(void *con, ffstr *data)
+{
+	return ffhttpcl_rawbody(con, data);
+}
 
 
 enum { IN_WAIT = 1, IN_DATANEXT };
@@ -407,6 +416,9 @@ static int netin_process(void *ctx, fmed_filt *d)
 
 #define FILT_NAME  "net.httpcli"
 
+#include <net/timeshift.h>
+#include <net/splice.h>
+
 struct httpclient {
 	void *con;
 	void *trk;
@@ -415,6 +427,14 @@ struct httpclient {
 	ffstr data;
 	ffstr next_filt_ext;
 	fmed_filt *d;
+	uint nresp;
+	struct tshift *ts;
+	uint ts_wait :1; // the filter waits for data
+	uint ts_fin :1; // no more data from server
+#ifdef FF_LINUX
+	struct nsplice *ns;
+	uint splice :1; // record the stream with splice()
+#endif
 };
 
 static void* httpcli_open(fmed_filt *d)
@@ -440,9 +460,28 @@ static void httpcli_close(void *ctx)
 {
 	struct httpclient *c = ctx;
 	http_iface.close(c->con);
+	tshift_close(c->ts);
+#ifdef FF_LINUX
+	nsplice_close(c->ns, c->d);
+#endif
 	ffmem_free(c);
 }
 
+/** Get ICY meta interval from response headers;  0: no ICY meta */
+static uint httpcli_metaint(struct httpclient *c, ffhttp_response *resp)
+{
+	ffstr s, meta;
+	uint n = 0;
+	ffstr_setz(&s, ICY_HTTPHDR_META_INT);
+	if (0 != ffhttp_findhdr(&resp->h, s.ptr, s.len, &meta)
+		&& !ffstr_toint(&meta, &n, FFS_INT32)) {
+		warnlog(c->trk, "invalid value for HTTP response header %s: %S"
+			, ICY_HTTPHDR_META_INT, &meta);
+		n = 0;
+	}
+	return n;
+}
+
 /** Process response: add appropriate filters to the chain */
 static int httpcli_resp(struct httpclient *c, ffhttp_response *resp)
 {
@@ -463,8 +502,9 @@ static int httpcli_resp(struct httpclient *c, ffhttp_response *resp)
 			dbglog(c->trk, "Content-Type: %S.  Will detect format from data.", &ct);
 	}
 
-	if (c->next_filt_ext.len != 0) {
-		if (!ffstr_eq2(&c->next_filt_ext, &ext)) {
+	if (c->nresp != 1) {
+		// reconnection: the filters and the time-shift buffer are already set up
+		if (c->next_filt_ext.len != 0 && !ffstr_eq2(&c->next_filt_ext, &ext)) {
 			errlog(c->trk, "unsupported behaviour: stream is changing audio format from %S to %S"
 				, &c->next_filt_ext, &ext);
 			return FMED_RERR;
@@ -481,25 +521,81 @@ static int httpcli_resp(struct httpclient *c, ffhttp_response *resp)
 		return FMED_RERR;
 	c->next_filt_ext = ext;
 
-	ffstr s, meta;
-	ffstr_setz(&s, ICY_HTTPHDR_META_INT);
-	if (0 != ffhttp_findhdr(&resp->h, s.ptr, s.len, &meta)) {
-		uint n;
-		if (ffstr_toint(&meta, &n, FFS_INT32)) {
-			if (0 == net->track->cmd(c->trk, FMED_TRACK_FILT_ADD, "net.icy"))
-				return FMED_RERR;
-			net->track->setvalstr(c->trk, "icy_format", ext.ptr);
-			net->track->setval(c->trk, "icy_meta_int", n);
-		} else {
-			warnlog(c->trk, "invalid value for HTTP response header %s: %S"
-				, ICY_HTTPHDR_META_INT, &meta);
-		}
+	uint metaint = httpcli_metaint(c, resp);
+	if (metaint != 0) {
+		if (0 == net->track->cmd(c->trk, FMED_TRACK_FILT_ADD, "net.icy"))
+			return FMED_RERR;
+		net->track->setvalstr(c->trk, "icy_format", ext.ptr);
+		net->track->setval(c->trk, "icy_meta_int", metaint);
 	}
 
+	if (c->d->net_timeshift != 0) {
+		if (NULL != (c->ts = tshift_open(c->d->net_timeshift, metaint, c->trk)))
+			c->d->net_tshift_on = 1;
+		else
+			warnlog(c->trk, "time-shift is disabled", 0);
+	}
 
 	return FMED_RDATA;
 }
 
+#ifdef FF_LINUX
+/** Start recording the response body with splice().
+Return 0 on success;  1: not supported for this response;  -1: error */
+static int httpcli_splice_resp(struct httpclient *c, ffhttp_response *resp)
+{
+	if (resp->code != 200)
+		return 1;
+
+	ffstr data;
+	ffskt sk = http_iface.rawbody(c->con, &data);
+	if (sk == FF_BADSKT) {
+		if (c->ns != NULL) {
+			errlog(c->trk, "can't continue recording with splice() after reconnection", 0);
+			return -1;
+		}
+		dbglog(c->trk, "splice() can't be used for this response", 0);
+		c->splice = 0;
+		return 1;
+	}
+
+	if (c->ns == NULL
+		&& NULL == (c->ns = nsplice_open(c->d)))
+		return -1;
+
+	if (0 != nsplice_start(c->ns, c->d, sk, httpcli_metaint(c, resp), data))
+		return -1;
+	return 0;
+}
+
+/** Move data from socket to file until there's no more data */
+static int httpcli_splice_process(struct httpclient *c, fmed_filt *d)
+{
+	if (c->status != FFHTTPCL_RESP_RECV)
+		return FMED_RERR;
+
+	int r = nsplice_read(c->ns, d);
+	if (r == 0) {
+		http_iface.send(c->con, NULL); // wait until the socket is readable
+		return FMED_RASYNC;
+	} else if (r < 0) {
+		return FMED_RERR;
+	}
+
+	c->ns->ok = 1;
+	return FMED_RFIN;
+}
+#endif
+
+/** Wake the track if it waits for data from us. */
+static void httpcli_ts_wake(struct httpclient *c, uint force)
+{
+	if (c->ts_wait || force) {
+		c->ts_wait = 0;
+		net->track->cmd(c->trk, FMED_TRACK_WAKE);
+	}
+}
+
 /** Handle events from 'httpif'. */
 static void httpcli_handler(void *param)
 {
@@ -512,7 +608,27 @@ static void httpcli_handler(void *param)
 	switch (r) {
 
 	case FFHTTPCL_RESP:
-		c->d->net_reconnect = 1;
+		if (c->nresp++ != 0)
+			ffint_fetch_add(&core->props->metrics.net_reconnects, 1);
+		if (c->ts != NULL)
+			tshift_reset(c->ts); // the next filter is reset when it reaches this data
+		else
+			c->d->net_reconnect = 1;
+
+#ifdef FF_LINUX
+		if (c->splice) {
+			r = httpcli_splice_resp(c, resp);
+			if (r <= 0) {
+				if (r < 0)
+					c->st = 3;
+				else
+					c->status = FFHTTPCL_RESP_RECV; // the track reads the socket
+				net->track->cmd(c->trk, FMED_TRACK_WAKE);
+				return;
+			}
+		}
+#endif
+
 		r = httpcli_resp(c, resp);
 		if (r == FMED_RERR) {
 			c->st = 3;
@@ -522,14 +638,35 @@ static void httpcli_handler(void *param)
 		break;
 
 	case FFHTTPCL_RESP_RECV:
+		ffint_fetch_add(&core->props->metrics.net_read_bytes, data.len);
+		if (c->ts != NULL) {
+			// store the data and continue receiving even if the track is paused
+			if (0 != tshift_write(c->ts, data, c->trk)) {
+				c->st = 3;
+				httpcli_ts_wake(c, 1);
+				return;
+			}
+			httpcli_ts_wake(c, 0);
+			break;
+		}
 		c->data = data;
 		//fallthrough
 	case FFHTTPCL_DONE:
+		if (c->ts != NULL) {
+			c->ts_fin = 1;
+			httpcli_ts_wake(c, 0);
+			return;
+		}
 		net->track->cmd(c->trk, FMED_TRACK_WAKE);
 		return;
 	}
 
 	if (r < 0) {
+		if (c->ts != NULL) {
+			c->ts_fin = 1;
+			httpcli_ts_wake(c, 0);
+			return;
+		}
 		net->track->cmd(c->trk, FMED_TRACK_WAKE);
 		return;
 	}
@@ -565,6 +702,42 @@ static void httpcli_log(void *udata, uint level, const char *fmt, ...)
 	va_end(va);
 }
 
+/** Pass data from time-shift buffer. */
+static int httpcli_ts_process(struct httpclient *c, fmed_filt *d)
+{
+	if (d->net_tshift_seek != 0) {
+		tshift_seek(c->ts, d, d->net_tshift_seek);
+		d->net_tshift_seek = 0;
+	}
+
+	if (d->net_tshift_save) {
+		d->net_tshift_save = 0;
+		tshift_mark_save(c->ts, d, &c->next_filt_ext);
+	}
+
+	ffstr out;
+	int r = tshift_read(c->ts, d, &out);
+	if (r < 0)
+		return FMED_RERR;
+	if (r > 0) {
+		d->out = out.ptr,  d->outlen = out.len;
+		return FMED_RDATA;
+	}
+
+	if (c->ts_fin) {
+		if (c->status == FFHTTPCL_DONE) {
+			d->outlen = 0;
+			return FMED_RDONE;
+		}
+		if (c->status == FFHTTPCL_ENOADDR)
+			c->d->error = FMED_E_NOSRC;
+		return FMED_RERR;
+	}
+
+	c->ts_wait = 1;
+	return FMED_RASYNC;
+}
+
 /**
 Make request via 'httpif'.
 Get data from 'httpif' and pass further through the chain. */
@@ -573,6 +746,12 @@ static int httpcli_process(void *ctx, fmed_filt *d)
 	struct httpclient *c = ctx;
 
 	if (d->flags & FMED_FSTOP) {
+#ifdef FF_LINUX
+		if (c->ns != NULL) {
+			c->ns->ok = 1;
+			return FMED_RFIN;
+		}
+#endif
 		d->outlen = 0;
 		return FMED_RDONE;
 	}
@@ -610,13 +789,26 @@ static int httpcli_process(void *ctx, fmed_filt *d)
 			http_iface.header(c->con, &name, &s, 0);
 		}
 
+#ifdef FF_LINUX
+		c->splice = nsplice_enabled(d);
+#endif
+
 		http_iface.sethandler(c->con, &httpcli_handler, c);
 		c->st = 1;
+		c->ts_wait = 1;
 		http_iface.send(c->con, NULL);
 		return FMED_RASYNC;
 	}
 
 	case 1:
+		if (c->ts != NULL)
+			return httpcli_ts_process(c, d);
+
+#ifdef FF_LINUX
+		if (c->ns != NULL)
+			return httpcli_splice_process(c, d);
+#endif
+
 		switch (c->status) {
 		case FFHTTPCL_RESP_RECV:
 			c->st = 2;
@@ -7,9 +7,13 @@ Copyright (c) 2019 Simon Zolin */
 #undef dbglog
 #undef warnlog
 #undef errlog
+#undef syserrlog
+#undef infolog
 #define dbglog(trk, ...)  fmed_dbglog(core, trk, FILT_NAME, __VA_ARGS__)
+#define infolog(trk, ...)  fmed_infolog(core, trk, FILT_NAME, __VA_ARGS__)
 #define warnlog(trk, ...)  fmed_warnlog(core, trk, FILT_NAME, __VA_ARGS__)
 #define errlog(trk, ...)  fmed_errlog(core, trk, FILT_NAME, __VA_ARGS__)
+#define syserrlog(trk, ...)  fmed_syserrlog(core, trk, FILT_NAME, __VA_ARGS__)
 
 
 typedef struct net_conf {
@@ -22,6 +26,7 @@ typedef struct net_conf {
 	byte max_redirect;
 	byte max_reconnect;
 	byte meta;
+	byte splice_record;
 	struct {
 		char *host;
 		uint port;
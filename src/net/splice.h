@@ -0,0 +1,242 @@
+/** fmedia: net.httpcli: record HTTP/ICY stream to a file without copying data to user space
+2023, Simon Zolin */
+
+/*
+socket -(splice)-> pipe -(splice)-> file
+
+The rest of the track's chain isn't used: net.httpcli writes the stream as is and then closes the track.
+Audio data of ICY stream is moved by parts no larger than the rest of the current 'metaint' block;
+ each meta block is received into user buffer and parsed.
+The body data received together with HTTP response headers is written with write().
+
+Limitation: pipe -> file splice() is synchronous and runs on the track's worker,
+ unlike file.out which writes via the file I/O threads.
+It moves at most one pipe of data (F_GETPIPE_SZ, 64KB by default) per socket read
+ and normally completes in page cache, but when the disk can't keep up with writeback
+ the worker is blocked for the duration of the write.
+Don't enable "splice_record" for recordings to slow or network storage.
+*/
+
+#ifdef FF_LINUX
+
+#include <fcntl.h>
+
+struct nsplice {
+	int pipe[2];
+	uint pipe_size;
+	size_t in_pipe; // bytes in pipe which aren't written to file yet
+	fffd fd;
+	char *fn;
+	char *fn_tmp;
+	ffskt sk;
+	uint metaint;
+	struct tshift_icy icy;
+	ffvec meta; // ICY meta block: LEN[1] META[LEN*16]
+	ffstr artist, title;
+	uint64 total;
+	uint ok :1;
+};
+
+/** Check whether the track is a pure stream-copy recording to a regular file */
+static int nsplice_enabled(fmed_filt *d)
+{
+	return net->conf.splice_record
+		&& d->stream_copy
+		&& d->out_filename != NULL
+		&& !ffsz_eq(d->out_filename, "@stdout")
+		&& NULL == ffsz_findc(d->out_filename, '$') // file.out expands the variables
+		&& d->net_timeshift == 0
+		&& (int64)d->audio.until == FMED_NULL;
+}
+
+static void nsplice_close(struct nsplice *ns, fmed_filt *d)
+{
+	if (ns == NULL)
+		return;
+
+	if (ns->pipe[0] != -1) {
+		close(ns->pipe[0]);
+		close(ns->pipe[1]);
+	}
+
+	if (ns->fd != FF_BADFD) {
+		fffile_close(ns->fd);
+		const char *fn = (ns->fn_tmp != NULL) ? ns->fn_tmp : ns->fn;
+		if (ns->total == 0) {
+			fffile_rm(fn);
+
+		} else if (ns->ok) {
+			if (ns->fn_tmp != NULL && 0 != fffile_rename(ns->fn_tmp, ns->fn))
+				syserrlog(d->trk, "fffile_rename: %s -> %s", ns->fn_tmp, ns->fn);
+			else
+				core->log(FMED_LOG_USER, d->trk, "file", "saved file %s, %U kbytes"
+					, ns->fn, ns->total / 1024);
+		}
+	}
+
+	ffvec_free(&ns->meta);
+	ffstr_free(&ns->artist);
+	ffstr_free(&ns->title);
+	ffmem_free(ns->fn);
+	ffmem_free(ns->fn_tmp);
+	ffmem_free(ns);
+}
+
+static struct nsplice* nsplice_open(fmed_filt *d)
+{
+	struct nsplice *ns;
+	if (NULL == (ns = ffmem_new(struct nsplice)))
+		return NULL;
+	ns->pipe[0] = ns->pipe[1] = -1;
+	ns->fd = FF_BADFD;
+	ns->sk = FF_BADSKT;
+
+	if (0 != pipe2(ns->pipe, O_NONBLOCK | O_CLOEXEC)) {
+		syserrlog(d->trk, "pipe2", 0);
+		ns->pipe[0] = -1;
+		goto err;
+	}
+	int r = fcntl(ns->pipe[1], F_GETPIPE_SZ);
+	ns->pipe_size = (r > 0) ? r : 4096;
+
+	ns->fn = ffsz_dup(d->out_filename);
+	const char *fn = ns->fn;
+	if (d->out_name_tmp) {
+		if (!d->out_overwrite && fffile_exists(fn)) {
+			errlog(d->trk, "%s: file already exists", fn);
+			goto err;
+		}
+		ns->fn_tmp = ffsz_allocfmt("%s.tmp", fn);
+		fn = ns->fn_tmp;
+	}
+
+	uint flags = (d->out_overwrite) ? FFFILE_CREATE | FFFILE_TRUNCATE : FFFILE_CREATENEW;
+	if (FF_BADFD == (ns->fd = fffile_open(fn, flags | FFFILE_WRITEONLY))) {
+		syserrlog(d->trk, "file create: %s", fn);
+		goto err;
+	}
+
+	dbglog(d->trk, "%s: recording with splice()", fn);
+	return ns;
+
+err:
+	nsplice_close(ns, d);
+	return NULL;
+}
+
+/** Write the data from pipe to file.
+Blocks the worker while the kernel writes the data (see the limitation above). */
+static int nsplice_flush(struct nsplice *ns, fmed_filt *d)
+{
+	while (ns->in_pipe != 0) {
+		ssize_t r = splice(ns->pipe[0], NULL, ns->fd, NULL, ns->in_pipe, SPLICE_F_MOVE);
+		if (r <= 0) {
+			syserrlog(d->trk, "splice: pipe -> %s", (ns->fn_tmp != NULL) ? ns->fn_tmp : ns->fn);
+			return -1;
+		}
+		ns->in_pipe -= r;
+		ffint_fetch_add(&core->props->metrics.file_write_bytes, r);
+	}
+	return 0;
+}
+
+/** Process the complete meta block */
+static void nsplice_meta(struct nsplice *ns, fmed_filt *d)
+{
+	ffstr m = FFSTR_INITN(ns->meta.ptr, ns->meta.len);
+	ffstr_shift(&m, 1);
+	while (m.len != 0 && m.ptr[m.len - 1] == '\0') {
+		m.len--;
+	}
+	if (m.len != 0)
+		icy_meta_store(d, &m, &ns->artist, &ns->title);
+	ns->meta.len = 0;
+}
+
+/** Process the data received in user buffer */
+static int nsplice_user(struct nsplice *ns, fmed_filt *d, ffstr data)
+{
+	while (data.len != 0) {
+		ffstr part;
+		uint blk_start;
+		if (tshift_icy_next(&ns->icy, ns->metaint, &data, &part, &blk_start)) {
+			if (0 != nsplice_flush(ns, d))
+				return -1;
+			if (part.len != (size_t)fffile_write(ns->fd, part.ptr, part.len)) {
+				syserrlog(d->trk, "file write: %s", (ns->fn_tmp != NULL) ? ns->fn_tmp : ns->fn);
+				return -1;
+			}
+			ns->total += part.len;
+			ffint_fetch_add(&core->props->metrics.file_write_bytes, part.len);
+			continue;
+		}
+
+		ffvec_add2(&ns->meta, &part, 1);
+		if (blk_start)
+			nsplice_meta(ns, d);
+	}
+	return 0;
+}
+
+/** Start reading from a new connection.
+data: body data received together with HTTP response headers */
+static int nsplice_start(struct nsplice *ns, fmed_filt *d, ffskt sk, uint metaint, ffstr data)
+{
+	ns->sk = sk;
+	ns->metaint = metaint;
+	tshift_icy_init(&ns->icy, metaint);
+	ns->meta.len = 0;
+	return nsplice_user(ns, d, data);
+}
+
+/** Move all available data from socket to file.
+Return 0: socket has no more data;
+ 1: server has closed connection;
+ -1: error */
+static int nsplice_read(struct nsplice *ns, fmed_filt *d)
+{
+	for (;;) {
+		if (0 != nsplice_flush(ns, d))
+			return -1;
+
+		ssize_t r;
+		if (ns->metaint == 0 || ns->icy.blk_left != 0) {
+			size_t n = ns->pipe_size;
+			if (ns->metaint != 0)
+				n = ffmin(n, ns->icy.blk_left);
+			r = splice(ns->sk, NULL, ns->pipe[1], NULL, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (r > 0) {
+				ns->in_pipe += r;
+				ns->total += r;
+				if (ns->metaint != 0)
+					ns->icy.blk_left -= r;
+				ffint_fetch_add(&core->props->metrics.net_read_bytes, r);
+				continue;
+			}
+
+		} else {
+			// the length byte, then the meta data
+			char buf[1 + 255 * 16];
+			size_t n = (ns->icy.meta_left != 0) ? ns->icy.meta_left : 1;
+			r = ffskt_recv(ns->sk, buf, n, 0);
+			if (r > 0) {
+				ffint_fetch_add(&core->props->metrics.net_read_bytes, r);
+				ffstr in = FFSTR_INITN(buf, r);
+				if (0 != nsplice_user(ns, d, in))
+					return -1;
+				continue;
+			}
+		}
+
+		if (r == 0) {
+			dbglog(d->trk, "server has closed connection", 0);
+			return 1;
+		} else if (fferr_again(fferr_last())) {
+			return 0;
+		}
+		syserrlog(d->trk, "socket read", 0);
+		return -1;
+	}
+}
+
+#endif
@@ -0,0 +1,414 @@
+/** fmedia: net: time-shift buffer for live streams
+2023, Simon Zolin */
+
+/*
+HTTP response body is written to a preallocated file used as a ring buffer,
+ and the data for the next filters is read from the file at the playback position.
+So the stream is received even while the track is paused,
+ the playback position can be moved back (until the data is overwritten) and forth (until the live position),
+ and a past range of the stream can be saved to a file.
+Only a small read buffer is held in memory, regardless of the file size.
+
+FILE: POINT[NPOINTS] DATA[SIZE]
+POINT: TIME_MSEC[8] OFFSET[8]
+The index points are written every TSHIFT_POINT_INTERVAL_MSEC at ICY block boundaries,
+ so the ICY parser may start from any point.
+Offsets are absolute positions within the stream: the position in file is "OFFSET % SIZE".
+Numbers are in host byte order.  The file is deleted when the track is closed.
+*/
+
+#include <FFOS/file.h>
+#include <FFOS/process.h>
+
+enum {
+	TSHIFT_POINT_INTERVAL_MSEC = 1000,
+	TSHIFT_POINT_BYTES = 1024, // index capacity: 1 point per this number of data bytes
+	TSHIFT_READ_SIZE = 64*1024,
+	TSHIFT_RESETS = 8,
+};
+
+struct tshift_point {
+	uint64 time_msec; // stream receive time, relative to the start
+	uint64 off;
+};
+
+/** ICY stream framing: AUDIO[METAINT] META_LEN[1] META[META_LEN*16] ... */
+struct tshift_icy {
+	uint blk_left; // audio bytes left in the current block
+	uint meta_left; // meta bytes left (including the length byte)
+};
+
+struct tshift {
+	fffd fd;
+	char *fn;
+	uint64 size; // data size
+	uint64 npoints_max;
+	uint64 wpos, rpos; // stream offsets
+	uint64 npoints; // total points written
+	uint64 start_time, last_point_time;
+	uint metaint;
+	struct tshift_icy wr;
+
+	uint64 resets[TSHIFT_RESETS]; // offsets at which the ICY parser must be reset (reconnection)
+	uint nresets;
+	uint64 mark; // start of the range to save;  -1:unset
+	ffvec buf;
+};
+
+static uint64 tshift_now(struct tshift *ts)
+{
+	fftime t = fftime_monotonic();
+	return fftime_to_msec(&t) - ts->start_time;
+}
+
+static void tshift_icy_init(struct tshift_icy *f, uint metaint)
+{
+	f->blk_left = metaint;
+	f->meta_left = 0;
+}
+
+/** Get the next part of ICY stream.
+Return 1 if 'part' is audio data;  0 if it's ICY meta.
+blk_start: set to 1 if a new audio block starts after 'part' */
+static int tshift_icy_next(struct tshift_icy *f, uint metaint, ffstr *in, ffstr *part, uint *blk_start)
+{
+	size_t n;
+	*blk_start = 0;
+
+	if (metaint == 0 || f->blk_left != 0) {
+		n = (metaint == 0) ? in->len : ffmin(in->len, f->blk_left);
+		ffstr_set(part, in->ptr, n);
+		ffstr_shift(in, n);
+		if (metaint != 0)
+			f->blk_left -= n;
+		return 1;
+	}
+
+	if (f->meta_left == 0)
+		f->meta_left = 1 + (byte)in->ptr[0] * 16;
+	n = ffmin(in->len, f->meta_left);
+	ffstr_set(part, in->ptr, n);
+	ffstr_shift(in, n);
+	f->meta_left -= n;
+	if (f->meta_left == 0) {
+		f->blk_left = metaint;
+		*blk_start = 1;
+	}
+	return 0;
+}
+
+static void tshift_close(struct tshift *ts)
+{
+	if (ts == NULL)
+		return;
+	if (ts->fd != FF_BADFD) {
+		fffile_close(ts->fd);
+		fffile_rm(ts->fn);
+	}
+	ffmem_free(ts->fn);
+	ffvec_free(&ts->buf);
+	ffmem_free(ts);
+}
+
+/**
+size_mb: data size
+metaint: ICY meta interval;  0:none */
+static struct tshift* tshift_open(uint size_mb, uint metaint, void *trk)
+{
+	struct tshift *ts;
+	if (core->props->user_path == NULL
+		|| NULL == (ts = ffmem_new(struct tshift)))
+		return NULL;
+	ts->fd = FF_BADFD;
+	ts->size = (uint64)size_mb * 1024*1024;
+	ts->npoints_max = ts->size / TSHIFT_POINT_BYTES;
+	ts->metaint = metaint;
+	ts->mark = (uint64)-1;
+	tshift_icy_init(&ts->wr, metaint);
+	fftime t = fftime_monotonic();
+	ts->start_time = fftime_to_msec(&t);
+	ts->last_point_time = (uint64)-TSHIFT_POINT_INTERVAL_MSEC;
+
+	ts->fn = ffsz_allocfmt("%scache%ctimeshift-%u-%p.bin"
+		, core->props->user_path, FFPATH_SLASH, ffps_curid(), ts);
+	uint64 total = ts->npoints_max * sizeof(struct tshift_point) + ts->size;
+	uint flags = FFFILE_CREATE | FFFILE_TRUNCATE | FFFILE_READWRITE;
+	if (FF_BADFD == (ts->fd = fmed_file_create(ts->fn, flags))) {
+		syserrlog(trk, "file open: %s", ts->fn);
+		goto err;
+	}
+	if (0 != fffile_trunc(ts->fd, total)) {
+		syserrlog(trk, "file truncate: %s", ts->fn);
+		goto err;
+	}
+	if (NULL == ffvec_alloc(&ts->buf, TSHIFT_READ_SIZE, 1))
+		goto err;
+
+	dbglog(trk, "time-shift: created %s  size:%UMB  points:%U"
+		, ts->fn, ts->size / (1024*1024), ts->npoints_max);
+	return ts;
+
+err:
+	tshift_close(ts);
+	return NULL;
+}
+
+/** The offset of the oldest data in the buffer. */
+static inline uint64 tshift_oldest(struct tshift *ts)
+{
+	return (ts->wpos > ts->size) ? ts->wpos - ts->size : 0;
+}
+
+static int tshift_io(struct tshift *ts, void *data, size_t n, uint64 pos, uint write)
+{
+	ffssize r;
+	if (write)
+		r = fffile_writeat(ts->fd, data, n, pos);
+	else
+		r = fffile_readat(ts->fd, data, n, pos);
+	if (r != (ffssize)n)
+		return -1;
+	return 0;
+}
+
+/** Read or write data at the stream offset, wrapping around the end of ring buffer. */
+static int tshift_data_io(struct tshift *ts, void *data, size_t n, uint64 off, uint write)
+{
+	uint64 base = ts->npoints_max * sizeof(struct tshift_point);
+	uint64 i = off % ts->size;
+	size_t n1 = ffmin(n, ts->size - i);
+	if (0 != tshift_io(ts, data, n1, base + i, write))
+		return -1;
+	if (n1 != n
+		&& 0 != tshift_io(ts, (char*)data + n1, n - n1, base, write))
+		return -1;
+	return 0;
+}
+
+static int tshift_point_get(struct tshift *ts, uint64 i, struct tshift_point *p)
+{
+	return tshift_io(ts, p, sizeof(*p), (i % ts->npoints_max) * sizeof(*p), 0);
+}
+
+static void tshift_point_add(struct tshift *ts, uint64 time_msec, uint64 off)
+{
+	struct tshift_point p = { time_msec, off };
+	if (0 != tshift_io(ts, &p, sizeof(p), (ts->npoints % ts->npoints_max) * sizeof(p), 1))
+		return;
+	ts->npoints++;
+	ts->last_point_time = time_msec;
+}
+
+/** Get the first point which refers to the data still present in the buffer. */
+static uint64 tshift_point_first(struct tshift *ts)
+{
+	uint64 lo = (ts->npoints > ts->npoints_max) ? ts->npoints - ts->npoints_max : 0;
+	uint64 hi = ts->npoints, oldest = tshift_oldest(ts);
+	struct tshift_point p;
+	while (lo < hi) {
+		uint64 i = lo + (hi - lo) / 2;
+		if (0 != tshift_point_get(ts, i, &p))
+			break;
+		if (p.off < oldest)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+/** Find the last valid point with TIME <= time_msec (by_time=1) or OFFSET <= off (by_time=0).
+Return the point number or -1 */
+static int64 tshift_point_find(struct tshift *ts, uint64 val, uint by_time, struct tshift_point *pt)
+{
+	uint64 first = tshift_point_first(ts);
+	if (first == ts->npoints)
+		return -1;
+	uint64 lo = first, hi = ts->npoints;
+	struct tshift_point p;
+	while (hi - lo > 1) {
+		uint64 i = lo + (hi - lo) / 2;
+		if (0 != tshift_point_get(ts, i, &p))
+			return -1;
+		if (((by_time) ? p.time_msec : p.off) <= val)
+			lo = i;
+		else
+			hi = i;
+	}
+	if (0 != tshift_point_get(ts, lo, pt))
+		return -1;
+	return lo;
+}
+
+/** Store the data received from server. */
+static int tshift_write(struct tshift *ts, ffstr data, void *trk)
+{
+	uint64 now = tshift_now(ts);
+	if (ts->wpos == 0 || ts->metaint == 0) {
+		if (now - ts->last_point_time >= TSHIFT_POINT_INTERVAL_MSEC)
+			tshift_point_add(ts, now, ts->wpos);
+	}
+
+	if (0 != tshift_data_io(ts, data.ptr, data.len, ts->wpos, 1)) {
+		syserrlog(trk, "file write: %s", ts->fn);
+		return -1;
+	}
+
+	// add index points at ICY block boundaries
+	ffstr in = data, part;
+	uint64 off = ts->wpos;
+	while (in.len != 0 && ts->metaint != 0) {
+		uint blk_start;
+		tshift_icy_next(&ts->wr, ts->metaint, &in, &part, &blk_start);
+		off += part.len;
+		if (blk_start && now - ts->last_point_time >= TSHIFT_POINT_INTERVAL_MSEC)
+			tshift_point_add(ts, now, off);
+	}
+
+	ts->wpos += data.len;
+	return 0;
+}
+
+/** A new HTTP response starts at the current write position. */
+static void tshift_reset(struct tshift *ts)
+{
+	tshift_icy_init(&ts->wr, ts->metaint);
+	tshift_point_add(ts, tshift_now(ts), ts->wpos);
+	if (ts->nresets == TSHIFT_RESETS) {
+		ffmem_move(&ts->resets[0], &ts->resets[1], (TSHIFT_RESETS - 1) * sizeof(ts->resets[0]));
+		ts->nresets--;
+	}
+	ts->resets[ts->nresets++] = ts->wpos;
+}
+
+/** Move read position to the point.
+The next filter must reset its state. */
+static void tshift_rpos_set(struct tshift *ts, fmed_track_info *d, uint64 off)
+{
+	ts->rpos = off;
+	uint i = 0;
+	while (i != ts->nresets && ts->resets[i] <= off)
+		i++;
+	ffmem_move(&ts->resets[0], &ts->resets[i], (ts->nresets - i) * sizeof(ts->resets[0]));
+	ts->nresets -= i;
+	d->net_reconnect = 1;
+}
+
+/** Get the data at read position.
+Return 0 if there's no more data yet. */
+static int tshift_read(struct tshift *ts, fmed_track_info *d, ffstr *out)
+{
+	if (ts->rpos < tshift_oldest(ts)) {
+		struct tshift_point p;
+		uint64 i = tshift_point_first(ts);
+		if (i == ts->npoints || 0 != tshift_point_get(ts, i, &p))
+			p.off = ts->wpos;
+		warnlog(d->trk, "time-shift: buffer overrun: skipping %U bytes", p.off - ts->rpos);
+		tshift_rpos_set(ts, d, p.off);
+	}
+
+	if (ts->nresets != 0 && ts->resets[0] == ts->rpos) {
+		ffmem_move(&ts->resets[0], &ts->resets[1], (ts->nresets - 1) * sizeof(ts->resets[0]));
+		ts->nresets--;
+		d->net_reconnect = 1;
+	}
+
+	uint64 end = (ts->nresets != 0) ? ts->resets[0] : ts->wpos;
+	size_t n = ffmin(end - ts->rpos, ts->buf.cap);
+	if (n == 0)
+		return 0;
+	if (0 != tshift_data_io(ts, ts->buf.ptr, n, ts->rpos, 0)) {
+		syserrlog(d->trk, "file read: %s", ts->fn);
+		return -1;
+	}
+	ffstr_set(out, ts->buf.ptr, n);
+	ts->rpos += n;
+	return n;
+}
+
+/** Move read position relative to the current one.
+delta_msec: <0: rewind;  >0: forward (not further than the live position) */
+static void tshift_seek(struct tshift *ts, fmed_track_info *d, int delta_msec)
+{
+	struct tshift_point cur, p;
+	if (0 > tshift_point_find(ts, ts->rpos, 0, &cur))
+		return;
+	int64 target = (int64)cur.time_msec + delta_msec;
+	if (0 > tshift_point_find(ts, ffmax(target, 0), 1, &p)
+		|| (delta_msec > 0 && p.off <= ts->rpos))
+		return;
+	dbglog(d->trk, "time-shift: seek: %dms  time:%U -> %U  offset:%U -> %U"
+		, delta_msec, cur.time_msec, p.time_msec, ts->rpos, p.off);
+	tshift_rpos_set(ts, d, p.off);
+}
+
+/** Write audio data within [from, to) to a file, skipping ICY meta. */
+static int tshift_save(struct tshift *ts, uint64 from, uint64 to, const char *fn, void *trk)
+{
+	int rc = -1;
+	fffd f = FF_BADFD;
+	struct tshift_icy fr;
+	ffvec buf = {};
+
+	if (from < tshift_oldest(ts)) {
+		errlog(trk, "time-shift: the range start is already overwritten");
+		return -1;
+	}
+	if (NULL == ffvec_alloc(&buf, TSHIFT_READ_SIZE, 1))
+		return -1;
+	if (FF_BADFD == (f = fffile_open(fn, FFFILE_CREATENEW | FFFILE_WRITEONLY))) {
+		syserrlog(trk, "file create: %s", fn);
+		goto end;
+	}
+
+	tshift_icy_init(&fr, ts->metaint);
+	uint64 off = from, total = 0;
+	while (off < to) {
+		size_t n = ffmin(to - off, buf.cap);
+		if (0 != tshift_data_io(ts, buf.ptr, n, off, 0)) {
+			syserrlog(trk, "file read: %s", ts->fn);
+			goto end;
+		}
+		off += n;
+
+		ffstr in = FFSTR_INITN(buf.ptr, n), part;
+		while (in.len != 0) {
+			uint blk_start;
+			if (!tshift_icy_next(&fr, ts->metaint, &in, &part, &blk_start))
+				continue;
+			if (part.len != (size_t)fffile_write(f, part.ptr, part.len)) {
+				syserrlog(trk, "file write: %s", fn);
+				goto end;
+			}
+			total += part.len;
+		}
+	}
+
+	infolog(trk, "time-shift: saved %U bytes to %s", total, fn);
+	rc = 0;
+
+end:
+	if (f != FF_BADFD)
+		fffile_close(f);
+	ffvec_free(&buf);
+	return rc;
+}
+
+/** The first call marks the start of the range;  the second call saves the range till read position. */
+static void tshift_mark_save(struct tshift *ts, fmed_track_info *d, const ffstr *ext)
+{
+	struct tshift_point p;
+	if (ts->mark == (uint64)-1) {
+		if (0 > tshift_point_find(ts, ts->rpos, 0, &p))
+			return;
+		ts->mark = p.off;
+		infolog(d->trk, "time-shift: range start is marked", 0);
+		return;
+	}
+
+	fftime t = fftime_monotonic();
+	char *fn = ffsz_allocfmt("fmedia-timeshift-%U.%S", fftime_to_msec(&t), ext);
+	tshift_save(ts, ts->mark, ts->rpos, fn, d->trk);
+	ffmem_free(fn);
+	ts->mark = (uint64)-1;
+}
@@ -4,6 +4,7 @@ Copyright (c) 2019 Simon Zolin */
 #include <fmedia.h>
 #include <plist/entry.h>
 #include <avpack/cue.h>
+#include <ffbase/lock.h>
 
 
 #define dbglog1(trk, ...)  fmed_dbglog(core, trk, NULL, __VA_ARGS__)
@@ -56,8 +57,14 @@ typedef struct cue {
 	ffarr trackno;
 	uint curtrk;
 
+	/* Single-pass mode: tracks of the current FILE.
+	"FROM TO [NAME VAL]...\n"..., tab-separated, positions in CD frames */
+	ffvec sp_tracks;
+	uint sp_from, sp_to;
+
 	uint have_gmeta :1;
 	uint utf8 :1;
+	uint single_pass :1;
 } cue;
 
 static int cue_trackno(cue *c, fmed_filt *d, ffarr *arr);
@@ -135,6 +142,7 @@ static void* cue_open(fmed_filt *d)
 	c->qu_cur = (void*)fmed_getval("queue_item");
 	c->cu.options = gaps;
 	c->utf8 = 1;
+	c->single_pass = (d->cue.single_pass == 1 && d->out_filename != NULL && !d->stream_copy);
 	return c;
 }
 
@@ -146,6 +154,7 @@ static void cue_close(void *ctx)
 	FFARR_FREE_ALL(&c->gmetas, ffarr_free, ffarr);
 	FFARR_FREE_ALL(&c->metas, ffarr_free, ffarr);
 	ffarr_free(&c->trackno);
+	ffvec_free(&c->sp_tracks);
 	ffmem_free(c);
 }
 
@@ -223,6 +232,38 @@ static ffcuetrk* ffcue_index(ffcue *c, uint type, uint val)
 	return NULL;
 }
 
+/** Add meta pair to the track line in single-pass mode. */
+static void cue_sp_addmeta(ffvec *buf, const ffstr *name, const ffstr *val)
+{
+	ffvec_addfmt(buf, "\t%S\t", name);
+	size_t off = buf->len;
+	ffvec_addstr(buf, val);
+	char *p = buf->ptr;
+	for (size_t i = off;  i != buf->len;  i++) {
+		if (p[i] == '\t' || p[i] == '\n')
+			p[i] = ' ';
+	}
+}
+
+/** Single-pass mode: add 1 queue item for the whole image.
+Track boundaries and meta are passed via "cue_tracks" track property. */
+static void cue_sp_flush(cue *c)
+{
+	if (c->sp_tracks.len == 0)
+		return;
+
+	c->ent.from = -(int)c->sp_from;
+	c->ent.to = -(int)c->sp_to;
+	c->ent.dur = (c->sp_to != 0) ? (c->sp_to - c->sp_from) * 1000 / 75 : 0;
+
+	fmed_que_entry *cur = (void*)qu->cmdv(FMED_QUE_ADDAFTER | FMED_QUE_NO_ONCHANGE, &c->ent, c->qu_cur);
+	qu->cmdv(FMED_QUE_COPYTRACKPROPS, cur, c->qu_cur);
+	qu->meta_set(cur, FFSTR("cue_tracks"), c->sp_tracks.ptr, c->sp_tracks.len, FMED_QUE_TRKDICT);
+	qu->cmd2(FMED_QUE_ADD | FMED_QUE_MORE | FMED_QUE_ADD_DONE, cur, 0);
+	c->qu_cur = cur;
+	c->sp_tracks.len = 0;
+}
+
 static int cue_process(void *ctx, fmed_filt *d)
 {
 	cue *c = ctx;
@@ -320,6 +361,7 @@ add_metaname:
 			break;
 
 		case CUEREAD_FILE:
+			cue_sp_flush(c);
 			if (!c->have_gmeta) {
 				c->have_gmeta = 1;
 				c->gmetas = c->metas;
@@ -349,6 +391,28 @@ add:
 			continue;
 		}
 
+		if (c->single_pass) {
+			if (c->sp_tracks.len == 0)
+				c->sp_from = ctrk->from;
+			c->sp_to = ctrk->to;
+			ffvec_addfmt(&c->sp_tracks, "%u\t%u", ctrk->from, ctrk->to);
+
+			m = (void*)c->gmetas.ptr;
+			for (uint i = 0;  i != c->gmetas.len;  i += 2) {
+				if (cue_meta_find(&c->metas, c->nmeta, &m[i]) >= 0)
+					continue;
+				cue_sp_addmeta(&c->sp_tracks, (ffstr*)&m[i], (ffstr*)&m[i + 1]);
+			}
+
+			m = (void*)c->metas.ptr;
+			for (uint i = 0;  i != c->nmeta;  i += 2) {
+				cue_sp_addmeta(&c->sp_tracks, (ffstr*)&m[i], (ffstr*)&m[i + 1]);
+			}
+
+			ffvec_addchar(&c->sp_tracks, '\n');
+			goto next;
+		}
+
 		c->ent.from = -(int)ctrk->from;
 		c->ent.to = -(int)ctrk->to;
 		c->ent.dur = (ctrk->to != 0) ? (ctrk->to - ctrk->from) * 1000 / 75 : 0;
@@ -392,6 +456,7 @@ next:
 		c->nmeta = c->metas.len;
 	}
 
+	cue_sp_flush(c);
 	qu->cmd(FMED_QUE_ADD | FMED_QUE_ADD_DONE, NULL);
 	qu->cmd(FMED_QUE_RM, (void*)fmed_getval("queue_item"));
 	rc = FMED_RFIN;
@@ -448,3 +513,588 @@ int cuehook_process(void *ctx, fmed_filt *d)
 }
 
 const fmed_filter cuehook_iface = { cuehook_open, cuehook_process, cuehook_close };
+
+
+/** Split the decoded .cue image into per-track output files (single-pass mode).
+Track boundaries are computed the same way as for the separate per-track conversion:
+ start = seek position (msec) -> sample;  end = start of .cue track + length in CD frames.
+
+With --parallel, each output file is written by a separate track on its own worker:
+
+  ... -> plist.cuesplit
+             |
+             +-> plist.cuesplit-in -> afilter.autoconv -> ENCODER -> file.out  (track #1)
+             +-> plist.cuesplit-in -> afilter.autoconv -> ENCODER -> file.out  (track #2)
+             +-> ...
+
+The decoded data for each branch is copied into its queue of blocks,
+ so the encoders of the previous tracks keep working while the image is being decoded further.
+Decoding is paused while the total size of the queued data exceeds CUESPLIT_QUEUE_MAX. */
+
+enum {
+	CUESPLIT_QUEUE_MAX = 64*1024*1024,
+};
+
+struct cs_block {
+	struct cs_block *next;
+	uint64 pos;
+	size_t len;
+	char data[0];
+};
+
+struct cs_branch {
+	struct cs_shared *sh;
+	void *trk;
+	fftask tsk_start;
+	char *meta; // "NAME\0VAL\0..."
+	size_t meta_len;
+	struct cs_block *first, *last; // queued data
+	struct cs_block *cur; // data block being processed by the branch track
+	uint fin :1; // no more data will be added
+	uint waiting :1; // the branch track waits for data
+	uint closed :1; // the branch track is closed
+};
+
+struct cs_shared {
+	fflock lk;
+	uint refs;
+	const fmed_track *track;
+	void *trk; // main track
+	size_t queued; // bytes in all branch queues
+	ffvec branches; // struct cs_branch*[]
+	uint waiting :1; // main track waits until the queued data is processed
+	uint closed :1; // main track is closed
+};
+
+struct cuesplit {
+	uint state;
+	ffstr tracks; // the remaining data of "cue_tracks"
+	ffstr meta; // meta of the current track
+	ffstr prev_meta; // meta of the previous track
+	uint64 base; // absolute position of the sample which is passed as position #0
+	uint64 start, end; // current track (absolute samples)
+	uint64 pos; // absolute position of the current data
+	uint64 total; // absolute length of the image;  0:unknown
+	size_t consumed; // bytes of the current input data block that were already passed
+	uint sampsize;
+	const fmed_modinfo *mi;
+	const char *datatype;
+	void *qent;
+
+	struct cs_shared *sh; // --parallel
+	struct cs_branch *cur; // the branch receiving data
+	uint input :1;
+};
+
+static void cs_block_free(struct cs_shared *sh, struct cs_block *k)
+{
+	if (k == NULL)
+		return;
+	sh->queued -= k->len;
+	ffmem_free(k);
+}
+
+static void cs_unref(struct cs_shared *sh)
+{
+	fflock_lock(&sh->lk);
+	uint refs = --sh->refs;
+	fflock_unlock(&sh->lk);
+	if (refs != 0)
+		return;
+
+	struct cs_branch **pb;
+	FFSLICE_WALK(&sh->branches, pb) {
+		struct cs_branch *b = *pb;
+		struct cs_block *k, *next;
+		for (k = b->first;  k != NULL;  k = next) {
+			next = k->next;
+			ffmem_free(k);
+		}
+		ffmem_free(b->cur);
+		ffmem_free(b->meta);
+		ffmem_free(b);
+	}
+	ffvec_free(&sh->branches);
+	ffmem_free(sh);
+}
+
+static void* cuesplit_open(fmed_filt *d)
+{
+	const char *val = d->track->getvalstr(d->trk, "cue_tracks");
+	if (val == FMED_PNULL)
+		return FMED_FILT_SKIP;
+
+	const char *ofn = d->out_filename;
+	ffstr ext;
+	ffpath_splitname(ofn, ffsz_len(ofn), NULL, &ext);
+	const fmed_modinfo *mi = core->getmod2(FMED_MOD_OUTEXT, ext.ptr, ext.len);
+	if (mi == NULL) {
+		errlog(core, d->trk, "cue", "no module can write to this file format: %S", &ext);
+		return NULL;
+	}
+
+	if (!d->audio.fmt.ileaved) {
+		errlog(core, d->trk, "cue", "non-interleaved input data isn't supported");
+		return NULL;
+	}
+
+	struct cuesplit *s = ffmem_new(struct cuesplit);
+	ffstr_setz(&s->tracks, val);
+	s->mi = mi;
+	s->sampsize = ffpcm_size(d->audio.fmt.format, d->audio.fmt.channels);
+	s->datatype = d->datatype;
+	s->qent = (void*)d->track->getval(d->trk, "queue_item");
+
+	uint rate = d->audio.fmt.sample_rate;
+	uint from;
+	ffstr v = s->tracks;
+	ffstr_splitby(&v, '\t', &v, NULL);
+	if (!ffstr_to_uint32(&v, &from)) {
+		errlog(core, d->trk, "cue", "bad cue_tracks value");
+		ffmem_free(s);
+		return NULL;
+	}
+	s->base = (uint64)from * rate / 75;
+	if ((int64)d->audio.total != FMED_NULL && d->audio.total != 0)
+		s->total = s->base + d->audio.total;
+
+	if (core->props->parallel) {
+		struct cs_shared *sh = ffmem_new(struct cs_shared);
+		fflock_init(&sh->lk);
+		sh->refs = 1;
+		sh->track = d->track;
+		sh->trk = d->trk;
+		s->sh = sh;
+	}
+	return s;
+}
+
+/** Finish the data for all branches, so they close after the queued data is processed. */
+static void cuesplit_close(void *ctx)
+{
+	struct cuesplit *s = ctx;
+	struct cs_shared *sh = s->sh;
+
+	if (sh != NULL) {
+		fflock_lock(&sh->lk);
+		sh->closed = 1;
+		struct cs_branch **pb;
+		FFSLICE_WALK(&sh->branches, pb) {
+			struct cs_branch *b = *pb;
+			b->fin = 1;
+			if (b->waiting) {
+				b->waiting = 0;
+				sh->track->cmd(b->trk, FMED_TRACK_WAKE);
+			}
+		}
+		fflock_unlock(&sh->lk);
+		cs_unref(sh);
+	}
+
+	ffmem_free(s);
+}
+
+/** Set meta for the next output file. */
+static void cuesplit_meta(struct cuesplit *s, ffstr meta)
+{
+	ffstr name, val;
+
+	if (s->qent == FMED_PNULL)
+		return;
+
+	while (s->prev_meta.len != 0) {
+		ffstr_splitby(&s->prev_meta, '\t', &name, &s->prev_meta);
+		ffstr_splitby(&s->prev_meta, '\t', NULL, &s->prev_meta);
+		qu->meta_set(s->qent, name.ptr, name.len, NULL, 0, FMED_QUE_METADEL);
+	}
+	s->prev_meta = meta;
+
+	while (meta.len != 0) {
+		ffstr_splitby(&meta, '\t', &name, &meta);
+		ffstr_splitby(&meta, '\t', &val, &meta);
+		qu->meta_set(s->qent, name.ptr, name.len, val.ptr, val.len, FMED_QUE_OVWRITE);
+	}
+}
+
+/** Get boundaries of the next track.
+Return 1 if there are no more tracks. */
+static int cuesplit_next(struct cuesplit *s, fmed_filt *d)
+{
+	ffstr line, v;
+	uint from, to;
+	uint rate = d->audio.fmt.sample_rate;
+
+	if (s->tracks.len == 0)
+		return 1;
+	ffstr_splitby(&s->tracks, '\n', &line, &s->tracks);
+	ffstr_splitby(&line, '\t', &v, &line);
+	ffstr_to_uint32(&v, &from);
+	ffstr_splitby(&line, '\t', &v, &line);
+	ffstr_to_uint32(&v, &to);
+
+	s->start = ffpcm_samples(from * 1000 / 75, rate);
+	s->end = (to != 0) ? (uint64)from * rate / 75 + (uint64)(to - from) * rate / 75 : (uint64)-1;
+	dbglog1(d->trk, "next track: %U..%U", s->start, s->end);
+
+	d->audio.total = FMED_NULL;
+	if (to != 0)
+		d->audio.total = s->end - s->start;
+	else if (s->total != 0)
+		d->audio.total = s->total - (uint64)from * rate / 75;
+
+	s->meta = line;
+	return 0;
+}
+
+/** Move back to the start of the new track:
+ the previous track overlaps with this one by a few samples. */
+static void cuesplit_rewind(struct cuesplit *s, fmed_filt *d)
+{
+	if (s->pos > s->start) {
+		size_t n = ffmin((s->pos - s->start) * s->sampsize, s->consumed);
+		d->data -= n;
+		d->datalen += n;
+		s->consumed -= n;
+		s->pos -= n / s->sampsize;
+	}
+}
+
+/** Skip the gap between tracks */
+static void cuesplit_skip(struct cuesplit *s, fmed_filt *d)
+{
+	if (s->pos < s->start) {
+		size_t n = ffmin((s->start - s->pos) * s->sampsize, d->datalen);
+		d->data += n;
+		d->datalen -= n;
+		s->consumed += n;
+		s->pos += n / s->sampsize;
+	}
+}
+
+/** Start the branch track.  Thread: main */
+static void cs_branch_xstart(void *param)
+{
+	struct cs_branch *b = param;
+	b->sh->track->cmd(b->trk, FMED_TRACK_XSTART);
+}
+
+/** Create a new track which writes the current .cue track to a file, and start it on the main thread. */
+static int cs_branch_start(struct cuesplit *s, fmed_filt *d)
+{
+	struct cs_shared *sh = s->sh;
+	struct cs_branch *b = ffmem_new(struct cs_branch);
+	b->sh = sh;
+
+	// "NAME\tVAL\t..." -> "NAME\0VAL\0...": the names and values are referenced by the track's meta
+	b->meta = ffsz_dupstr(&s->meta);
+	b->meta_len = s->meta.len;
+	for (size_t i = 0;  i != b->meta_len;  i++) {
+		if (b->meta[i] == '\t')
+			b->meta[i] = '\0';
+	}
+
+	fmed_track_obj *trk;
+	if (NULL == (trk = d->track->create(FMED_TRK_TYPE_NONE, ""))) {
+		ffmem_free(b->meta);
+		ffmem_free(b);
+		return -1;
+	}
+
+	fmed_trk *ti = d->track->conf(trk);
+	d->track->copy_info(ti, d);
+	ti->datatype = s->datatype;
+	ti->audio.seek = FMED_NULL;
+	ti->audio.until = FMED_NULL;
+	ti->audio.split = FMED_NULL;
+	ti->audio.abs_seek = 0;
+	ti->out_seekable = 1;
+
+	const char *input = d->track->getvalstr(d->trk, "input");
+	if (input != FMED_PNULL)
+		d->track->setvalstr4(trk, "input", ffsz_dup(input), FMED_TRK_FACQUIRE);
+	d->track->setval(trk, "cuesplit_branch", (size_t)b);
+	d->track->cmd2(trk, FMED_TRACK_META_COPYFROM, d->trk);
+
+	for (size_t i = 0;  i < b->meta_len;  ) {
+		const char *name = &b->meta[i];
+		i += ffsz_len(name) + 1;
+		if (i > b->meta_len)
+			break;
+		const char *val = &b->meta[i];
+		i += ffsz_len(val) + 1;
+		d->track->setvalstr4(trk, name, val, FMED_TRK_META);
+	}
+
+	if (0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, "plist.cuesplit-in")
+		|| 0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, "afilter.autoconv")
+		|| 0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, s->mi->name)
+		|| 0 == d->track->cmd(trk, FMED_TRACK_FILT_ADDLAST, "#file.out")) {
+		d->track->cmd(trk, FMED_TRACK_STOP);
+		ffmem_free(b->meta);
+		ffmem_free(b);
+		return -1;
+	}
+
+	b->trk = trk;
+	fflock_lock(&sh->lk);
+	*ffvec_pushT(&sh->branches, struct cs_branch*) = b;
+	sh->refs++;
+	fflock_unlock(&sh->lk);
+	s->cur = b;
+
+	dbglog1(d->trk, "starting branch #%L", sh->branches.len);
+	fftask_set(&b->tsk_start, &cs_branch_xstart, b);
+	core->task(&b->tsk_start, FMED_TASK_POST);
+	return 0;
+}
+
+/** Add data to the current branch's queue.
+fin: this is the last data for the branch */
+static int cs_branch_put(struct cuesplit *s, const void *data, size_t len, uint64 pos, uint fin)
+{
+	struct cs_shared *sh = s->sh;
+	struct cs_branch *b = s->cur;
+	struct cs_block *k = NULL;
+
+	if (len != 0) {
+		if (NULL == (k = ffmem_alloc(sizeof(struct cs_block) + len)))
+			return -1;
+		k->next = NULL;
+		k->pos = pos;
+		k->len = len;
+		ffmem_copy(k->data, data, len);
+	}
+
+	fflock_lock(&sh->lk);
+	if (b->closed) {
+		ffmem_free(k);
+	} else if (k != NULL) {
+		if (b->last != NULL)
+			b->last->next = k;
+		else
+			b->first = k;
+		b->last = k;
+		sh->queued += len;
+	}
+	if (fin)
+		b->fin = 1;
+	if (b->waiting) {
+		b->waiting = 0;
+		sh->track->cmd(b->trk, FMED_TRACK_WAKE);
+	}
+	fflock_unlock(&sh->lk);
+
+	if (fin)
+		s->cur = NULL;
+	return 0;
+}
+
+/* --parallel: pass data to the branch tracks */
+static int cuesplit_mt_process(struct cuesplit *s, fmed_filt *d)
+{
+	struct cs_shared *sh = s->sh;
+
+	if ((d->flags & FMED_FFWD) && !s->input) {
+		if ((int64)d->audio.pos == FMED_NULL)
+			return FMED_RDONE;
+		s->input = 1;
+		s->pos = s->base + d->audio.pos;
+		s->consumed = 0;
+	}
+	if (!s->input)
+		return FMED_RMORE;
+
+	fflock_lock(&sh->lk);
+	if (sh->queued > CUESPLIT_QUEUE_MAX) {
+		// the encoders don't keep up with the decoder
+		sh->waiting = 1;
+		fflock_unlock(&sh->lk);
+		return FMED_RASYNC;
+	}
+	fflock_unlock(&sh->lk);
+
+	for (;;) {
+		if (s->state == 0) {
+			if (0 != cuesplit_next(s, d)) {
+				s->input = 0;
+				return FMED_RDONE;
+			}
+			cuesplit_rewind(s, d);
+			if (0 != cs_branch_start(s, d))
+				return FMED_RERR;
+			s->state = 1;
+		}
+
+		cuesplit_skip(s, d);
+
+		size_t n = d->datalen;
+		uint64 pos = s->pos - ffmin(s->pos, s->start);
+		uint samps = d->datalen / s->sampsize;
+		uint fin = 0;
+		if (s->pos + samps >= s->end) {
+			dbglog1(d->trk, "reached sample #%U", s->end);
+			n = (s->end > s->pos) ? (s->end - s->pos) * s->sampsize : 0;
+			fin = 1;
+		}
+		if (0 != cs_branch_put(s, d->data, n, pos, fin)) {
+			syserrlog(core, d->trk, "cue", "%s", ffmem_alloc_S);
+			return FMED_RERR;
+		}
+		d->data += n;
+		d->datalen -= n;
+		s->consumed += n;
+		s->pos += n / s->sampsize;
+		if (!fin)
+			break;
+		s->state = 0;
+	}
+
+	s->input = 0;
+	if (d->flags & FMED_FLAST) {
+		if (s->cur != NULL)
+			cs_branch_put(s, NULL, 0, 0, 1);
+		return FMED_RDONE;
+	}
+	return FMED_RMORE;
+}
+
+static int cuesplit_process(void *ctx, fmed_filt *d)
+{
+	struct cuesplit *s = ctx;
+
+	if (s->sh != NULL)
+		return cuesplit_mt_process(s, d);
+
+	if (d->flags & FMED_FFWD) {
+		if ((int64)d->audio.pos == FMED_NULL)
+			return FMED_RDONE;
+		s->pos = s->base + d->audio.pos;
+		s->consumed = 0;
+	}
+
+	switch (s->state) {
+	case 0:
+		if (0 != cuesplit_next(s, d))
+			return FMED_RDONE;
+		cuesplit_meta(s, s->meta);
+		cuesplit_rewind(s, d);
+
+		d->datatype = s->datatype; // the audio output filter needs input data type, but overwrites this value afterwards
+		if (0 == d->track->cmd(d->trk, FMED_TRACK_FILT_ADDLAST, "afilter.autoconv")
+			|| 0 == d->track->cmd(d->trk, FMED_TRACK_FILT_ADDLAST, s->mi->name)
+			|| 0 == d->track->cmd(d->trk, FMED_TRACK_FILT_ADDLAST, "#file.out"))
+			return FMED_RERR;
+		d->out_seekable = 1;
+		s->state = 1;
+		break;
+
+	case 1:
+		if (!(d->flags & FMED_FFWD) && d->datalen == 0)
+			return FMED_RMORE;
+		break;
+	}
+
+	cuesplit_skip(s, d);
+
+	d->out = d->data;
+	d->outlen = d->datalen;
+	d->audio.pos = s->pos - ffmin(s->pos, s->start);
+
+	uint samps = d->datalen / s->sampsize;
+	dbglog1(d->trk, "at %U..%U", s->pos, s->pos + samps);
+	if (s->pos + samps >= s->end) {
+		dbglog1(d->trk, "reached sample #%U", s->end);
+		d->outlen = (s->end > s->pos) ? (s->end - s->pos) * s->sampsize : 0;
+		d->data += d->outlen;
+		d->datalen -= d->outlen;
+		s->consumed += d->outlen;
+		s->pos += d->outlen / s->sampsize;
+		s->state = 0;
+		return FMED_RNEXTDONE;
+	}
+
+	s->consumed += d->datalen;
+	s->pos += samps;
+	d->datalen = 0;
+	if (d->flags & FMED_FLAST)
+		return FMED_RDONE;
+	return FMED_RDATA;
+}
+
+const fmed_filter cuesplit_iface = { cuesplit_open, cuesplit_process, cuesplit_close };
+
+
+/** Branch track: get the data of 1 .cue track from the queue filled by plist.cuesplit */
+
+static void* cuesplitin_open(fmed_filt *d)
+{
+	int64 val = d->track->getval(d->trk, "cuesplit_branch");
+	if (val == FMED_NULL)
+		return NULL;
+	return (void*)(size_t)val;
+}
+
+static void cuesplitin_close(void *ctx)
+{
+	struct cs_branch *b = ctx;
+	struct cs_shared *sh = b->sh;
+
+	fflock_lock(&sh->lk);
+	b->closed = 1;
+	cs_block_free(sh, b->cur);
+	b->cur = NULL;
+	struct cs_block *k, *next;
+	for (k = b->first;  k != NULL;  k = next) {
+		next = k->next;
+		cs_block_free(sh, k);
+	}
+	b->first = b->last = NULL;
+	if (sh->waiting && !sh->closed) {
+		sh->waiting = 0;
+		sh->track->cmd(sh->trk, FMED_TRACK_WAKE);
+	}
+	fflock_unlock(&sh->lk);
+
+	cs_unref(sh);
+}
+
+static int cuesplitin_process(void *ctx, fmed_filt *d)
+{
+	struct cs_branch *b = ctx;
+	struct cs_shared *sh = b->sh;
+
+	fflock_lock(&sh->lk);
+
+	cs_block_free(sh, b->cur);
+	b->cur = NULL;
+	if (sh->waiting && !sh->closed && sh->queued <= CUESPLIT_QUEUE_MAX / 2) {
+		sh->waiting = 0;
+		sh->track->cmd(sh->trk, FMED_TRACK_WAKE);
+	}
+
+	struct cs_block *k = b->first;
+	if (k == NULL) {
+		uint fin = b->fin;
+		if (!fin)
+			b->waiting = 1;
+		fflock_unlock(&sh->lk);
+		if (fin) {
+			d->outlen = 0;
+			return FMED_RDONE;
+		}
+		return FMED_RASYNC;
+	}
+	b->first = k->next;
+	if (b->first == NULL)
+		b->last = NULL;
+	b->cur = k;
+
+	fflock_unlock(&sh->lk);
+
+	d->out = k->data;
+	d->outlen = k->len;
+	d->audio.pos = k->pos;
+	return FMED_RDATA;
+}
+
+const fmed_filter cuesplitin_iface = { cuesplitin_open, cuesplitin_process, cuesplitin_close };
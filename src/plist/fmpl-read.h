@@ -0,0 +1,100 @@
+/** fmedia: .fmpl read
+2023, Simon Zolin */
+
+struct fmplr {
+	fmpl pl;
+	fmed_que_entry *qu_cur;
+	uint removed :1;
+};
+
+static void* fmplr_open(fmed_filt *d)
+{
+	struct fmplr *m = ffmem_new(struct fmplr);
+	if (d->track->getval != NULL)
+		m->qu_cur = (void*)fmed_getval("queue_item");
+
+	const char *fn = d->track->getvalstr(d->trk, "input");
+	fffd f;
+	if (FFFILE_NULL == (f = fffile_open(fn, FFFILE_READONLY))) {
+		syserrlog1(d->trk, "file open: %s", fn);
+		goto err;
+	}
+	int r = fmpl_open(&m->pl, f);
+	fffile_close(f);
+	if (r == -1) {
+		syserrlog1(d->trk, "%s: file map", fn);
+		goto err;
+	} else if (r != 0) {
+		errlog1(d->trk, "%s: bad .fmpl file", fn);
+		goto err;
+	}
+
+	dbglog1(d->trk, "%s: entries:%u/%u  strings:%U"
+		, fn, m->pl.hdr->n, m->pl.hdr->cap, m->pl.hdr->strs_size);
+	return m;
+
+err:
+	ffmem_free(m);
+	return NULL;
+}
+
+static void fmplr_close(void *ctx)
+{
+	struct fmplr *m = ctx;
+	if (!m->removed)
+		qu->cmdv(FMED_QUE_RM, m->qu_cur);
+	fmpl_close(&m->pl);
+	ffmem_free(m);
+}
+
+static int fmplr_add(struct fmplr *m, fmed_filt *d, const struct fmpl_ent *fe)
+{
+	fmed_que_entry ent = {}, *cur;
+	ffstr meta[2];
+
+	ffstr url = fmpl_str(&m->pl, fe->url);
+	if (0 != plist_fullname(d, &url, &ent.url))
+		return 1;
+	ent.dur = fe->dur_msec;
+
+	cur = (void*)qu->cmdv(FMED_QUE_ADDAFTER | FMED_QUE_NO_ONCHANGE, &ent, m->qu_cur);
+	ffstr_free(&ent.url);
+	qu->cmdv(FMED_QUE_COPYTRACKPROPS, cur, m->qu_cur);
+
+	if (fe->artist.len != 0) {
+		ffstr_setcz(&meta[0], "artist");
+		meta[1] = fmpl_str(&m->pl, fe->artist);
+		qu->cmd2(FMED_QUE_METASET | (FMED_QUE_TMETA << 16), cur, (size_t)meta);
+	}
+
+	if (fe->title.len != 0) {
+		ffstr_setcz(&meta[0], "title");
+		meta[1] = fmpl_str(&m->pl, fe->title);
+		qu->cmd2(FMED_QUE_METASET | (FMED_QUE_TMETA << 16), cur, (size_t)meta);
+	}
+
+	qu->cmd2(FMED_QUE_ADD | FMED_QUE_MORE | FMED_QUE_ADD_DONE, cur, 0);
+	if (!m->removed) {
+		m->removed = 1;
+		qu->cmdv(FMED_QUE_RM, m->qu_cur);
+	}
+	m->qu_cur = cur;
+	return 0;
+}
+
+/* The entries are read directly from the mapped file: no input data from the previous filter is needed. */
+static int fmplr_process(void *ctx, fmed_filt *d)
+{
+	struct fmplr *m = ctx;
+	uint n = fmpl_count(&m->pl);
+
+	for (uint i = 0;  i != n;  i++) {
+		if (0 != fmplr_add(m, d, fmpl_ent(&m->pl, i)))
+			return FMED_RERR;
+	}
+
+	qu->cmd(FMED_QUE_ADD | FMED_QUE_ADD_DONE, NULL);
+	return FMED_RFIN;
+}
+
+const fmed_filter fmpl_input = { fmplr_open, fmplr_process, fmplr_close };
@@ -0,0 +1,277 @@
+/** fmedia: .fmpl write
+2023, Simon Zolin */
+
+/*
+The filter writes to the file directly (not via file.out), because it updates the existing file in-place:
+if the first N entries of the list are the same as in the file (including meta data),
+ only the new entries are appended.
+Otherwise a new file is written to ".tmp" file which is then renamed.
+The existing entries are never modified in-place:
+ an interrupted write must leave the previous version of the list intact.
+*/
+
+struct fmplw {
+	fmed_que_entry *cur;
+	const fmed_track *track;
+	void *trk;
+	uint next;
+	const char *fn;
+	ffvec ents; // struct fmpl_ent[]
+	ffvec strs; // string pool
+};
+
+static void* fmplw_open(fmed_filt *d)
+{
+	if (d->out_filename == NULL)
+		return FMED_FILT_SKIP;
+
+	struct fmplw *m = ffmem_new(struct fmplw);
+	m->trk = d->trk;
+	m->track = d->track;
+	m->cur = d->que_cur;
+	m->fn = d->out_filename;
+	return m;
+}
+
+static void fmplw_close(void *ctx)
+{
+	struct fmplw *m = ctx;
+	ffvec_free(&m->ents);
+	ffvec_free(&m->strs);
+	ffmem_free(m);
+}
+
+static void fmplw_expand_done(void *ctx)
+{
+	struct fmplw *m = ctx;
+	m->track->cmd(m->trk, FMED_TRACK_WAKE);
+}
+
+static struct fmpl_str fmplw_str(ffvec *strs, ffstr s)
+{
+	struct fmpl_str r = { strs->len, s.len };
+	ffvec_add2T(strs, &s, char);
+	return r;
+}
+
+static void fmplw_add(struct fmplw *m, fmed_que_entry *e)
+{
+	ffstr *s, empty = {};
+	struct fmpl_ent *ent = ffvec_zpushT(&m->ents, struct fmpl_ent);
+	ent->url = fmplw_str(&m->strs, e->url);
+	ent->url_hash = fmpl_hash(e->url);
+	ent->dur_msec = (e->dur > 0) ? e->dur : 0;
+
+	if (NULL == (s = qu->meta_find(e, FFSTR("artist"))))
+		s = &empty;
+	ent->artist = fmplw_str(&m->strs, *s);
+
+	if (NULL == (s = qu->meta_find(e, FFSTR("title"))))
+		s = &empty;
+	ent->title = fmplw_str(&m->strs, *s);
+}
+
+static ffstr fmplw_entstr(struct fmplw *m, struct fmpl_str s)
+{
+	ffstr r;
+	ffstr_set(&r, (char*)m->strs.ptr + s.off, s.len);
+	return r;
+}
+
+/** Return TRUE if the entry in file has the same data */
+static int fmplw_ent_eq(struct fmplw *m, const struct fmpl_ent *e, fmpl *pl, const struct fmpl_ent *fe)
+{
+	ffstr a = fmplw_entstr(m, e->artist), t = fmplw_entstr(m, e->title);
+	ffstr fa = fmpl_str(pl, fe->artist), ft = fmpl_str(pl, fe->title);
+	return e->dur_msec == fe->dur_msec
+		&& ffstr_eq2(&a, &fa)
+		&& ffstr_eq2(&t, &ft);
+}
+
+/** Copy string to the pool being appended to the file */
+static void fmplw_str_move(struct fmplw *m, struct fmpl_str *s, ffvec *strs, uint64 base)
+{
+	*s = fmplw_str(strs, fmplw_entstr(m, *s));
+	s->off += base;
+}
+
+/** Append the new entries to the existing file.
+Return 0 on success;  1: the file must be rewritten;  -1: error */
+static int fmplw_append(struct fmplw *m)
+{
+	int rc = 1;
+	fffd f;
+	fmpl pl = {};
+	ffvec strs = {}, slots = {};
+	struct fmpl_hdr h;
+	struct fmpl_ent *e = m->ents.ptr;
+	uint n = m->ents.len;
+
+	if (FFFILE_NULL == (f = fffile_open(m->fn, FFFILE_READWRITE)))
+		return 1;
+	if (0 != fmpl_open(&pl, f))
+		goto end;
+	h = *pl.hdr;
+
+	if (n < h.n || n > h.cap
+		|| h.strs_size + m->strs.len > 0xffffffff)
+		goto end;
+
+	for (uint i = 0;  i != h.n;  i++) {
+		ffstr url = fmplw_entstr(m, e[i].url), furl = fmpl_str(&pl, pl.ents[i].url);
+		if (!ffstr_eq2(&url, &furl))
+			goto end;
+		if (!fmplw_ent_eq(m, &e[i], &pl, &pl.ents[i]))
+			goto end; // cached meta data has changed
+	}
+
+	ffvec_alloc(&strs, m->strs.len, 1);
+	ffvec_allocT(&slots, h.hash_cap, uint);
+	ffmem_copy(slots.ptr, pl.hash, h.hash_cap * sizeof(uint));
+	for (uint i = h.n;  i != n;  i++) {
+		fmplw_str_move(m, &e[i].url, &strs, h.strs_size);
+		fmplw_str_move(m, &e[i].artist, &strs, h.strs_size);
+		fmplw_str_move(m, &e[i].title, &strs, h.strs_size);
+	}
+
+	fmpl_close(&pl);
+	rc = -1;
+
+	// the data beyond N and STRINGS_SIZE is not visible to readers until the header is written
+	if (0 > fffile_writeat(f, strs.ptr, strs.len, h.strs_off + h.strs_size))
+		goto end;
+
+	if (n != h.n
+		&& 0 > fffile_writeat(f, &e[h.n], (n - h.n) * sizeof(*e), h.ents_off + h.n * sizeof(*e)))
+		goto end;
+
+	for (uint i = h.n;  i != n;  i++) {
+		uint k = fmpl_hash_add(slots.ptr, h.hash_cap, e[i].url_hash, i);
+		if (0 > fffile_writeat(f, (uint*)slots.ptr + k, sizeof(uint), h.hash_off + k * sizeof(uint)))
+			goto end;
+	}
+
+	dbglog1(m->trk, "%s: appended %u entries"
+		, m->fn, n - h.n);
+	h.n = n;
+	h.strs_size += strs.len;
+	if (0 > fffile_writeat(f, &h, sizeof(h), 0))
+		goto end;
+	rc = 0;
+
+end:
+	if (rc < 0)
+		syserrlog1(m->trk, "%s: %s", m->fn, "file write");
+	fmpl_close(&pl);
+	fffile_close(f);
+	ffvec_free(&strs);
+	ffvec_free(&slots);
+	return rc;
+}
+
+/** Write a new file */
+static int fmplw_write(struct fmplw *m)
+{
+	int rc = -1;
+	fffd f = FFFILE_NULL;
+	ffvec slots = {};
+	char *tmpname = ffsz_allocfmt("%s.tmp", m->fn);
+	uint n = m->ents.len;
+	struct fmpl_hdr h = {};
+
+	if (m->strs.len > 0xffffffff) {
+		errlog1(m->trk, "%s: playlist is too large", m->fn);
+		goto end;
+	}
+
+	ffmem_copy(h.magic, FMPL_MAGIC, 8);
+	h.ver = FMPL_VER;
+	h.n = n;
+	h.cap = fmpl_cap(n);
+	h.hash_cap = fmpl_hash_cap(h.cap);
+	h.hash_off = sizeof(h);
+	h.ents_off = h.hash_off + h.hash_cap * sizeof(uint);
+	h.strs_off = h.ents_off + h.cap * sizeof(struct fmpl_ent);
+	h.strs_size = m->strs.len;
+
+	ffvec_allocT(&slots, h.hash_cap, uint);
+	ffmem_zero(slots.ptr, h.hash_cap * sizeof(uint));
+	const struct fmpl_ent *e = m->ents.ptr;
+	for (uint i = 0;  i != n;  i++) {
+		fmpl_hash_add(slots.ptr, h.hash_cap, e[i].url_hash, i);
+	}
+
+	// keep the reserved part of the entry table zeroed
+	ffvec_growT(&m->ents, h.cap - n, struct fmpl_ent);
+	ffmem_zero((struct fmpl_ent*)m->ents.ptr + n, (h.cap - n) * sizeof(struct fmpl_ent));
+
+	if (FFFILE_NULL == (f = fffile_open(tmpname, FFFILE_CREATE | FFFILE_TRUNCATE | FFFILE_WRITEONLY))
+		|| 0 > fffile_writeat(f, &h, sizeof(h), 0)
+		|| 0 > fffile_writeat(f, slots.ptr, h.hash_cap * sizeof(uint), h.hash_off)
+		|| 0 > fffile_writeat(f, m->ents.ptr, h.cap * sizeof(struct fmpl_ent), h.ents_off)
+		|| 0 > fffile_writeat(f, m->strs.ptr, m->strs.len, h.strs_off)) {
+		syserrlog1(m->trk, "%s: %s", tmpname, "file write");
+		goto end;
+	}
+
+	fffile_close(f);
+	f = FFFILE_NULL;
+	if (0 != fffile_rename(tmpname, m->fn)) {
+		syserrlog1(m->trk, "%s: %s", m->fn, "file rename");
+		goto end;
+	}
+
+	dbglog1(m->trk, "%s: written %u entries", m->fn, n);
+	rc = 0;
+
+end:
+	if (f != FFFILE_NULL) {
+		fffile_close(f);
+		fffile_remove(tmpname);
+	}
+	ffmem_free(tmpname);
+	ffvec_free(&slots);
+	return rc;
+}
+
+static int fmplw_process(void *ctx, fmed_filt *d)
+{
+	struct fmplw *m = ctx;
+	fmed_que_entry *e = m->cur;
+
+	for (;;) {
+
+		if (m->cur == NULL)
+			break; // empty list
+
+		if (m->next) {
+			if (0 == qu->cmdv(FMED_QUE_LIST_NOFILTER, &e))
+				break;
+		} else {
+			m->next = 1;
+		}
+
+		uint t = 0;
+#ifndef FF_ANDROID
+		t = core->cmd(FMED_FILETYPE, e->url.ptr);
+#endif
+		if (t == FMED_FT_DIR || t == FMED_FT_PLIST) {
+			m->cur = e;
+			void *trk = (void*)qu->cmdv(FMED_QUE_EXPAND2, e, &fmplw_expand_done, m);
+			if (trk == NULL || trk == FMED_TRK_EFMT)
+				continue;
+			return FMED_RASYNC;
+		}
+
+		fmplw_add(m, e);
+	}
+
+	int r = fmplw_append(m);
+	if (r > 0)
+		r = fmplw_write(m);
+	if (r != 0)
+		return FMED_RERR;
+	return FMED_RFIN;
+}
+
+const fmed_filter fmpl_output = { fmplw_open, fmplw_process, fmplw_close };
@@ -0,0 +1,213 @@
+/** fmedia: .fmpl: indexed binary playlist
+2023, Simon Zolin */
+
+/*
+The file is mapped into memory when opened, so opening a playlist of any size takes constant time,
+ and any entry can be accessed by its index without parsing the entries before it.
+An entry can be found by its file name via the hash index.
+
+HDR HASH ENTRY[CAP] STRINGS
+HDR: "fmedplst" VER[4] N[4] CAP[4] HASH_CAP[4]
+  HASH_OFF[8] ENTRIES_OFF[8] STRINGS_OFF[8] STRINGS_SIZE[8] RESERVED[8]
+HASH: (ENTRY_INDEX+1 [4])[HASH_CAP]  (0: empty slot; linear probing)
+ENTRY: URL_OFF[4] URL_LEN[4] ARTIST_OFF[4] ARTIST_LEN[4] TITLE_OFF[4] TITLE_LEN[4]
+  DURATION_MSEC[4] URL_HASH[4]
+STRINGS: string data (offsets are relative to STRINGS_OFF)
+Numbers are in host byte order.
+
+The entry table has spare capacity, and the string pool is at the end of file,
+ so new entries are appended without moving the existing data:
+ strings are written after STRINGS_SIZE, then the entry and its hash slot are written,
+ and only then the header with the new N and STRINGS_SIZE.
+If the writer is interrupted, the file still contains the previous version of the list.
+*/
+
+#include <ffbase/murmurhash3.h>
+#ifdef FF_WIN
+#else
+#include <sys/mman.h>
+#endif
+
+#define FMPL_MAGIC  "fmedplst"
+enum {
+	FMPL_VER = 1,
+	FMPL_HASH_SEED = 0x12345678,
+};
+
+struct fmpl_hdr {
+	char magic[8];
+	uint ver;
+	uint n; // number of valid entries
+	uint cap; // max. number of entries in the table
+	uint hash_cap; // number of hash slots (power of 2)
+	uint64 hash_off;
+	uint64 ents_off;
+	uint64 strs_off;
+	uint64 strs_size; // number of valid bytes in the string pool
+	uint64 reserved;
+};
+
+struct fmpl_str {
+	uint off, len;
+};
+
+struct fmpl_ent {
+	struct fmpl_str url, artist, title;
+	uint dur_msec;
+	uint url_hash;
+};
+
+static inline uint fmpl_hash(ffstr url)
+{
+	return murmurhash3(url.ptr, url.len, FMPL_HASH_SEED);
+}
+
+/** Get the table capacity for N entries: leave room for appending */
+static inline uint fmpl_cap(uint n)
+{
+	return n + n / 2 + 64;
+}
+
+/** Get the number of hash slots: keep the load factor below 1/2 */
+static inline uint fmpl_hash_cap(uint cap)
+{
+	return ffint_align_power2(cap * 2);
+}
+
+/** Insert entry into hash table.
+A slot referring to an entry with index >= 'index' is a leftover from an interrupted append and is reused.
+Return slot number */
+static inline uint fmpl_hash_add(uint *slots, uint hash_cap, uint hash, uint index)
+{
+	uint i = hash & (hash_cap - 1);
+	while (slots[i] != 0 && slots[i] <= index) {
+		i = (i + 1) & (hash_cap - 1);
+	}
+	slots[i] = index + 1;
+	return i;
+}
+
+/** Read-only view of .fmpl file */
+typedef struct fmpl {
+	const char *data;
+	size_t size;
+	const struct fmpl_hdr *hdr;
+	const uint *hash;
+	const struct fmpl_ent *ents;
+	const char *strs;
+} fmpl;
+
+static inline void fmpl_close(fmpl *pl)
+{
+	if (pl->data == NULL)
+		return;
+#ifdef FF_WIN
+	UnmapViewOfFile(pl->data);
+#else
+	munmap((void*)pl->data, pl->size);
+#endif
+	pl->data = NULL;
+}
+
+/** Check that the data regions are within the file */
+static inline int fmpl_check(fmpl *pl)
+{
+	const struct fmpl_hdr *h = pl->hdr;
+	if (pl->size < sizeof(*h)
+		|| ffmem_cmp(h->magic, FMPL_MAGIC, 8)
+		|| h->ver != FMPL_VER
+		|| h->n > h->cap
+		|| h->hash_cap < h->cap
+		|| h->hash_cap == 0
+		|| (h->hash_cap & (h->hash_cap - 1)) != 0
+		|| h->hash_off > pl->size
+		|| (uint64)h->hash_cap * sizeof(uint) > pl->size - h->hash_off
+		|| h->ents_off > pl->size
+		|| (uint64)h->cap * sizeof(struct fmpl_ent) > pl->size - h->ents_off
+		|| h->strs_off > pl->size
+		|| h->strs_size > pl->size - h->strs_off)
+		return -1;
+
+	pl->hash = (uint*)(pl->data + h->hash_off);
+	pl->ents = (struct fmpl_ent*)(pl->data + h->ents_off);
+	pl->strs = pl->data + h->strs_off;
+	return 0;
+}
+
+/** Map file into memory.
+Return 0 on success;
+ -1: system error;
+ -2: bad file format */
+static inline int fmpl_open(fmpl *pl, fffd f)
+{
+	ffmem_zero_obj(pl);
+	uint64 size = fffile_size(f);
+	if ((int64)size < (int64)sizeof(struct fmpl_hdr))
+		return -2;
+	if (size != (size_t)size)
+		return -1;
+
+#ifdef FF_WIN
+	HANDLE fm;
+	if (NULL == (fm = CreateFileMappingW(f, NULL, PAGE_READONLY, 0, 0, NULL)))
+		return -1;
+	pl->data = MapViewOfFile(fm, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(fm);
+	if (pl->data == NULL)
+		return -1;
+#else
+	void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, f, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	pl->data = p;
+#endif
+
+	pl->size = size;
+	pl->hdr = (struct fmpl_hdr*)pl->data;
+	if (0 != fmpl_check(pl)) {
+		fmpl_close(pl);
+		return -2;
+	}
+	return 0;
+}
+
+static inline uint fmpl_count(fmpl *pl)
+{
+	return pl->hdr->n;
+}
+
+/** Get entry by index */
+static inline const struct fmpl_ent* fmpl_ent(fmpl *pl, uint i)
+{
+	FF_ASSERT(i < pl->hdr->n);
+	return &pl->ents[i];
+}
+
+/** Get string from the pool; empty string if the reference is invalid */
+static inline ffstr fmpl_str(fmpl *pl, struct fmpl_str s)
+{
+	ffstr r = {};
+	if ((uint64)s.off + s.len <= pl->hdr->strs_size)
+		ffstr_set(&r, pl->strs + s.off, s.len);
+	return r;
+}
+
+/** Find entry by file name.
+Return entry index;  -1: not found */
+static inline int fmpl_find(fmpl *pl, ffstr url)
+{
+	uint hash = fmpl_hash(url), mask = pl->hdr->hash_cap - 1;
+	uint i = hash & mask;
+	for (uint n = 0;  n != pl->hdr->hash_cap;  n++) {
+		uint k = pl->hash[i];
+		if (k == 0 || k > pl->hdr->n)
+			break;
+		const struct fmpl_ent *e = &pl->ents[k - 1];
+		ffstr s = fmpl_str(pl, e->url);
+		if (e->url_hash == hash
+			&& ffstr_eq2(&url, &s))
+			return k - 1;
+		i = (i + 1) & mask;
+	}
+	return -1;
+}
@@ -1,10 +1,13 @@
-/** M3U, PLS input.
+/** M3U, PLS, FMPL input.
 Copyright (c) 2015 Simon Zolin */
 
 #include <fmedia.h>
 #include <util/url.h>
 
+#define syserrlog1(trk, ...)  fmed_syserrlog(core, trk, NULL, __VA_ARGS__)
+#define errlog1(trk, ...)  fmed_errlog(core, trk, NULL, __VA_ARGS__)
 #define warnlog1(trk, ...)  fmed_warnlog(core, trk, NULL, __VA_ARGS__)
+#define dbglog1(trk, ...)  fmed_dbglog(core, trk, NULL, __VA_ARGS__)
 
 const fmed_core *core;
 const fmed_queue *qu;
@@ -29,6 +32,8 @@ FF_EXP const fmed_mod* fmed_getmod(const fmed_core *_core)
 
 extern const fmed_filter fmed_cue_input;
 extern const fmed_filter cuehook_iface;
+extern const fmed_filter cuesplit_iface;
+extern const fmed_filter cuesplitin_iface;
 extern const fmed_filter fmed_dir_input;
 extern const fmed_filter fmed_plheal;
 extern int dir_conf(fmed_conf_ctx *ctx);
@@ -36,6 +41,9 @@ extern int dir_conf(fmed_conf_ctx *ctx);
 #include <plist/m3u-read.h>
 #include <plist/pls-read.h>
 #include <plist/m3u-write.h>
+#include <plist/fmpl.h>
+#include <plist/fmpl-read.h>
+#include <plist/fmpl-write.h>
 
 static const void* plist_iface(const char *name)
 {
@@ -43,12 +51,20 @@ static const void* plist_iface(const char *name)
 		return &fmed_m3u_input;
 	else if (ffsz_eq(name, "m3u-out"))
 		return &m3u_output;
+	else if (ffsz_eq(name, "fmpl"))
+		return &fmpl_input;
+	else if (ffsz_eq(name, "fmpl-out"))
+		return &fmpl_output;
 	else if (!ffsz_cmp(name, "pls"))
 		return &fmed_pls_input;
 	else if (!ffsz_cmp(name, "cue"))
 		return &fmed_cue_input;
 	else if (ffsz_eq(name, "cuehook"))
 		return &cuehook_iface;
+	else if (ffsz_eq(name, "cuesplit"))
+		return &cuesplit_iface;
+	else if (ffsz_eq(name, "cuesplit-in"))
+		return &cuesplitin_iface;
 	else if (!ffsz_cmp(name, "dir"))
 		return &fmed_dir_input;
 	else if (ffsz_eq(name, "heal"))
@@ -95,6 +95,7 @@ enum CMDS {
 
 	CMD_MASK = 0xff,
 
+	_CMD_TRKWORKER = 1 << 25, // call handler within the worker thread which processes the track (the handler modifies track's data)
 	_CMD_CURTRK_REC = 1 << 26,
 	_CMD_F3 = 1 << 27, //use 'cmdfunc3'
 	_CMD_CURTRK = 1 << 28, // use 'cmdfunc'.  Call handler only if there's an active track
@@ -416,6 +417,13 @@ static void tui_seek(tui *t, uint cmd, void *udata)
 	default:
 		return;
 	}
+	if (t->d->net_tshift_on) {
+		t->d->net_tshift_seek = (cmd == CMD_SEEKRIGHT) ? (int)by : -(int)by;
+		if (t->d->adev_ctx != NULL)
+			t->d->adev->cmd(FMED_ADEV_CMD_CLEAR, t->d->adev_ctx);
+		return;
+	}
+
 	if (cmd == CMD_SEEKRIGHT)
 		pos += by;
 	else
@@ -655,6 +663,10 @@ static void tui_op_trk(struct tui *t, uint cmd)
 		break;
 
 	case CMD_SAVETRK:
+		if (t->d->net_tshift_on) {
+			t->d->net_tshift_save = 1;
+			break;
+		}
 		fmed_infolog(core, t->trk, "tui", "Saving track to disk");
 		t->d->save_trk = 1;
 		break;
@@ -769,7 +781,7 @@ static struct key hotkeys[] = {
 	{ 'd',	_CMD_CURTRK | _CMD_CORE,	&tui_rmfile },
 	{ 'h',	_CMD_F1,	&tui_help },
 	{ 'i',	CMD_SHOWTAGS | _CMD_CURTRK | _CMD_CORE,	&tui_op_trk },
-	{ 'm',	CMD_MUTE | _CMD_CURTRK | _CMD_CORE,	&tui_vol },
+	{ 'm',	CMD_MUTE | _CMD_CURTRK | _CMD_TRKWORKER | _CMD_CORE,	&tui_vol },
 	{ 'n',	CMD_NEXT | _CMD_F1 | _CMD_CORE,	&tui_op },
 	{ 'p',	CMD_PREV | _CMD_F1 | _CMD_CORE,	&tui_op },
 	{ 'q',	CMD_QUIT | _CMD_F1 | _CMD_CORE,	&tui_op },
@@ -777,10 +789,10 @@ static struct key hotkeys[] = {
 	{ 's',	CMD_STOP | _CMD_F1 | _CMD_CORE,	&tui_op },
 	{ 'x',	_CMD_F1 | _CMD_CORE,	trk_rm_playnext },
 
-	{ FFKEY_UP,	CMD_VOLUP | _CMD_CURTRK | _CMD_CORE,	&tui_vol },
-	{ FFKEY_DOWN,	CMD_VOLDOWN | _CMD_CURTRK | _CMD_CORE,	&tui_vol },
-	{ FFKEY_RIGHT,	CMD_SEEKRIGHT | _CMD_F3 | _CMD_CORE,	&tui_seek },
-	{ FFKEY_LEFT,	CMD_SEEKLEFT | _CMD_F3 | _CMD_CORE,	&tui_seek },
+	{ FFKEY_UP,	CMD_VOLUP | _CMD_CURTRK | _CMD_TRKWORKER | _CMD_CORE,	&tui_vol },
+	{ FFKEY_DOWN,	CMD_VOLDOWN | _CMD_CURTRK | _CMD_TRKWORKER | _CMD_CORE,	&tui_vol },
+	{ FFKEY_RIGHT,	CMD_SEEKRIGHT | _CMD_F3 | _CMD_TRKWORKER | _CMD_CORE,	&tui_seek },
+	{ FFKEY_LEFT,	CMD_SEEKLEFT | _CMD_F3 | _CMD_TRKWORKER | _CMD_CORE,	&tui_seek },
 };
 
 static const struct key* key2cmd(int key)
@@ -803,6 +815,7 @@ struct corecmd {
 	fftask tsk;
 	const struct key *k;
 	void *udata;
+	void *trk; // _CMD_TRKWORKER: the track which was active when the command was received
 };
 
 static void tui_help(uint cmd)
@@ -825,10 +838,49 @@ static void tui_help(uint cmd)
 		fffile_write(ffstdout, buf, n);
 }
 
+/** Execute the command for the current track.
+Thread: worker */
+static void tui_trkcmd(void *param)
+{
+	struct corecmd *c = param;
+
+	fflk_lock(&gt->lktrk);
+	if (gt->curtrk == NULL || gt->curtrk->trk != c->trk)
+		goto done; // the track has been closed
+
+	if (c->k->cmd & _CMD_F3) {
+		cmdfunc3 func3 = (void*)c->k->func;
+		func3(gt->curtrk, c->k->cmd & CMD_MASK, c->udata);
+	} else {
+		cmdfunc func = (void*)c->k->func;
+		func(gt->curtrk, c->k->cmd & CMD_MASK);
+	}
+
+done:
+	fflk_unlock(&gt->lktrk);
+	ffmem_free(c);
+}
+
 static void tui_corecmd(void *param)
 {
 	struct corecmd *c = param;
 
+	if (c->k->cmd & _CMD_TRKWORKER) {
+		// the track may be processed in another thread: pass the command to its worker.
+		// Post while holding the lock: the track can't be closed (and freed) meanwhile.
+		fftask_set(&c->tsk, &tui_trkcmd, c);
+		fflk_lock(&gt->lktrk);
+		if (gt->curtrk != NULL) {
+			c->trk = gt->curtrk->trk;
+			gt->track->cmd(c->trk, FMED_TRACK_XPOST, &c->tsk);
+			c = NULL;
+		}
+		fflk_unlock(&gt->lktrk);
+		if (c == NULL)
+			return;
+		goto done;
+	}
+
 	if (c->k->cmd & _CMD_F1) {
 		cmdfunc1 func1 = (void*)c->k->func;
 		func1(c->k->cmd & CMD_MASK);
@@ -390,6 +390,7 @@ void ffhttpcl_sethandler(void *con, ffhttpcl_handler func, void *udata)
 enum {
 	I_START, I_ADDR, I_NEXTADDR, I_CONN,
 	I_HTTP_REQ, I_HTTP_REQ_SEND, I_HTTP_RESP, I_HTTP_RESP_PARSE, I_HTTP_RECVBODY, I_HTTP_RESPBODY,
+	I_RAWBODY, I_RAWBODY_WAIT,
 	I_DONE, I_ERR, I_ERR2, I_NOOP,
 };
 
@@ -577,6 +578,22 @@ static void httpcl_process(http *c)
 		call_handler(c, FFHTTPCL_RESP_RECV);
 		return;
 
+	case I_RAWBODY:
+		// the user has read all data from socket: wait for more
+#ifdef FF_UNIX
+		c->aio.rhandler = &tcp_aio;
+#endif
+		c->async = 1;
+		c->conf.timer(&c->tmr, c->conf.timeout);
+		c->state = I_RAWBODY_WAIT;
+		return;
+
+	case I_RAWBODY_WAIT:
+		c->state = I_RAWBODY;
+		c->outdata.len = 0;
+		call_handler(c, FFHTTPCL_RESP_RECV);
+		return;
+
 	case I_ERR:
 	case I_DONE: {
 		ffuint r = (c->state == I_ERR) ? FFHTTPCL_ERR : FFHTTPCL_DONE;
@@ -610,6 +627,22 @@ int ffhttpcl_recv(void *con, ffhttp_response **resp, ffstr *data)
 	return c->status;
 }
 
+ffskt ffhttpcl_rawbody(void *con, ffstr *data)
+{
+	http *c = con;
+#ifdef FF_UNIX
+	if (c->state == I_HTTP_RESPBODY
+		&& c->f.iface == &ffhttp_connclose_filter) {
+		*data = c->data;
+		c->data.len = 0;
+		c->state = I_RAWBODY;
+		dbglog("reading response body directly from socket");
+		return c->sk;
+	}
+#endif
+	return FF_BADSKT;
+}
+
 void ffhttpcl_header(void *con, const ffstr *name, const ffstr *val, ffuint flags)
 {
 	http *c = con;
@@ -336,3 +336,12 @@ ssize_t ffaio_fread(ffaio_filetask *ft, void *data, size_t len, uint64 off, ffai
 		r = fffile_pread(ft->kev.fd, data, len, off);
 	return r;
 }
+
+
+int ffthread_affinity(const ffcpuset *s)
+{
+	// the kernel's CPU mask is an array of 'unsigned long' which has the same layout as uint64[] on little-endian CPUs
+	if (0 != syscall(SYS_sched_setaffinity, 0, sizeof(s->mask), s->mask))
+		return -1;
+	return 0;
+}
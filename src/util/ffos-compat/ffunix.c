@@ -15,7 +15,10 @@ Copyright (c) 2013 Simon Zolin
 #include <sys/wait.h>
 #if !defined FF_NOTHR && defined FF_BSD
 #include <pthread_np.h>
+#include <sys/cpuset.h>
 #endif
+#include <pthread.h>
+#include <sched.h>
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -144,3 +147,42 @@ done:
 }
 
 #endif
+
+
+#if defined FF_BSD && !defined FF_NOTHR
+int ffthread_affinity(const ffcpuset *s)
+{
+	cpuset_t cs;
+	CPU_ZERO(&cs);
+	for (uint i = 0;  i != FFCPUSET_MAX && i != CPU_SETSIZE;  i++) {
+		if (s->mask[i / 64] & ((uint64)1 << (i % 64)))
+			CPU_SET(i, &cs);
+	}
+	int e;
+	if (0 != (e = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs))) {
+		fferr_set(e);
+		return -1;
+	}
+	return 0;
+}
+
+#elif defined FF_APPLE
+int ffthread_affinity(const ffcpuset *s)
+{
+	fferr_set(ENOSYS);
+	return -1;
+}
+#endif
+
+int ffthread_rtprio(void)
+{
+	struct sched_param sp = {};
+	int min = sched_get_priority_min(SCHED_FIFO), max = sched_get_priority_max(SCHED_FIFO);
+	sp.sched_priority = min + (max - min) / 2;
+	int e;
+	if (0 != (e = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp))) {
+		fferr_set(e);
+		return -1;
+	}
+	return 0;
+}
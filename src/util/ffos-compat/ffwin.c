@@ -93,3 +93,18 @@ ssize_t ffaio_fread(ffaio_filetask *ft, void *data, size_t len, uint64 off, ffai
 	fferr_set(EAGAIN);
 	return -1;
 }
+
+
+int ffthread_affinity(const ffcpuset *s)
+{
+	if (0 == SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)s->mask[0]))
+		return -1;
+	return 0;
+}
+
+int ffthread_rtprio(void)
+{
+	if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+		return -1;
+	return 0;
+}
@@ -7,3 +7,37 @@
 #define ffthd_detach(th)  ffthread_detach(th)
 #define ffthd_sleep(ms)  ffthread_sleep(ms)
 #define ffthd_curid()  ffthread_curid()
+
+
+enum { FFCPUSET_MAX = 1024 };
+
+/** Set of CPUs: bit #N is CPU #N */
+typedef struct ffcpuset {
+	uint64 mask[FFCPUSET_MAX / 64];
+} ffcpuset;
+
+static inline int ffcpuset_empty(const ffcpuset *s)
+{
+	for (uint i = 0;  i != FFCPUSET_MAX / 64;  i++) {
+		if (s->mask[i] != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static inline void ffcpuset_add(ffcpuset *s, uint cpu)
+{
+	s->mask[cpu / 64] |= (uint64)1 << (cpu % 64);
+}
+
+/** Allow the current thread to run only on the specified CPUs.
+Windows: only CPUs of the current processor group (#0..#63) are supported.
+macOS: not supported.
+Return 0 on success */
+FF_EXTERN int ffthread_affinity(const ffcpuset *s);
+
+/** Set real-time priority for the current thread.
+UNIX: SCHED_FIFO (requires CAP_SYS_NICE or RLIMIT_RTPRIO on Linux).
+Windows: THREAD_PRIORITY_TIME_CRITICAL.
+Return 0 on success */
+FF_EXTERN int ffthread_rtprio(void);
@@ -79,6 +79,9 @@ static int FFTHDCALL ffthpool_loop(void *udata)
 {
 	ffthpool *p = udata;
 
+	if (p->conf.cpus != NULL)
+		(void)ffthread_affinity(p->conf.cpus);
+
 	while (!FF_READONCE(p->stop)) {
 
 		void *ptr;
@@ -294,6 +294,13 @@ static gboolean _ffui_view_button_press_event(GtkWidget *w, GdkEventButton *ev,
 	return 0;
 }
 
+static void _ffui_view_scrolled(GtkAdjustment *a, gpointer udata)
+{
+	ffui_view *v = udata;
+	if (v->scroll_id != 0)
+		v->wnd->on_action(v->wnd, v->scroll_id);
+}
+
 int ffui_view_create(ffui_view *v, ffui_wnd *parent)
 {
 	v->h = gtk_tree_view_new();
@@ -305,6 +312,9 @@ int ffui_view_create(ffui_view *v, ffui_wnd *parent)
 	gtk_container_add(GTK_CONTAINER(scroll), v->h);
 	gtk_box_pack_start(GTK_BOX(parent->vbox), scroll, /*expand=*/1, /*fill=*/1, /*padding=*/0);
 	g_signal_connect(v->h, "button-press-event", (GCallback)_ffui_view_button_press_event, v);
+	GtkAdjustment *a = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(v->h));
+	g_signal_connect(a, "value-changed", G_CALLBACK(&_ffui_view_scrolled), v);
+	g_signal_connect(a, "changed", G_CALLBACK(&_ffui_view_scrolled), v);
 	return 0;
 }
 
@@ -21,6 +21,7 @@ struct ffui_view {
 	uint dropfile_id;
 	uint dispinfo_id;
 	uint edit_id;
+	uint scroll_id; // the visible range has changed (scrolled or resized)
 	ffui_menu *popup_menu;
 
 	union {
@@ -298,6 +299,20 @@ static inline void ffui_view_scroll_setvert(ffui_view *v, uint val)
 	gtk_adjustment_set_value(a, (double)val / 100);
 }
 
+/** Get the indexes of the first and the last visible rows.
+Return 0 if there are no visible rows */
+static inline int ffui_view_visible_range(ffui_view *v, uint *first, uint *last)
+{
+	GtkTreePath *start, *end;
+	if (!gtk_tree_view_get_visible_range(GTK_TREE_VIEW(v->h), &start, &end))
+		return 0;
+	*first = gtk_tree_path_get_indices(start)[0];
+	*last = gtk_tree_path_get_indices(end)[0];
+	gtk_tree_path_free(start);
+	gtk_tree_path_free(end);
+	return 1;
+}
+
 static inline void ffui_view_popupmenu(ffui_view *v, ffui_menu *m)
 {
 	v->popup_menu = m;
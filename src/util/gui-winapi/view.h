@@ -71,6 +71,9 @@ static inline int ffui_view_hittest(ffui_view *v, const ffui_point *pt, int *sub
 /** Get top visible item index. */
 #define ffui_view_topindex(v)  ffui_ctl_send(v, LVM_GETTOPINDEX, 0, 0)
 
+/** Get the number of fully visible items. */
+#define ffui_view_countperpage(v)  ffui_ctl_send(v, LVM_GETCOUNTPERPAGE, 0, 0)
+
 #define ffui_view_makevisible(v, idx)  ffui_ctl_send(v, LVM_ENSUREVISIBLE, idx, /*partial_ok*/ 0)
 #define ffui_view_scroll(v, dx, dy)  ffui_ctl_send(v, LVM_SCROLL, dx, dy)
 
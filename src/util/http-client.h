@@ -8,6 +8,7 @@ This interface provides an easy way to retrieve a document via HTTP.
 #include <FFOS/string.h>
 #include "http1.h"
 #include <FFOS/timerqueue.h>
+#include <FFOS/socket.h>
 
 
 /** Deinitialize recycled connection objects (on kqueue close). */
@@ -156,6 +157,17 @@ static inline void ffhttp_resp_init(ffhttp_response *r) {
 Return enum FFHTTPCL_ST. */
 FF_EXTERN int ffhttpcl_recv(void *con, ffhttp_response **resp, ffstr *data);
 
+/** Read response body directly from socket.
+May be called only from the handler with FFHTTPCL_RESP status.
+The user reads the socket until it has no data, then calls send():
+ the handler is called with FFHTTPCL_RESP_RECV (and empty data) when the socket becomes readable.
+I/O timeout and reconnection are handled as usual:
+ the handler is called with FFHTTPCL_RESP for the new connection.
+data: part of body received together with headers
+Return socket descriptor;
+ FF_BADSKT: not supported for this response (chunked or with Content-Length) or on this OS */
+FF_EXTERN ffskt ffhttpcl_rawbody(void *con, ffstr *data);
+
 /** Add request header. */
 FF_EXTERN void ffhttpcl_header(void *con, const ffstr *name, const ffstr *val, ffuint flags);
 
@@ -11,6 +11,7 @@ Copyright (c) 2020 Simon Zolin
 typedef struct ffthpoolconf {
 	uint maxthreads; // max. allowed threads
 	uint maxqueue; // task queue capacity
+	const ffcpuset *cpus; // CPU affinity for the threads (optional)
 } ffthpoolconf;
 
 typedef struct ffthpool ffthpool;
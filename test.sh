@@ -4,9 +4,10 @@
 
 TESTS_ALL=(
 	record info play cue
-	convert convert_meta convert_streamcopy convert_parallel
-	filters filters_aconv filters_gain filters_dynanorm
-	playlist-heal
+	convert convert_meta convert_flac_mt convert_enc_mt convert_streamcopy convert_parallel convert_pcmcache convert_pipe
+	filters filters_aconv filters_gain filters_dsp filters_dynanorm filters_loudness
+	playlist playlist-heal
+	alsa_null
 	)
 
 if test "$#" -lt 1 ; then
@@ -27,6 +28,50 @@ if test "$1" = "all" ; then
 	TESTS=("${TESTS_ALL[@]}")
 fi
 
+# Create fmedtest/NAME.conf: fmedia.conf with 'mod_conf "MOD" {BODY}' appended for each MOD BODY pair
+# Usage: conf_with NAME MOD BODY [MOD BODY]...
+conf_with() {
+	local CONF="fmedtest/$1.conf"
+	shift
+	cp fmedia.conf $CONF
+	while test "$#" -ge 2 ; do
+		printf 'mod_conf "%s" {\n\t%s\n}\n' "$1" "$2" >>$CONF
+		shift 2
+	done
+}
+
+# awk functions to write int16/48000 .wav files
+WAV_AWK='
+function le(f, v, nbytes) { for (; nbytes != 0; nbytes--) { printf "%c", v % 256 >f;  v = int(v / 256) } }
+function s16(f, v) { le(f, (v < 0) ? v + 65536 : v, 2) }
+function wav_hdr(f, ch, n) {
+	printf "RIFF" >f;  le(f, 36 + n*ch*2, 4);  printf "WAVEfmt " >f
+	le(f, 16, 4);  le(f, 1, 2);  le(f, ch, 2);  le(f, 48000, 4);  le(f, 48000*ch*2, 4);  le(f, ch*2, 2);  le(f, 16, 2)
+	printf "data" >f;  le(f, n*ch*2, 4)
+}
+function tone(hz, amp, i) { return int(amp * sin(2 * atan2(0, -1) * hz * i / 48000)) }
+'
+
+# Generate FILE: int16/48000/stereo .wav of SECONDS length with 2 sine tones (the same data on every run)
+# Usage: gen_wav FILE SECONDS
+gen_wav() {
+	LC_ALL=C awk -v f=$1 -v n=$(( $2 * 48000 )) "$WAV_AWK"'
+		BEGIN {
+			wav_hdr(f, 2, n)
+			for (i = 0; i != n; i++) {
+				s16(f, tone(440, 8000, i) + tone(3000, 4000, i))
+				s16(f, tone(660, 8000, i))
+			}
+		}'
+}
+
+# Check that 2 files have the same decoded PCM data
+pcm_crc_eq() {
+	./fmedia "$1" --pcm-peaks --pcm-crc 2>&1 | grep 'CRC' >fmedtest/crc_a.txt
+	./fmedia "$2" --pcm-peaks --pcm-crc 2>&1 | grep 'CRC' >fmedtest/crc_b.txt
+	diff fmedtest/crc_a.txt fmedtest/crc_b.txt
+}
+
 for CMD in "${TESTS[@]}" ; do
 
 rm -rf fmedtest
@@ -38,6 +83,26 @@ if test "$CMD" = "perf" ; then
 		./fmedia afile --print-time -o fmedia-test.wav -y --rate=96000 --format=int32
 	done
 
+	# resampler throughput for each profile
+	for q in low-latency high vhq ; do
+		echo "--resample-quality=$q"
+		./fmedia afile --print-time -o fmedia-test.wav -y --rate=96000 --resample-quality=$q --resample-threads=1
+	done
+	./fmedia afile --print-time -o fmedia-test.wav -y --rate=96000 --resample-quality=vhq --resample-threads=0
+
+	# logging overhead: text vs. binary trace
+	./fmedia afile --print-time -o fmedia-test.wav -y --debug >fmedtest/debug.log 2>&1
+	./fmedia afile --print-time -o fmedia-test.wav -y --trace=fmedtest/trace.bin
+	./fmedia --trace-print=fmedtest/trace.bin | tail -5
+
+elif test "$CMD" = "perf_startup" ; then
+	# process start -> first output data; many short conversions
+	if ! test -f "rec.wav" ; then
+		./fmedia --record --format=int16 --rate=48000 --channels=2 --until=2 -o rec.wav -y
+	fi
+	./fmedia rec.wav --print-time --until=0.1 -o fmedtest/startup.wav -y
+	time (for i in $(seq 1 50) ; do ./fmedia rec.wav --until=0.1 -o fmedtest/startup.wav -y ; done)
+
 elif test "$CMD" = "clean" ; then
 	rm -rf fmedtest
 	rm *.aac *.wav *.flac *.mp3 *.m4a *.ogg *.opus *.mpc *.wv *.mp4 *.mkv *.avi *.caf *.cue
@@ -46,6 +111,34 @@ elif test "$CMD" = "clean" ; then
 elif test "$CMD" = "radio" ; then
 	URL="http://"
 	./fmedia $URL -o '$artist-$title.mp3' --out-copy --stream-copy -y --meta=artist=A --until=1
+	./fmedia $URL --timeshift=1 --until=3
+	# net.http.splice_record: zero-copy recording until interrupted
+	conf_with splice net.http 'splice_record true'
+	# fmedia stops the tracks on SIGINT and exits normally: the exit code must be 0
+	RC=0
+	timeout --preserve-status -s INT 5 ./fmedia $URL -o fmedtest/radio.mp3 --stream-copy -y --conf=fmedtest/splice.conf --debug >fmedtest/radio.log 2>&1 || RC=$?
+	test "$RC" -eq 0
+	grep 'recording with splice()' fmedtest/radio.log
+	grep "meta: .*StreamTitle='.* - .*'" fmedtest/radio.log
+	test -s fmedtest/radio.mp3
+	./fmedia fmedtest/radio.mp3 --pcm-peaks
+
+elif test "$CMD" = "http_ctl" ; then
+	./fmedia rec.wav --http-ctl --until=3 &
+	sleep 1
+	curl -s http://127.0.0.1:7314/api/metrics | grep -E 'fmedia_worker_jobs|fmedia_worker_busy_seconds_total|fmedia_tracks\{type="playback"\} 1|fmedia_file_read_bytes_total'
+	wait
+
+elif test "$CMD" = "globcmd" ; then
+	./fmedia --globcmd=listen &
+	sleep 1
+	ls rec.* >globcmd-list.txt
+	./fmedia --globcmd.add-list=globcmd-list.txt --globcmd="next" | grep 'OK  index:0'
+	timeout 2 ./fmedia --globcmd.events --globcmd="stop" >globcmd-events.txt
+	grep 'stop #' globcmd-events.txt
+	./fmedia --globcmd=quit
+	wait
+	rm globcmd-list.txt globcmd-events.txt
 
 elif test "$CMD" = "rec1" ; then
 	./fmedia --record -o rec.wav -y --until=2 --rate=44100 --format=int16
@@ -98,6 +191,10 @@ elif test "$CMD" = "play" ; then
 	./fmedia play_* --seek=2 --pcm-peaks
 	./fmedia play_*
 	./fmedia play_* --seek=2
+
+	# seek using index
+	./fmedia play_mp3.mp3 play_vorbis.ogg play_opus.ogg play_flac.flac --seek-index
+	./fmedia play_mp3.mp3 play_vorbis.ogg play_opus.ogg play_flac.flac --seek=2 --pcm-peaks
 fi
 
 if test "$CMD" = "cue" ; then
@@ -112,6 +209,13 @@ TRACK 02 AUDIO
  TITLE T2
  INDEX 01 00:02:00' >cue.cue
 	./fmedia cue.cue
+	./fmedia cue.cue -o 'cue_$tracknumber.wav' -y
+	./fmedia cue.cue -o 'cue1p_$tracknumber.wav' -y --cue-single-pass
+	cmp cue_01.wav cue1p_01.wav
+	cmp cue_02.wav cue1p_02.wav
+	./fmedia cue.cue -o 'cue1pmt_$tracknumber.wav' -y --cue-single-pass --parallel
+	cmp cue_01.wav cue1pmt_01.wav
+	cmp cue_02.wav cue1pmt_02.wav
 fi
 
 if test "$CMD" = "convert" ; then
@@ -121,6 +225,7 @@ if test "$CMD" = "convert" ; then
 	# convert .wav -> .*
 	OPTS="-y"
 	./fmedia rec.wav -o enc.wav $OPTS
+	./fmedia rec.wav -o enc-tee.wav --tee=enc-tee.flac --tee='enc-tee.mp3;rate=44100' $OPTS
 	./fmedia rec.wav -o enc.flac $OPTS
 	./fmedia rec.wav -o enc.mp3 $OPTS
 	./fmedia rec.wav -o enc.m4a $OPTS
@@ -247,6 +352,84 @@ if test "$CMD" = "convert_parallel" ; then
 	./fmedia rec.* -o 'parallel-$counter.m4a' $OPTS
 	./fmedia parallel-*.m4a --pcm-peaks --parallel
 
+elif test "$CMD" = "convert_flac_mt" ; then
+	# FLAC encoding on several threads must produce the same PCM as on one thread
+	./fmedia --record --format=int16 --rate=48000 --channels=2 --until=30 -o fmedtest/flacmt_rec.wav -y
+	conf_with flacmt flac.encode 'threads 4'
+	./fmedia fmedtest/flacmt_rec.wav -o fmedtest/flacmt_st.flac -y
+	./fmedia fmedtest/flacmt_rec.wav -o fmedtest/flacmt_mt.flac -y --conf=fmedtest/flacmt.conf --debug 2>&1 | grep 'encoding on 4 threads'
+	pcm_crc_eq fmedtest/flacmt_st.flac fmedtest/flacmt_mt.flac
+
+elif test "$CMD" = "convert_enc_mt" ; then
+	# AAC/Opus encoding on several threads: the decoded length must be the same as with 1 thread,
+	#  the peaks must be within 0.5dB,
+	#  and the difference from 1-thread output near chunk boundaries must be no larger than inside the chunks
+	gen_wav fmedtest/encmt_src.wav 30
+	conf_with encmt aac.encode 'threads 4' opus.encode 'threads 4'
+	for EXT in m4a opus ; do
+		./fmedia fmedtest/encmt_src.wav -o fmedtest/encmt_st.$EXT -y --print-time
+		./fmedia fmedtest/encmt_src.wav -o fmedtest/encmt_mt.$EXT -y --print-time --conf=fmedtest/encmt.conf --debug 2>&1 | tee fmedtest/encmt.log | grep 'encoding on 4 threads'
+		./fmedia fmedtest/encmt_st.$EXT --pcm-peaks 2>&1 | grep -E 'total samples|highest peak' >fmedtest/encmt_st.peaks
+		./fmedia fmedtest/encmt_mt.$EXT --pcm-peaks 2>&1 | grep -E 'total samples|highest peak' >fmedtest/encmt_mt.peaks
+		diff <(grep 'total samples' fmedtest/encmt_st.peaks) <(grep 'total samples' fmedtest/encmt_mt.peaks)
+		paste -d '\n' <(grep -o 'peak:[-0-9.]*' fmedtest/encmt_st.peaks) <(grep -o 'peak:[-0-9.]*' fmedtest/encmt_mt.peaks) \
+			| cut -d: -f2 | paste - - \
+			| awk '{ d = $1 - $2; if (d < 0) d = -d; if (d > 0.5) { print "peak differs: " $1 " " $2; exit 1 } }'
+
+		# chunk length in samples: AAC-LC frame = 1024 samples, Opus frame = 40msec (default) @48kHz
+		FRAME=1024
+		if test "$EXT" = "opus" ; then
+			FRAME=1920
+		fi
+		CHUNK=$(( $(grep -o 'chunk:[0-9]*' fmedtest/encmt.log | cut -d: -f2) * FRAME ))
+		./fmedia fmedtest/encmt_st.$EXT -o fmedtest/encmt_st.wav -y --format=int16
+		./fmedia fmedtest/encmt_mt.$EXT -o fmedtest/encmt_mt.wav -y --format=int16
+		OFF_ST=$(( $(grep -obUa 'data' fmedtest/encmt_st.wav | head -1 | cut -d: -f1) + 8 ))
+		OFF_MT=$(( $(grep -obUa 'data' fmedtest/encmt_mt.wav | head -1 | cut -d: -f1) + 8 ))
+		# RMS of (MT - ST) over 2048 samples around each chunk boundary vs. around the middle of the preceding chunk
+		paste <(od -An -v -j $OFF_ST -t d2 -w4 fmedtest/encmt_st.wav) <(od -An -v -j $OFF_MT -t d2 -w4 fmedtest/encmt_mt.wav) \
+			| awk -v chunk=$CHUNK -v win=1024 '
+			{
+				i = NR - 1;  d = ($1 - $3)^2 + ($2 - $4)^2
+				k = int((i + win) / chunk)
+				if (k != 0 && i - k * chunk < win) { seam[k] += d;  nseam[k]++ }
+				k = int((i + chunk/2 + win) / chunk)
+				if (k != 0 && i - (k * chunk - chunk/2) < win) { mid[k] += d;  nmid[k]++ }
+			}
+			END {
+				for (k = 1;  nseam[k] == 2 * win;  k++) {
+					s = sqrt(seam[k] / nseam[k]);  m = sqrt(mid[k] / nmid[k])
+					print "boundary #" k ": RMS diff " s ", mid-chunk RMS diff " m
+					if (s > 2 * m + 16) { print "seam at boundary #" k;  exit 1 }
+				}
+				if (k == 1) { print "no chunk boundaries";  exit 1 }
+			}'
+	done
+
+elif test "$CMD" = "convert_pcmcache" ; then
+	# the first conversion writes the cache, the next ones read from it
+	./fmedia play_flac.flac -o pcmcache1.mp3 -y --pcm-cache
+	./fmedia play_flac.flac -o pcmcache2.mp3 -y --pcm-cache --mpeg-quality=5
+	./fmedia play_flac.flac -o pcmcache3.mp3 -y --pcm-cache --seek=2 --until=4
+	./fmedia pcmcache* --pcm-peaks --tags
+
+	# the data read from cache must be the same as decoded from the source file
+	./fmedia play_flac.flac -o fmedtest/pcmcache.wav -y --pcm-cache
+	./fmedia play_flac.flac -o fmedtest/pcmcache_cached.wav -y --pcm-cache --debug 2>&1 | grep 'PCM cache: using'
+	./fmedia play_flac.flac -o fmedtest/pcmcache_fresh.wav -y
+	pcm_crc_eq fmedtest/pcmcache_cached.wav fmedtest/pcmcache_fresh.wav
+
+elif test "$CMD" = "convert_pipe" ; then
+	# write to a non-seekable output: fragmented .mp4, .wav with max. data size
+	./fmedia rec.wav -o @stdout.m4a | cat >pipe_enc.m4a
+	head -c 8 pipe_enc.m4a | tail -c 4 | grep 'ftyp'
+	grep -q -a 'moof' pipe_enc.m4a
+	./fmedia rec.wav -o @stdout.wav | cat >pipe_enc.wav
+	./fmedia pipe_enc.wav --pcm-peaks
+	if which ffprobe ; then
+		ffprobe pipe_enc.m4a
+	fi
+
 elif test "$CMD" = "convert_streamcopy" ; then
 	# convert with stream-copy
 	./fmedia play_aac.mp4 -o copy_aac.m4a -y --stream-copy
@@ -271,6 +454,15 @@ elif test "$CMD" = "convert_streamcopy" ; then
 	./fmedia play_aac.mp4 -o copy_meta.m4a -y --stream-copy --meta='artist=SomeArtist;title=SomeTitle'
 	./fmedia copy_meta.m4a --info 2>&1 | grep 'SomeArtist - SomeTitle'
 
+	# remux without decoding
+	./fmedia play_aac.mp4 -o remux_aac_mp4.aac -y --stream-copy
+	./fmedia play_aac.mkv -o remux_aac_mkv.aac -y --stream-copy
+	./fmedia play_aac.mkv -o remux_aac_mkv.m4a -y --stream-copy
+	./fmedia play_vorbis.mkv -o remux_vorbis_mkv.ogg -y --stream-copy
+	./fmedia play_opus.mkv -o remux_opus_mkv.ogg -y --stream-copy
+	./fmedia play_flac.ogg -o remux_flac_ogg.flac -y --stream-copy
+	./fmedia remux_* --pcm-peaks
+
 elif test "$CMD" = "filters" ; then
 	OPTS="-y"
 	./fmedia rec.wav -o 'split-$counter.wav' --split=0.100 $OPTS
@@ -303,6 +495,63 @@ elif test "$CMD" = "filters_gain" ; then
 	./fmedia rec.wav -o gain.wav --gain=-6.0 $OPTS
 	./fmedia gain.wav --pcm-peaks
 
+elif test "$CMD" = "filters_dsp" ; then
+	# afilter.dsp output must be equal to the PCM computed here for a generated input
+	LC_ALL=C awk "$WAV_AWK"'
+		BEGIN {
+			# gain: stereo, 2 seconds;  float(10^(-6/20)) = 8408526/2^24
+			n = 2 * 48000;  g = 8408526 / 16777216
+			wav_hdr("fmedtest/dsp_gain_in.wav", 2, n);  wav_hdr("fmedtest/dsp_gain_exp.wav", 2, n)
+			for (i = 0; i != n; i++) {
+				split(tone(440, 8000, i) + tone(3000, 4000, i) " " tone(660, 20000, i), s, " ")
+				for (c = 1; c <= 2; c++) {
+					s16("fmedtest/dsp_gain_in.wav", s[c])
+					v = s[c] * g
+					s16("fmedtest/dsp_gain_exp.wav", (v < 0) ? -int(-v + 0.5) : int(v + 0.5))
+				}
+			}
+
+			# start level -20dB: mono, 1 second of silence, then 1 second of tone;
+			#  output starts at the first sample with |x| > 0.1 * 32768
+			n = 2 * 48000
+			for (i = 0; i != n; i++) {
+				x[i] = (i < 48000) ? 0 : tone(440, 8000, i)
+			}
+			for (start = 0; x[start] <= 3276 && x[start] >= -3276; start++) {}
+			wav_hdr("fmedtest/dsp_start_in.wav", 1, n);  wav_hdr("fmedtest/dsp_start_exp.wav", 1, n - start)
+			for (i = 0; i != n; i++) {
+				s16("fmedtest/dsp_start_in.wav", x[i])
+				if (i >= start)
+					s16("fmedtest/dsp_start_exp.wav", x[i])
+			}
+
+			# stop level -30dB: mono, 1 second of tone, then 6 seconds of silence;
+			#  output stops at the sample where |x| <= 0.0316 * 32768 for 5 seconds (default time)
+			n = 7 * 48000
+			for (i = 0; i != n; i++) {
+				x[i] = (i < 48000) ? tone(440, 8000, i) : 0
+			}
+			quiet = 0
+			for (stop = 0; stop != n; stop++) {
+				quiet = (x[stop] <= 1036 && x[stop] >= -1036) ? quiet + 1 : 0
+				if (quiet == 5 * 48000)
+					break
+			}
+			wav_hdr("fmedtest/dsp_stop_in.wav", 1, n);  wav_hdr("fmedtest/dsp_stop_exp.wav", 1, stop)
+			for (i = 0; i != n; i++) {
+				s16("fmedtest/dsp_stop_in.wav", x[i])
+				if (i < stop)
+					s16("fmedtest/dsp_stop_exp.wav", x[i])
+			}
+		}'
+
+	./fmedia fmedtest/dsp_gain_in.wav -o fmedtest/dsp_gain.wav -y --gain=-6.0
+	pcm_crc_eq fmedtest/dsp_gain.wav fmedtest/dsp_gain_exp.wav
+	./fmedia fmedtest/dsp_start_in.wav -o fmedtest/dsp_start.wav -y --start-dblevel=-20
+	pcm_crc_eq fmedtest/dsp_start.wav fmedtest/dsp_start_exp.wav
+	./fmedia fmedtest/dsp_stop_in.wav -o fmedtest/dsp_stop.wav -y --stop-dblevel=-30
+	pcm_crc_eq fmedtest/dsp_stop.wav fmedtest/dsp_stop_exp.wav
+
 elif test "$CMD" = "filters_dynanorm" ; then
 	./fmedia --record --until=2 --dynanorm -o rec-dynanorm.wav -y
 	./fmedia rec-dynanorm.wav --pcm-peaks
@@ -312,6 +561,27 @@ elif test "$CMD" = "filters_dynanorm" ; then
 	./fmedia rec-dynanorm.wav -o dynanorm.wav --dynanorm -y
 	./fmedia dynanorm.wav --pcm-peaks
 
+elif test "$CMD" = "filters_loudness" ; then
+	./fmedia rec.wav -o loudness.mp3 -y
+	./fmedia rec.wav loudness.mp3 --loudness --parallel
+	./fmedia loudness.mp3 --loudness-tags
+	./fmedia loudness.mp3 --tags
+
+elif test "$CMD" = "alsa_null" ; then
+	# ALSA playback/capture via "null" plugin: check wakeups, underruns and latency in debug log
+	mkdir -p alsa-null
+	echo 'pcm.!default { type null }' >alsa-null/.asoundrc
+	HOME=$(pwd)/alsa-null ./fmedia --record -o alsa-null.wav -y --until=2 --debug 2>&1 | grep -E 'period|overruns'
+	HOME=$(pwd)/alsa-null ./fmedia alsa-null.wav --debug 2>&1 | grep -E 'period|drained'
+	HOME=$(pwd)/alsa-null ./fmedia alsa-null.wav --debug --playback-buffer=40 2>&1 | grep -E 'period|drained'
+
+elif test "$CMD" = "playlist" ; then
+	# write binary playlist, append to it, convert it to .m3u
+	./fmedia play_mp3.mp3 play_flac.flac -o fmedtest/list.fmpl
+	./fmedia play_mp3.mp3 play_flac.flac play_opus.ogg -o fmedtest/list.fmpl --debug 2>&1 | grep 'appended 1 entries'
+	./fmedia fmedtest/list.fmpl -o fmedtest/list.m3u8
+	cat fmedtest/list.m3u8
+
 elif test "$CMD" = "playlist-heal" ; then
 	mkdir fmedtest/plheal
 	echo '#EXTM3U